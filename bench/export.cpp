@@ -0,0 +1,180 @@
+/***********************************************************************
+ bench/export.cpp - Times the CSV, TSV and JSON Lines result writers
+	against the fetch_row() and iostreams way of exporting a result
+	set, using a synthetic result set so no server is needed.
+
+	Usage: bench_export [rows [output-file]]
+
+	The defaults are 10 million rows, written to the null device.
+
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#include "fakedriver.h"
+
+#include <resultwriter.h>
+#include <stopwatch.h>
+
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#if defined(LIBTABULA_PLATFORM_WINDOWS)
+#	include <io.h>
+#	define open _open
+#	define close _close
+#	define NULL_DEVICE "NUL"
+#else
+#	include <unistd.h>
+#	define NULL_DEVICE "/dev/null"
+#endif
+
+using namespace std;
+
+
+// A FakeDriver that builds its rows without iostreams, so that the
+// time spent making up the data doesn't swamp the time spent writing
+// it out
+class BenchDriver : public FakeDriver
+{
+public:
+	BenchDriver(unsigned long rows) :
+	FakeDriver(0),
+	rows_(rows),
+	next_(0)
+	{
+		memcpy(name_, "row ", 4);
+	}
+
+	const char* const* fetch_raw_row(libtabula::ResultBase::Impl&)
+	{
+		if (next_ == rows_) return 0;
+
+		// Format the row number backwards into the end of id_
+		char* end = id_ + sizeof(id_);
+		char* p = end;
+		unsigned long n = next_;
+		do {
+			*--p = char('0' + n % 10);
+			n /= 10;
+		} while (n);
+		lengths_[0] = (unsigned long)(end - p);
+		memcpy(name_ + 4, p, lengths_[0]);
+		lengths_[1] = lengths_[0] + 4;
+		raw_[0] = p;
+		raw_[1] = next_ % 5 ? name_ : 0;
+		++next_;
+		return raw_;
+	}
+
+	const unsigned long* fetch_lengths(libtabula::ResultBase::Impl&) const
+			{ return lengths_; }
+
+private:
+	unsigned long rows_, next_;
+	char id_[24];
+	char name_[28];
+	const char* raw_[2];
+	unsigned long lengths_[2];
+};
+
+
+// Print how long one run took
+static void
+report(const char* what, unsigned long rows, libtabula::ulonglong usec)
+{
+	double sec = usec / 1e6;
+	cout << setw(22) << left << what << right << fixed <<
+			setprecision(3) << setw(9) << sec << " s" <<
+			setprecision(0) << setw(12) << (sec ? rows / sec : 0) <<
+			" rows/s" << endl;
+}
+
+
+// Time one of the writers
+template <class Writer>
+static void
+time_writer(const char* what, unsigned long rows, const char* path)
+{
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		perror(path);
+		exit(1);
+	}
+
+	BenchDriver driver(rows);
+	libtabula::UseQueryResult res = fake_use_result(driver);
+	libtabula::Stopwatch sw;
+	Writer out(fd);
+	out.write(res);
+	report(what, rows, sw.elapsed());
+
+	close(fd);
+}
+
+
+int
+main(int argc, char* argv[])
+{
+	unsigned long rows = argc > 1 ? strtoul(argv[1], 0, 10) : 10000000;
+	const char* path = argc > 2 ? argv[2] : NULL_DEVICE;
+
+	try {
+		{
+			// Just reading the rows, as a floor for the others
+			BenchDriver driver(rows);
+			libtabula::UseQueryResult res = fake_use_result(driver);
+			libtabula::Stopwatch sw;
+			while (driver.fetch_raw_row(res.impl())) { }
+			report("read only", rows, sw.elapsed());
+		}
+
+		{
+			// The way examples/printdata.cpp does it
+			ofstream os(path);
+			BenchDriver driver(rows);
+			libtabula::NoExceptions ne(driver);	// end of rows isn't an error
+			libtabula::UseQueryResult res = fake_use_result(driver);
+			libtabula::Stopwatch sw;
+			while (libtabula::Row row = res.fetch_row()) {
+				os << row[0] << '\t' << row[1] << '\n';
+			}
+			os.flush();
+			report("fetch_row + ostream", rows, sw.elapsed());
+		}
+
+		time_writer<libtabula::CSVWriter>("CSVWriter", rows, path);
+		time_writer<libtabula::TSVWriter>("TSVWriter", rows, path);
+		time_writer<libtabula::JSONLinesWriter>("JSONLinesWriter", rows,
+				path);
+	}
+	catch (const libtabula::Exception& e) {
+		cerr << "Export failed: " << e.what() << endl;
+		return 1;
+	}
+
+	return 0;
+}
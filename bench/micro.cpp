@@ -0,0 +1,783 @@
+/***********************************************************************
+ bench/micro.cpp - Microbenchmarks for the library's hot paths: value
+	conversions, SQL escaping, query building, result set structures,
+	result sets replayed through ReplayDriver, and the connection
+	pool.  None of them need a database server.
+
+	Usage: bench_micro [-f text|json|csv] [-t msec] [-r repeats]
+			[-c threads] [name-filter...]
+
+	Each benchmark is first run with more and more iterations until
+	one run takes at least -t milliseconds (default 100), then timed
+	-r more times (default 5) at that count.  The median, fastest and
+	slowest of those are reported in nanoseconds per operation.  The
+	json format gives one JSON object per line, for feeding to
+	something that tracks the numbers over time; csv is also on offer.
+	If any name filters are given, only benchmarks whose names
+	contain one of them are run.  -c sets the number of threads for
+	the contended connection pool benchmark (default 4).
+
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#include <libtabula.h>
+#include <ssqls.h>
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <stdlib.h>
+#include <string.h>
+
+using namespace std;
+
+sql_create_5(bench_stock,
+	1, 5,
+	libtabula::sql_bigint,		id,
+	libtabula::sql_char,		item,
+	libtabula::sql_int,			num,
+	libtabula::sql_double,		weight,
+	libtabula::sql_datetime,	sdate)
+
+
+// Results go here so the compiler can't optimize the work away
+static volatile size_t sink;
+
+
+// Base class for the benchmarks.  Setup goes in the ctor, so it
+// isn't timed; run() does the operation being measured n times.
+class Benchmark
+{
+public:
+	explicit Benchmark(const char* name) : name_(name) { }
+	virtual ~Benchmark() { }
+
+	const char* name() const { return name_; }
+	virtual void run(unsigned long n) = 0;
+
+private:
+	const char* name_;
+};
+
+
+//// Value conversions /////////////////////////////////////////////////
+
+class StringToInt : public Benchmark
+{
+public:
+	StringToInt() :
+	Benchmark("string_to_int"),
+	s_("1234567", 7, libtabula::FieldType::ft_integer)
+	{
+	}
+
+	void run(unsigned long n)
+	{
+		for (unsigned long i = 0; i < n; ++i) sink += int(s_);
+	}
+
+private:
+	libtabula::String s_;
+};
+
+
+class StringToDouble : public Benchmark
+{
+public:
+	StringToDouble() :
+	Benchmark("string_to_double"),
+	s_("3.14159265", 10, libtabula::FieldType::ft_real)
+	{
+	}
+
+	void run(unsigned long n)
+	{
+		for (unsigned long i = 0; i < n; ++i) {
+			sink += size_t(double(s_));
+		}
+	}
+
+private:
+	libtabula::String s_;
+};
+
+
+class StringToDateTime : public Benchmark
+{
+public:
+	StringToDateTime() :
+	Benchmark("string_to_datetime"),
+	s_("2018-05-06 12:34:56", 19, libtabula::FieldType::ft_datetime)
+	{
+	}
+
+	void run(unsigned long n)
+	{
+		for (unsigned long i = 0; i < n; ++i) {
+			libtabula::DateTime dt(s_);
+			sink += dt.hour();
+		}
+	}
+
+private:
+	libtabula::String s_;
+};
+
+
+class AdapterInt : public Benchmark
+{
+public:
+	AdapterInt() : Benchmark("stadapter_int") { }
+
+	void run(unsigned long n)
+	{
+		for (unsigned long i = 0; i < n; ++i) {
+			libtabula::SQLTypeAdapter sta(static_cast<int>(i));
+			sink += sta.length();
+		}
+	}
+};
+
+
+class AdapterString : public Benchmark
+{
+public:
+	AdapterString() :
+	Benchmark("stadapter_string"),
+	s_("Hot Mustard, 8 oz. jar")
+	{
+	}
+
+	void run(unsigned long n)
+	{
+		for (unsigned long i = 0; i < n; ++i) {
+			libtabula::SQLTypeAdapter sta(s_);
+			sink += sta.length();
+		}
+	}
+
+private:
+	std::string s_;
+};
+
+
+class AdapterDateTime : public Benchmark
+{
+public:
+	AdapterDateTime() :
+	Benchmark("stadapter_datetime"),
+	dt_(2018, 5, 6, 12, 34, 56)
+	{
+	}
+
+	void run(unsigned long n)
+	{
+		for (unsigned long i = 0; i < n; ++i) {
+			libtabula::SQLTypeAdapter sta(dt_);
+			sink += sta.length();
+		}
+	}
+
+private:
+	libtabula::DateTime dt_;
+};
+
+
+//// SQL escaping and query building ///////////////////////////////////
+
+class EscapeGeneric : public Benchmark
+{
+public:
+	EscapeGeneric() :
+	Benchmark("escape_string_generic"),
+	s_("O'Reilly's \"Pickle\" Relish, with a \\ and a\nnewline")
+	{
+		buf_.resize(s_.length() * 2 + 1);
+	}
+
+	void run(unsigned long n)
+	{
+		for (unsigned long i = 0; i < n; ++i) {
+			sink += libtabula::SQLStream::escape_string_generic(&buf_[0],
+					s_.data(), s_.length());
+		}
+	}
+
+private:
+	std::string s_;
+	std::vector<char> buf_;
+};
+
+
+// The query benchmarks use a Connection that's never connected, so
+// escaping falls back to SQLStream::escape_string_generic()
+static const char* const template_sql =
+		"SELECT * FROM stock WHERE item = %0q:item AND num > %1 "
+		"AND sdate < %2q ORDER BY %3 LIMIT 10";
+
+
+class QueryParse : public Benchmark
+{
+public:
+	QueryParse() :
+	Benchmark("query_parse"),
+	q_(conn_.query())
+	{
+	}
+
+	void run(unsigned long n)
+	{
+		for (unsigned long i = 0; i < n; ++i) {
+			q_.reset();
+			q_ << template_sql;
+			q_.parse();
+		}
+	}
+
+private:
+	libtabula::Connection conn_;
+	libtabula::Query q_;
+};
+
+
+class QueryProc : public Benchmark
+{
+public:
+	QueryProc() :
+	Benchmark("query_proc"),
+	q_(conn_.query())
+	{
+		q_ << template_sql;
+		q_.parse();
+		p_ << "Hot Mustard" << 42 <<
+				libtabula::DateTime(2018, 5, 6, 12, 34, 56) << "item";
+	}
+
+	void run(unsigned long n)
+	{
+		for (unsigned long i = 0; i < n; ++i) {
+			sink += q_.str(p_).length();
+		}
+	}
+
+private:
+	libtabula::Connection conn_;
+	libtabula::Query q_;
+	libtabula::SQLQueryParms p_;
+};
+
+
+class ValueList : public Benchmark
+{
+public:
+	ValueList() :
+	Benchmark("ssqls_value_list"),
+	q_(conn_.query()),
+	row_(42, "Hot Mustard", 75, 0.95,
+			libtabula::DateTime(2018, 5, 6, 12, 34, 56))
+	{
+	}
+
+	void run(unsigned long n)
+	{
+		for (unsigned long i = 0; i < n; ++i) {
+			q_.reset();
+			q_ << row_.value_list();
+			sink += q_.str().length();
+		}
+	}
+
+private:
+	libtabula::Connection conn_;
+	libtabula::Query q_;
+	bench_stock row_;
+};
+
+
+class Insert : public Benchmark
+{
+public:
+	Insert() :
+	Benchmark("ssqls_insert"),
+	q_(conn_.query()),
+	row_(42, "Hot Mustard", 75, 0.95,
+			libtabula::DateTime(2018, 5, 6, 12, 34, 56))
+	{
+	}
+
+	void run(unsigned long n)
+	{
+		for (unsigned long i = 0; i < n; ++i) {
+			q_.reset();
+			q_.insert(row_);
+			sink += q_.str().length();
+		}
+	}
+
+private:
+	libtabula::Connection conn_;
+	libtabula::Query q_;
+	bench_stock row_;
+};
+
+
+//// Result sets ///////////////////////////////////////////////////////
+
+// Builds a StoreQueryResult with the given number of columns and no
+// rows, for its FieldNames
+static libtabula::StoreQueryResult
+make_result(int columns)
+{
+	libtabula::Fields fields;
+	for (int i = 0; i < columns; ++i) {
+		ostringstream name;
+		name << "column_" << i;
+		fields.push_back(libtabula::Field(name.str().c_str(), "stock",
+				"bench", libtabula::FieldType(
+					libtabula::FieldType::ft_integer), 11, 4));
+	}
+	return libtabula::StoreQueryResult(fields);
+}
+
+
+class FieldNamesLookup : public Benchmark
+{
+public:
+	FieldNamesLookup() :
+	Benchmark("field_names_lookup"),
+	res_(make_result(10))
+	{
+		names_.push_back("column_0");
+		names_.push_back("COLUMN_7");
+		names_.push_back("column_9");
+		names_.push_back("column_4");
+	}
+
+	void run(unsigned long n)
+	{
+		for (unsigned long i = 0; i < n; ++i) {
+			sink += res_.field_num(names_[i % names_.size()]);
+		}
+	}
+
+private:
+	libtabula::StoreQueryResult res_;
+	std::vector<std::string> names_;
+};
+
+
+class RowConstruct : public Benchmark
+{
+public:
+	RowConstruct() :
+	Benchmark("row_construct"),
+	res_(make_result(5))
+	{
+	}
+
+	void run(unsigned long n)
+	{
+		static const char* const values[] = {
+			"42", "Hot Mustard", "75", "0.95", "2018-05-06 12:34:56"
+		};
+		for (unsigned long i = 0; i < n; ++i) {
+			libtabula::Row::Impl* pd = new libtabula::Row::Impl;
+			pd->reserve(5);
+			for (int j = 0; j < 5; ++j) {
+				pd->push_back(libtabula::String(values[j],
+						strlen(values[j]),
+						libtabula::FieldType::ft_text));
+			}
+			libtabula::Row row(pd, res_.field_names());
+			sink += row.size();
+		}
+	}
+
+private:
+	libtabula::StoreQueryResult res_;
+};
+
+
+// The replay benchmarks run a query for 1000 made-up rows shaped like
+// bench_stock through a ReplayDriver, so they time everything between
+// the driver and the caller, with no server in the way
+static const char* const replay_sql = "SELECT * FROM stock";
+static const unsigned long replay_rows = 1000;
+
+
+static libtabula::Connection*
+replay_connection()
+{
+	libtabula::Fields fields;
+	fields.push_back(libtabula::Field("id", "stock", "bench",
+			libtabula::FieldType(libtabula::FieldType::ft_integer), 20, 0));
+	fields.push_back(libtabula::Field("item", "stock", "bench",
+			libtabula::FieldType(libtabula::FieldType::ft_text), 20, 0));
+	fields.push_back(libtabula::Field("num", "stock", "bench",
+			libtabula::FieldType(libtabula::FieldType::ft_integer), 11, 0));
+	fields.push_back(libtabula::Field("weight", "stock", "bench",
+			libtabula::FieldType(libtabula::FieldType::ft_real), 22, 0));
+	fields.push_back(libtabula::Field("sdate", "stock", "bench",
+			libtabula::FieldType(libtabula::FieldType::ft_datetime), 19, 0));
+
+	libtabula::ReplayDriver* rd = new libtabula::ReplayDriver;
+	rd->generate(replay_sql, fields, replay_rows);
+	return new libtabula::Connection(rd);
+}
+
+
+class ReplayStore : public Benchmark
+{
+public:
+	ReplayStore() :
+	Benchmark("replay_store_1000"),
+	conn_(replay_connection()),
+	q_(conn_->query())
+	{
+	}
+
+	~ReplayStore() { delete conn_; }
+
+	void run(unsigned long n)
+	{
+		for (unsigned long i = 0; i < n; ++i) {
+			sink += q_.store(replay_sql).num_rows();
+		}
+	}
+
+private:
+	libtabula::Connection* conn_;
+	libtabula::Query q_;
+};
+
+
+class ReplayUse : public Benchmark
+{
+public:
+	ReplayUse() :
+	Benchmark("replay_use_1000"),
+	conn_(replay_connection()),
+	q_(conn_->query())
+	{
+	}
+
+	~ReplayUse() { delete conn_; }
+
+	void run(unsigned long n)
+	{
+		for (unsigned long i = 0; i < n; ++i) {
+			libtabula::UseQueryResult res = q_.use(replay_sql);
+			while (libtabula::Row row = res.fetch_row()) {
+				sink += row.size();
+			}
+		}
+	}
+
+private:
+	libtabula::Connection* conn_;
+	libtabula::Query q_;
+};
+
+
+class ReplaySSQLS : public Benchmark
+{
+public:
+	ReplaySSQLS() :
+	Benchmark("replay_ssqls_1000"),
+	conn_(replay_connection()),
+	q_(conn_->query())
+	{
+	}
+
+	~ReplaySSQLS() { delete conn_; }
+
+	void run(unsigned long n)
+	{
+		for (unsigned long i = 0; i < n; ++i) {
+			std::vector<bench_stock> rows;
+			q_.storein(rows, replay_sql);
+			sink += rows.size();
+		}
+	}
+
+private:
+	libtabula::Connection* conn_;
+	libtabula::Query q_;
+};
+
+
+//// Connection pool ///////////////////////////////////////////////////
+
+class BenchPool : public libtabula::ConnectionPool
+{
+public:
+	~BenchPool() { clear(); }
+
+private:
+	libtabula::Connection* create()
+			{ return new libtabula::Connection(false); }
+	void destroy(libtabula::Connection* cp) { delete cp; }
+	unsigned int max_idle_time() { return 3600; }
+};
+
+
+// Grabs and releases a connection n times
+class PoolUser : public libtabula::Thread::Runnable
+{
+public:
+	PoolUser(BenchPool& pool) : pool_(pool), n_(0) { }
+
+	void set(unsigned long n) { n_ = n; }
+
+	void run()
+	{
+		for (unsigned long i = 0; i < n_; ++i) {
+			pool_.release(pool_.grab());
+		}
+	}
+
+private:
+	BenchPool& pool_;
+	unsigned long n_;
+};
+
+
+class PoolGrabRelease : public Benchmark
+{
+public:
+	PoolGrabRelease() : Benchmark("cpool_grab_release"), user_(pool_) { }
+
+	void run(unsigned long n)
+	{
+		user_.set(n);
+		user_.run();
+	}
+
+private:
+	BenchPool pool_;
+	PoolUser user_;
+};
+
+
+// The same, split across several threads sharing one pool, reporting
+// the wall clock time per grab and release pair across all of them
+class PoolContended : public Benchmark
+{
+public:
+	explicit PoolContended(int threads) :
+	Benchmark("cpool_contended")
+	{
+		for (int i = 0; i < threads; ++i) {
+			users_.push_back(new PoolUser(pool_));
+		}
+	}
+
+	~PoolContended()
+	{
+		for (size_t i = 0; i < users_.size(); ++i) delete users_[i];
+	}
+
+	void run(unsigned long n)
+	{
+		const size_t t = users_.size();
+		if (!libtabula::Thread::supported()) {
+			users_[0]->set(n);
+			users_[0]->run();
+			return;
+		}
+
+		std::vector<libtabula::Thread*> threads;
+		for (size_t i = 0; i < t; ++i) {
+			users_[i]->set(n / t + (i < n % t ? 1 : 0));
+			threads.push_back(new libtabula::Thread(*users_[i]));
+			threads.back()->start();
+		}
+		for (size_t i = 0; i < t; ++i) {
+			delete threads[i];		// joins it
+		}
+	}
+
+private:
+	BenchPool pool_;
+	std::vector<PoolUser*> users_;
+};
+
+
+//// Harness ///////////////////////////////////////////////////////////
+
+enum Format { fmt_text, fmt_json, fmt_csv };
+
+
+// Time n iterations of a benchmark, in microseconds
+static libtabula::ulonglong
+time_run(Benchmark& b, unsigned long n)
+{
+	libtabula::Stopwatch sw;
+	b.run(n);
+	return sw.elapsed();
+}
+
+
+// Calibrate, time and report one benchmark
+static void
+measure(Benchmark& b, Format fmt, unsigned long msec, int repeats)
+{
+	// Find an iteration count that takes long enough to time well
+	const libtabula::ulonglong target = libtabula::ulonglong(msec) * 1000;
+	unsigned long n = 1;
+	libtabula::ulonglong usec;
+	while ((usec = time_run(b, n)) < target && n < 1000000000UL) {
+		// Aim a bit past the target, but don't grow too fast on the
+		// strength of a tiny, noisy first timing
+		double scale = usec ? 1.2 * target / usec : 100;
+		n = (unsigned long)(n * (scale > 100 ? 100 : scale < 2 ? 2 : scale));
+	}
+
+	std::vector<double> ns;
+	for (int i = 0; i < repeats; ++i) {
+		ns.push_back(time_run(b, n) * 1000.0 / n);
+	}
+	std::sort(ns.begin(), ns.end());
+	const double median = ns[ns.size() / 2];
+
+	switch (fmt) {
+		case fmt_text:
+			cout << setw(24) << left << b.name() << right << fixed <<
+					setprecision(1) << setw(12) << median << " ns/op" <<
+					"  (" << ns.front() << " to " << ns.back() << ", " <<
+					n << " iterations)" << endl;
+			break;
+
+		case fmt_json:
+			cout << fixed << setprecision(2) << "{\"benchmark\":\"" <<
+					b.name() << "\",\"iterations\":" << n <<
+					",\"repeats\":" << repeats << ",\"ns_per_op\":" <<
+					median << ",\"min_ns\":" << ns.front() <<
+					",\"max_ns\":" << ns.back() << ",\"version\":\"" <<
+					(LIBTABULA_HEADER_VERSION >> 16) << '.' <<
+					((LIBTABULA_HEADER_VERSION >> 8) & 0xFF) << '.' <<
+					(LIBTABULA_HEADER_VERSION & 0xFF) << "\"}" << endl;
+			break;
+
+		case fmt_csv:
+			cout << fixed << setprecision(2) << b.name() << ',' << n <<
+					',' << repeats << ',' << median << ',' <<
+					ns.front() << ',' << ns.back() << endl;
+			break;
+	}
+}
+
+
+static int
+usage()
+{
+	cerr << "usage: bench_micro [-f text|json|csv] [-t msec] "
+			"[-r repeats] [-c threads] [name-filter...]" << endl;
+	return 1;
+}
+
+
+int
+main(int argc, char* argv[])
+{
+	Format fmt = fmt_text;
+	unsigned long msec = 100;
+	int repeats = 5, threads = 4;
+	std::vector<std::string> filters;
+
+	for (int i = 1; i < argc; ++i) {
+		const std::string arg(argv[i]);
+		if (arg[0] != '-') {
+			filters.push_back(arg);
+		}
+		else if (i + 1 == argc) {
+			return usage();
+		}
+		else if (arg == "-f") {
+			const std::string f(argv[++i]);
+			if (f == "text") fmt = fmt_text;
+			else if (f == "json") fmt = fmt_json;
+			else if (f == "csv") fmt = fmt_csv;
+			else return usage();
+		}
+		else if (arg == "-t") {
+			msec = strtoul(argv[++i], 0, 10);
+		}
+		else if (arg == "-r") {
+			repeats = atoi(argv[++i]);
+		}
+		else if (arg == "-c") {
+			threads = atoi(argv[++i]);
+		}
+		else {
+			return usage();
+		}
+	}
+	if (msec == 0 || repeats < 1 || threads < 1) return usage();
+
+	std::vector<Benchmark*> all;
+	all.push_back(new StringToInt);
+	all.push_back(new StringToDouble);
+	all.push_back(new StringToDateTime);
+	all.push_back(new AdapterInt);
+	all.push_back(new AdapterString);
+	all.push_back(new AdapterDateTime);
+	all.push_back(new EscapeGeneric);
+	all.push_back(new QueryParse);
+	all.push_back(new QueryProc);
+	all.push_back(new ValueList);
+	all.push_back(new Insert);
+	all.push_back(new FieldNamesLookup);
+	all.push_back(new RowConstruct);
+	all.push_back(new ReplayStore);
+	all.push_back(new ReplayUse);
+	all.push_back(new ReplaySSQLS);
+	all.push_back(new PoolGrabRelease);
+	all.push_back(new PoolContended(threads));
+
+	int status = 0;
+	try {
+		if (fmt == fmt_csv) {
+			cout << "benchmark,iterations,repeats,ns_per_op,min_ns,"
+					"max_ns" << endl;
+		}
+
+		for (size_t i = 0; i < all.size(); ++i) {
+			bool wanted = filters.empty();
+			for (size_t j = 0; !wanted && j < filters.size(); ++j) {
+				wanted = strstr(all[i]->name(), filters[j].c_str()) != 0;
+			}
+			if (wanted) measure(*all[i], fmt, msec, repeats);
+		}
+	}
+	catch (const libtabula::Exception& e) {
+		cerr << "Benchmark failed: " << e.what() << endl;
+		status = 1;
+	}
+
+	for (size_t i = 0; i < all.size(); ++i) delete all[i];
+	return status;
+}
@@ -134,8 +134,13 @@ worker_thread(thread_arg_t running_flag)
 	// allocate these resources implicitly, but there's a nonzero chance
 	// that this won't happen.  Anyway, this is an example program,
 	// meant to show good style, so we take the high road and ensure the
-	// resources are allocated before we do any queries.
-	libtabula::Connection::thread_start();
+	// resources are allocated before we do any queries.  The call goes
+	// through a Connection only because that's what knows which driver
+	// we're using; the resources belong to this thread, not to it.
+	{
+		libtabula::ScopedConnection cp(*poolptr, true);
+		cp->thread_start();
+	}
 	cout.put('S'); cout.flush(); // indicate thread started
 
 	// Pull data from the sample table a bunch of times, releasing the
@@ -170,7 +175,10 @@ worker_thread(thread_arg_t running_flag)
 	cout.put('E'); cout.flush(); // indicate thread ended
 	
 	// Release the per-thread resources before we exit
-	libtabula::Connection::thread_end();
+	{
+		libtabula::ScopedConnection cp(*poolptr, true);
+		cp->thread_end();
+	}
 
 	return 0;
 }
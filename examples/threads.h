@@ -47,6 +47,7 @@
 #		include <unistd.h>
 #	endif
 #	if defined(HAVE_PTHREAD)
+#		include <pthread.h>
 #		define HAVE_THREADS
 #		define CALLBACK_SPECIFIER
 		typedef void* thread_return_t;
@@ -0,0 +1,645 @@
+/***********************************************************************
+ arrowwriter.cpp - Implements the ArrowWriter class, including just
+	enough of a FlatBuffers encoder to build Arrow's message metadata.
+
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#define LIBTABULA_NOT_HEADER
+#include "arrowwriter.h"
+
+#include <stdlib.h>
+
+using namespace std;
+
+// Values from Arrow's Schema.fbs and Message.fbs
+enum {
+	ARROW_METADATA_V5 = 4,
+	ARROW_HEADER_SCHEMA = 1,
+	ARROW_HEADER_RECORD_BATCH = 3,
+	ARROW_TYPE_INT = 2,
+	ARROW_TYPE_FLOATING_POINT = 3,
+	ARROW_TYPE_BINARY = 4,
+	ARROW_TYPE_UTF8 = 5,
+	ARROW_TYPE_DECIMAL = 7,
+	ARROW_TYPE_DATE = 8,
+	ARROW_TYPE_TIMESTAMP = 10,
+	ARROW_PRECISION_DOUBLE = 2,
+	ARROW_DATE_DAY = 0,
+	ARROW_TIME_MICROSECOND = 2
+};
+
+// Keep each batch's variable-length data well within what 32-bit
+// offsets can address
+static const size_t max_batch_bytes = 1 << 30;
+
+namespace libtabula {
+
+// Append the low n bytes of x to v, least significant first, as Arrow
+// wants regardless of the platform's byte order
+static inline void
+put_le(vector<char>& v, ulonglong x, size_t n)
+{
+	for (size_t i = 0; i < n; ++i, x >>= 8) {
+		v.push_back(char(x & 0xFF));
+	}
+}
+
+
+// Round n up to a multiple of 8, as Arrow wants for buffers and
+// metadata
+static inline size_t
+pad8(size_t n)
+{
+	return (n + 7) & ~size_t(7);
+}
+
+
+// Builds a FlatBuffer the way the official library does: from the end
+// of the buffer back toward the start, so that each object is complete
+// before anything refers to it.  Positions are kept as distances from
+// the end of the buffer, since those don't change as the buffer grows.
+class FlatBuilder
+{
+public:
+	FlatBuilder() : minalign_(1), table_start_(0) { }
+
+	// Add a reference to an object built earlier
+	void offset(size_t target)
+	{
+		prealign(4, 4);
+		push(ulonglong(size() + 4 - target), 4);
+	}
+
+	// Add a scalar, aligned to its own size
+	void scalar(ulonglong v, size_t n)
+	{
+		prealign(n, n);
+		push(v, n);
+	}
+
+	// Add a string, returning its position
+	size_t text(const std::string& s)
+	{
+		prealign(s.length() + 1, 4);
+		buf_.insert(buf_.begin(), 1, 0);
+		buf_.insert(buf_.begin(), s.begin(), s.end());
+		push(s.length(), 4);
+		return size();
+	}
+
+	// Add a vector of structs, each already laid out in elems,
+	// returning its position
+	size_t structs(const vector<char>& elems, size_t count, size_t align)
+	{
+		prealign(elems.size(), 4);
+		prealign(elems.size(), align);
+		buf_.insert(buf_.begin(), elems.begin(), elems.end());
+		push(count, 4);
+		return size();
+	}
+
+	// Add a vector of references to objects built earlier, returning
+	// its position
+	size_t offsets(const vector<size_t>& targets)
+	{
+		prealign(targets.size() * 4, 4);
+		for (size_t i = targets.size(); i > 0; --i) offset(targets[i - 1]);
+		push(targets.size(), 4);
+		return size();
+	}
+
+	// Begin a table.  Add its fields with the functions below, then
+	// call end_table().
+	void start_table()
+	{
+		slots_.clear();
+		table_start_ = size();
+	}
+
+	void field(size_t slot, ulonglong v, size_t n)
+	{
+		scalar(v, n);
+		mark(slot);
+	}
+
+	void field_offset(size_t slot, size_t target)
+	{
+		offset(target);
+		mark(slot);
+	}
+
+	// Finish a table by adding its vtable, returning its position
+	size_t end_table()
+	{
+		scalar(0, 4);			// will point to the vtable
+		size_t table = size();
+		for (size_t i = slots_.size(); i > 0; --i) {
+			push(slots_[i - 1] ? table - slots_[i - 1] : 0, 2);
+		}
+		push(table - table_start_, 2);
+		push((slots_.size() + 2) * 2, 2);
+
+		// The table's first word is the signed distance back to its
+		// vtable, which we just put right before it.
+		ulonglong back = size() - table;
+		for (size_t i = 0; i < 4; ++i, back >>= 8) {
+			buf_[size() - table + i] = (unsigned char)(back & 0xFF);
+		}
+		return table;
+	}
+
+	// Finish the buffer, with the given table as its root
+	const vector<unsigned char>& finish(size_t root)
+	{
+		prealign(4, minalign_);
+		offset(root);
+		return buf_;
+	}
+
+private:
+	size_t size() const { return buf_.size(); }
+
+	void mark(size_t slot)
+	{
+		if (slots_.size() <= slot) slots_.resize(slot + 1, 0);
+		slots_[slot] = size();
+	}
+
+	// Pad so that, once len more bytes are added, the buffer is aligned
+	// to align bytes
+	void prealign(size_t len, size_t align)
+	{
+		if (align > minalign_) minalign_ = align;
+		size_t pad = (align - (size() + len) % align) % align;
+		buf_.insert(buf_.begin(), pad, 0);
+	}
+
+	void push(ulonglong v, size_t n)
+	{
+		unsigned char b[8];
+		for (size_t i = 0; i < n; ++i, v >>= 8) {
+			b[i] = (unsigned char)(v & 0xFF);
+		}
+		buf_.insert(buf_.begin(), b, b + n);
+	}
+
+	vector<unsigned char> buf_;
+	size_t minalign_;
+	size_t table_start_;
+	vector<size_t> slots_;	// position of each field in current table
+};
+
+
+// Parse exactly n digits from p, advancing it
+static bool
+parse_digits(const char*& p, const char* end, int n, int& out)
+{
+	if (end - p < n) return false;
+
+	out = 0;
+	for (int i = 0; i < n; ++i, ++p) {
+		if (*p < '0' || *p > '9') return false;
+		out = out * 10 + (*p - '0');
+	}
+	return true;
+}
+
+
+// Parse a "YYYY-MM-DD" date from p, advancing it, and return the number
+// of days since 1970-01-01.  Uses the algorithm from Howard Hinnant's
+// "chrono-Compatible Low-Level Date Algorithms".
+static bool
+parse_date(const char*& p, const char* end, long& days)
+{
+	int y, m, d;
+	if (!parse_digits(p, end, 4, y) || p == end || *p++ != '-' ||
+			!parse_digits(p, end, 2, m) || p == end || *p++ != '-' ||
+			!parse_digits(p, end, 2, d) ||
+			m < 1 || m > 12 || d < 1 || d > 31) {
+		return false;		// includes MySQL's zero dates
+	}
+
+	y -= m <= 2;
+	long era = (y >= 0 ? y : y - 399) / 400;
+	long yoe = y - era * 400;
+	long doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+	long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	days = era * 146097 + doe - 719468;
+	return true;
+}
+
+
+// Parse an optionally signed integer
+static bool
+parse_integer(const char* p, const char* end, bool& negative,
+		ulonglong& value)
+{
+	negative = p != end && *p == '-';
+	if (p != end && (*p == '-' || *p == '+')) ++p;
+	if (p == end) return false;
+
+	value = 0;
+	for ( ; p != end; ++p) {
+		if (*p < '0' || *p > '9') return false;
+		value = value * 10 + (*p - '0');
+	}
+	return true;
+}
+
+
+// Multiply a 128-bit integer held as four 32-bit limbs, least
+// significant first, by 10 and add a digit
+static void
+mul10add(unsigned long limbs[4], int digit)
+{
+	ulonglong carry = digit;
+	for (int i = 0; i < 4; ++i) {
+		carry += ulonglong(limbs[i]) * 10;
+		limbs[i] = (unsigned long)(carry & 0xFFFFFFFFUL);
+		carry >>= 32;
+	}
+}
+
+
+// Parse a decimal number, scaled up by 10^scale, into a 128-bit two's
+// complement integer held as limbs.  Digits past the scale are dropped.
+static bool
+parse_decimal(const char* p, const char* end, int scale,
+		unsigned long limbs[4])
+{
+	bool negative = p != end && *p == '-';
+	if (p != end && (*p == '-' || *p == '+')) ++p;
+
+	limbs[0] = limbs[1] = limbs[2] = limbs[3] = 0;
+	bool point = false, any = false;
+	int frac = 0;
+	for ( ; p != end; ++p) {
+		if (*p == '.' && !point) {
+			point = true;
+			continue;
+		}
+		else if (*p < '0' || *p > '9') {
+			return false;
+		}
+
+		any = true;
+		if (point) {
+			if (frac == scale) continue;
+			++frac;
+		}
+		mul10add(limbs, *p - '0');
+	}
+	if (!any) return false;
+	for ( ; frac < scale; ++frac) mul10add(limbs, 0);
+
+	if (negative) {
+		ulonglong carry = 1;
+		for (int i = 0; i < 4; ++i) {
+			carry += ~limbs[i] & 0xFFFFFFFFUL;
+			limbs[i] = (unsigned long)(carry & 0xFFFFFFFFUL);
+			carry >>= 32;
+		}
+	}
+	return true;
+}
+
+
+bool
+ArrowWriter::append(Column& col, const char* data, size_t length)
+{
+	const char* end = data + length;
+	switch (col.kind) {
+		case ak_int64:
+		case ak_uint64: {
+			bool negative;
+			ulonglong v;
+			if (!data || !parse_integer(data, end, negative, v) ||
+					(negative && col.kind == ak_uint64)) {
+				put_le(col.data, 0, 8);
+				return false;
+			}
+			put_le(col.data, negative ? ~v + 1 : v, 8);
+			return true;
+		}
+
+		case ak_double: {
+			union { double d; ulonglong u; } v;
+			v.d = 0;
+			char buf[64];
+			char* stop = 0;
+			if (data && length < sizeof(buf)) {
+				memcpy(buf, data, length);
+				buf[length] = '\0';
+				v.d = strtod(buf, &stop);
+			}
+			bool ok = stop && stop == buf + length && length > 0;
+			put_le(col.data, ok ? v.u : 0, 8);
+			return ok;
+		}
+
+		case ak_decimal: {
+			unsigned long limbs[4];
+			bool ok = data && parse_decimal(data, end, col.scale, limbs);
+			for (int i = 0; i < 4; ++i) {
+				put_le(col.data, ok ? limbs[i] : 0, 4);
+			}
+			return ok;
+		}
+
+		case ak_date: {
+			long days;
+			const char* p = data;
+			bool ok = data && parse_date(p, end, days) && p == end;
+			put_le(col.data, ok ? ulonglong(days) : 0, 4);
+			return ok;
+		}
+
+		case ak_timestamp: {
+			// "YYYY-MM-DD HH:MM:SS", with optional fractional seconds
+			long days;
+			int h, m, s, digits = 0;
+			long usec = 0;
+			const char* p = data;
+			bool ok = data && parse_date(p, end, days) &&
+					p != end && (*p == ' ' || *p == 'T') &&
+					parse_digits(++p, end, 2, h) &&
+					p != end && *p++ == ':' &&
+					parse_digits(p, end, 2, m) &&
+					p != end && *p++ == ':' &&
+					parse_digits(p, end, 2, s);
+			if (ok && p != end) {
+				ok = *p++ == '.';
+				for ( ; ok && p != end; ++p, ++digits) {
+					ok = *p >= '0' && *p <= '9' && digits < 6;
+					usec = usec * 10 + (*p - '0');
+				}
+				for ( ; digits < 6; ++digits) usec *= 10;
+			}
+			longlong t = ok ? ((longlong(days) * 24 + h) * 60 + m) * 60 + s : 0;
+			put_le(col.data, ok ? ulonglong(t * 1000000 + usec) : 0, 8);
+			return ok;
+		}
+
+		case ak_binary:
+		case ak_utf8:
+			if (data) {
+				col.data.insert(col.data.end(), data, end);
+				pending_bytes_ += length;
+			}
+			put_le(col.offsets, col.data.size(), 4);
+			return data != 0;
+	}
+
+	return false;
+}
+
+
+void
+ArrowWriter::begin(const Fields& fields)
+{
+	columns_.clear();
+	columns_.resize(fields.size());
+	pending_ = pending_bytes_ = 0;
+
+	FlatBuilder fb;
+	vector<size_t> fts;
+	for (size_t i = 0; i < fields.size(); ++i) {
+		Column& col = columns_[i];
+		const FieldType& ft = fields[i].type();
+		bool nullable = ft.is_null();
+
+		// Pick the column's Arrow type, and build its type table
+		size_t type;
+		int type_type;
+		fb.start_table();
+		switch (ft.base_type()) {
+			case FieldType::ft_date:
+				if (fields[i].length() != 4) {
+					col.kind = ak_date;
+					nullable = true;		// for zero dates
+					type_type = ARROW_TYPE_DATE;
+					fb.field(0, ARROW_DATE_DAY, 2);		// unit
+					break;
+				}
+				// else it's a YEAR column, so treat it as an integer
+				// fall through
+
+			case FieldType::ft_integer:
+				col.kind = ft.is_unsigned() ? ak_uint64 : ak_int64;
+				type_type = ARROW_TYPE_INT;
+				fb.field(0, 64, 4);						// bitWidth
+				fb.field(1, !ft.is_unsigned(), 1);		// is_signed
+				break;
+
+			case FieldType::ft_real:
+				col.kind = ak_double;
+				type_type = ARROW_TYPE_FLOATING_POINT;
+				fb.field(0, ARROW_PRECISION_DOUBLE, 2);	// precision
+				break;
+
+			case FieldType::ft_decimal: {
+				// MySQL counts a sign and a decimal point in the length
+				size_t digits = fields[i].length();
+				col.kind = ak_decimal;
+				col.scale = fields[i].decimals();
+				if (col.scale > 0 && digits > 0) --digits;
+				if (!ft.is_unsigned() && digits > 0) --digits;
+				col.precision = digits > 0 && digits <= 38 ? int(digits) : 38;
+				if (col.scale > col.precision) col.scale = col.precision;
+				type_type = ARROW_TYPE_DECIMAL;
+				fb.field(0, col.precision, 4);			// precision
+				fb.field(1, col.scale, 4);				// scale
+				fb.field(2, 128, 4);					// bitWidth
+				break;
+			}
+
+			case FieldType::ft_datetime:
+			case FieldType::ft_timestamp:
+				col.kind = ak_timestamp;
+				nullable = true;
+				type_type = ARROW_TYPE_TIMESTAMP;
+				fb.field(0, ARROW_TIME_MICROSECOND, 2);	// unit
+				break;
+
+			case FieldType::ft_blob:
+				col.kind = ak_binary;
+				type_type = ARROW_TYPE_BINARY;
+				break;
+
+			default:
+				col.kind = ak_utf8;
+				type_type = ARROW_TYPE_UTF8;
+				break;
+		}
+		type = fb.end_table();
+
+		if (col.kind == ak_binary || col.kind == ak_utf8) {
+			put_le(col.offsets, 0, 4);
+		}
+
+		size_t name = fb.text(fields[i].name());
+		size_t children = fb.offsets(vector<size_t>());
+		fb.start_table();
+		fb.field_offset(0, name);
+		fb.field(1, nullable, 1);
+		fb.field(2, type_type, 1);
+		fb.field_offset(3, type);
+		fb.field_offset(5, children);
+		fts.push_back(fb.end_table());
+	}
+
+	size_t list = fb.offsets(fts);
+	fb.start_table();
+	fb.field(0, 0, 2);						// endianness: little
+	fb.field_offset(1, list);
+	size_t schema = fb.end_table();
+
+	fb.start_table();
+	fb.field(0, ARROW_METADATA_V5, 2);
+	fb.field(1, ARROW_HEADER_SCHEMA, 1);
+	fb.field_offset(2, schema);
+	fb.field(3, 0, 8);						// bodyLength
+	write_message(fb.finish(fb.end_table()));
+}
+
+
+void
+ArrowWriter::end()
+{
+	if (pending_ > 0) write_batch();
+
+	// End-of-stream marker: a continuation marker and a zero length
+	put("\xFF\xFF\xFF\xFF\0\0\0\0", 8);
+}
+
+
+void
+ArrowWriter::row(const char* const* raw, const unsigned long* lengths,
+		size_t count)
+{
+	size_t bit = pending_ % 8;
+	for (size_t i = 0; i < count; ++i) {
+		Column& col = columns_[i];
+		if (bit == 0) col.validity.push_back(0);
+		if (append(col, raw[i], raw[i] ? lengths[i] : 0)) {
+			col.validity.back() |= 1 << bit;
+		}
+		else {
+			++col.nulls;
+		}
+	}
+
+	if (++pending_ >= batch_rows_ || pending_bytes_ >= max_batch_bytes) {
+		write_batch();
+	}
+}
+
+
+void
+ArrowWriter::write_batch()
+{
+	// List the body's buffers, in the order Arrow expects them
+	vector<const char*> data;
+	vector<size_t> lengths;
+	for (size_t i = 0; i < columns_.size(); ++i) {
+		Column& col = columns_[i];
+
+		// Validity bitmap; may be left out if there are no nulls
+		data.push_back(col.validity.empty() ? 0 :
+				reinterpret_cast<const char*>(&col.validity[0]));
+		lengths.push_back(col.nulls ? col.validity.size() : 0);
+
+		if (col.kind == ak_binary || col.kind == ak_utf8) {
+			data.push_back(&col.offsets[0]);
+			lengths.push_back(col.offsets.size());
+		}
+		data.push_back(col.data.empty() ? 0 : &col.data[0]);
+		lengths.push_back(col.data.size());
+	}
+
+	// Describe them to the reader
+	vector<char> nodes, buffers;
+	size_t body = 0;
+	for (size_t i = 0; i < columns_.size(); ++i) {
+		put_le(nodes, pending_, 8);
+		put_le(nodes, columns_[i].nulls, 8);
+	}
+	for (size_t i = 0; i < lengths.size(); ++i) {
+		put_le(buffers, body, 8);
+		put_le(buffers, lengths[i], 8);
+		body += pad8(lengths[i]);
+	}
+
+	FlatBuilder fb;
+	size_t nv = fb.structs(nodes, columns_.size(), 8);
+	size_t bv = fb.structs(buffers, lengths.size(), 8);
+	fb.start_table();
+	fb.field(0, pending_, 8);				// length
+	fb.field_offset(1, nv);
+	fb.field_offset(2, bv);
+	size_t batch = fb.end_table();
+
+	fb.start_table();
+	fb.field(0, ARROW_METADATA_V5, 2);
+	fb.field(1, ARROW_HEADER_RECORD_BATCH, 1);
+	fb.field_offset(2, batch);
+	fb.field(3, body, 8);					// bodyLength
+	write_message(fb.finish(fb.end_table()));
+
+	static const char zeros[8] = { 0 };
+	for (size_t i = 0; i < lengths.size(); ++i) {
+		put(data[i], lengths[i]);
+		put(zeros, pad8(lengths[i]) - lengths[i]);
+	}
+
+	// Start the next batch, keeping the memory
+	for (size_t i = 0; i < columns_.size(); ++i) {
+		Column& col = columns_[i];
+		col.validity.clear();
+		col.data.clear();
+		col.nulls = 0;
+		if (!col.offsets.empty()) {
+			col.offsets.clear();
+			put_le(col.offsets, 0, 4);
+		}
+	}
+	pending_ = pending_bytes_ = 0;
+}
+
+
+void
+ArrowWriter::write_message(const std::vector<unsigned char>& metadata)
+{
+	// Continuation marker, then the padded metadata length
+	size_t length = pad8(metadata.size());
+	vector<char> prefix;
+	put_le(prefix, 0xFFFFFFFFUL, 4);
+	put_le(prefix, length, 4);
+	put(&prefix[0], prefix.size());
+
+	static const char zeros[8] = { 0 };
+	put(reinterpret_cast<const char*>(&metadata[0]), metadata.size());
+	put(zeros, length - metadata.size());
+}
+
+} // end namespace libtabula
@@ -0,0 +1,152 @@
+/// \file arrowwriter.h
+/// \brief Declares the ArrowWriter class, which streams result sets
+/// out in the Apache Arrow IPC stream format.
+
+/***********************************************************************
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#if !defined(LIBTABULA_ARROWWRITER_H)
+#define LIBTABULA_ARROWWRITER_H
+
+#include "common.h"
+
+#include "resultwriter.h"
+
+#include <vector>
+
+namespace libtabula {
+
+/// \brief Writes result sets as Apache Arrow record batches
+///
+/// Each call to write() produces one complete Arrow IPC stream: a
+/// schema message, a record batch for every set_batch_rows() rows, and
+/// the end-of-stream marker.  Anything that reads Arrow streams, such
+/// as \c pyarrow.ipc.open_stream(), can read the output directly,
+/// without parsing text:
+///
+/// \code
+///   libtabula::ArrowWriter out(fd);
+///   out.set_batch_rows(10000);
+///   out.write(conn.query("SELECT * FROM stock").use());
+/// \endcode
+///
+/// The format is produced here, so there's no dependency on the Arrow
+/// libraries.  Fields map to Arrow types by their FieldType::Base:
+///
+/// - \c ft_integer: 64-bit integer, unsigned if the field is
+/// - \c ft_real: 64-bit floating point
+/// - \c ft_decimal: 128-bit decimal, with the scale from
+///   Field::decimals() and the precision worked out from its length
+/// - \c ft_date: 32-bit date, in days, except that MySQL's \c YEAR
+///   columns, which it reports as dates, become integers
+/// - \c ft_datetime and \c ft_timestamp: 64-bit timestamp in
+///   microseconds, without a time zone
+/// - \c ft_blob: binary
+/// - \c ft_text and everything else: UTF-8 text, in the form the
+///   database sent it
+///
+/// The MySQL driver reports \c DECIMAL columns as \c ft_real, so
+/// those come out as floating point.
+///
+/// SQL nulls are recorded in each column's validity bitmap.  So are
+/// MySQL's "zero" dates, and any value that can't be parsed as its
+/// field's type, since Arrow has no way to represent them.
+class LIBTABULA_EXPORT ArrowWriter : public ResultWriter
+{
+public:
+	/// \brief Create the object
+	///
+	/// \param fd file descriptor to write to
+	/// \param buffer_size how much output to collect before writing
+	/// \param te if true, throw exceptions on errors
+	explicit ArrowWriter(int fd, size_t buffer_size = 1 << 20,
+			bool te = true) :
+	ResultWriter(fd, buffer_size, te),
+	batch_rows_(65536),
+	pending_(0),
+	pending_bytes_(0)
+	{
+	}
+
+	/// \brief Set the most rows to put in each record batch
+	///
+	/// Rows are held in memory until there are this many, so this
+	/// trades memory for fewer, larger batches.  The default is 65536.
+	/// A batch may be cut short to keep its variable-length data under
+	/// the 2 GB that Arrow's 32-bit offsets can address.
+	void set_batch_rows(size_t rows) { batch_rows_ = rows ? rows : 1; }
+
+protected:
+	void begin(const Fields& fields);
+	void end();
+	void row(const char* const* raw, const unsigned long* lengths,
+			size_t count);
+
+private:
+	/// \brief How a column's values are stored
+	enum Kind {
+		ak_int64,
+		ak_uint64,
+		ak_double,
+		ak_decimal,
+		ak_date,
+		ak_timestamp,
+		ak_binary,
+		ak_utf8
+	};
+
+	/// \brief One column of the record batch being built
+	struct Column
+	{
+		Kind kind;
+		int precision;				///< for ak_decimal
+		int scale;					///< for ak_decimal
+		std::vector<unsigned char> validity;	///< bit set if not null
+		std::vector<char> data;		///< fixed-width values, or text
+		std::vector<char> offsets;	///< into data, for ak_binary and ak_utf8
+		size_t nulls;
+
+		Column() : kind(ak_utf8), precision(0), scale(0), nulls(0) { }
+	};
+
+	/// \brief Append a value to a column
+	///
+	/// \return false if the value can't be parsed as the column's type
+	bool append(Column& col, const char* data, size_t length);
+
+	/// \brief Write the rows held so far as a record batch
+	void write_batch();
+
+	/// \brief Write an IPC message: the metadata flatbuffer, then
+	/// padding to an 8-byte boundary
+	void write_message(const std::vector<unsigned char>& metadata);
+
+	std::vector<Column> columns_;
+	size_t batch_rows_;
+	size_t pending_;				///< rows in the current batch
+	size_t pending_bytes_;			///< variable-length data in it
+};
+
+} // end namespace libtabula
+
+#endif // !defined(LIBTABULA_ARROWWRITER_H)
@@ -0,0 +1,235 @@
+/***********************************************************************
+ batchloader.cpp - Implements the BatchLoader class.
+
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#define LIBTABULA_NOT_HEADER
+#include "batchloader.h"
+
+#include "connection.h"
+#include "cpool.h"
+#include "dbdriver.h"
+#include "query.h"
+#include "scopedconnection.h"
+#include "stopwatch.h"
+
+using namespace std;
+
+namespace libtabula {
+
+// Marks a key in Batch::rows that has no row yet
+static const size_t no_row = ~size_t(0);
+
+
+BatchLoader::BatchLoader(ConnectionPool& pool, const std::string& table,
+		const std::string& key_column, size_t max_keys,
+		unsigned long window_msec) :
+pool_(pool),
+table_(table),
+key_column_(key_column),
+max_keys_(max_keys ? max_keys : 1),
+window_msec_(window_msec),
+open_(0),
+lookups_(0),
+queries_(0)
+{
+}
+
+
+void
+BatchLoader::fetch(Batch& batch)
+{
+	try {
+		ScopedConnection conn(pool_);
+
+		Query q = conn->query();
+		q.enable_exceptions();
+		q << "SELECT * FROM `" << table_ << "` WHERE `" << key_column_ <<
+				"` IN (";
+		for (size_t i = 0; i < batch.keys.size(); ++i) {
+			if (i) q << ',';
+			if (batch.quote[i]) {
+				string escaped;
+				q.escape_string(&escaped, batch.keys[i].data(),
+						batch.keys[i].length());
+				q << '\'' << escaped << '\'';
+			}
+			else {
+				q << batch.keys[i];
+			}
+		}
+		q << ')';
+
+		UseQueryResult res = q.use();
+		int key_field = res.field_num(key_column_);
+		if (key_field < 0 || size_t(key_field) >= res.num_fields()) {
+			throw BadFieldName(key_column_.c_str());
+		}
+		batch.names = res.field_names();
+		batch.types = res.field_types();
+		batch.data.fill(res, ~size_t(0));
+		if (res.driver()->errnum()) {
+			throw UseQueryError(res.driver()->error());
+		}
+
+		// Index the rows by key.  The Row objects built here never
+		// leave this thread, so they can share the result's field name
+		// list.
+		for (size_t i = 0; i < batch.data.size(); ++i) {
+			Row row = batch.data.row(i, batch.names, *batch.types);
+			const String& key = row[key_field];
+			map<string, size_t>::iterator it =
+					batch.rows.find(string(key.data(), key.length()));
+			if (it != batch.rows.end() && it->second == no_row) {
+				it->second = i;
+			}
+		}
+	}
+	catch (const BadQuery& e) {
+		batch.failed = true;
+		batch.error = e.what();
+		batch.errnum = e.errnum();
+	}
+	catch (const std::exception& e) {
+		batch.failed = true;
+		batch.error = e.what();
+	}
+}
+
+
+BatchLoader::Batch*
+BatchLoader::join(const std::string& key, bool quote, bool& leader)
+{
+	leader = !open_;
+	if (leader) open_ = new Batch;
+
+	Batch* batch = open_;
+	++batch->users;
+	if (batch->rows.insert(make_pair(key, no_row)).second) {
+		batch->keys.push_back(key);
+		batch->quote.push_back(quote);
+	}
+
+	if (batch->keys.size() >= max_keys_) {
+		// Full, so close it and tell its leader to send it now
+		open_ = 0;
+		full_.broadcast();
+	}
+
+	return batch;
+}
+
+
+Row
+BatchLoader::load(const SQLTypeAdapter& key)
+{
+	const string raw(key.data(), key.length());
+	bool leader;
+	Batch* batch;
+	{
+		ScopedLock lock(mutex_);
+		++lookups_;
+		batch = join(raw, key.quote_q(), leader);
+		if (leader) {
+			// Give other threads a chance to add their keys
+			if (Thread::supported()) {
+				const ulonglong limit = ulonglong(window_msec_) * 1000;
+				Stopwatch timer;
+				ulonglong usec;
+				while (open_ == batch && (usec = timer.elapsed()) < limit) {
+					full_.wait(mutex_,
+							(unsigned long)((limit - usec + 999) / 1000));
+				}
+			}
+			if (open_ == batch) open_ = 0;
+			++queries_;
+		}
+	}
+
+	if (leader) {
+		fetch(*batch);
+
+		ScopedLock lock(mutex_);
+		batch->done = true;
+		fetched_.broadcast();
+	}
+	else {
+		ScopedLock lock(mutex_);
+		while (!batch->done) fetched_.wait(mutex_);
+	}
+
+	// The batch doesn't change once it's done, so we can read it
+	// without the lock.  Our Row gets its own copy of the field name
+	// list, since RefCountedPointer's count isn't thread-safe.
+	Row row;
+	bool failed = batch->failed;
+	string error = batch->error;
+	int errnum = batch->errnum;
+	if (!failed) {
+		size_t i = batch->rows.find(raw)->second;
+		if (i != no_row) {
+			RefCountedPointer<FieldNames> names(
+					new FieldNames(*batch->names));
+			row = batch->data.row(i, names, *batch->types,
+					throw_exceptions());
+		}
+	}
+
+	{
+		ScopedLock lock(mutex_);
+		if (--batch->users == 0) delete batch;
+	}
+
+	if (failed && throw_exceptions()) throw BadQuery(error, errnum);
+	return row;
+}
+
+
+ulonglong
+BatchLoader::lookups() const
+{
+	ScopedLock lock(mutex_);
+	return lookups_;
+}
+
+
+ulonglong
+BatchLoader::queries() const
+{
+	ScopedLock lock(mutex_);
+	return queries_;
+}
+
+
+Row
+BatchLoader::Scope::load(const SQLTypeAdapter& key)
+{
+	const string raw(key.data(), key.length());
+	map<string, Row>::iterator it = cache_.find(raw);
+	if (it == cache_.end()) {
+		it = cache_.insert(make_pair(raw, loader_.load(key))).first;
+	}
+	return it->second;
+}
+
+} // end namespace libtabula
@@ -0,0 +1,186 @@
+/// \file batchloader.h
+/// \brief Declares the BatchLoader class, which merges point lookups
+/// from many threads into fewer queries.
+
+/***********************************************************************
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#if !defined(LIBTABULA_BATCHLOADER_H)
+#define LIBTABULA_BATCHLOADER_H
+
+#include "common.h"
+
+#include "beemutex.h"
+#include "field_names.h"
+#include "field_types.h"
+#include "noexceptions.h"
+#include "refcounted.h"
+#include "row.h"
+#include "rowbatch.h"
+#include "stadapter.h"
+#include "thread.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace libtabula {
+
+#if !defined(DOXYGEN_IGNORE)
+// Make Doxygen ignore this
+class LIBTABULA_EXPORT ConnectionPool;
+#endif
+
+/// \brief Merges single-row lookups by key from many threads into
+/// multi-key queries
+///
+/// When many threads each run their own <tt>SELECT * FROM t WHERE
+/// id = %0</tt>, most of the time goes to round trips, not to finding
+/// the rows.  Call load() instead, and the first thread to ask for a
+/// key opens a batch, waits a short window for other threads to add
+/// their keys, then runs one <tt>SELECT * FROM t WHERE id IN
+/// (...)</tt> on a pooled connection and hands each waiting thread its
+/// row.  A batch is sent early if it fills up.  The cost is up to one
+/// window of added latency on each lookup.
+///
+/// \code
+///   libtabula::BatchLoader loader(pool, "stock", "id", 100, 2);
+///   ...
+///   // on any thread:
+///   if (libtabula::Row row = loader.load(id)) {
+///       ...
+///   }
+/// \endcode
+///
+/// Rows are matched to keys by comparing the key column's text as the
+/// server sends it to the key as given, byte for byte.  That works for
+/// integer keys and for string keys with a binary or case-sensitive
+/// collation; keys that the server would write differently, such as
+/// floating-point values, may not be found.
+///
+/// Lookups within one unit of work often repeat; give each one a
+/// Scope to answer those from memory instead.
+class LIBTABULA_EXPORT BatchLoader : public OptionalExceptions
+{
+public:
+	/// \brief Per-caller cache in front of a BatchLoader
+	///
+	/// Create one for each request or other unit of work, on the
+	/// thread doing that work.  Each key is looked up at most once
+	/// for the life of the Scope, or until clear(), even if no row
+	/// was found for it.  A Scope must not be shared among threads.
+	class LIBTABULA_EXPORT Scope
+	{
+	public:
+		/// \brief Create an empty cache in front of \c loader
+		Scope(BatchLoader& loader) : loader_(loader) { }
+
+		/// \brief Look up a key, going to the loader only if this
+		/// Scope hasn't seen it before
+		Row load(const SQLTypeAdapter& key);
+
+		/// \brief Forget everything looked up so far
+		void clear() { cache_.clear(); }
+
+	private:
+		BatchLoader& loader_;
+		std::map<std::string, Row> cache_;
+	};
+
+	/// \brief Set up the loader
+	///
+	/// \param pool where to get connections for the batch queries
+	/// \param table name of the table to look rows up in
+	/// \param key_column name of the column to match keys against,
+	///     normally the primary key
+	/// \param max_keys most keys to send in one query
+	/// \param window_msec longest time the first key in a batch waits
+	///     for others to join it; 0 sends each batch as soon as the
+	///     first key is in
+	BatchLoader(ConnectionPool& pool, const std::string& table,
+			const std::string& key_column, size_t max_keys = 100,
+			unsigned long window_msec = 1);
+
+	/// \brief Look up the row with the given key
+	///
+	/// Blocks until the batch holding the key has been fetched.
+	///
+	/// \return the matching row, or an empty Row if there is none or
+	///     the batch query failed and exceptions are disabled
+	Row load(const SQLTypeAdapter& key);
+
+	/// \brief Returns the number of load() calls so far
+	ulonglong lookups() const;
+
+	/// \brief Returns the number of batch queries sent so far
+	ulonglong queries() const;
+
+private:
+	/// \brief One batch of keys, and once fetched, their rows
+	struct Batch
+	{
+		std::vector<std::string> keys;		///< unquoted, no repeats
+		std::vector<bool> quote;			///< true if key needs quotes
+		std::map<std::string, size_t> rows;	///< key to index in data
+		RowBatch data;						///< the fetched rows
+		RefCountedPointer<FieldNames> names;	///< field info for data
+		RefCountedPointer<FieldTypes> types;
+		size_t users;						///< threads waiting on it
+		bool done;							///< fetch is complete
+		bool failed;						///< fetch threw an exception
+		std::string error;					///< why the fetch failed
+		int errnum;
+
+		Batch() : users(0), done(false), failed(false), errnum(0) { }
+	};
+
+	BatchLoader(const BatchLoader&);
+	BatchLoader& operator =(const BatchLoader&);
+
+	/// \brief Run a batch's query and index its rows by key.  Mutex
+	/// must not be held.
+	void fetch(Batch& batch);
+
+	/// \brief Add a key to the open batch, opening one if needed.
+	/// Mutex must be held.
+	///
+	/// \return the batch the key went into
+	Batch* join(const std::string& key, bool quote, bool& leader);
+
+	ConnectionPool& pool_;
+	std::string table_;
+	std::string key_column_;
+	size_t max_keys_;
+	unsigned long window_msec_;
+
+	mutable BeecryptMutex mutex_;	///< guards everything below
+	Condition full_;				///< the open batch was closed
+	Condition fetched_;				///< a batch's fetch is complete
+	Batch* open_;					///< batch accepting keys, if any
+	ulonglong lookups_;
+	ulonglong queries_;
+};
+
+} // end namespace libtabula
+
+#endif // !defined(LIBTABULA_BATCHLOADER_H)
@@ -40,6 +40,7 @@ namespace libtabula {
 
 #define ACTUALLY_DOES_SOMETHING
 #if defined(HAVE_PTHREAD)
+#	include <pthread.h>
 	typedef pthread_mutex_t bc_mutex_t;
 #elif defined(HAVE_SYNCH_H)
 #	include <synch.h>
@@ -73,7 +74,7 @@ BeecryptMutex::BeecryptMutex()
 		throw MutexFailed("CreateMutex failed");
 #else
 #	if HAVE_SYNCH_H || HAVE_PTHREAD
-	register int rc;
+	int rc;
 #	endif
 #	if HAVE_PTHREAD
 		if ((rc = pthread_mutex_init(impl_ptr(pmutex_), 0)))
@@ -111,7 +112,7 @@ BeecryptMutex::lock()
 	throw MutexFailed("WaitForSingleObject failed");
 #else
 #	if HAVE_SYNCH_H || HAVE_PTHREAD
-	register int rc;
+	int rc;
 #	endif
 #	if HAVE_PTHREAD
 		if ((rc = pthread_mutex_lock(impl_ptr(pmutex_))))
@@ -138,7 +139,7 @@ BeecryptMutex::trylock()
 				throw MutexFailed("WaitForSingleObbject failed");
 		}
 #	else
-		register int rc;
+		int rc;
 #		if HAVE_PTHREAD
 			if ((rc = pthread_mutex_trylock(impl_ptr(pmutex_))) == 0)
 				return true;
@@ -167,7 +168,7 @@ BeecryptMutex::unlock()
 		throw MutexFailed("ReleaseMutex failed");
 #else
 #	if HAVE_SYNCH_H || HAVE_PTHREAD
-		register int rc;
+		int rc;
 #	endif
 #	if HAVE_PTHREAD
 		if ((rc = pthread_mutex_unlock(impl_ptr(pmutex_))))
@@ -80,6 +80,8 @@ public:
 	void unlock();
 
 private:
+	friend class Condition;		// needs the platform mutex
+
 	void* pmutex_;
 };
 
@@ -0,0 +1,164 @@
+/// \file binio.h
+/// \brief Declares the little-endian binary reader and writer shared
+/// by the Snapshot and ReplayDriver file formats
+///
+/// None of this is meant to be used outside the library itself.  None
+/// of this is considered part of the library interface.  It is subject
+/// to change at any time, with no notice.
+
+/***********************************************************************
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#if !defined(LIBTABULA_BINIO_H)
+#define LIBTABULA_BINIO_H
+
+#include "common.h"
+
+#include <string>
+
+#include <stdio.h>
+#include <string.h>
+
+namespace libtabula {
+	namespace internal {
+		/// \brief Reads little-endian integers and length-prefixed
+		/// strings out of a buffer, keeping track of whether it ran
+		/// off the end
+		class BinaryReader
+		{
+		public:
+			BinaryReader(const char* p, size_t size) :
+			p_(p),
+			end_(p + size),
+			ok_(true)
+			{
+			}
+
+			/// \brief Returns the next n bytes, or 0 if there
+			/// aren't that many left
+			const char* bytes(size_t n)
+			{
+				if (!ok_ || size_t(end_ - p_) < n) {
+					ok_ = false;
+					return 0;
+				}
+				const char* r = p_;
+				p_ += n;
+				return r;
+			}
+
+			/// \brief Returns the next size-byte integer, or 0 if
+			/// there aren't that many bytes left
+			ulonglong number(int size)
+			{
+				const char* p = bytes(size);
+				ulonglong n = 0;
+				for (int i = 0; p && i < size; ++i) {
+					n |= ulonglong(static_cast<unsigned char>(p[i])) <<
+							(8 * i);
+				}
+				return n;
+			}
+
+			/// \brief Returns false if any read so far ran off the
+			/// end of the buffer
+			bool ok() const { return ok_; }
+
+			/// \brief Returns the next string, stored as a 32-bit
+			/// length followed by that many bytes
+			std::string text()
+			{
+				size_t n = size_t(number(4));
+				const char* p = bytes(n);
+				return p ? std::string(p, n) : std::string();
+			}
+
+		private:
+			const char* p_;
+			const char* end_;
+			bool ok_;
+		};
+
+		/// \brief Writes what BinaryReader reads to a file,
+		/// buffering to cut down on stdio calls
+		class BinaryWriter
+		{
+		public:
+			explicit BinaryWriter(FILE* f) :
+			f_(f),
+			ok_(true)
+			{
+			}
+
+			/// \brief Writes n bytes as they are
+			void bytes(const char* p, size_t n)
+			{
+				buf_.append(p, n);
+				if (buf_.size() >= 65536) flush();
+			}
+
+			/// \brief Writes out anything still buffered, returning
+			/// false if this or any earlier write failed
+			bool flush()
+			{
+				if (ok_ && !buf_.empty()) {
+					ok_ = fwrite(buf_.data(), 1, buf_.size(), f_) ==
+							buf_.size();
+				}
+				buf_.clear();
+				return ok_;
+			}
+
+			/// \brief Writes n as a size-byte integer
+			void number(ulonglong n, int size)
+			{
+				for (int i = 0; i < size; ++i) {
+					buf_ += char((n >> (8 * i)) & 0xFF);
+				}
+			}
+
+			/// \brief Writes s with a 32-bit length prefix
+			void text(const std::string& s)
+			{
+				number(s.length(), 4);
+				bytes(s.data(), s.length());
+			}
+
+			/// \brief Writes the C string p with a 32-bit length
+			/// prefix
+			void text(const char* p)
+			{
+				size_t n = strlen(p);
+				number(n, 4);
+				bytes(p, n);
+			}
+
+		private:
+			FILE* f_;
+			std::string buf_;
+			bool ok_;
+		};
+	} // end namespace libtabula::internal
+} // end namespace libtabula
+
+#endif // !defined(LIBTABULA_BINIO_H)
@@ -0,0 +1,258 @@
+/***********************************************************************
+ bulkinsert.cpp - Implements the ParallelInsertBase class.
+
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#define LIBTABULA_NOT_HEADER
+#include "bulkinsert.h"
+
+#include "connection.h"
+#include "cpool.h"
+#include "scopedconnection.h"
+#include "stopwatch.h"
+#include "utility.h"
+
+#include <algorithm>
+#include <sstream>
+
+using namespace std;
+
+namespace libtabula {
+
+ParallelInsertBase::ParallelInsertBase(ConnectionPool& pool,
+		size_t connections) :
+pool_(pool),
+connections_(connections ? connections : 1),
+mode_(per_partition),
+workers_(0),
+waiting_(0),
+next_partition_(0),
+failed_(false)
+{
+}
+
+
+bool
+ParallelInsertBase::all_done()
+{
+	ScopedLock lock(mutex_);
+	++waiting_;
+	finished_.broadcast();
+	while (waiting_ < workers_ && !failed_) {
+		finished_.wait(mutex_);
+	}
+	return !failed_;
+}
+
+
+void
+ParallelInsertBase::fail(size_t first_row, size_t rows, int errnum,
+		const std::string& message)
+{
+	BatchError e;
+	e.first_row = first_row;
+	e.rows = rows;
+	e.errnum = errnum;
+	e.message = message;
+	errors_.push_back(e);
+
+	failed_ = true;
+	finished_.broadcast();
+}
+
+
+bool
+ParallelInsertBase::insert_partition(Query& q, size_t partition)
+{
+	for (;;) {
+		size_t first_row = 0, rows = 0;
+		try {
+			if (!render(partition, q, first_row, rows)) return true;
+		}
+		catch (const std::exception& e) {
+			ScopedLock lock(mutex_);
+			fail(first_row, rows, 0, e.what());
+			return false;
+		}
+
+		if (mode_ == all_partitions) {
+			// No point going on if it's all going to be rolled back
+			ScopedLock lock(mutex_);
+			if (failed_) return false;
+		}
+
+		string sql = q.str();
+		Stopwatch timer;
+		try {
+			q.exec(sql);
+		}
+		catch (const BadQuery& e) {
+			ScopedLock lock(mutex_);
+			fail(first_row, rows, e.errnum(), e.what());
+			return false;
+		}
+
+		ScopedLock lock(mutex_);
+		stats_.exec_usec += timer.elapsed();
+		stats_.rows += rows;
+		stats_.bytes += sql.size();
+		++stats_.batches;
+	}
+}
+
+
+bool
+ParallelInsertBase::run()
+{
+	errors_.clear();
+	stats_ = Stats();
+	next_partition_ = 0;
+	waiting_ = 0;
+	failed_ = false;
+
+	Stopwatch timer;
+	workers_ = min(connections_, partitions());
+	if (workers_ > 1 && Thread::supported()) {
+		vector<Worker*> workers;
+		vector<Thread*> threads;
+		for (size_t i = 0; i < workers_; ++i) {
+			workers.push_back(new Worker(*this));
+			threads.push_back(new Thread(*workers.back()));
+		}
+
+		try {
+			for (size_t i = 0; i < threads.size(); ++i) {
+				threads[i]->start();
+			}
+		}
+		catch (...) {
+			// Couldn't start them all, so stop handing out partitions,
+			// and wait for the workers that did start.
+			{
+				ScopedLock lock(mutex_);
+				next_partition_ = partitions();
+				failed_ = true;
+				finished_.broadcast();
+			}
+			for (size_t i = 0; i < threads.size(); ++i) {
+				delete threads[i];
+				delete workers[i];
+			}
+			throw;
+		}
+
+		for (size_t i = 0; i < threads.size(); ++i) {
+			delete threads[i];			// joins the thread
+			delete workers[i];
+		}
+	}
+	else if (workers_ > 0) {
+		// One connection, or no thread support, so do it all here
+		workers_ = 1;
+		work(false);
+	}
+	stats_.usec = timer.elapsed();
+
+	if (errors_.empty()) return true;
+
+	sort(errors_.begin(), errors_.end());
+	if (throw_exceptions()) {
+		const BatchError& e = errors_.front();
+		ostringstream os;
+		if (e.first_row != ~size_t(0)) {
+			os << "Insert of " << e.rows << " rows starting at row " <<
+					e.first_row << " failed: ";
+		}
+		os << e.message;
+		throw BadQuery(os.str(), e.errnum);
+	}
+	return false;
+}
+
+
+void
+ParallelInsertBase::insert_partitions(Connection& conn, Query& q)
+{
+	for (;;) {
+		size_t i;
+		{
+			ScopedLock lock(mutex_);
+			if ((failed_ && mode_ == all_partitions) ||
+					next_partition_ == partitions()) {
+				break;
+			}
+			i = next_partition_++;
+		}
+
+		if (mode_ == per_partition) {
+			Transaction t(conn);
+			if (insert_partition(q, i)) {
+				t.commit();
+			}
+			else {
+				t.rollback();
+			}
+		}
+		else {
+			insert_partition(q, i);
+		}
+	}
+}
+
+
+void
+ParallelInsertBase::work(bool own_thread)
+{
+	try {
+		ScopedConnection conn(pool_);
+		internal::ThreadScope scope(*conn, own_thread);
+
+		Query q = conn->query();
+		q.enable_exceptions();
+
+		if (mode_ == all_partitions) {
+			Transaction all(*conn);
+			insert_partitions(*conn, q);
+			if (all_done()) {
+				all.commit();
+			}
+			else {
+				all.rollback();
+			}
+		}
+		else {
+			insert_partitions(*conn, q);
+		}
+	}
+	catch (const std::exception& e) {
+		// Connection or transaction trouble, not a statement failure
+		ScopedLock lock(mutex_);
+		fail(~size_t(0), 0, 0, e.what());
+	}
+	catch (...) {
+		ScopedLock lock(mutex_);
+		fail(~size_t(0), 0, 0, "unknown exception");
+	}
+}
+
+} // end namespace libtabula
@@ -0,0 +1,334 @@
+/// \file bulkinsert.h
+/// \brief Declares the ParallelInsert template and its base class,
+/// which spread a bulk insert over several pooled connections.
+
+/***********************************************************************
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#if !defined(LIBTABULA_BULKINSERT_H)
+#define LIBTABULA_BULKINSERT_H
+
+#include "common.h"
+
+#include "beemutex.h"
+#include "noexceptions.h"
+#include "query.h"
+#include "thread.h"
+
+#include <iomanip>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace libtabula {
+
+#if !defined(DOXYGEN_IGNORE)
+// Make Doxygen ignore this
+class LIBTABULA_EXPORT ConnectionPool;
+#endif
+
+/// \brief The non-template part of ParallelInsert
+///
+/// This runs the worker threads, executes the statements they build,
+/// manages transactions, and keeps the error list and statistics.
+/// Subclasses say how to build each statement.
+class LIBTABULA_EXPORT ParallelInsertBase : public OptionalExceptions
+{
+public:
+	/// \brief How the inserts are grouped into transactions
+	enum TransactionMode {
+		/// Each statement commits on its own.  A failure stops its
+		/// partition, but everything sent before it stays.
+		no_transaction,
+
+		/// Each partition is one transaction, committed when the
+		/// partition is done.  A failure rolls back its own partition
+		/// only; the others carry on.
+		per_partition,
+
+		/// Each connection holds one transaction open until every
+		/// partition is done, then they all commit, or if anything
+		/// failed, they all roll back.  This isn't a true distributed
+		/// transaction: if a commit itself fails after others have
+		/// succeeded, you'll be left with part of the data.
+		all_partitions
+	};
+
+	/// \brief One failed statement
+	struct BatchError
+	{
+		size_t first_row;		///< input position of batch's first row,
+								///< or ~0 if the failure wasn't in a batch
+		size_t rows;			///< rows in the batch
+		int errnum;				///< DB error number, if any
+		std::string message;	///< error message
+
+		/// \brief Order errors by their position in the input
+		bool operator <(const BatchError& other) const
+				{ return first_row < other.first_row; }
+	};
+
+	/// \brief Throughput statistics for a run
+	struct Stats
+	{
+		ulonglong rows;			///< rows in statements that succeeded,
+								///< even if later rolled back
+		ulonglong batches;		///< statements that succeeded
+		ulonglong bytes;		///< SQL text sent in those statements
+		ulonglong exec_usec;	///< time spent executing, all threads
+		ulonglong usec;			///< wall-clock time for the whole run
+
+		Stats() : rows(0), batches(0), bytes(0), exec_usec(0), usec(0) { }
+
+		/// \brief Returns the overall insert rate
+		double rows_per_sec() const
+				{ return usec ? rows * 1e6 / usec : 0.0; }
+	};
+
+	/// \brief Destroy the object
+	virtual ~ParallelInsertBase() { }
+
+	/// \brief Choose the transaction grouping; the default is
+	/// per_partition
+	void set_transaction_mode(TransactionMode mode) { mode_ = mode; }
+
+	/// \brief Run the insert
+	///
+	/// Blocks until every partition is done or has failed.  On
+	/// failure, throws BadQuery describing the failure earliest in the
+	/// input, if exceptions are enabled; otherwise returns false.
+	/// Either way, errors() has the whole list.
+	bool run();
+
+	/// \brief Returns the failed statements from the last run(), in
+	/// input order
+	const std::vector<BatchError>& errors() const { return errors_; }
+
+	/// \brief Returns the statistics for the last run()
+	const Stats& stats() const { return stats_; }
+
+protected:
+	/// \brief Set up the insert
+	///
+	/// \param pool where to get connections from
+	/// \param connections most connections, and so threads, to use
+	ParallelInsertBase(ConnectionPool& pool, size_t connections);
+
+	/// \brief Returns the number of partitions the input is split into
+	virtual size_t partitions() const = 0;
+
+	/// \brief Build the next statement for a partition into \c q
+	///
+	/// Called on a worker thread.  Set \c first_row to the input
+	/// position of the statement's first row before doing anything
+	/// that might throw.
+	///
+	/// \return false if the partition has no more rows
+	virtual bool render(size_t partition, Query& q, size_t& first_row,
+			size_t& rows) = 0;
+
+private:
+	/// \brief The Thread::Runnable for each worker thread
+	class Worker : public Thread::Runnable
+	{
+	public:
+		Worker(ParallelInsertBase& p) : p_(p) { }
+		void run() { p_.work(true); }
+	private:
+		ParallelInsertBase& p_;
+	};
+
+	friend class Worker;
+
+	ParallelInsertBase(const ParallelInsertBase&);
+	ParallelInsertBase& operator =(const ParallelInsertBase&);
+
+	/// \brief Record a failure.  Mutex must be held.
+	void fail(size_t first_row, size_t rows, int errnum,
+			const std::string& message);
+
+	/// \brief Send all of one partition's statements
+	///
+	/// \return false if one failed
+	bool insert_partition(Query& q, size_t partition);
+
+	/// \brief Take partitions off the queue and send them until there
+	/// are none left, or one fails in all_partitions mode
+	void insert_partitions(Connection& conn, Query& q);
+
+	/// \brief Wait for every worker to finish its partitions, then say
+	/// whether they all succeeded
+	bool all_done();
+
+	/// \brief Body of each worker thread
+	///
+	/// \c own_thread is true when called on a thread we started, and
+	/// so must set up for the C API; false when run() calls it on the
+	/// caller's thread, which is the caller's to manage.
+	void work(bool own_thread);
+
+	ConnectionPool& pool_;
+	size_t connections_;
+	TransactionMode mode_;
+
+	BeecryptMutex mutex_;		///< guards everything below
+	Condition finished_;		///< a worker finished, or one failed
+	size_t workers_;			///< workers in this run
+	size_t waiting_;			///< workers waiting in all_done()
+	size_t next_partition_;		///< next partition for a worker to take
+	bool failed_;
+	std::vector<BatchError> errors_;
+	Stats stats_;
+};
+
+
+/// \brief Inserts a range of SSQLS objects over several pooled
+/// connections at once
+///
+/// Query::insertfrom() sends its INSERT statements one after another
+/// on a single connection.  When the server can absorb more than one
+/// writer's worth of inserts, this gets the job done sooner: it splits
+/// the input range into one contiguous partition per connection, and
+/// each worker thread grabs a connection from the pool, builds
+/// multi-row INSERT statements from its partition, and sends them.
+///
+/// The insert policy decides where each statement ends, just as with
+/// insertfrom().  Each partition gets its own copy of the policy, so
+/// stateful policies like RowCountInsertPolicy work as expected.  The
+/// policy's access controller type is not used; transactions are
+/// instead controlled by set_transaction_mode().
+///
+/// Statement failures are collected in errors() sorted by their
+/// position in the input, so you can tell exactly which rows did not
+/// make it, regardless of which thread hit the problem first.
+///
+/// \code
+///   libtabula::Query::RowCountInsertPolicy<> policy(1000);
+///   libtabula::ParallelInsert<std::vector<stock>::const_iterator>
+///           insert(pool, v.begin(), v.end(), policy, 8);
+///   insert.run();
+///   cout << insert.stats().rows_per_sec() << " rows/s" << endl;
+/// \endcode
+///
+/// The objects in the range are read from several threads at once, so
+/// don't change them while the insert runs.
+template <class Iter,
+		class InsertPolicy = Query::RowCountInsertPolicy<NoTransaction> >
+class ParallelInsert : public ParallelInsertBase
+{
+public:
+	/// \brief Set up the insert
+	///
+	/// \param pool where to get connections from
+	/// \param first first object to insert
+	/// \param last one past the last object to insert
+	/// \param policy insert policy to copy for each partition
+	/// \param connections number of connections to use at most
+	ParallelInsert(ConnectionPool& pool, Iter first, Iter last,
+			const InsertPolicy& policy, size_t connections = 4) :
+	ParallelInsertBase(pool, connections)
+	{
+		size_t n = size_t(std::distance(first, last));
+		size_t parts = connections ? connections : 1;
+		if (parts > n) parts = n;
+
+		size_t pos = 0;
+		for (size_t i = 0; i < parts; ++i) {
+			size_t len = n / parts + (i < n % parts ? 1 : 0);
+			Iter end = first;
+			std::advance(end, len);
+			parts_.push_back(new Partition(first, end, pos, policy));
+			first = end;
+			pos += len;
+		}
+	}
+
+	/// \brief Destroy the object
+	~ParallelInsert()
+	{
+		for (size_t i = 0; i < parts_.size(); ++i) {
+			delete parts_[i];
+		}
+	}
+
+protected:
+	size_t partitions() const { return parts_.size(); }
+
+	bool render(size_t partition, Query& q, size_t& first_row,
+			size_t& rows)
+	{
+		Partition& p = *parts_[partition];
+		first_row = p.pos;
+		rows = 0;
+		if (p.next == p.end) return false;
+
+		q.reset();
+		for (/* */; p.next != p.end; ++p.next) {
+			if (p.policy.can_add(int(q.tellp()), *p.next)) {
+				if (rows == 0) {
+					q << std::setprecision(16) << "INSERT INTO `" <<
+							p.next->table() << "` (" <<
+							p.next->field_list() << ") VALUES (";
+				}
+				else {
+					q << ",(";
+				}
+				q << p.next->value_list() << ')';
+				++rows;
+			}
+			else if (rows == 0) {
+				throw BadInsertPolicy("Insert policy is too strict");
+			}
+			else {
+				break;
+			}
+		}
+
+		p.pos += rows;
+		return true;
+	}
+
+private:
+	/// \brief One contiguous piece of the input range
+	struct Partition
+	{
+		Iter next;				///< next object to insert
+		Iter end;				///< one past the partition's last object
+		size_t pos;				///< input position of \c next
+		InsertPolicy policy;	///< this partition's copy of the policy
+
+		Partition(Iter f, Iter l, size_t p, const InsertPolicy& ip) :
+		next(f),
+		end(l),
+		pos(p),
+		policy(ip)
+		{
+		}
+	};
+
+	std::vector<Partition*> parts_;
+};
+
+} // end namespace libtabula
+
+#endif // !defined(LIBTABULA_BULKINSERT_H)
@@ -29,6 +29,7 @@
 
 #include "query.h"
 #include "result.h"
+#include "stmtcache.h"
 
 #include "mysql/driver.h"
 
@@ -39,6 +40,22 @@ namespace libtabula {
 Connection::Connection(bool te) :
 OptionalExceptions(te),
 driver_(new MySQLDriver(te)),
+statements_(0),
+slow_log_(0),
+max_rows_(0),
+max_bytes_(0),
+copacetic_(true)
+{
+}
+
+
+Connection::Connection(DBDriver* driver, bool te) :
+OptionalExceptions(te),
+driver_(driver),
+statements_(0),
+slow_log_(0),
+max_rows_(0),
+max_bytes_(0),
 copacetic_(true)
 {
 }
@@ -48,6 +65,10 @@ Connection::Connection(const char* db, const char* server,
 		const char* user, const char* password, unsigned int port) :
 OptionalExceptions(),
 driver_(new MySQLDriver()),
+statements_(0),
+slow_log_(0),
+max_rows_(0),
+max_bytes_(0),
 copacetic_(true)
 {
 	try {
@@ -64,7 +85,11 @@ copacetic_(true)
 
 Connection::Connection(const Connection& other) :
 OptionalExceptions(other.throw_exceptions()),
-driver_(other.driver_->clone())
+driver_(other.driver_->clone()),
+statements_(0),
+slow_log_(0),
+max_rows_(0),
+max_bytes_(0)
 {
 	copy(other);
 }
@@ -73,6 +98,7 @@ driver_(other.driver_->clone())
 Connection::~Connection()
 {
 	disconnect();
+	delete statements_;
 	delete driver_;
 }
 
@@ -98,9 +124,12 @@ Connection::connect(const char* db, const char* server,
 		const char* user, const char* password, unsigned int port)
 {
 	// Figure out what the server parameter means, then try to establish
-	// the connection.
+	// the connection.  Statements prepared in any old session die
+	// with it.
 	error_message_.clear();
+	if (statements_) statements_->clear();
 	string host, socket_name;
+	driver_->set_cancellable(max_rows_ || max_bytes_);
 	copacetic_ = parse_ipc_method(server, host, port, socket_name) &&
 			driver_->connect(host.c_str(),
 			(socket_name.empty() ? 0 : socket_name.c_str()), port, db,
@@ -128,8 +157,13 @@ Connection::copy(const Connection& other)
 {
 	error_message_.clear();
 	set_exceptions(other.throw_exceptions());
+	delete statements_;
+	statements_ = 0;
 	delete driver_;
 	driver_ = other.driver_->clone();
+	slow_log_ = other.slow_log_;
+	max_rows_ = other.max_rows_;
+	max_bytes_ = other.max_bytes_;
 }
 
 
@@ -162,6 +196,7 @@ void
 Connection::disconnect()
 {
 	error_message_.clear();
+	if (statements_) statements_->clear();
 	driver_->disconnect();
 }
 
@@ -190,6 +225,21 @@ Connection::error() const
 }
 
 
+ulonglong
+Connection::max_allowed_packet()
+{
+	error_message_.clear();
+	Query q(this, throw_exceptions());
+	q << "SELECT @@max_allowed_packet";
+	if (StoreQueryResult res = q.store()) {
+		return res[0][0];
+	}
+	else {
+		return 0;
+	}
+}
+
+
 Connection&
 Connection::operator=(const Connection& rhs)
 {
@@ -310,6 +360,14 @@ Connection::set_option(Option* o)
 }
 
 
+StatementCache&
+Connection::statements()
+{
+	if (!statements_) statements_ = new StatementCache(*this);
+	return *statements_;
+}
+
+
 bool Connection::thread_aware() { return driver_->thread_aware(); }
 void Connection::thread_end() { driver_->thread_end(); }
 bool Connection::thread_start() { return driver_->thread_start(); }
@@ -47,6 +47,8 @@ namespace libtabula {
 #if !defined(DOXYGEN_IGNORE)
 // Make Doxygen ignore this
 class LIBTABULA_EXPORT Query;
+class LIBTABULA_EXPORT SlowQueryLog;
+class LIBTABULA_EXPORT StatementCache;
 class DBDriver;
 #endif
 
@@ -71,6 +73,16 @@ public:
 	/// \param te if true, exceptions are thrown on errors
 	Connection(bool te = true);
 
+	/// \brief Create object using the given driver instead of the one
+	/// it would otherwise create
+	///
+	/// \param driver the driver to use; we take ownership of it
+	/// \param te if true, exceptions are thrown on errors
+	///
+	/// This is for handing a ReplayDriver to code that wants a
+	/// Connection.  It's connected if the driver already was.
+	explicit Connection(DBDriver* driver, bool te = true);
+
 	/// \brief Create object and connect to database server in one step.
 	///
 	/// This constructor allows you to most fully specify the options
@@ -185,6 +197,14 @@ public:
 	/// or one from the current database driver otherwise.
 	const char* error() const;
 
+	/// \brief Returns the largest statement the server will accept,
+	/// in bytes
+	///
+	/// This is syntactic sugar for a \c SELECT \c @@max_allowed_packet
+	/// SQL query.  Returns 0 if the query fails and exceptions are
+	/// disabled.
+	ulonglong max_allowed_packet();
+
 	/// \brief Test whether any error has occurred within the object.
 	///
 	/// Allows the object to be used in bool context, like this:
@@ -274,6 +294,58 @@ public:
 	/// \retval true if option was successfully set
 	bool set_option(Option* o);
 
+	/// \brief Limit the size of result sets from this connection's
+	/// queries
+	///
+	/// \param max_rows the most rows a result set may have, or 0 for
+	///     no limit
+	/// \param max_bytes the most memory a result set's rows may take
+	///     up, or 0 for no limit
+	///
+	/// Query objects created after this start out with these limits.
+	/// Copies of this connection have them, too.
+	///
+	/// Set them before connect() if you want the server asked to stop
+	/// sending rows once a result set goes over a limit.  The MySQL
+	/// driver does that by sending \c KILL \c QUERY over a second
+	/// connection, so it has to keep the password you connected with.
+	/// It only does that for connections made with limits on, so the
+	/// password isn't held in memory on connections that will never
+	/// need it.  Without that, going over a limit still stops the
+	/// result set, but the rest of its rows are read and thrown away.
+	///
+	/// \see Query::set_result_limits()
+	void set_result_limits(ulonglong max_rows, ulonglong max_bytes = 0)
+	{
+		max_rows_ = max_rows;
+		max_bytes_ = max_bytes;
+	}
+
+	/// \brief Returns the row limit given to set_result_limits(), or 0
+	ulonglong max_result_rows() const { return max_rows_; }
+
+	/// \brief Returns the memory limit given to set_result_limits(),
+	/// or 0
+	ulonglong max_result_bytes() const { return max_bytes_; }
+
+	/// \brief Log this connection's slow queries to the given log
+	///
+	/// Pass 0 to stop logging.  The log isn't owned by the connection,
+	/// so it must outlive it, or at least its use by it.  Copies of
+	/// this connection log to the same place.
+	///
+	/// \see SlowQueryLog
+	void set_slow_query_log(SlowQueryLog* log) { slow_log_ = log; }
+
+	/// \brief Returns the log set by set_slow_query_log(), or 0
+	SlowQueryLog* slow_query_log() const { return slow_log_; }
+
+	/// \brief Returns this connection's prepared statement cache
+	///
+	/// The cache is created on first use.  See StatementCache for
+	/// details.
+	StatementCache& statements();
+
 	/// \brief Returns true if both libtabula and database driver we're
 	/// using were compiled with thread awareness.
 	bool thread_aware();
@@ -323,6 +395,10 @@ protected:
 
 private:
 	DBDriver* driver_;
+	StatementCache* statements_;
+	SlowQueryLog* slow_log_;
+	ulonglong max_rows_;
+	ulonglong max_bytes_;
 	bool copacetic_;
 };
 
@@ -27,6 +27,7 @@
 #include "cpool.h"
 
 #include "connection.h"
+#include "observer.h"
 
 #include <algorithm>
 #include <functional>
@@ -104,14 +105,16 @@ ConnectionPool::exchange(const Connection* pc)
 //// find_mru //////////////////////////////////////////////////////////
 // Find most recently used available connection.  Uses operator< for
 // ConnectionInfo to order pool with MRU connection last.  Returns 0 if
-// there are no connections not in use.
+// there are no connections not in use.  The connection found is marked
+// as grabbed at the given time.
 
 Connection*
-ConnectionPool::find_mru()
+ConnectionPool::find_mru(ulonglong when)
 {
 	PoolIt mru = std::max_element(pool_.begin(), pool_.end());
 	if (mru != pool_.end() && !mru->in_use) {
 		mru->in_use = true;
+		mru->grabbed = when;
 		return mru->conn;
 	}
 	else {
@@ -125,16 +128,27 @@ ConnectionPool::find_mru()
 Connection*
 ConnectionPool::grab()
 {
-	ScopedLock lock(mutex_);	// ensure we're not interfered with
-	remove_old_connections();
-	if (Connection* mru = find_mru()) {
-		return mru;
+	QueryObserver* obs = QueryObserver::installed();
+	ulonglong start = obs ? Stopwatch::now() : 0;
+
+	Connection* pc;
+	{
+		ScopedLock lock(mutex_);	// ensure we're not interfered with
+		remove_old_connections();
+		if (!(pc = find_mru(start))) {
+			// No free connections, so create and return a new one.
+			pool_.push_back(ConnectionInfo(create(), start));
+			pc = pool_.back().conn;
+		}
 	}
-	else {
-		// No free connections, so create and return a new one.
-		pool_.push_back(ConnectionInfo(create()));
-		return pool_.back().conn;
+
+	if (obs) {
+		QueryEvent ev(QueryEvent::ev_grab, 0, pc);
+		ev.elapsed = ev.start - start;
+		ev.start = start;
+		obs->observe(ev);
 	}
+	return pc;
 }
 
 
@@ -143,15 +157,26 @@ ConnectionPool::grab()
 void
 ConnectionPool::release(const Connection* pc)
 {
-	ScopedLock lock(mutex_);	// ensure we're not interfered with
-
-	for (PoolIt it = pool_.begin(); it != pool_.end(); ++it) {
-		if (it->conn == pc) {
-			it->in_use = false;
-			it->last_used = time(0);
-			break;
+	QueryObserver* obs = QueryObserver::installed();
+	ulonglong grabbed = 0;
+	{
+		ScopedLock lock(mutex_);	// ensure we're not interfered with
+
+		for (PoolIt it = pool_.begin(); it != pool_.end(); ++it) {
+			if (it->conn == pc) {
+				it->in_use = false;
+				it->last_used = time(0);
+				grabbed = it->grabbed;
+				break;
+			}
 		}
 	}
+
+	if (obs) {
+		QueryEvent ev(QueryEvent::ev_release, 0, pc);
+		if (grabbed) ev.elapsed = ev.start - grabbed;
+		obs->observe(ev);
+	}
 }
 
 
@@ -116,6 +116,10 @@ public:
 	/// Do not delete the returned pointer.  This object manages the
 	/// lifetime of connection objects it creates.
 	///
+	/// If a QueryObserver is installed, it gets a QueryEvent::ev_grab
+	/// event saying how long this took, including any time spent
+	/// waiting for the pool's lock or creating a new connection.
+	///
 	/// \retval a pointer to the connection
 	virtual Connection* grab();
 
@@ -132,6 +136,11 @@ public:
 	/// really been idle, it can't make good judgements about when to
 	/// remove it from the pool.
 	///
+	/// If a QueryObserver is installed, it gets a
+	/// QueryEvent::ev_release event, whose \c elapsed member is how
+	/// long the connection was held, if it was grabbed while the
+	/// observer was installed, or 0 otherwise.
+	///
 	/// \param pc pointer to a Connection object to be returned to the
 	/// pool and marked as unused.
 	virtual void release(const Connection* pc);
@@ -214,11 +223,13 @@ private:
 	struct ConnectionInfo {
 		Connection* conn;
 		time_t last_used;
+		ulonglong grabbed;	// Stopwatch::now(), if observed
 		bool in_use;
 
-		ConnectionInfo(Connection* c) :
+		ConnectionInfo(Connection* c, ulonglong when = 0) :
 		conn(c),
 		last_used(time(0)),
+		grabbed(when),
 		in_use(true)
 		{
 		}
@@ -240,7 +251,7 @@ private:
 	typedef PoolT::iterator PoolIt;
 
 	//// Internal support functions
-	Connection* find_mru();
+	Connection* find_mru(ulonglong when);
 	void remove(const PoolIt& it);
 	void remove_old_connections();
 
@@ -35,6 +35,7 @@ namespace libtabula {
 DBDriver::DBDriver(bool te) :
 OptionalExceptions(te),
 is_connected_(false),
+cancellable_(false),
 option_error_(Option::err_NONE)
 {
 }
@@ -78,6 +79,16 @@ DBDriver::apply_pending_options(bool quit_on_first_failure)
 }
 
 
+void
+DBDriver::apply_options_to(DBDriver& other) const
+{
+	for (OptionList::const_iterator it = applied_options_.begin();
+			it != applied_options_.end(); ++it) {
+		(*it)->set(&other);
+	}
+}
+
+
 bool
 DBDriver::connect(const char*, const char*, unsigned int, 
 		const char*, const char*, const char*)
@@ -37,7 +37,9 @@
 namespace libtabula {
 
 #if !defined(DOXYGEN_IGNORE)
+class ParamArray;
 class Row;
+class SQLQueryParms;
 #endif
 
 #define DBD_SET_OPTION_IMPL(T) \
@@ -67,6 +69,16 @@ public:
 		nr_not_supported	///< DBMS doesn't support "next result"
 	};
 
+	/// \brief A statement prepared on the server by prepare()
+	///
+	/// Each leaf class derives its own from this to hold the DBMS's
+	/// statement handle.  Deleting it releases the statement.
+	class PreparedStatement
+	{
+	public:
+		virtual ~PreparedStatement() { }
+	};
+
 	/// \brief Create object
 	///
 	/// \param te If true, the driver throws exceptions on error.
@@ -84,6 +96,27 @@ public:
 	/// \brief Return the number of rows affected by the last query
 	virtual ulonglong affected_rows() = 0;
 
+	/// \brief Ask the server to stop running the current query
+	///
+	/// This is for abandoning a result set partway through, so the
+	/// server doesn't go on sending rows no one will read.  The
+	/// default does nothing and returns false; leaf classes that can
+	/// do this override it.
+	virtual bool cancel_query() { return false; }
+
+	/// \brief Returns true if connect() prepares for cancel_query()
+	///
+	/// \sa set_cancellable()
+	bool cancellable() const { return cancellable_; }
+
+	/// \brief Say whether connect() should prepare for cancel_query()
+	///
+	/// A leaf class that can only cancel a query from a second
+	/// connection has to keep the login credentials around to make
+	/// it.  It only does that for connections made while this is set.
+	/// Connection sets it when it connects with result limits on.
+	void set_cancellable(bool c) { cancellable_ = c; }
+
 	/// \brief Get database client library version
 	virtual std::string client_version() const = 0;
 
@@ -126,6 +159,21 @@ public:
 	/// The values returned are specific to the leaf class.
 	virtual int errnum() = 0;
 
+	/// \brief Returns true if the given error number, as returned by
+	/// errnum(), means the connection to the server was lost
+	///
+	/// Code that can pick up where it left off, such as KeysetScan,
+	/// uses this to tell a dropped connection worth retrying on from
+	/// an error that would only happen again.
+	virtual bool connection_lost(int errnum) const = 0;
+
+	/// \brief Returns true if the given error number means a
+	/// server-side prepared statement no longer exists, or must be
+	/// prepared again before it can run
+	///
+	/// StatementCache uses this to tell when to re-prepare.
+	virtual bool statement_lost(int errnum) const = 0;
+
 	/// \brief Return a SQL-escaped version of the given character
 	/// buffer
 	///
@@ -187,6 +235,75 @@ public:
 	/// \brief Executes the given query string
 	virtual bool execute(const char* qstr, size_t length) = 0;
 
+	/// \brief Runs a query through a read-only server-side cursor
+	///
+	/// The server keeps the result set, and the rows come back to us
+	/// \c fetch_size at a time as they're read.  Unlike use_result(),
+	/// this leaves the connection free for other queries while the
+	/// result set is open.
+	///
+	/// \param sql the query
+	/// \param fetch_size number of rows to ask the server for at once
+	/// \param error set to the reason for failure, if any
+	/// \param errnum set to the DBMS error number on failure, or 0 if
+	///     the query ran but returns no result set
+	///
+	/// \return an object that can be used to instantiate a
+	///     UseQueryResult, or 0 on failure or when there are no rows
+	virtual ResultBase::Impl* open_cursor(const std::string& sql,
+			unsigned long fetch_size, std::string& error,
+			int& errnum) = 0;
+
+	/// \brief Returns true if execute_array() can work on this
+	/// connection
+	///
+	/// This depends on both the client library we were built against
+	/// and the server we're connected to.
+	virtual bool array_binding() = 0;
+
+	/// \brief Runs a statement returned by prepare() once for each
+	/// row of parameter values, in a single round trip
+	///
+	/// \param stmt statement prepared by this driver, with one \c ?
+	///     placeholder per column of \c params
+	/// \param params parameter values
+	/// \param error set to the reason for failure, if any
+	/// \param errnum set to the DBMS error number on failure
+	///
+	/// \retval true if the statement ran for every row
+	virtual bool execute_array(PreparedStatement& stmt,
+			const ParamArray& params, std::string& error,
+			int& errnum) = 0;
+
+	/// \brief Has the server prepare the given statement for running
+	/// later with execute_prepared()
+	///
+	/// \param sql the statement, with a \c ? for each parameter
+	/// \param error set to the reason for failure, if any
+	/// \param errnum set to the DBMS error number on failure
+	///
+	/// \return the prepared statement, which the caller must delete
+	///     before this driver, or 0 on failure
+	virtual PreparedStatement* prepare(const std::string& sql,
+			std::string& error, int& errnum) = 0;
+
+	/// \brief Runs a statement returned by prepare()
+	///
+	/// \param stmt statement prepared by this driver
+	/// \param params one value per parameter marker; each goes to the
+	///     server as a string or a null, and the server converts it to
+	///     the type it needs, as with a text query
+	/// \param result set to an object that can be used to instantiate
+	///     a StoreQueryResult if the statement returns rows, else 0.
+	///     It's only good until the statement is run again or deleted.
+	/// \param error set to the reason for failure, if any
+	/// \param errnum set to the DBMS error number on failure
+	///
+	/// \retval true if the statement ran
+	virtual bool execute_prepared(PreparedStatement& stmt,
+			const SQLQueryParms& params, ResultBase::Impl*& result,
+			std::string& error, int& errnum) = 0;
+
 	/// \brief Fill out a Fields list from the given MySQL result
 	virtual void fetch_fields(Fields& fl, ResultBase::Impl& impl) const = 0;
 	
@@ -197,6 +314,21 @@ public:
 	/// \brief Returns the next row from the given "use" query result set.
 	virtual Row fetch_row(ResultBase& res) = 0;
 
+	/// \brief Returns the next row from the given "use" query result
+	/// set in the DBMS's native form, without building a Row.
+	///
+	/// The return value is an array of C string pointers, one per
+	/// field, with a null pointer standing in for each SQL null.  Call
+	/// fetch_lengths() to find out how long each one is.  Returns 0
+	/// at the end of the result set or on error; check errnum() to tell
+	/// the two apart.
+	///
+	/// Because this doesn't touch the result set's shared FieldNames
+	/// list, it is safe to call from a thread other than the one
+	/// building Row objects from that result set.  ReadAheadResult
+	/// depends on this.
+	virtual const char* const* fetch_raw_row(ResultBase::Impl& impl) = 0;
+
 	/// \brief Releases memory used by a result set
 	virtual void free_result(ResultBase::Impl& impl) const = 0;
 
@@ -356,12 +488,22 @@ protected:
 	/// implementation.
 	virtual bool apply_pending_options(bool quit_on_first_failure);
 
+	/// \brief Sets the options applied to this driver on another,
+	/// not yet connected, which doesn't take ownership of them
+	///
+	/// For leaf classes that need a second connection set up the way
+	/// this one was.
+	void apply_options_to(DBDriver& other) const;
+
 	/// \brief Returns true if connect() has successfully been called
 	/// on this object without a following disconnect().
 	///
 	/// \sa connected()
 	bool is_connected_;
 
+	/// \brief Set by set_cancellable()
+	bool cancellable_;
+
 private:
 	/// \brief Data type of the list of applied connection options
 	typedef std::deque<Option*> OptionList;
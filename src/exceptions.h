@@ -397,6 +397,42 @@ public:
 };
 
 
+/// \brief Exception thrown when a Thread object fails.
+
+class LIBTABULA_EXPORT ThreadFailed : public Exception
+{
+public:
+	/// \brief Create exception object
+	explicit ThreadFailed(const char* w = "thread failed") :
+	Exception(w)
+	{
+	}
+};
+
+
+/// \brief Exception thrown when code running on one of the library's
+/// worker threads throws.
+///
+/// The library can't carry the original exception object across
+/// threads, so this holds a copy of its what() message instead.
+
+class LIBTABULA_EXPORT WorkerFailed : public Exception
+{
+public:
+	/// \brief Create exception object
+	explicit WorkerFailed(const char* w = "worker thread failed") :
+	Exception(w)
+	{
+	}
+
+	/// \brief Create exception object
+	explicit WorkerFailed(const std::string& w) :
+	Exception(w)
+	{
+	}
+};
+
+
 /// \brief Exception thrown when you try to use an object that isn't
 /// completely initialized.
 
@@ -464,6 +500,69 @@ public:
 };
 
 
+/// \brief Exception thrown when Snapshot or ReplayDriver can't write
+/// its data to a file, or read it back
+
+class LIBTABULA_EXPORT BadSnapshot : public Exception
+{
+public:
+	/// \brief Create exception object
+	explicit BadSnapshot(const std::string& w) :
+	Exception(w)
+	{
+	}
+};
+
+
+/// \brief Exception thrown when a ResultWriter, SlowQueryLog or
+/// TraceRecorder can't write its output
+
+class LIBTABULA_EXPORT ExportFailed : public Exception
+{
+public:
+	/// \brief Create exception object
+	explicit ExportFailed(const std::string& w) :
+	Exception(w)
+	{
+	}
+};
+
+
+/// \brief Exception thrown when a result set goes over the row or
+/// memory limit set with Query::set_result_limits()
+///
+/// By the time this is thrown, the server has been asked to stop
+/// sending the rest of the result set.
+
+class LIBTABULA_EXPORT ResultTooLarge : public Exception
+{
+public:
+	/// \brief Create exception object
+	///
+	/// \param w explanation for why the exception was thrown
+	/// \param rows the number of rows read, counting the one that
+	///     went over the limit
+	/// \param bytes the memory those rows took up
+	ResultTooLarge(const std::string& w, ulonglong rows, ulonglong bytes) :
+	Exception(w),
+	rows_(rows),
+	bytes_(bytes)
+	{
+	}
+
+	/// \brief Returns the number of rows read before we gave up
+	ulonglong rows() const { return rows_; }
+
+	/// \brief Returns the memory those rows took up, as counted by
+	/// Row::memory_usage()
+	ulonglong bytes() const { return bytes_; }
+
+private:
+	ulonglong rows_;
+	ulonglong bytes_;
+};
+
+
 } // end namespace libtabula
 
 #endif // !defined(LIBTABULA_EXCEPTIONS_H)
@@ -49,7 +49,8 @@ public:
 	/// \brief Create empty object
 	Field() :
 	length_(0),
-	max_length_(0)
+	max_length_(0),
+	decimals_(0)
 	{
 	}
 
@@ -62,7 +63,24 @@ public:
 #endif
 	type_(MySQLFieldType(pf->type, pf->flags)),
 	length_(pf->length),
-	max_length_(pf->max_length)
+	max_length_(pf->max_length),
+	decimals_(pf->decimals)
+	{
+	}
+
+	/// \brief Create object from its parts, as when reading it back
+	/// from somewhere other than the C API
+	Field(const char* name, const char* table, const char* db,
+			const FieldType& type, size_t length, size_t max_length,
+			unsigned int decimals = 0) :
+	name_(name),
+	table_(table),
+	db_(db),
+	type_(type),
+	length_(length),
+	max_length_(max_length),
+	decimals_(decimals),
+	flags_(0)
 	{
 	}
 
@@ -73,7 +91,8 @@ public:
 	db_(other.db_),
 	type_(other.type_),
 	length_(other.length_),
-	max_length_(other.max_length_)
+	max_length_(other.max_length_),
+	decimals_(other.decimals_)
 	{
 	}
 
@@ -86,6 +105,10 @@ public:
 	/// \brief Returns true if field is of some BLOB type
 	bool blob_type() const { return flags_ & BLOB_FLAG; }
 
+	/// \brief Return the number of digits after the decimal point,
+	/// for numeric fields
+	unsigned int decimals() const { return decimals_; }
+
 	/// \brief Return the name of the database the field comes from
 	const char* db() const { return db_.c_str(); }
 
@@ -141,6 +164,7 @@ private:
 	FieldType type_;		///< info about the field's type
 	size_t length_;			///< creation size of column
 	size_t max_length_;		///< size of largest item in column in result set
+	unsigned int decimals_;	///< digits after the decimal point
 	unsigned int flags_;	///< DB engine-specific set of bit flags
 };
 
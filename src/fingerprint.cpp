@@ -0,0 +1,358 @@
+/***********************************************************************
+ fingerprint.cpp - Implements the Fingerprint class.
+
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#define LIBTABULA_NOT_HEADER
+#include "fingerprint.h"
+
+#include <vector>
+
+using namespace std;
+
+namespace libtabula {
+
+// Kinds of token, as far as spacing and list collapsing care
+enum TokenClass {
+	tc_none,		// start of statement
+	tc_word,		// keyword or name
+	tc_literal,		// value, written as ?
+	tc_open,		// (
+	tc_close,		// )
+	tc_comma,		// , or ;
+	tc_dot,			// .
+	tc_op			// operator
+};
+
+
+// Character classes.  We don't use <ctype.h> because its answers
+// depend on the locale, and we want the same fingerprint everywhere.
+
+static inline bool
+is_digit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+static inline bool
+is_space(char c)
+{
+	return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+static inline bool
+is_word_char(char c)
+{
+	return	(c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+			is_digit(c) || c == '_' || c == '$' || c == '@' ||
+			(c & 0x80);
+}
+
+static inline char
+to_lower(char c)
+{
+	return c >= 'A' && c <= 'Z' ? char(c - 'A' + 'a') : c;
+}
+
+
+// Returns the position just past the quoted string starting at p
+static const char*
+skip_quoted(const char* p, const char* end)
+{
+	const char quote = *p++;
+	while (p < end) {
+		if (*p == '\\') {
+			p = p + 2 < end ? p + 2 : end;
+		}
+		else if (*p == quote) {
+			if (p + 1 < end && p[1] == quote) p += 2;	// doubled quote
+			else return p + 1;
+		}
+		else {
+			++p;
+		}
+	}
+	return end;
+}
+
+
+// Builds the normalized text a token at a time
+class Normalizer
+{
+public:
+	explicit Normalizer(string& out) :
+	out_(out),
+	prev_(tc_none),
+	sign_at_(string::npos),
+	before_sign_(tc_none)
+	{
+	}
+
+	TokenClass prev() const { return prev_; }
+
+	// Add a token, lowercasing it if it's a word and fold is true
+	void add(TokenClass tc, const char* p, size_t n, bool fold = true)
+	{
+		// A + or - before a literal goes with the literal, unless it
+		// follows something it could be subtracted from
+		if (tc == tc_literal && sign_at_ != string::npos) {
+			out_.resize(sign_at_);
+			prev_ = before_sign_;
+			if (!groups_.empty()) --groups_.back().others;
+		}
+		sign_at_ = string::npos;
+
+		if (tc == tc_close) {
+			close();
+			return;
+		}
+
+		size_t start = out_.size();
+		if (prev_ != tc_none && prev_ != tc_open && prev_ != tc_dot &&
+				tc != tc_comma && tc != tc_dot &&
+				!(tc == tc_open && prev_ == tc_word)) {
+			out_ += ' ';
+		}
+
+		if (!groups_.empty()) {
+			if (tc == tc_literal) ++groups_.back().literals;
+			else if (tc != tc_comma) ++groups_.back().others;
+		}
+
+		if (tc == tc_op && n == 1 && (*p == '-' || *p == '+') &&
+				prev_ != tc_word && prev_ != tc_literal &&
+				prev_ != tc_close) {
+			sign_at_ = start;
+			before_sign_ = prev_;
+		}
+		else if (tc == tc_open) {
+			groups_.push_back(Group(out_.size()));
+		}
+
+		if (tc == tc_word && fold) {
+			for (size_t i = 0; i < n; ++i) out_ += to_lower(p[i]);
+		}
+		else {
+			out_.append(p, n);
+		}
+		prev_ = tc;
+	}
+
+	// Drop any trailing statement terminators
+	void finish()
+	{
+		while (!out_.empty() && out_[out_.size() - 1] == ';') {
+			out_.resize(out_.size() - 1);
+		}
+	}
+
+private:
+	// A parenthesized group we're inside of, and what's been in it
+	struct Group
+	{
+		size_t open;		// position of the (
+		size_t literals;
+		size_t others;
+
+		explicit Group(size_t o) : open(o), literals(0), others(0) { }
+	};
+
+	// Close the innermost group, collapsing it if it's a list of values
+	void close()
+	{
+		prev_ = tc_close;
+		if (groups_.empty()) {
+			out_ += ')';
+			return;
+		}
+
+		Group g = groups_.back();
+		groups_.pop_back();
+		if (g.literals == 0 || g.others != 0) {
+			out_ += ')';
+			return;
+		}
+
+		out_.resize(g.open + 1);
+		out_ += "...)";
+
+		// Fold a run of value lists down to one
+		static const char run[] = "(...), (...)";
+		const size_t n = sizeof(run) - 1;
+		if (out_.size() >= n &&
+				out_.compare(out_.size() - n, n, run) == 0) {
+			out_.resize(out_.size() - n + 5);
+		}
+	}
+
+	string& out_;
+	TokenClass prev_;
+	size_t sign_at_;			// where a possible sign starts, or npos
+	TokenClass before_sign_;	// what came before it
+	vector<Group> groups_;
+};
+
+
+void
+Fingerprint::build(const char* sql, size_t length)
+{
+	text_.clear();
+	text_.reserve(length);
+	Normalizer n(text_);
+
+	const char* p = sql;
+	const char* const end = sql + length;
+	while (p < end) {
+		const char c = *p;
+		const char next = p + 1 < end ? p[1] : '\0';
+
+		if (is_space(c)) {
+			++p;
+		}
+		else if (c == '#' || (c == '-' && next == '-' &&
+				(p + 2 == end || is_space(p[2])))) {
+			// Comment to end of line
+			while (p < end && *p != '\n') ++p;
+		}
+		else if (c == '/' && next == '*') {
+			// Block comment, including the /*! ... */ and /*+ ... */
+			// kinds, which don't change what the statement is
+			for (p += 2; p < end && !(*p == '*' && p + 1 < end &&
+					p[1] == '/'); ++p) { }
+			p = p < end ? p + 2 : end;
+		}
+		else if (c == '\'' || c == '"') {
+			p = skip_quoted(p, end);
+			n.add(tc_literal, "?", 1);
+		}
+		else if (c == '`') {
+			// Quoted name: keep the quotes only if it needs them
+			const char* q = skip_quoted(p, end);
+			bool plain = q - p > 2 && q[-1] == '`';
+			for (const char* r = p + 1; plain && r < q - 1; ++r) {
+				plain = is_word_char(*r);
+			}
+			if (plain) {
+				n.add(tc_word, p + 1, q - p - 2);
+			}
+			else {
+				n.add(tc_word, p, q - p, false);
+			}
+			p = q;
+		}
+		else if ((is_digit(c) && n.prev() != tc_dot) ||
+				(c == '.' && is_digit(next) && n.prev() != tc_word &&
+				 n.prev() != tc_close)) {
+			// Number, unless it turns out to be a name starting with
+			// digits, which MySQL allows
+			const char* q = p;
+			if (c == '0' && (next == 'x' || next == 'X' ||
+					next == 'b' || next == 'B')) {
+				for (q += 2; q < end && is_word_char(*q); ++q) { }
+			}
+			else {
+				while (q < end && is_digit(*q)) ++q;
+				if (q < end && *q == '.') {
+					for (++q; q < end && is_digit(*q); ++q) { }
+				}
+				if (q < end && (*q == 'e' || *q == 'E')) {
+					const char* e = q + 1;
+					if (e < end && (*e == '+' || *e == '-')) ++e;
+					if (e < end && is_digit(*e)) {
+						for (q = e; q < end && is_digit(*q); ++q) { }
+					}
+				}
+			}
+
+			if (q < end && is_word_char(*q) && *p != '.') {
+				while (q < end && is_word_char(*q)) ++q;
+				n.add(tc_word, p, q - p);
+			}
+			else {
+				n.add(tc_literal, "?", 1);
+			}
+			p = q;
+		}
+		else if (is_word_char(c)) {
+			const char* q = p;
+			while (q < end && is_word_char(*q)) ++q;
+
+			// X'...', B'...', N'...' and _charset'...' are literals
+			size_t len = q - p;
+			if (q < end && *q == '\'' && (*p == '_' || (len == 1 &&
+					(to_lower(*p) == 'x' || to_lower(*p) == 'b' ||
+					 to_lower(*p) == 'n')))) {
+				p = skip_quoted(q, end);
+				n.add(tc_literal, "?", 1);
+			}
+			else {
+				n.add(tc_word, p, len);
+				p = q;
+			}
+		}
+		else if (c == '?') {
+			n.add(tc_literal, p++, 1);
+		}
+		else if (c == '(') {
+			n.add(tc_open, p++, 1);
+		}
+		else if (c == ')') {
+			n.add(tc_close, p++, 1);
+		}
+		else if (c == ',' || c == ';') {
+			n.add(tc_comma, p++, 1);
+		}
+		else if (c == '.') {
+			n.add(tc_dot, p++, 1);
+		}
+		else {
+			// Operator: a run of symbols, up to anything that starts
+			// something else
+			const char* q = p + 1;
+			while (q < end && !is_space(*q) && !is_word_char(*q) &&
+					!is_digit(*q) && *q != '\'' && *q != '"' &&
+					*q != '`' && *q != '?' && *q != '(' && *q != ')' &&
+					*q != ',' && *q != ';' && *q != '.' && *q != '#' &&
+					!(*q == '/' && q + 1 < end && q[1] == '*') &&
+					!(*q == '-' && q + 1 < end && q[1] == '-') &&
+					!((*q == '-' || *q == '+') && q + 1 < end &&
+						(is_digit(q[1]) || q[1] == '.'))) {
+				++q;
+			}
+			n.add(tc_op, p, q - p);
+			p = q;
+		}
+	}
+	n.finish();
+
+	// 64-bit FNV-1a, with the constants built up from 32-bit halves
+	// because C++98 has no long long literals
+	const ulonglong prime = (ulonglong(0x100) << 32) | 0x1b3;
+	digest_ = (ulonglong(0xcbf29ce4) << 32) | 0x84222325;
+	for (size_t i = 0; i < text_.size(); ++i) {
+		digest_ ^= static_cast<unsigned char>(text_[i]);
+		digest_ *= prime;
+	}
+}
+
+} // end namespace libtabula
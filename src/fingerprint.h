@@ -0,0 +1,117 @@
+/// \file fingerprint.h
+/// \brief Declares the Fingerprint class, which reduces a SQL
+/// statement to a normalized form and a 64-bit digest, so that
+/// statements differing only in their literal values can be grouped.
+
+/***********************************************************************
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#if !defined(LIBTABULA_FINGERPRINT_H)
+#define LIBTABULA_FINGERPRINT_H
+
+#include "common.h"
+
+#include <string>
+
+namespace libtabula {
+
+/// \brief The normalized form of a SQL statement, and its digest
+///
+/// Two statements get the same fingerprint if they differ only in
+/// their literal values, spacing, comments, or the case of their
+/// keywords and names.  This is the same idea as MySQL's statement
+/// digests, done on the client side in one pass over the text, so it
+/// is cheap enough to run on every query.  For example, both of
+///
+/// \code
+///   SELECT * FROM stock WHERE id IN (1, 2, 3) AND name = 'Pickle Relish'
+///   select *
+///     from `stock`   -- any comment
+///     where id in (42) and name='Hot Mustard'
+/// \endcode
+///
+/// come out as
+///
+/// \code
+///   select * from stock where id in(...) and name = ?
+/// \endcode
+///
+/// The rules:
+///
+/// - Quoted strings, numbers, hex and bit literals, and \c ? place
+///   holders become \c ?.  A leading sign on a number is dropped
+///   where it can't be a subtraction.
+/// - A parenthesized list of nothing but literals becomes \c (...),
+///   and a run of such lists, as in a multi-row \c VALUES clause,
+///   becomes one.
+/// - Comments are dropped, and the remaining words and symbols are
+///   separated by single spaces, except around \c . and inside
+///   parentheses, and there's no space before a parenthesis that
+///   follows a word.
+/// - Unquoted words are folded to lower case, and backquotes are
+///   dropped from names that don't need them.
+///
+/// The digest is a 64-bit FNV-1a hash of the normalized text, so it's
+/// the same from run to run and from one platform to another.
+class LIBTABULA_EXPORT Fingerprint
+{
+public:
+	/// \brief Create an empty fingerprint
+	Fingerprint() :
+	digest_(0)
+	{
+	}
+
+	/// \brief Fingerprint a SQL statement
+	Fingerprint(const char* sql, size_t length) { build(sql, length); }
+
+	/// \brief Fingerprint a SQL statement
+	explicit Fingerprint(const std::string& sql)
+			{ build(sql.data(), sql.length()); }
+
+	/// \brief Returns the 64-bit digest of the normalized statement
+	ulonglong digest() const { return digest_; }
+
+	/// \brief Returns the normalized statement
+	const std::string& text() const { return text_; }
+
+	/// \brief Returns true if two fingerprints are of the same
+	/// statement
+	bool operator ==(const Fingerprint& rhs) const
+			{ return digest_ == rhs.digest_ && text_ == rhs.text_; }
+
+	/// \brief Returns true if two fingerprints are of different
+	/// statements
+	bool operator !=(const Fingerprint& rhs) const
+			{ return !(*this == rhs); }
+
+private:
+	void build(const char* sql, size_t length);
+
+	std::string text_;
+	ulonglong digest_;
+};
+
+} // end namespace libtabula
+
+#endif // !defined(LIBTABULA_FINGERPRINT_H)
@@ -211,5 +211,190 @@ private:
 	int size_;
 };
 
+
+/// \brief An insert policy object that tunes the number of rows per
+/// INSERT statement as it goes, aiming for a target statement latency
+///
+/// Query::insertfrom() and replacefrom() tell this policy how big
+/// each statement was and how long it took to execute.  After each
+/// statement that filled up to the current row target, the target
+/// grows by a fixed step if the statement beat the latency target,
+/// and is cut in half if it missed: the same "additive increase,
+/// multiplicative decrease" scheme TCP uses to find a link's
+/// capacity.  Statements cut short for other reasons, like the last
+/// one of a run, don't change the target.
+///
+/// The policy also keeps each statement under the server's
+/// \c max_allowed_packet limit, which insertfrom() looks up for you
+/// unless you give it to the ctor.  Row sizes are measured from the
+/// growth of the statement between calls to can_add(), rather than
+/// by building each row's SQL twice the way MaxPacketInsertPolicy
+/// does.  The catch is that the next row's size is only estimated,
+/// as twice the largest row seen so far in that statement, so if
+/// your rows vary wildly in size -- big BLOBs mixed with small ones,
+/// say -- use MaxPacketInsertPolicy instead.
+///
+/// Call decisions() to see how it got to where it is.
+template <class AccessController = Transaction>
+class LIBTABULA_EXPORT AdaptiveInsertPolicy
+{
+public:
+	/// \brief Record of one executed statement and what the policy
+	/// did about it
+	struct Decision
+	{
+		size_t rows;			///< rows in the statement
+		size_t bytes;			///< length of the statement
+		ulonglong usec;			///< time it took to execute
+		size_t next_rows;		///< row target chosen afterward
+	};
+
+	/// \brief Constructor
+	///
+	/// \param target_msec how long each statement should take to
+	///     execute
+	/// \param max_packet largest statement allowed, in bytes; 0 means
+	///     ask the server for its \c max_allowed_packet value
+	/// \param initial_rows row target for the first statement
+	AdaptiveInsertPolicy(unsigned long target_msec = 250,
+			size_t max_packet = 0, size_t initial_rows = 100) :
+	target_usec_(ulonglong(target_msec) * 1000),
+	max_packet_(max_packet),
+	row_target_(initial_rows ? initial_rows : 1),
+	min_rows_(1),
+	max_rows_(1000000),
+	step_(row_target_ / 4 ? row_target_ / 4 : 1),
+	rows_(0),
+	last_size_(0),
+	max_row_(0),
+	capped_(false)
+	{
+	}
+
+	/// \brief Destructor
+	~AdaptiveInsertPolicy() { }
+
+	/// \brief Can we add another object to the query?
+	///
+	/// \param size current length of the INSERT statement
+	/// \param object the SSQLS object to be added
+	///
+	/// \retval true if the object is allowed to be added to the
+	///     INSERT statement
+	template <class RowT>
+	bool can_add(int size, const RowT& object)
+	{
+		(void)object;		// we don't use this, but other policies do
+
+		if (size == 0) {
+			// Starting a new statement; always allow one row
+			rows_ = 1;
+			last_size_ = 0;
+			max_row_ = 0;
+			capped_ = false;
+			return true;
+		}
+
+		// The statement grew by one row (and, the first time, its
+		// header) since we were last called.
+		size_t row = size_t(size) - last_size_;
+		if (row > max_row_) max_row_ = row;
+		last_size_ = size_t(size);
+
+		if (rows_ >= row_target_) {
+			return false;
+		}
+		else if (size_t(size) + 2 * max_row_ > max_packet()) {
+			capped_ = true;
+			return false;
+		}
+		else {
+			++rows_;
+			return true;
+		}
+	}
+
+	/// \brief Take note of an executed statement, and adjust the row
+	/// target
+	///
+	/// Query::insertfrom() and replacefrom() call this for you.
+	///
+	/// \param bytes length of the statement
+	/// \param usec time it took to execute
+	void executed(size_t bytes, ulonglong usec)
+	{
+		if (rows_ >= row_target_ && !capped_) {
+			if (usec <= target_usec_) {
+				row_target_ += step_;
+			}
+			else {
+				row_target_ /= 2;
+			}
+			if (row_target_ < min_rows_) row_target_ = min_rows_;
+			if (row_target_ > max_rows_) row_target_ = max_rows_;
+		}
+
+		Decision d;
+		d.rows = rows_;
+		d.bytes = bytes;
+		d.usec = usec;
+		d.next_rows = row_target_;
+		decisions_.push_back(d);
+		if (decisions_.size() > 1000) decisions_.pop_front();
+	}
+
+	/// \brief Set the smallest and largest row targets the policy may
+	/// choose, and the amount it grows by after a fast statement
+	void set_limits(size_t min_rows, size_t max_rows, size_t step)
+	{
+		min_rows_ = min_rows ? min_rows : 1;
+		max_rows_ = max_rows < min_rows_ ? min_rows_ : max_rows;
+		step_ = step ? step : 1;
+		if (row_target_ < min_rows_) row_target_ = min_rows_;
+		if (row_target_ > max_rows_) row_target_ = max_rows_;
+	}
+
+	/// \brief Set the largest statement allowed, in bytes
+	void set_max_packet(size_t bytes) { max_packet_ = bytes; }
+
+	/// \brief Returns the largest statement allowed, in bytes
+	///
+	/// If this wasn't given to the ctor and hasn't been looked up from
+	/// the server yet, returns 1 MiB, the smallest default any MySQL
+	/// version has used.
+	size_t max_packet() const
+			{ return max_packet_ ? max_packet_ : 1024 * 1024; }
+
+	/// \brief Returns true if the packet limit was given or looked up,
+	/// rather than defaulted
+	bool max_packet_known() const { return max_packet_ != 0; }
+
+	/// \brief Returns the number of rows the policy currently allows
+	/// in each statement
+	size_t row_target() const { return row_target_; }
+
+	/// \brief Returns the most recent statements and what the policy
+	/// did after each, oldest first
+	///
+	/// Only the last 1000 are kept.
+	const std::deque<Decision>& decisions() const { return decisions_; }
+
+	/// \brief Alias for our access controller type
+	typedef AccessController access_controller;
+
+private:
+	ulonglong target_usec_;
+	size_t max_packet_;
+	size_t row_target_;
+	size_t min_rows_;
+	size_t max_rows_;
+	size_t step_;
+	size_t rows_;			///< rows in the statement being built
+	size_t last_size_;		///< statement size at last can_add() call
+	size_t max_row_;		///< largest row in the statement being built
+	bool capped_;			///< statement was cut short by packet limit
+	std::deque<Decision> decisions_;
+};
+
 #endif // !defined(LIBTABULA_INSERTPOLICY_H)
 
@@ -0,0 +1,176 @@
+/***********************************************************************
+ keyfilter.cpp - Implements the KeyFilter class.
+
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#define LIBTABULA_NOT_HEADER
+#include "keyfilter.h"
+
+#include "connection.h"
+#include "manip.h"
+#include "query.h"
+#include "sqlstream.h"
+
+#include <sstream>
+
+using namespace std;
+
+namespace libtabula {
+
+
+KeyFilter::KeyFilter(Connection& conn, const std::string& key_type) :
+OptionalExceptions(conn.throw_exceptions()),
+conn_(conn),
+key_type_(key_type),
+threshold_(1000)
+{
+}
+
+
+KeyFilter::~KeyFilter()
+{
+	// Can't let an exception out of a dtor, and if the DROP fails, the
+	// connection is probably gone, and the table with it.
+	try {
+		NoExceptions ne(*this);
+		drop();
+	}
+	catch (...) {
+	}
+}
+
+
+void
+KeyFilter::add(const SQLTypeAdapter& key)
+{
+	// The table no longer matches the key set
+	if (!table_.empty()) drop();
+
+	SQLStream s(&conn_);
+	s << quote << key;
+	keys_.push_back(s.str());
+}
+
+
+void
+KeyFilter::clear()
+{
+	drop();
+	keys_.clear();
+}
+
+
+bool
+KeyFilter::drop()
+{
+	if (table_.empty()) return true;
+
+	string table = table_;
+	table_.clear();
+
+	Query q(&conn_, throw_exceptions());
+	return q.exec("DROP TEMPORARY TABLE IF EXISTS `" + table + '`');
+}
+
+
+bool
+KeyFilter::upload()
+{
+	// Temporary tables are private to the session, so the name need
+	// only differ from those of other KeyFilters on this connection.
+	ostringstream name;
+	name << "libtabula_keys_" << hex << size_t(this);
+
+	Query q(&conn_, throw_exceptions());
+	q << "CREATE TEMPORARY TABLE `" << name.str() << "` (k " <<
+			key_type_ << " NOT NULL PRIMARY KEY)";
+	if (!q.exec()) return false;
+	table_ = name.str();
+
+	try {
+		// Send as many keys per statement as the server will take,
+		// leaving some room for error.  INSERT IGNORE skips duplicate
+		// keys.
+		size_t limit = size_t(conn_.max_allowed_packet());
+		if (limit == 0) limit = 1024 * 1024;
+		limit -= limit > 2048 ? 1024 : limit / 2;
+
+		const string head = "INSERT IGNORE INTO `" + table_ +
+				"` (k) VALUES ";
+		string sql;
+		size_t i = 0;
+		while (i < keys_.size()) {
+			sql = head;
+			sql += '(';
+			sql += keys_[i++];
+			sql += ')';
+			while (i < keys_.size() &&
+					sql.size() + keys_[i].size() + 3 <= limit) {
+				sql += ",(";
+				sql += keys_[i++];
+				sql += ')';
+			}
+
+			if (!q.exec(sql)) {
+				drop();
+				return false;
+			}
+		}
+	}
+	catch (...) {
+		// Don't leave where() filtering against a partial key set.
+		// drop() forgets the table before it tries to drop it, so a
+		// second failure there changes nothing.
+		try {
+			drop();
+		}
+		catch (...) {
+		}
+		throw;
+	}
+
+	return true;
+}
+
+
+std::string
+KeyFilter::where(const std::string& column)
+{
+	if (uses_table() && (!table_.empty() || upload())) {
+		return column + " IN (SELECT k FROM `" + table_ + "`)";
+	}
+
+	if (keys_.empty()) {
+		return column + " IN (NULL)";	// never true
+	}
+
+	string cond = column + " IN (";
+	for (size_t i = 0; i < keys_.size(); ++i) {
+		if (i) cond += ',';
+		cond += keys_[i];
+	}
+	cond += ')';
+	return cond;
+}
+
+} // end namespace libtabula
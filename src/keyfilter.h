@@ -0,0 +1,145 @@
+/// \file keyfilter.h
+/// \brief Declares the KeyFilter class, which filters a query by a
+/// large set of keys.
+
+/***********************************************************************
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#if !defined(LIBTABULA_KEYFILTER_H)
+#define LIBTABULA_KEYFILTER_H
+
+#include "common.h"
+
+#include "noexceptions.h"
+#include "stadapter.h"
+
+#include <string>
+#include <vector>
+
+namespace libtabula {
+
+#if !defined(DOXYGEN_IGNORE)
+// Make Doxygen ignore this
+class LIBTABULA_EXPORT Connection;
+#endif
+
+/// \brief Builds a WHERE condition matching a set of keys, moving the
+/// keys into a temporary table when there are too many to list inline
+///
+/// A condition like <tt>id IN (1,2,3)</tt> is fine for a few keys, but
+/// with hundreds of thousands of them the statement runs to megabytes,
+/// and the server spends longer parsing it than running it.  Past a
+/// threshold, this class instead uploads the keys into an indexed
+/// session temporary table with multi-row INSERT statements, and gives
+/// a condition like <tt>id IN (SELECT k FROM tmp)</tt>.  The server
+/// runs that as a semi-join against the temporary table's primary key,
+/// which, unlike a plain join, doesn't repeat rows when the key set
+/// has duplicates.
+///
+/// \code
+///   libtabula::KeyFilter keys(conn);
+///   keys.add(ids.begin(), ids.end());
+///   libtabula::Query q = conn.query();
+///   q << "SELECT * FROM stock WHERE " << keys.where("id");
+///   libtabula::StoreQueryResult res = q.store();
+/// \endcode
+///
+/// The temporary table is dropped when the object is destroyed, or
+/// when keys are added after it was uploaded.  Since temporary tables
+/// belong to the connection that created them, use the condition only
+/// on the Connection given to the constructor.
+class LIBTABULA_EXPORT KeyFilter : public OptionalExceptions
+{
+public:
+	/// \brief Create an empty key set
+	///
+	/// \param conn connection the filtered queries will run on
+	/// \param key_type SQL type for the temporary table's key column;
+	///     it should match the type of the column being filtered
+	KeyFilter(Connection& conn, const std::string& key_type = "BIGINT");
+
+	/// \brief Destroy the object, dropping the temporary table if
+	/// there is one
+	~KeyFilter();
+
+	/// \brief Add a key to the set
+	void add(const SQLTypeAdapter& key);
+
+	/// \brief Add a range of keys to the set
+	template <class Iter>
+	void add(Iter first, Iter last)
+	{
+		for (/* */; first != last; ++first) {
+			add(SQLTypeAdapter(*first));
+		}
+	}
+
+	/// \brief Empty the key set and drop the temporary table
+	void clear();
+
+	/// \brief Drop the temporary table, if there is one
+	///
+	/// The keys are kept, so the next call to where() uploads them
+	/// again.  You only need to call this to free the table early.
+	///
+	/// \return false if the DROP failed and exceptions are disabled
+	bool drop();
+
+	/// \brief Set the largest key count to list inline; the default
+	/// is 1000
+	void set_threshold(size_t keys) { threshold_ = keys; }
+
+	/// \brief Returns the number of keys in the set
+	size_t size() const { return keys_.size(); }
+
+	/// \brief Returns true if where() will use a temporary table
+	bool uses_table() const { return keys_.size() > threshold_; }
+
+	/// \brief Returns a condition that's true for rows whose \c column
+	/// is one of the keys
+	///
+	/// If the key set is over the threshold, this uploads it into the
+	/// temporary table first, unless that was already done.  If the
+	/// upload fails and exceptions are disabled, the keys are listed
+	/// inline instead.
+	///
+	/// \param column column name or expression, inserted as-is
+	std::string where(const std::string& column);
+
+private:
+	KeyFilter(const KeyFilter&);
+	KeyFilter& operator =(const KeyFilter&);
+
+	/// \brief Create the temporary table and insert the keys into it
+	bool upload();
+
+	Connection& conn_;
+	std::string key_type_;
+	std::vector<std::string> keys_;	///< quoted and escaped key values
+	size_t threshold_;
+	std::string table_;				///< temporary table, if uploaded
+};
+
+} // end namespace libtabula
+
+#endif // !defined(LIBTABULA_KEYFILTER_H)
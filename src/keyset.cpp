@@ -0,0 +1,181 @@
+/***********************************************************************
+ keyset.cpp - Implements the KeysetScanBase class.
+
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#define LIBTABULA_NOT_HEADER
+#include "keyset.h"
+
+#include "connection.h"
+#include "dbdriver.h"
+#include "stopwatch.h"
+
+using namespace std;
+
+namespace libtabula {
+
+
+KeysetScanBase::KeysetScanBase(Connection& conn, const std::string& table,
+		const std::string& keys, size_t chunk_rows) :
+OptionalExceptions(conn.throw_exceptions()),
+conn_(conn),
+table_(table),
+keys_(keys),
+first_(conn.query()),
+next_(conn.query()),
+prepared_(false),
+chunk_rows_(chunk_rows ? chunk_rows : 1),
+min_rows_(1),
+max_rows_(~size_t(0)),
+target_usec_(0),
+retries_(3),
+chunks_(0),
+rows_(0),
+reconnects_(0),
+done_(false)
+{
+	// We handle errors in fetch_chunk(), so the queries always throw
+	first_.enable_exceptions();
+	next_.enable_exceptions();
+}
+
+
+void
+KeysetScanBase::adapt(ulonglong usec, size_t rows)
+{
+	if (!target_usec_ || !rows) return;
+
+	// Aim for the row count that would have hit the target at the rate
+	// we just saw, but only go halfway there, and never more than
+	// double or halve the size in one step, so one odd chunk can't
+	// throw things off much.
+	double ideal = double(target_usec_) * rows / (usec ? usec : 1);
+	double next = (chunk_rows_ + ideal) / 2;
+	if (next > 2.0 * chunk_rows_) next = 2.0 * chunk_rows_;
+	if (next < chunk_rows_ / 2.0) next = chunk_rows_ / 2.0;
+	if (next > double(max_rows_)) next = double(max_rows_);
+	if (next < double(min_rows_)) next = double(min_rows_);
+	chunk_rows_ = size_t(next);
+}
+
+
+std::string
+KeysetScanBase::chunk_query(const std::string& after)
+{
+	prepare();
+
+	SQLQueryParms p;
+	if (after.empty()) {
+		p << ulonglong(chunk_rows_);
+		return first_.str(p);
+	}
+	else {
+		p << after << ulonglong(chunk_rows_);
+		return next_.str(p);
+	}
+}
+
+
+StoreQueryResult
+KeysetScanBase::fetch_chunk(const std::string& after)
+{
+	prepare();
+
+	for (int attempt = 0; ; ++attempt) {
+		SQLQueryParms p;
+		if (!after.empty()) p << after;
+		p << ulonglong(chunk_rows_);
+		Query& q = after.empty() ? first_ : next_;
+
+		try {
+			Stopwatch timer;
+			StoreQueryResult res = q.store(p);
+			ulonglong usec = timer.elapsed();
+
+			++chunks_;
+			rows_ += res.num_rows();
+			if (res.num_rows() < chunk_rows_) {
+				done_ = true;
+			}
+			else {
+				adapt(usec, res.num_rows());
+			}
+			return res;
+		}
+		catch (const BadQuery& e) {
+			// If the connection dropped and we can get it back, retry.
+			// Nothing was handed to the caller from the failed chunk,
+			// so we pick up right where we left off.
+			if (attempt < retries_ &&
+					conn_.driver()->connection_lost(e.errnum()) &&
+					conn_.ping()) {
+				++reconnects_;
+				continue;
+			}
+
+			done_ = true;
+			if (throw_exceptions()) throw;
+			return StoreQueryResult();
+		}
+	}
+}
+
+
+void
+KeysetScanBase::prepare()
+{
+	if (prepared_) return;
+
+	// Double any percent signs in the caller's condition, so parse()
+	// doesn't take them for template parameters.
+	string where;
+	for (size_t i = 0; i < where_.size(); ++i) {
+		if (where_[i] == '%') where += '%';
+		where += where_[i];
+	}
+
+	first_ << "SELECT * FROM `" << table_ << '`';
+	if (!where.empty()) first_ << " WHERE (" << where << ')';
+	first_ << " ORDER BY " << keys_ << " LIMIT %0";
+	first_.parse();
+
+	next_ << "SELECT * FROM `" << table_ << "` WHERE (" << keys_ <<
+			") > (%0)";
+	if (!where.empty()) next_ << " AND (" << where << ')';
+	next_ << " ORDER BY " << keys_ << " LIMIT %1";
+	next_.parse();
+
+	prepared_ = true;
+}
+
+
+void
+KeysetScanBase::set_chunk_limits(size_t min_rows, size_t max_rows)
+{
+	min_rows_ = min_rows ? min_rows : 1;
+	max_rows_ = max_rows < min_rows_ ? min_rows_ : max_rows;
+	if (chunk_rows_ < min_rows_) chunk_rows_ = min_rows_;
+	if (chunk_rows_ > max_rows_) chunk_rows_ = max_rows_;
+}
+
+} // end namespace libtabula
@@ -0,0 +1,309 @@
+/// \file keyset.h
+/// \brief Declares the KeysetScan template and its base class, which
+/// walk a table in key order a chunk at a time.
+
+/***********************************************************************
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#if !defined(LIBTABULA_KEYSET_H)
+#define LIBTABULA_KEYSET_H
+
+#include "common.h"
+
+#include "noexceptions.h"
+#include "query.h"
+#include "sqlstream.h"
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace libtabula {
+
+/// \brief The non-template part of KeysetScan
+///
+/// This builds and runs the chunk queries, times them, adjusts the
+/// chunk size, and recovers from dropped connections.  It knows the
+/// key only as SQL text: a column list, and the quoted values of the
+/// last key seen.  KeysetScan fills those in from an SSQLS.
+class LIBTABULA_EXPORT KeysetScanBase : public OptionalExceptions
+{
+public:
+	/// \brief Add a condition every row must meet
+	///
+	/// \param where a SQL boolean expression; it is parenthesized and
+	///     ANDed with the key condition.  Must be set before the first
+	///     chunk is fetched.
+	void set_where(const std::string& where) { where_ = where; }
+
+	/// \brief Have the chunk size adapt so that each chunk query takes
+	/// about this long
+	///
+	/// After each full chunk, the chunk size is moved toward the row
+	/// count that would have taken \c msec to fetch at the rate just
+	/// seen, within the limits given to set_chunk_limits().  Pass 0,
+	/// the default, to keep the chunk size fixed.
+	void set_target_latency(unsigned long msec)
+			{ target_usec_ = ulonglong(msec) * 1000; }
+
+	/// \brief Set the smallest and largest chunk sizes the latency
+	/// target may choose
+	void set_chunk_limits(size_t min_rows, size_t max_rows);
+
+	/// \brief Set how many times in a row we'll reconnect and retry
+	/// a chunk after losing the connection to the server
+	///
+	/// Reconnection is done with Connection::ping(), so it only works
+	/// if you've set ReconnectOption on the connection.  The default
+	/// is 3.
+	void set_retries(int retries) { retries_ = retries; }
+
+	/// \brief Returns the number of rows the next chunk query asks for
+	size_t chunk_rows() const { return chunk_rows_; }
+
+	/// \brief Returns the number of chunk queries run so far
+	ulonglong chunks() const { return chunks_; }
+
+	/// \brief Returns the number of rows fetched so far
+	ulonglong rows() const { return rows_; }
+
+	/// \brief Returns the number of times we've reconnected
+	ulonglong reconnects() const { return reconnects_; }
+
+	/// \brief Returns true once a chunk has come back short, meaning
+	/// we've reached the end of the table
+	bool done() const { return done_; }
+
+protected:
+	/// \brief Set up the scan
+	///
+	/// \param conn connection to run the chunk queries on
+	/// \param table name of the table to scan
+	/// \param keys comma-separated list of key columns, in the order
+	///     they are to be compared
+	/// \param chunk_rows number of rows to ask for in each chunk, at
+	///     least at first
+	KeysetScanBase(Connection& conn, const std::string& table,
+			const std::string& keys, size_t chunk_rows);
+
+	/// \brief Returns the SQL for the chunk following the given key
+	///
+	/// \param after comma-separated list of quoted key values; empty
+	///     to start at the beginning of the table
+	std::string chunk_query(const std::string& after);
+
+	/// \brief Run the chunk query following the given key
+	///
+	/// This is where the timing, chunk size adjustment, and retries
+	/// happen.  Sets done() if the chunk comes back short.
+	StoreQueryResult fetch_chunk(const std::string& after);
+
+	/// \brief Returns the connection the scan runs on
+	Connection& connection() const { return conn_; }
+
+	/// \brief Set or clear the done() flag
+	void set_done(bool done) { done_ = done; }
+
+private:
+	/// \brief Adjust the chunk size after a chunk query
+	void adapt(ulonglong usec, size_t rows);
+
+	/// \brief Build and parse the template queries, if not yet done
+	void prepare();
+
+	Connection& conn_;
+	std::string table_;
+	std::string keys_;
+	std::string where_;
+	Query first_;			///< template for the first chunk
+	Query next_;			///< template for every chunk after that
+	bool prepared_;			///< true once first_ and next_ are parsed
+	size_t chunk_rows_;
+	size_t min_rows_;
+	size_t max_rows_;
+	ulonglong target_usec_;
+	int retries_;
+	ulonglong chunks_;
+	ulonglong rows_;
+	ulonglong reconnects_;
+	bool done_;
+};
+
+
+/// \brief Walks a table in key order, one chunk at a time, using
+/// "keyset" pagination
+///
+/// A Query::use() over a big table ties up a server-side result set
+/// for the whole scan, and if the connection drops, the scan is lost.
+/// This instead fetches the table in chunks with queries like:
+///
+/// \code
+///   SELECT * FROM `stock` WHERE (`id`) > (1234) ORDER BY `id` LIMIT 1000
+/// \endcode
+///
+/// Each chunk is a short-lived stored result set, and because each
+/// query starts from the last key seen rather than from an \c OFFSET,
+/// every chunk costs the same no matter how far into the table you
+/// are, given an index on the key.
+///
+/// The key is the first \c CMP fields of the SSQLS -- the same ones
+/// its comparison operators and <tt>equal_list(..., sql_use_compare)</tt>
+/// use -- so for this to work, those fields must form a unique key
+/// for the table.  Multi-column keys are compared with a SQL row
+/// constructor, so the order is the same as the SSQLS's own operator<.
+///
+/// The chunk queries are template queries, parsed once and refilled
+/// for each chunk.  If the connection to the server drops between
+/// chunks, the scan reconnects and picks up after the last key it
+/// handed you.  You can also resume a scan in a later run by saving
+/// last() and passing it to resume_after(); since last() is the last
+/// row the scan handed you, no row is skipped or repeated.
+///
+/// \code
+///   libtabula::KeysetScan<stock> scan(conn, 500);
+///   scan.set_target_latency(100);
+///   stock s;
+///   while (scan.fetch(s)) {
+///       ...
+///   }
+/// \endcode
+template <class SSQLS>
+class KeysetScan : public KeysetScanBase
+{
+public:
+	/// \brief Set up a scan of the table the SSQLS maps to
+	///
+	/// \param conn connection to run the chunk queries on
+	/// \param chunk_rows number of rows to fetch in each chunk, at
+	///     least at first
+	/// \param proto object whose table() names the table to scan;
+	///     pass one if you've called instance_table() on it
+	KeysetScan(Connection& conn, size_t chunk_rows = 1000,
+			const SSQLS& proto = SSQLS()) :
+	KeysetScanBase(conn, proto.table(), key_list(proto), chunk_rows),
+	pos_(0),
+	has_last_(false)
+	{
+	}
+
+	/// \brief Fetch the next chunk of rows
+	///
+	/// \param rows receives the chunk; it is cleared first
+	///
+	/// \return false if there were no more rows, or if an error
+	/// occurred and exceptions are disabled
+	bool next_chunk(std::vector<SSQLS>& rows)
+	{
+		if (!read_chunk(rows)) return false;
+		returned_ = rows.back();
+		return true;
+	}
+
+	/// \brief Fetch the next row, fetching another chunk if needed
+	///
+	/// \return false at the end of the table, or if an error occurred
+	/// and exceptions are disabled
+	bool fetch(SSQLS& row)
+	{
+		if (pos_ == chunk_.size()) {
+			pos_ = 0;
+			if (!read_chunk(chunk_)) return false;
+		}
+		row = returned_ = chunk_[pos_++];
+		return true;
+	}
+
+	/// \brief Start the scan just after the given key
+	///
+	/// Only the key fields of \c key matter.  Any rows already
+	/// fetched from the server but not yet returned by fetch() are
+	/// dropped, and a scan that had reached the end of the table
+	/// starts reading again.
+	void resume_after(const SSQLS& key)
+	{
+		last_ = returned_ = key;
+		has_last_ = true;
+		chunk_.clear();
+		pos_ = 0;
+		set_done(false);
+	}
+
+	/// \brief Returns the last row handed to you by fetch() or
+	/// next_chunk(), or the key given to resume_after() if later
+	///
+	/// Pass this to resume_after() to pick up a scan where you left
+	/// off.  The scan itself may have fetched rows beyond this one
+	/// from the server, since fetch() works through a whole chunk at
+	/// a time.
+	const SSQLS& last() const { return returned_; }
+
+	/// \brief Returns the SQL for the next chunk query
+	std::string next_query() { return chunk_query(after()); }
+
+private:
+	/// \brief Fetch the next chunk of rows from the server, without
+	/// counting them as handed to the caller
+	bool read_chunk(std::vector<SSQLS>& rows)
+	{
+		rows.clear();
+		if (done()) return false;
+
+		StoreQueryResult res = fetch_chunk(after());
+		for (size_t i = 0; i < res.num_rows(); ++i) {
+			rows.push_back(SSQLS(res[i]));
+		}
+		if (!rows.empty()) {
+			last_ = rows.back();
+			has_last_ = true;
+		}
+		return !rows.empty();
+	}
+
+	/// \brief Returns the key values of the last row fetched from the
+	/// server, ready for chunk_query()
+	std::string after()
+	{
+		if (!has_last_) return std::string();
+		SQLStream s(&connection());
+		s << last_.value_list(",", sql_use_compare);
+		return s.str();
+	}
+
+	/// \brief Returns the key column list for the SSQLS
+	static std::string key_list(const SSQLS& proto)
+	{
+		std::ostringstream os;
+		os << proto.field_list(",", sql_use_compare);
+		return os.str();
+	}
+
+	std::vector<SSQLS> chunk_;	///< rows fetched but not yet returned
+	size_t pos_;				///< next row in chunk_ for fetch()
+	SSQLS last_;				///< last row fetched from the server
+	bool has_last_;
+	SSQLS returned_;			///< last row handed to the caller
+};
+
+} // end namespace libtabula
+
+#endif // !defined(LIBTABULA_KEYSET_H)
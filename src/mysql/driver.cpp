@@ -26,6 +26,12 @@
 #define LIBTABULA_NOT_HEADER
 #include "driver.h"
 
+#include "paramarray.h"
+#include "qparms.h"
+
+#include <sstream>
+#include <vector>
+
 // An argument was added to mysql_shutdown() in MySQL 4.1.3 and 5.0.1.
 #if ((MYSQL_VERSION_ID >= 40103) && (MYSQL_VERSION_ID <= 49999)) || (MYSQL_VERSION_ID >= 50001)
 #	define SHUTDOWN_ARG ,SHUTDOWN_DEFAULT
@@ -37,8 +43,19 @@ using namespace std;
 
 namespace libtabula {
 
+// Returns s as a C string, or a null pointer if it's empty; the C API
+// treats the two alike for the connection parameters we use it for
+static const char*
+null_if_empty(const string& s)
+{
+	return s.empty() ? 0 : s.c_str();
+}
+
+
 MySQLDriver::MySQLDriver(bool te) :
-DBDriver(te)
+DBDriver(te),
+port_(0),
+has_password_(false)
 {
 	// We have to init the mysql_ object in the ctors even though we
 	// never call mysql_*() until after connect() because some of the
@@ -55,10 +72,123 @@ MySQLDriver::~MySQLDriver()
 }
 
 
+bool
+MySQLDriver::array_binding()
+{
+#if defined(HAVE_MYSQL_STMT_ARRAY_SIZE)
+	// Connector/C can talk to MySQL too, but only MariaDB 10.2 and up
+	// understand the bulk execution request.
+	return connected() && strstr(mysql_get_server_info(&mysql_), "MariaDB") &&
+			mysql_get_server_version(&mysql_) >= 100200;
+#else
+	return false;
+#endif
+}
+
+
+MySQLDriver::CursorImpl::CursorImpl(MYSQL_STMT* stmt,
+		RefCountedPointer<MYSQL_RES>& meta, size_t columns, size_t rows,
+		bool owner) :
+ResultImpl(meta, rows, !owner),
+stmt_(stmt),
+owner_(owner),
+binds_(columns),
+buffers_(binds_.size(), vector<char>(256)),
+lengths_(binds_.size()),
+row_(binds_.size())
+{
+}
+
+
+bool
+MySQLDriver::CursorImpl::bind()
+{
+	// Ask for every column as a string, as in the text protocol.  The
+	// buffers start small and grow as fetch() finds longer values.
+	memset(&binds_[0], 0, sizeof(MYSQL_BIND) * binds_.size());
+	for (size_t i = 0; i < binds_.size(); ++i) {
+		binds_[i].buffer_type = MYSQL_TYPE_STRING;
+		binds_[i].buffer = &buffers_[i][0];
+		binds_[i].buffer_length = static_cast<unsigned long>(
+				buffers_[i].size());
+		binds_[i].length = &lengths_[i];
+	}
+
+	return stmt_bind_result(&binds_[0]);
+}
+
+
+const char* const*
+MySQLDriver::CursorImpl::fetch()
+{
+	int status = stmt_fetch();
+	if (status != 0 && status != MYSQL_DATA_TRUNCATED) {
+		return 0;		// MYSQL_NO_DATA, or an error
+	}
+
+	// Fetch any value that didn't fit its buffer again, into a bigger
+	// one.  We check the lengths rather than trust status because the
+	// truncation report can be turned off.
+	bool rebind = false;
+	for (size_t i = 0; i < binds_.size(); ++i) {
+		if (!binds_[i].is_null_value && lengths_[i] >= buffers_[i].size()) {
+			buffers_[i].resize(lengths_[i] + 1);
+			binds_[i].buffer = &buffers_[i][0];
+			binds_[i].buffer_length = static_cast<unsigned long>(
+					buffers_[i].size());
+			if (!stmt_fetch_column(&binds_[i],
+					static_cast<unsigned int>(i))) {
+				return 0;
+			}
+			rebind = true;
+		}
+	}
+	if (rebind && !stmt_bind_result(&binds_[0])) {
+		return 0;
+	}
+
+	for (size_t i = 0; i < binds_.size(); ++i) {
+		row_[i] = binds_[i].is_null_value ? 0 : &buffers_[i][0];
+	}
+	return &row_[0];
+}
+
+
+bool
+MySQLDriver::cancel_query()
+{
+	if (!is_connected_ || !cancellable()) return false;
+
+	// Set up the second connection the way this one was
+	MySQLDriver killer(false);
+	apply_options_to(killer);
+	if (!killer.connect(null_if_empty(host_), null_if_empty(socket_name_),
+			port_, 0, null_if_empty(user_),
+			has_password_ ? password_.c_str() : 0)) {
+		return false;
+	}
+
+	// Go straight to the C API, so the KILL isn't observed or logged
+	// as one of the application's queries
+	ostringstream os;
+	os << "KILL QUERY " << mysql_thread_id(&mysql_);
+	const string sql = os.str();
+	return !mysql_real_query(&killer.mysql_, sql.data(),
+			static_cast<unsigned long>(sql.length()));
+}
+
+
 DBDriver*
 MySQLDriver::clone()
 {
 	MySQLDriver* other = new MySQLDriver(throw_exceptions());
+	other->set_cancellable(cancellable());
+	other->host_ = host_;
+	other->socket_name_ = socket_name_;
+	other->user_ = user_;
+	other->password_ = password_;
+	other->port_ = port_;
+	other->has_password_ = has_password_;
 	mysql_init(&other->mysql_);
 	other->is_connected_ =
 			mysql_real_connect(&mysql_, mysql_.host, mysql_.user,
@@ -74,6 +204,25 @@ MySQLDriver::connect(const char* host, const char* socket_name,
 		const char* password)
 {
 	disconnect();			// no-op if already disconnected
+
+	// Only hold on to the password if we'll need it
+	if (cancellable()) {
+		host_ = host ? host : "";
+		socket_name_ = socket_name ? socket_name : "";
+		user_ = user ? user : "";
+		password_ = password ? password : "";
+		port_ = port;
+		has_password_ = password != 0;
+	}
+	else {
+		host_.clear();
+		socket_name_.clear();
+		user_.clear();
+		password_.clear();
+		port_ = 0;
+		has_password_ = false;
+	}
+
 	return is_connected_ =
 			apply_pending_options(false) &&	// some opts modify client_flag
 			(mysql_real_connect(&mysql_, host, user, password, db,
@@ -122,6 +271,248 @@ MySQLDriver::escape_string(std::string* ps, const char* original,
 }
 
 
+bool
+MySQLDriver::execute_array(PreparedStatement& stmt, const ParamArray& params,
+		std::string& error, int& errnum)
+{
+	StatementImpl& si = dynamic_cast<StatementImpl&>(stmt);
+	QueryObserver* obs = QueryObserver::installed();
+	if (!obs) return execute_array_impl(si, params, error, errnum);
+
+	QueryEvent ev(QueryEvent::ev_execute, this);
+	bool ok = execute_array_impl(si, params, error, errnum);
+	ev.finish();
+	ev.sql = si.sql().data();
+	ev.sql_length = si.sql().length();
+	ev.bytes = si.sql().length() + params.bytes();
+	ev.rows = ok ? params.rows() : 0;
+	ev.errnum = ok ? 0 : errnum;
+	obs->observe(ev);
+	return ok;
+}
+
+
+bool
+MySQLDriver::execute_array_impl(StatementImpl& stmt,
+		const ParamArray& params, std::string& error, int& errnum)
+{
+#if defined(HAVE_MYSQL_STMT_ARRAY_SIZE)
+	if (!same_session(stmt, error, errnum)) return false;
+
+	// Bind the parameters column-wise: each gets an array of value
+	// pointers, one of lengths, and one of null indicators, with one
+	// element per row.  Everything goes as a string, and the server
+	// converts it to the column's type, as it would for a text INSERT.
+	const size_t rows = params.rows(), cols = params.columns();
+	vector<MYSQL_BIND> binds(cols);
+	vector< vector<char*> > values(cols, vector<char*>(rows));
+	vector< vector<unsigned long> > lengths(cols,
+			vector<unsigned long>(rows));
+	vector< vector<char> > indicators(cols, vector<char>(rows));
+	memset(&binds[0], 0, sizeof(MYSQL_BIND) * cols);
+	for (size_t c = 0; c < cols; ++c) {
+		for (size_t r = 0; r < rows; ++r) {
+			const std::string& v = params.value(r, c);
+			values[c][r] = const_cast<char*>(v.data());
+			lengths[c][r] = static_cast<unsigned long>(v.length());
+			indicators[c][r] = params.is_null(r, c) ?
+					STMT_INDICATOR_NULL : STMT_INDICATOR_NONE;
+		}
+		binds[c].buffer_type = MYSQL_TYPE_STRING;
+		binds[c].buffer = &values[c][0];
+		binds[c].length = &lengths[c][0];
+		binds[c].u.indicator = &indicators[c][0];
+	}
+
+	unsigned int size = static_cast<unsigned int>(rows);
+	bool ok = !mysql_stmt_attr_set(stmt, STMT_ATTR_ARRAY_SIZE, &size) &&
+			!mysql_stmt_bind_param(stmt, &binds[0]) &&
+			!mysql_stmt_execute(stmt);
+	if (!ok) {
+		error = mysql_stmt_error(stmt);
+		errnum = mysql_stmt_errno(stmt);
+	}
+	return ok;
+#else
+	(void)stmt;
+	(void)params;
+	error = "client library has no array binding";
+	errnum = 0;
+	return false;
+#endif
+}
+
+
+bool
+MySQLDriver::execute_prepared(PreparedStatement& stmt,
+		const SQLQueryParms& params, ResultBase::Impl*& result,
+		std::string& error, int& errnum)
+{
+	StatementImpl& si = dynamic_cast<StatementImpl&>(stmt);
+	QueryObserver* obs = QueryObserver::installed();
+	if (!obs) {
+		return execute_prepared_impl(si, params, result, error, errnum);
+	}
+
+	QueryEvent ev(QueryEvent::ev_execute, this);
+	bool ok = execute_prepared_impl(si, params, result, error, errnum);
+	ev.finish();
+	ev.sql = si.sql().data();
+	ev.sql_length = ev.bytes = si.sql().length();
+	for (size_t i = 0; i < params.size(); ++i) {
+		ev.bytes += params[i].length();
+	}
+	if (ok) {
+		ev.rows = result ? mysql_stmt_num_rows(si) :
+				mysql_stmt_affected_rows(si);
+	}
+	else {
+		ev.errnum = errnum;
+	}
+	obs->observe(ev);
+	return ok;
+}
+
+
+bool
+MySQLDriver::execute_prepared_impl(StatementImpl& stmt,
+		const SQLQueryParms& params, ResultBase::Impl*& result,
+		std::string& error, int& errnum)
+{
+	result = 0;
+	if (!same_session(stmt, error, errnum)) return false;
+
+#if defined(HAVE_MYSQL_STMT_ARRAY_SIZE)
+	// The statement may have last run through execute_array()
+	unsigned int size = 0;
+	if (mysql_stmt_attr_set(stmt, STMT_ATTR_ARRAY_SIZE, &size)) {
+		error = mysql_stmt_error(stmt);
+		errnum = mysql_stmt_errno(stmt);
+		return false;
+	}
+#endif
+
+	// Bind every parameter as a string or a null, as execute_array()
+	// does.  The values stay in params until the statement has run.
+	const size_t n = params.size();
+	if (n != mysql_stmt_param_count(stmt)) {
+		ostringstream os;
+		os << "statement takes " << mysql_stmt_param_count(stmt) <<
+				" parameters, but " << n << " were given";
+		error = os.str();
+		errnum = CR_INVALID_PARAMETER_NO;
+		return false;
+	}
+	vector<MYSQL_BIND> binds(n);
+	vector<unsigned long> lengths(n);
+	if (n) {
+		memset(&binds[0], 0, sizeof(MYSQL_BIND) * n);
+		for (size_t i = 0; i < n; ++i) {
+			if (params[i].is_null()) {
+				binds[i].buffer_type = MYSQL_TYPE_NULL;
+			}
+			else {
+				lengths[i] = static_cast<unsigned long>(
+						params[i].length());
+				binds[i].buffer_type = MYSQL_TYPE_STRING;
+				binds[i].buffer = const_cast<char*>(params[i].data());
+				binds[i].buffer_length = lengths[i];
+				binds[i].length = &lengths[i];
+			}
+		}
+	}
+
+	if ((n == 0 || !mysql_stmt_bind_param(stmt, &binds[0])) &&
+			!mysql_stmt_execute(stmt)) {
+		if (mysql_stmt_field_count(stmt) == 0) {
+			return true;	// not the sort of statement that returns rows
+		}
+
+		// Buffer the whole result set on our side, so its row count
+		// is known up front, as with store_result().
+		if (!mysql_stmt_store_result(stmt)) {
+			if (MYSQL_RES* pres = mysql_stmt_result_metadata(stmt)) {
+				RefCountedPointer<MYSQL_RES> meta(pres);
+				CursorImpl* pc = new CursorImpl(stmt, meta,
+						mysql_num_fields(pres),
+						size_t(mysql_stmt_num_rows(stmt)), false);
+				if (pc->bind()) {
+					result = pc;
+					return true;
+				}
+				delete pc;
+			}
+		}
+	}
+
+	error = mysql_stmt_error(stmt);
+	errnum = mysql_stmt_errno(stmt);
+	return false;
+}
+
+
+ResultBase::Impl*
+MySQLDriver::open_cursor(const std::string& sql, unsigned long fetch_size,
+		std::string& error, int& errnum)
+{
+	QueryObserver* obs = QueryObserver::installed();
+	if (!obs) return open_cursor_impl(sql, fetch_size, error, errnum);
+
+	QueryEvent ev(QueryEvent::ev_execute, this);
+	ResultBase::Impl* pi = open_cursor_impl(sql, fetch_size, error,
+			errnum);
+	ev.finish();
+	ev.sql = sql.data();
+	ev.sql_length = ev.bytes = sql.length();
+	ev.errnum = pi ? 0 : errnum;
+	obs->observe(ev);
+	return pi;
+}
+
+
+ResultBase::Impl*
+MySQLDriver::open_cursor_impl(const std::string& sql,
+		unsigned long fetch_size, std::string& error, int& errnum)
+{
+	MYSQL_STMT* stmt = mysql_stmt_init(&mysql_);
+	if (!stmt) {
+		error = mysql_error(&mysql_);
+		errnum = mysql_errno(&mysql_);
+		return 0;
+	}
+
+	unsigned long type = CURSOR_TYPE_READ_ONLY;
+	if (fetch_size == 0) fetch_size = 1;
+	if (!mysql_stmt_prepare(stmt, sql.data(),
+				static_cast<unsigned long>(sql.length())) &&
+			!mysql_stmt_attr_set(stmt, STMT_ATTR_CURSOR_TYPE, &type) &&
+			!mysql_stmt_attr_set(stmt, STMT_ATTR_PREFETCH_ROWS,
+				&fetch_size) &&
+			!mysql_stmt_execute(stmt)) {
+		if (MYSQL_RES* pres = mysql_stmt_result_metadata(stmt)) {
+			RefCountedPointer<MYSQL_RES> meta(pres);
+			CursorImpl* pc = new CursorImpl(stmt, meta,
+					mysql_num_fields(pres));
+			if (pc->bind()) {
+				return pc;		// it owns stmt now
+			}
+
+			error = mysql_stmt_error(stmt);
+			errnum = mysql_stmt_errno(stmt);
+			delete pc;
+			return 0;
+		}
+	}
+
+	// Either it failed, or it ran but isn't the sort of statement
+	// that returns rows, in which case errnum is 0.
+	error = mysql_stmt_error(stmt);
+	errnum = mysql_stmt_errno(stmt);
+	mysql_stmt_close(stmt);
+	return 0;
+}
+
+
 void
 MySQLDriver::fetch_fields(Fields& fl, ResultBase::Impl& impl) const
 {
@@ -142,6 +533,91 @@ MySQLDriver::fetch_fields(Fields& fl, ResultBase::Impl& impl) const
 }
 
 
+const char* const*
+MySQLDriver::ResultImpl::observed_fetch(MySQLDriver& driver)
+{
+	ulonglong start = Stopwatch::now();
+	if (fetched_ == 0 && fetch_time_ == 0) fetch_start_ = start;
+
+	const char* const* raw = fetch();
+	fetch_time_ += Stopwatch::now() - start;
+
+	if (raw) {
+		if (fetched_++ == 0 && !stored_) {
+			QueryEvent ev(QueryEvent::ev_first_row, &driver);
+			ev.elapsed = ev.start - start;
+			ev.start = start;
+			if (QueryObserver* obs = QueryObserver::installed()) {
+				obs->observe(ev);
+			}
+		}
+	}
+	else if (!stored_) {
+		QueryEvent ev(QueryEvent::ev_fetch, &driver);
+		ev.start = fetch_start_;
+		ev.elapsed = fetch_time_;
+		ev.rows = fetched_;
+		ev.errnum = driver.errnum();
+		if (QueryObserver* obs = QueryObserver::installed()) {
+			obs->observe(ev);
+		}
+	}
+	return raw;
+}
+
+
+bool
+MySQLDriver::observed_execute(const char* qstr, size_t length)
+{
+	QueryEvent ev(QueryEvent::ev_execute, this);
+	bool ok = !mysql_real_query(&mysql_, qstr,
+			static_cast<unsigned long>(length));
+	ev.finish();
+	ev.sql = qstr;
+	ev.sql_length = ev.bytes = length;
+	if (!ok) {
+		ev.errnum = mysql_errno(&mysql_);
+	}
+	else if (mysql_field_count(&mysql_) == 0) {
+		ev.rows = mysql_affected_rows(&mysql_);
+	}
+
+	if (QueryObserver* obs = QueryObserver::installed()) {
+		obs->observe(ev);
+	}
+	return ok;
+}
+
+
+ResultBase::Impl*
+MySQLDriver::observed_result(bool store)
+{
+	QueryEvent ev(store ? QueryEvent::ev_store : QueryEvent::ev_use,
+			this);
+	MYSQL_RES* pres = store ? mysql_store_result(&mysql_) :
+			mysql_use_result(&mysql_);
+	ev.finish();
+	ev.errnum = mysql_errno(&mysql_);
+
+	ResultImpl* pi = 0;
+	if (pres) {
+		RefCountedPointer<MYSQL_RES> res(pres);
+		if (store) {
+			ev.rows = mysql_num_rows(pres);
+			pi = new ResultImpl(res, size_t(ev.rows), true);
+		}
+		else {
+			pi = new ResultImpl(res);
+		}
+	}
+
+	if (QueryObserver* obs = QueryObserver::installed()) {
+		obs->observe(ev);
+	}
+	return pi;
+}
+
+
 Row
 MySQLDriver::fetch_row(ResultBase& res)
 {
@@ -149,7 +625,7 @@ MySQLDriver::fetch_row(ResultBase& res)
 	// happen after Query.use() because the table data is in the
 	// StoreQueryResult object.  This is what crashes the count_rows()
 	// call in examples/resetdb.cpp.
-	if (MYSQL_ROW raw = mysql_fetch_row(MYSQL_RES_FROM_IMPL(res.impl()))) {
+	if (const char* const* raw = fetch_raw_row(res.impl())) {
 		Row::size_type size = res.num_fields();
 		Row::Impl* pd = new Row::Impl;
 		pd->reserve(size);
@@ -585,6 +1061,45 @@ MySQLDriver::set_option_impl(const WriteTimeoutOption& opt)
 }
 
 
+DBDriver::PreparedStatement*
+MySQLDriver::prepare(const std::string& sql, std::string& error,
+		int& errnum)
+{
+	MYSQL_STMT* stmt = mysql_stmt_init(&mysql_);
+	if (!stmt) {
+		error = mysql_error(&mysql_);
+		errnum = mysql_errno(&mysql_);
+		return 0;
+	}
+
+	if (mysql_stmt_prepare(stmt, sql.data(),
+			static_cast<unsigned long>(sql.length()))) {
+		error = mysql_stmt_error(stmt);
+		errnum = mysql_stmt_errno(stmt);
+		mysql_stmt_close(stmt);
+		return 0;
+	}
+
+	return new StatementImpl(stmt, sql, mysql_thread_id(&mysql_));
+}
+
+
+bool
+MySQLDriver::same_session(const StatementImpl& stmt, std::string& error,
+		int& errnum)
+{
+	if (stmt.thread_id() == mysql_thread_id(&mysql_)) return true;
+
+	// The C API dropped the statement when it reconnected.  This is the
+	// error the server gives for a statement it doesn't know; it's in
+	// mysqld_error.h, which mysql.h doesn't bring in.
+	error = "prepared statement was lost when the connection was "
+			"reestablished";
+	errnum = 1243;		// ER_UNKNOWN_STMT_HANDLER
+	return false;
+}
+
+
 bool
 MySQLDriver::shutdown()
 {
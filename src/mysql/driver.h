@@ -29,6 +29,9 @@
 #define LIBTABULA_MYSQLDRIVER_H
 
 #include "dbdriver.h"
+#include "observer.h"
+
+#include <vector>
 
 namespace libtabula {
 
@@ -82,10 +85,15 @@ public:
 	class ResultImpl : public ResultBase::Impl
 	{
 	public:
-		ResultImpl(RefCountedPointer<MYSQL_RES>& res, size_t rows = 0) :
+		ResultImpl(RefCountedPointer<MYSQL_RES>& res, size_t rows = 0,
+				bool stored = false) :
 		ResultBase::Impl(),
 		res_(res),
-		rows_(rows)
+		rows_(rows),
+		stored_(stored),
+		fetched_(0),
+		fetch_start_(0),
+		fetch_time_(0)
 		{
 		}
 
@@ -93,6 +101,16 @@ public:
 		operator MYSQL_RES*() const { return res_.raw(); }
 
 		size_t rows() const { return rows_; }
+		bool stored() const { return stored_; }
+
+		// Fetch the next row, and return the lengths of its fields
+		virtual const char* const* fetch()
+				{ return mysql_fetch_row(res_.raw()); }
+		virtual const unsigned long* lengths() const
+				{ return mysql_fetch_lengths(res_.raw()); }
+
+		// Fetch the next row, timing it for the installed QueryObserver
+		const char* const* observed_fetch(MySQLDriver& driver);
 
 	private:
 		// Has to be mutable because so many Connector/C APIs take
@@ -101,6 +119,79 @@ public:
 
 		// Nonzero only for store() queries
 		size_t rows_;		
+
+		// Bookkeeping for QueryEvent::ev_fetch, which is only reported
+		// for results that don't come from store()
+		bool stored_;
+		ulonglong fetched_;
+		ulonglong fetch_start_;
+		ulonglong fetch_time_;
+	};
+
+	// Result set info for rows read through a prepared statement: a
+	// server-side cursor, or the buffered result of a statement run by
+	// execute_prepared().  The base class holds the result set
+	// metadata, so fetch_fields() works as for the other kinds of
+	// result; rows come from the statement instead.  We close the
+	// statement when we're done with it only if we own it.
+	class CursorImpl : public ResultImpl
+	{
+	public:
+		CursorImpl(MYSQL_STMT* stmt, RefCountedPointer<MYSQL_RES>& meta,
+				size_t columns, size_t rows = 0, bool owner = true);
+		~CursorImpl() { if (owner_) mysql_stmt_close(stmt_); }
+
+		// Bind our buffers to the statement's result columns
+		bool bind();
+
+		// Fetch the next row, or return 0 at the end or on error
+		const char* const* fetch();
+
+		const unsigned long* lengths() const { return &lengths_[0]; }
+
+	protected:
+		// The C API calls bind() and fetch() make, virtual so the
+		// tests can stand in for the server
+		virtual bool stmt_bind_result(MYSQL_BIND* binds)
+				{ return !mysql_stmt_bind_result(stmt_, binds); }
+		virtual int stmt_fetch() { return mysql_stmt_fetch(stmt_); }
+		virtual bool stmt_fetch_column(MYSQL_BIND* bind,
+				unsigned int column)
+				{ return !mysql_stmt_fetch_column(stmt_, bind, column, 0); }
+
+	private:
+		MYSQL_STMT* stmt_;
+		bool owner_;
+		std::vector<MYSQL_BIND> binds_;
+		std::vector< std::vector<char> > buffers_;
+		std::vector<unsigned long> lengths_;
+		std::vector<const char*> row_;
+	};
+
+	// A statement returned by prepare()
+	class StatementImpl : public PreparedStatement
+	{
+	public:
+		StatementImpl(MYSQL_STMT* stmt, const std::string& sql,
+				unsigned long thread_id) :
+		stmt_(stmt),
+		sql_(sql),
+		thread_id_(thread_id)
+		{
+		}
+
+		~StatementImpl() { mysql_stmt_close(stmt_); }
+		operator MYSQL_STMT*() const { return stmt_; }
+
+		const std::string& sql() const { return sql_; }
+
+		// Server thread ID of the session the statement belongs to
+		unsigned long thread_id() const { return thread_id_; }
+
+	private:
+		MYSQL_STMT* stmt_;
+		std::string sql_;
+		unsigned long thread_id_;
 	};
 #endif
 
@@ -118,6 +209,23 @@ public:
 		return mysql_affected_rows(&mysql_);
 	}
 
+	/// \brief Ask the server to stop running the current query
+	///
+	/// This connection is busy sending us the query's rows, so this
+	/// opens a second connection to the same server as the same user,
+	/// with the same connection options (SSL, timeouts and so on),
+	/// and sends \c KILL \c QUERY over that.  Once the server stops
+	/// sending rows, freeing the result set finishes quickly.
+	///
+	/// This needs the login credentials, which connect() only keeps
+	/// if cancellable() was true at the time; otherwise this returns
+	/// false at once.  It's also best-effort: if the second connection
+	/// or the \c KILL fails, it returns false and the rest of the rows
+	/// just arrive as usual.  Options that only take effect once connected, and the
+	/// ones that failed to apply to this connection, aren't carried
+	/// over.
+	bool cancel_query();
+
 	/// \brief Get database client library version
 	///
 	/// Wraps \c mysql_get_client_info() in the MySQL C API.
@@ -170,6 +278,22 @@ public:
 	/// Wraps \c mysql_errno() in the MySQL C API.
 	int errnum() { return mysql_errno(&mysql_); }
 
+	/// \brief Returns true if the given error number is one the MySQL
+	/// C API uses for a dropped connection
+	bool connection_lost(int errnum) const
+	{
+		return errnum == CR_SERVER_GONE_ERROR || errnum == CR_SERVER_LOST;
+	}
+
+	/// \brief Returns true if the given error number is one MySQL uses
+	/// for a prepared statement that's gone or needs re-preparing
+	bool statement_lost(int errnum) const
+	{
+		// ER_UNKNOWN_STMT_HANDLER and ER_NEED_REPREPARE; they're in
+		// mysqld_error.h, which mysql.h doesn't bring in.
+		return errnum == 1243 || errnum == 1615;
+	}
+
 	/// \brief Return a SQL-escaped version of the given character
 	/// buffer
 	///
@@ -191,21 +315,84 @@ public:
 	/// Wraps \c mysql_real_query() in the MySQL C API.
 	bool execute(const char* qstr, size_t length)
 	{
+		if (QueryObserver::installed()) {
+			return observed_execute(qstr, length);
+		}
 		return !mysql_real_query(&mysql_, qstr,
 				static_cast<unsigned long>(length));
 	}
 
+	/// \brief Opens a read-only server-side cursor on a query
+	///
+	/// Wraps \c mysql_stmt_prepare() and \c mysql_stmt_execute(), with
+	/// \c STMT_ATTR_CURSOR_TYPE set to \c CURSOR_TYPE_READ_ONLY and
+	/// \c STMT_ATTR_PREFETCH_ROWS set to \c fetch_size.
+	///
+	/// \see DBDriver::open_cursor()
+	ResultBase::Impl* open_cursor(const std::string& sql,
+			unsigned long fetch_size, std::string& error, int& errnum);
+
+	/// \brief Has the server prepare a statement
+	///
+	/// Wraps \c mysql_stmt_init() and \c mysql_stmt_prepare().
+	///
+	/// \see DBDriver::prepare()
+	PreparedStatement* prepare(const std::string& sql, std::string& error,
+			int& errnum);
+
+	/// \brief Runs a statement returned by prepare()
+	///
+	/// Wraps \c mysql_stmt_bind_param(), \c mysql_stmt_execute() and,
+	/// for statements that return rows, \c mysql_stmt_store_result().
+	///
+	/// A statement prepared before ReconnectOption reconnected us
+	/// went away with the old session, so it fails with
+	/// \c ER_UNKNOWN_STMT_HANDLER, as if the server had dropped it.
+	///
+	/// \see DBDriver::execute_prepared()
+	bool execute_prepared(PreparedStatement& stmt,
+			const SQLQueryParms& params, ResultBase::Impl*& result,
+			std::string& error, int& errnum);
+
+	/// \brief Returns true if we were built against a client library
+	/// with array binding, and are talking to a server that can use it
+	///
+	/// This needs MariaDB Connector/C and MariaDB Server 10.2 or newer.
+	bool array_binding();
+
+	/// \brief Runs a prepared statement for many rows at once
+	///
+	/// Wraps \c mysql_stmt_execute(), with \c STMT_ATTR_ARRAY_SIZE set
+	/// to the number of rows.
+	///
+	/// \see DBDriver::execute_array()
+	bool execute_array(PreparedStatement& stmt, const ParamArray& params,
+			std::string& error, int& errnum);
+
 	/// \brief Returns the next DB row from the given result set.
 	///
 	/// Wraps \c mysql_fetch_row() in MySQL C API.
 	Row fetch_row(ResultBase& res);
 
+	/// \brief Returns the next DB row from the given result set,
+	/// without wrapping it in a Row object.
+	///
+	/// Wraps \c mysql_fetch_row() in MySQL C API.
+	const char* const* fetch_raw_row(ResultBase::Impl& impl)
+	{
+		ResultImpl& ri = MYSQL_RES_FROM_IMPL(impl);
+		if (QueryObserver::installed()) {
+			return ri.observed_fetch(*this);
+		}
+		return ri.fetch();
+	}
+
 	/// \brief Returns the lengths of the fields in the current row
 	///
 	/// Wraps \c mysql_fetch_lengths() in MySQL C API.
 	const unsigned long* fetch_lengths(ResultBase::Impl& impl) const
 	{
-		return mysql_fetch_lengths(MYSQL_RES_FROM_IMPL(impl));
+		return MYSQL_RES_FROM_IMPL(impl).lengths();
 	}
 
 	/// \brief Fill out a Fields list from the given MySQL result
@@ -312,7 +499,10 @@ public:
 	/// storage space for the number of known rows in the result set.
 	ulonglong num_rows(ResultBase::Impl& impl) const
 	{
-		return mysql_num_rows(MYSQL_RES_FROM_IMPL(impl));
+		// Results from execute_prepared() have only metadata in their
+		// MYSQL_RES, so we use the row count we saved for them.
+		const ResultImpl& ri = MYSQL_RES_FROM_IMPL(impl);
+		return ri.stored() ? ri.rows() : mysql_num_rows(ri);
 	}
 
 	/// \brief "Pings" the MySQL database
@@ -402,9 +592,12 @@ public:
 	/// Wraps \c mysql_store_result() in the MySQL C API.
 	ResultBase::Impl* store_result()
 	{
+		if (QueryObserver::installed()) {
+			return observed_result(true);
+		}
 		if (MYSQL_RES* pres = mysql_store_result(&mysql_)) {
 			RefCountedPointer<MYSQL_RES> res(pres);
-			return new ResultImpl(res, mysql_num_rows(pres));
+			return new ResultImpl(res, mysql_num_rows(pres), true);
 		}
 		else {
 			return 0;
@@ -479,6 +672,9 @@ public:
 	/// Wraps \c mysql_use_result() in the MySQL C API.
 	ResultBase::Impl* use_result()
 	{
+		if (QueryObserver::installed()) {
+			return observed_result(false);
+		}
 		if (MYSQL_RES* pres = mysql_use_result(&mysql_)) {
 			RefCountedPointer<MYSQL_RES> res(pres);
 			return new ResultImpl(res);
@@ -489,6 +685,29 @@ public:
 	}
 
 private:
+	/// \brief execute(), timed for the installed QueryObserver
+	bool observed_execute(const char* qstr, size_t length);
+
+	/// \brief store_result() or use_result(), timed for the installed
+	/// QueryObserver
+	ResultBase::Impl* observed_result(bool store);
+
+	/// \brief The parts of open_cursor(), execute_array() and
+	/// execute_prepared() that talk to the server, without the
+	/// QueryObserver hooks
+	ResultBase::Impl* open_cursor_impl(const std::string& sql,
+			unsigned long fetch_size, std::string& error, int& errnum);
+	bool execute_array_impl(StatementImpl& stmt,
+			const ParamArray& params, std::string& error, int& errnum);
+	bool execute_prepared_impl(StatementImpl& stmt,
+			const SQLQueryParms& params, ResultBase::Impl*& result,
+			std::string& error, int& errnum);
+
+	/// \brief Returns true if the statement belongs to our current
+	/// session, else fails as if the server didn't know it
+	bool same_session(const StatementImpl& stmt, std::string& error,
+			int& errnum);
+
 	/// \brief Enable or disable multi-statements
 	///
 	/// This enables both multi-statements and multi-results, and it
@@ -552,6 +771,14 @@ private:
 	MySQLDriver(const MySQLDriver&) { }
 
 	MYSQL mysql_;			///< C API handle for the DBMS connection
+
+	// Where connect() last connected us, and as whom, so
+	// cancel_query() can make a second connection the same way.  A
+	// null C string parameter is recorded as empty.  Only kept when
+	// cancellable() was true at the time.
+	std::string host_, socket_name_, user_, password_;
+	unsigned int port_;
+	bool has_password_;		///< password given wasn't a null pointer
 };
 
 
@@ -203,6 +203,14 @@ String::length() const
 }
 
 
+String::size_type
+String::memory_usage() const
+{
+	// The buffer, plus RefCountedPointer's reference count
+	return buffer_ ? buffer_->memory_usage() + sizeof(size_t) : 0;
+}
+
+
 bool
 String::quote_q() const
 {
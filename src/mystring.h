@@ -248,6 +248,25 @@ public:
 	{
 	}
 
+	/// \brief Constructor for a String that refers to another object's
+	/// memory instead of copying it
+	///
+	/// \param str the string this object represents, which must be
+	///     followed by a null terminator
+	/// \param len the length of the string; embedded nulls are legal
+	/// \param type MySQL type information for data within str
+	/// \param is_null string represents a SQL null, not literal data
+	/// \param owner object that owns \c str; the String holds a
+	///     reference to it
+	///
+	/// Snapshot uses this to build rows that point into a
+	/// memory-mapped file.
+	String(const char* str, size_type len, FieldType::Base type,
+			bool is_null, const RefCountedPointer<SQLBufferOwner>& owner) :
+	buffer_(new BorrowedSQLBuffer(str, len, type, is_null, owner))
+	{
+	}
+
 	/// \brief Destroy string
 	~String() { }
 
@@ -424,6 +443,13 @@ public:
 	/// stored.
 	size_type max_size() const { return size(); }
 
+	/// \brief Returns the bytes of memory this object's data buffer
+	/// takes up, not counting the String object itself
+	///
+	/// A buffer shared by several String objects counts in full
+	/// toward each of them.
+	size_type memory_usage() const;
+
 	/// \brief Returns true if data of this type should be quoted, false
 	/// otherwise.
 	bool quote_q() const;
@@ -0,0 +1,146 @@
+/// \file observer.h
+/// \brief Declares the QueryObserver interface, through which programs
+/// can watch the queries libtabula runs and the connections it hands
+/// out, and the QueryEvent structure passed to it.
+
+/***********************************************************************
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#if !defined(LIBTABULA_OBSERVER_H)
+#define LIBTABULA_OBSERVER_H
+
+#include "common.h"
+
+#include "stopwatch.h"
+
+namespace libtabula {
+
+#if !defined(DOXYGEN_IGNORE)
+class Connection;
+class DBDriver;
+#endif
+
+/// \brief Describes one timed operation, for QueryObserver::observe()
+struct LIBTABULA_EXPORT QueryEvent
+{
+	/// \brief What sort of operation the event describes
+	enum Kind {
+		ev_execute,	///< DBDriver::execute(), open_cursor() or execute_array()
+		ev_store,	///< DBDriver::store_result()
+		ev_use,		///< DBDriver::use_result()
+		ev_fetch,	///< all the row fetches from a "use" result or cursor
+		ev_grab,	///< ConnectionPool::grab()
+		ev_release,	///< ConnectionPool::release()
+		ev_query,	///< a whole Query::execute(), exec(), store(), use() or cursor()
+		ev_first_row,	///< the wait for a "use" result's first row
+		ev_row		///< one UseQueryResult::fetch_row() call
+	};
+
+	Kind kind;					///< what happened
+	const char* sql;			///< query text, for ev_execute; not null-terminated
+	size_t sql_length;			///< length of \c sql
+	ulonglong bytes;			///< bytes sent to the server, for ev_execute
+	ulonglong rows;				///< rows stored, fetched, or affected
+	ulonglong start;			///< Stopwatch::now() when it started
+	ulonglong elapsed;			///< microseconds it took
+	int errnum;					///< driver error number, 0 on success
+	const DBDriver* driver;		///< driver, for all but ev_grab and ev_release
+	const Connection* conn;		///< connection, for ev_grab, ev_release and ev_query
+
+	/// \brief Create an event of the given kind, starting now
+	explicit QueryEvent(Kind k, const DBDriver* d = 0,
+			const Connection* c = 0) :
+	kind(k),
+	sql(0),
+	sql_length(0),
+	bytes(0),
+	rows(0),
+	start(Stopwatch::now()),
+	elapsed(0),
+	errnum(0),
+	driver(d),
+	conn(c)
+	{
+	}
+
+	/// \brief Stop the clock on the event
+	void finish() { elapsed = Stopwatch::now() - start; }
+};
+
+
+/// \brief Interface for watching what libtabula does
+///
+/// Derive from this and install() an instance to be told about every
+/// query executed, every result set stored or fetched, and every
+/// connection grabbed from or released to a ConnectionPool, along
+/// with how long each took.  QueryStats is a ready-made observer that
+/// keeps latency histograms for each statement, and TraceRecorder is
+/// one that records a timeline of it all.
+///
+/// While no observer is installed, the hooks cost one test of a
+/// pointer each, and nothing is timed.
+///
+/// Events on a given DBDriver happen in order: an \c ev_store or
+/// \c ev_use event belongs to the \c ev_execute before it on the same
+/// driver.  An \c ev_fetch event covers every row read from a "use"
+/// result set or cursor, and comes when the last one has been read;
+/// nothing is reported for a result set abandoned partway through.
+///
+/// The \c ev_query, \c ev_first_row and \c ev_row events are for
+/// observers that draw timelines, like TraceRecorder.  An \c ev_query
+/// event spans the \c ev_execute and any \c ev_store or \c ev_use
+/// that Query did on the caller's behalf, and an \c ev_row event
+/// comes for every row, so observers that only want totals should
+/// ignore them.
+///
+/// observe() is called on whichever thread did the work, so an
+/// observer shared by several threads has to do its own locking.  It
+/// must not throw.
+class LIBTABULA_EXPORT QueryObserver
+{
+public:
+	/// \brief Destroy the object
+	virtual ~QueryObserver() { }
+
+	/// \brief Called after each operation, with what happened
+	virtual void observe(const QueryEvent& ev) = 0;
+
+	/// \brief Set the observer for the whole program
+	///
+	/// Pass 0 to stop observing.  The observer must outlive any work
+	/// that might report to it, so install it before starting threads
+	/// that use the database, and remove it after they're done.
+	///
+	/// \return the previously installed observer, or 0
+	static QueryObserver* install(QueryObserver* obs);
+
+	/// \brief Returns the installed observer, or 0 if there isn't one
+	static QueryObserver* installed() { return installed_; }
+
+private:
+	static QueryObserver* installed_;
+};
+
+} // end namespace libtabula
+
+#endif // !defined(LIBTABULA_OBSERVER_H)
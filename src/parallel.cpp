@@ -0,0 +1,253 @@
+/***********************************************************************
+ parallel.cpp - Implements the ParallelRowDispatcher class.
+
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#define LIBTABULA_NOT_HEADER
+#include "parallel.h"
+
+#include "dbdriver.h"
+
+namespace libtabula {
+
+
+ParallelRowDispatcher::ParallelRowDispatcher(const UseQueryResult& res,
+		size_t n_workers, size_t batch_rows, bool ordered) :
+OptionalExceptions(res.throw_exceptions()),
+res_(res),
+batch_rows_(batch_rows ? batch_rows : 1),
+ordered_(ordered),
+slots_(2 * (n_workers ? n_workers : 1)),
+next_deliver_(0),
+stopping_(false),
+failed_(false)
+{
+	// Without thread support, run() does all the work itself.
+	if (Thread::supported()) {
+		for (size_t i = 0; i < slots_.size() / 2; ++i) {
+			workers_.push_back(new Worker(*this));
+			threads_.push_back(new Thread(*workers_.back()));
+		}
+	}
+}
+
+
+ParallelRowDispatcher::~ParallelRowDispatcher()
+{
+	stop();
+	for (size_t i = 0; i < threads_.size(); ++i) {
+		delete threads_[i];
+		delete workers_[i];
+	}
+}
+
+
+void
+ParallelRowDispatcher::deliver_ready()
+{
+	for (;;) {
+		size_t slot = slots_.size();
+		for (size_t i = 0; i < slots_.size(); ++i) {
+			if (slots_[i].state == slot_done &&
+					slots_[i].seq == next_deliver_) {
+				slot = i;
+				break;
+			}
+		}
+		if (slot == slots_.size()) return;
+
+		// Don't make the workers wait on the caller's sink functor
+		mutex_.unlock();
+		try {
+			deliver(slot);
+		}
+		catch (...) {
+			mutex_.lock();
+			throw;
+		}
+		mutex_.lock();
+
+		slots_[slot].state = slot_free;
+		++next_deliver_;
+	}
+}
+
+
+void
+ParallelRowDispatcher::run()
+{
+	DBDriver* driver = res_.driver();
+	if (!res_ || !driver) return;
+
+	if (threads_.empty()) {
+		// No thread support, so do it all on this thread
+		RefCountedPointer<FieldNames> names(res_.field_names());
+		bool more = true;
+		while (more) {
+			more = slots_[0].batch.fill(res_, batch_rows_);
+			process(0, slots_[0].batch, names);
+			if (ordered_) deliver(0);
+		}
+		if (driver->errnum() && throw_exceptions()) {
+			throw UseQueryError(driver->error());
+		}
+		return;
+	}
+
+	std::string error;
+	try {
+		for (size_t i = 0; i < threads_.size(); ++i) {
+			threads_[i]->start();
+		}
+
+		ulonglong seq = 0;
+		bool more = true;
+		while (more) {
+			// Find a free slot, delivering finished batches while we
+			// wait for one if we're in ordered mode.
+			size_t slot = slots_.size();
+			{
+				ScopedLock lock(mutex_);
+				for (;;) {
+					if (ordered_) deliver_ready();
+					if (failed_) break;
+					for (size_t i = 0; i < slots_.size(); ++i) {
+						if (slots_[i].state == slot_free) {
+							slot = i;
+							break;
+						}
+					}
+					if (slot < slots_.size()) break;
+					slot_ready_.wait(mutex_);
+				}
+			}
+			if (slot == slots_.size()) break;	// a worker failed
+
+			// A free slot belongs to this thread alone, so fill it
+			// without holding the lock.
+			Slot& s = slots_[slot];
+			more = s.batch.fill(res_, batch_rows_);
+			if (!more && driver->errnum()) {
+				error = driver->error();
+			}
+
+			ScopedLock lock(mutex_);
+			if (!s.batch.empty()) {
+				s.state = slot_queued;
+				s.seq = seq++;
+				queue_.push_back(slot);
+				work_ready_.signal();
+			}
+		}
+
+		// Wait for the workers to finish the last few batches
+		ScopedLock lock(mutex_);
+		for (;;) {
+			if (ordered_) deliver_ready();
+			if (failed_) break;
+
+			size_t i;
+			for (i = 0; i < slots_.size(); ++i) {
+				if (slots_[i].state != slot_free) break;
+			}
+			if (i == slots_.size()) break;
+
+			slot_ready_.wait(mutex_);
+		}
+	}
+	catch (...) {
+		stop();
+		throw;
+	}
+
+	stop();
+	if (failed_) {
+		throw WorkerFailed(failure_);
+	}
+	else if (!error.empty() && throw_exceptions()) {
+		throw UseQueryError(error.c_str());
+	}
+}
+
+
+void
+ParallelRowDispatcher::stop()
+{
+	{
+		ScopedLock lock(mutex_);
+		stopping_ = true;
+		work_ready_.broadcast();
+	}
+
+	for (size_t i = 0; i < threads_.size(); ++i) {
+		threads_[i]->join();
+	}
+}
+
+
+void
+ParallelRowDispatcher::work()
+{
+	// Row objects built on this thread get their own copy of the field
+	// name list, so their reference counting doesn't race with Row
+	// objects on other threads.
+	RefCountedPointer<FieldNames> names(
+			new FieldNames(*res_.field_names()));
+
+	mutex_.lock();
+	for (;;) {
+		while (queue_.empty() && !stopping_ && !failed_) {
+			work_ready_.wait(mutex_);
+		}
+		if (failed_ || queue_.empty()) break;
+
+		size_t slot = queue_.front();
+		queue_.pop_front();
+		slots_[slot].state = slot_busy;
+		mutex_.unlock();
+
+		std::string failure;
+		try {
+			process(slot, slots_[slot].batch, names);
+		}
+		catch (const std::exception& e) {
+			failure = e.what();
+			if (failure.empty()) failure = "unknown error";
+		}
+		catch (...) {
+			failure = "unknown exception";
+		}
+
+		mutex_.lock();
+		slots_[slot].state = ordered_ ? slot_done : slot_free;
+		if (!failure.empty() && !failed_) {
+			failed_ = true;
+			failure_ = failure;
+			work_ready_.broadcast();
+		}
+		slot_ready_.signal();
+	}
+	mutex_.unlock();
+}
+
+} // end namespace libtabula
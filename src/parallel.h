@@ -0,0 +1,264 @@
+/// \file parallel.h
+/// \brief Declares the classes behind Query::for_each_parallel()
+/// and Query::for_each_parallel_ordered().
+///
+/// These split the work of a "use" query in two: the calling thread
+/// reads raw rows from the server in batches, and a pool of worker
+/// threads turns those batches into Row objects and runs your functor
+/// on them.  This is a win when your per-row work is CPU-heavy enough
+/// that a single thread can't keep up with the network.
+
+/***********************************************************************
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#if !defined(LIBTABULA_PARALLEL_H)
+#define LIBTABULA_PARALLEL_H
+
+#include "common.h"
+
+#include "beemutex.h"
+#include "noexceptions.h"
+#include "result.h"
+#include "rowbatch.h"
+#include "thread.h"
+
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace libtabula {
+
+/// \brief Reads a "use" query result set in batches on the calling
+/// thread and hands the batches to a pool of worker threads.
+///
+/// The number of batches in flight at any one time -- waiting for a
+/// worker, being processed, or in ordered mode, waiting to be
+/// delivered -- is limited to twice the number of workers, so memory
+/// use stays bounded no matter how much faster the server is than your
+/// functor.  Idle workers take the oldest waiting batch, so a slow
+/// batch on one worker doesn't hold up the others.
+///
+/// If the code run on a worker throws, no new batches are handed out,
+/// the workers are stopped, and run() throws WorkerFailed carrying the
+/// original exception's message.  We can't rethrow the original
+/// exception object itself in C++98, since we don't know its type.
+///
+/// This is an abstract base class: subclasses say what to do with each
+/// batch.  End-user code normally uses it indirectly, through
+/// Query::for_each_parallel() and Query::for_each_parallel_ordered().
+class LIBTABULA_EXPORT ParallelRowDispatcher : public OptionalExceptions
+{
+public:
+	/// \brief Set up the dispatcher, but don't start any threads
+	///
+	/// \param res the result set to read from
+	/// \param n_workers number of worker threads to start; 0 is
+	///     treated as 1
+	/// \param batch_rows number of rows per batch
+	/// \param ordered if true, completed batches are handed to
+	///     deliver() on the calling thread in result set order
+	ParallelRowDispatcher(const UseQueryResult& res, size_t n_workers,
+			size_t batch_rows, bool ordered);
+
+	/// \brief Stop the worker threads, if they're still running
+	virtual ~ParallelRowDispatcher();
+
+	/// \brief Read the whole result set, dispatching it to the worker
+	/// threads, and return once every batch has been processed
+	void run();
+
+	/// \brief Returns the number of batch slots, which is the upper
+	/// limit on batches in flight
+	size_t slots() const { return slots_.size(); }
+
+protected:
+	/// \brief Process one batch of rows
+	///
+	/// Called on a worker thread.  \c names is a private copy of the
+	/// result set's field name list for that worker; use it when
+	/// building Row objects from the batch so the workers aren't all
+	/// fighting over one reference count.
+	virtual void process(size_t slot, const RowBatch& batch,
+			const RefCountedPointer<FieldNames>& names) = 0;
+
+	/// \brief Deliver the results of processing one batch
+	///
+	/// Called on the calling thread, in result set order, only when
+	/// the \c ordered ctor parameter was true.
+	virtual void deliver(size_t slot) { (void)slot; }
+
+	/// \brief Returns the field types for the result set
+	const FieldTypes& types() const { return *res_.field_types(); }
+
+private:
+	/// \brief Life cycle of a batch slot
+	enum SlotState {
+		slot_free,			///< available to the reader
+		slot_queued,		///< filled, waiting for a worker
+		slot_busy,			///< a worker is processing it
+		slot_done			///< processed, waiting for deliver()
+	};
+
+	/// \brief One batch and its bookkeeping
+	struct Slot
+	{
+		RowBatch batch;
+		SlotState state;
+		ulonglong seq;		///< batch's position in the result set
+
+		Slot() : state(slot_free), seq(0) { }
+	};
+
+	/// \brief The Thread::Runnable for each worker thread
+	class Worker : public Thread::Runnable
+	{
+	public:
+		Worker(ParallelRowDispatcher& d) : d_(d) { }
+		void run() { d_.work(); }
+	private:
+		ParallelRowDispatcher& d_;
+	};
+
+	friend class Worker;
+
+	ParallelRowDispatcher(const ParallelRowDispatcher&);
+	ParallelRowDispatcher& operator =(const ParallelRowDispatcher&);
+
+	/// \brief Deliver all completed batches that are next in order.
+	/// Mutex must be held; it is released during delivery.
+	void deliver_ready();
+
+	/// \brief Ask the workers to exit, then wait for them
+	void stop();
+
+	/// \brief Body of each worker thread
+	void work();
+
+	UseQueryResult res_;
+	size_t batch_rows_;
+	bool ordered_;
+	std::vector<Slot> slots_;
+	std::vector<Worker*> workers_;
+	std::vector<Thread*> threads_;
+
+	BeecryptMutex mutex_;			///< guards everything below
+	Condition work_ready_;			///< a batch was queued, or we're done
+	Condition slot_ready_;			///< a batch finished processing
+	std::deque<size_t> queue_;		///< slots waiting for a worker
+	ulonglong next_deliver_;		///< seq of next batch to deliver()
+	bool stopping_;					///< workers should exit when idle
+	bool failed_;					///< a worker threw
+	std::string failure_;			///< ...and this is what it said
+};
+
+
+/// \brief Calls a functor on every row of a result set, from several
+/// worker threads at once
+///
+/// \sa Query::for_each_parallel()
+template <class Function>
+class ParallelForEach : public ParallelRowDispatcher
+{
+public:
+	/// \brief Set up the dispatcher
+	///
+	/// We hold a reference to \c fn, so it must outlive this object.
+	ParallelForEach(const UseQueryResult& res, Function& fn,
+			size_t n_workers, size_t batch_rows) :
+	ParallelRowDispatcher(res, n_workers, batch_rows, false),
+	fn_(fn)
+	{
+	}
+
+private:
+	void process(size_t, const RowBatch& batch,
+			const RefCountedPointer<FieldNames>& names)
+	{
+		for (size_t i = 0; i < batch.size(); ++i) {
+			Row row = batch.row(i, names, types(), throw_exceptions());
+			fn_(row);
+		}
+	}
+
+	Function& fn_;
+};
+
+
+/// \brief Calls a functor on every row of a result set from several
+/// worker threads at once, then passes the functor's results to a
+/// second functor on the calling thread, in result set order
+///
+/// \c Function must declare its return type as \c result_type, with
+/// a \c typedef.
+///
+/// \sa Query::for_each_parallel_ordered()
+template <class Function, class Sink>
+class OrderedParallelForEach : public ParallelRowDispatcher
+{
+public:
+	/// \brief The type returned by the per-row functor
+	typedef typename Function::result_type result_type;
+
+	/// \brief Set up the dispatcher
+	///
+	/// We hold references to \c fn and \c sink, so they must outlive
+	/// this object.
+	OrderedParallelForEach(const UseQueryResult& res, Function& fn,
+			Sink& sink, size_t n_workers, size_t batch_rows) :
+	ParallelRowDispatcher(res, n_workers, batch_rows, true),
+	fn_(fn),
+	sink_(sink),
+	results_(slots())
+	{
+	}
+
+private:
+	void process(size_t slot, const RowBatch& batch,
+			const RefCountedPointer<FieldNames>& names)
+	{
+		std::vector<result_type>& out = results_[slot];
+		out.clear();
+		out.reserve(batch.size());
+		for (size_t i = 0; i < batch.size(); ++i) {
+			Row row = batch.row(i, names, types(), throw_exceptions());
+			out.push_back(fn_(row));
+		}
+	}
+
+	void deliver(size_t slot)
+	{
+		std::vector<result_type>& out = results_[slot];
+		for (size_t i = 0; i < out.size(); ++i) {
+			sink_(out[i]);
+		}
+		out.clear();
+	}
+
+	Function& fn_;
+	Sink& sink_;
+	std::vector<std::vector<result_type> > results_;
+};
+
+} // end namespace libtabula
+
+#endif // !defined(LIBTABULA_PARALLEL_H)
@@ -0,0 +1,161 @@
+/// \file paramarray.h
+/// \brief Declares the ParamArray class, which holds rows of
+/// statement parameter values for DBDriver::execute_array().
+
+/***********************************************************************
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#if !defined(LIBTABULA_PARAMARRAY_H)
+#define LIBTABULA_PARAMARRAY_H
+
+#include "common.h"
+
+#include "stadapter.h"
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace libtabula {
+
+/// \brief Rows of parameter values for one statement, in text form
+///
+/// Query::insertfrom() fills one of these from SSQLS objects when the
+/// database driver can bind arrays of parameters to a prepared
+/// statement, and hands it to DBDriver::execute_array().  Values are
+/// kept row by row, as the unquoted, unescaped text SQLTypeAdapter
+/// gives for them; the value for parameter \c c of row \c r is at
+/// index <tt>r * columns() + c</tt>.
+class ParamArray
+{
+public:
+	/// \brief Create an empty array
+	///
+	/// \param columns number of parameters in each row
+	explicit ParamArray(size_t columns = 0) :
+	columns_(columns),
+	bytes_(0)
+	{
+	}
+
+	/// \brief Append a value to the current row
+	void add(const SQLTypeAdapter& v)
+	{
+		if (v.is_null()) {
+			values_.push_back(std::string());
+			nulls_.push_back(1);
+		}
+		else {
+			values_.push_back(std::string(v.data(), v.length()));
+			nulls_.push_back(0);
+			bytes_ += v.length();
+		}
+	}
+
+	/// \brief Remove all values, keeping the column count
+	void clear()
+	{
+		values_.clear();
+		nulls_.clear();
+		bytes_ = 0;
+	}
+
+	/// \brief Returns the total length of the non-null values
+	size_t bytes() const { return bytes_; }
+
+	/// \brief Returns the number of parameters in each row
+	size_t columns() const { return columns_; }
+
+	/// \brief Returns true if no values have been added
+	bool empty() const { return values_.empty(); }
+
+	/// \brief Returns true if the given parameter is SQL null
+	bool is_null(size_t row, size_t column) const
+			{ return nulls_[row * columns_ + column] != 0; }
+
+	/// \brief Returns the number of complete rows
+	size_t rows() const { return columns_ ? values_.size() / columns_ : 0; }
+
+	/// \brief Returns the given parameter's value
+	const std::string& value(size_t row, size_t column) const
+			{ return values_[row * columns_ + column]; }
+
+	/// \brief Returns the number of values added so far
+	size_t values() const { return values_.size(); }
+
+private:
+	size_t columns_;
+	std::vector<std::string> values_;
+	std::vector<char> nulls_;		///< nonzero if SQL null
+	size_t bytes_;
+};
+
+
+#if !defined(DOXYGEN_IGNORE)
+// Doxygen will not generate documentation for this section.
+
+// A manipulator that appends each value inserted after it to a
+// ParamArray instead of writing it to the stream.  This lets Query
+// pull the field values out of an SSQLS one at a time, using its
+// value_list() method.
+struct param_array_type0
+{
+	ParamArray* params;
+	explicit param_array_type0(ParamArray* p) :
+	params(p)
+	{
+	}
+};
+
+
+struct param_array_type1
+{
+	std::ostream* ostr;
+	ParamArray* params;
+	param_array_type1(std::ostream* o, ParamArray* p) :
+	ostr(o),
+	params(p)
+	{
+	}
+};
+
+
+inline param_array_type1
+operator <<(std::ostream& o, param_array_type0 m)
+{
+	return param_array_type1(&o, m.params);
+}
+
+
+inline std::ostream&
+operator <<(param_array_type1 o, const SQLTypeAdapter& in)
+{
+	o.params->add(in);
+	return *o.ostr;
+}
+
+#endif // !defined(DOXYGEN_IGNORE)
+
+} // end namespace libtabula
+
+#endif // !defined(LIBTABULA_PARAMARRAY_H)
@@ -0,0 +1,444 @@
+/***********************************************************************
+ partscan.cpp - Implements the PartitionedScan class.
+
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#define LIBTABULA_NOT_HEADER
+#include "partscan.h"
+
+#include "connection.h"
+#include "cpool.h"
+#include "dbdriver.h"
+#include "query.h"
+#include "scopedconnection.h"
+#include "utility.h"
+
+#include <sstream>
+
+using namespace std;
+
+namespace libtabula {
+
+
+PartitionedScan::PartitionedScan(ConnectionPool& pool,
+		const std::string& table, const std::string& key_column,
+		size_t partitions, size_t threads) :
+pool_(pool)
+{
+	init(table, key_column, partitions, threads);
+}
+
+
+PartitionedScan::PartitionedScan(ConnectionPool& pool, const char* table,
+		const std::string& key_column, size_t partitions,
+		size_t threads) :
+pool_(pool)
+{
+	init(table, key_column, partitions, threads);
+}
+
+
+PartitionedScan::~PartitionedScan()
+{
+	cancel();
+	for (size_t i = 0; i < threads_.size(); ++i) {
+		delete threads_[i];
+		delete workers_[i];
+	}
+	delete current_;
+}
+
+
+void
+PartitionedScan::cancel()
+{
+	{
+		ScopedLock lock(mutex_);
+		cancelled_ = true;
+		space_ready_.broadcast();
+	}
+
+	for (size_t i = 0; i < threads_.size(); ++i) {
+		threads_[i]->join();
+	}
+	release_inline();
+
+	while (!queue_.empty()) {
+		delete queue_.front();
+		queue_.pop_front();
+	}
+}
+
+
+void
+PartitionedScan::fail(const std::string& why)
+{
+	if (!failed_) {
+		failed_ = true;
+		failure_ = why;
+	}
+	data_ready_.broadcast();
+	space_ready_.broadcast();
+}
+
+
+Row
+PartitionedScan::fetch_row()
+{
+	for (;;) {
+		if (current_) {
+			if (pos_ < current_->size()) {
+				return current_->row(pos_++, names_, *types_,
+						throw_exceptions());
+			}
+			delete current_;
+			current_ = 0;
+		}
+
+		if (threads_.empty()) {
+			if (fill_inline()) continue;
+		}
+		else {
+			ScopedLock lock(mutex_);
+			while (queue_.empty() && running_ > 0 && !failed_ &&
+					!cancelled_) {
+				data_ready_.wait(mutex_);
+			}
+			if (!queue_.empty() && !failed_ && !cancelled_) {
+				current_ = queue_.front();
+				queue_.pop_front();
+				pos_ = 0;
+				space_ready_.signal();
+				continue;
+			}
+		}
+
+		// All workers are done, one failed, or we were cancelled
+		if (!cancelled_) wait();
+		return Row();
+	}
+}
+
+
+bool
+PartitionedScan::fill_inline()
+{
+	try {
+		while (!failed_ && !cancelled_) {
+			if (!res_) {
+				if (next_partition_ == partitions_.size()) break;
+				if (!conn_) conn_ = pool_.grab();
+
+				partition_ = next_partition_++;
+				Query q = conn_->query(partition_query(partition_));
+				res_ = q.use();
+				if (!names_) {
+					names_ = res_.field_names();
+					types_ = res_.field_types();
+				}
+			}
+
+			RowBatch* batch = new RowBatch;
+			bool more = batch->fill(res_, batch_rows_);
+			if (!more && res_.driver()->errnum()) {
+				string error = res_.driver()->error();
+				delete batch;
+				throw UseQueryError(error.c_str());
+			}
+			partitions_[partition_].rows += batch->size();
+			if (!more) res_ = UseQueryResult();
+
+			if (batch->empty()) {
+				delete batch;
+			}
+			else {
+				current_ = batch;
+				pos_ = 0;
+				return true;
+			}
+		}
+	}
+	catch (const std::exception& e) {
+		ScopedLock lock(mutex_);
+		fail(e.what());
+	}
+	catch (...) {
+		ScopedLock lock(mutex_);
+		fail("unknown exception");
+	}
+
+	release_inline();
+	return false;
+}
+
+
+void
+PartitionedScan::init(const std::string& table,
+		const std::string& key_column, size_t partitions, size_t threads)
+{
+	table_ = table;
+	key_ = key_column;
+	columns_ = "*";
+	num_partitions_ = partitions ? partitions : 1;
+	batch_rows_ = 256;
+	sink_ = 0;
+	next_partition_ = 0;
+	running_ = 0;
+	cancelled_ = false;
+	failed_ = false;
+	current_ = 0;
+	pos_ = 0;
+
+	conn_ = 0;
+	partition_ = 0;
+
+	// Without thread support, start() and fetch_row() do all the work
+	// themselves.
+	if (!threads || threads > num_partitions_) threads = num_partitions_;
+	if (!Thread::supported()) threads = 0;
+	for (size_t i = 0; i < threads; ++i) {
+		workers_.push_back(new Worker(*this));
+		threads_.push_back(new Thread(*workers_.back()));
+	}
+}
+
+
+std::string
+PartitionedScan::partition_query(size_t i) const
+{
+	const Partition& p = partitions_.at(i);
+	ostringstream os;
+	os << "SELECT " << columns_ << " FROM `" << table_ << '`';
+	const char* glue = " WHERE ";
+	if (p.has_lower) {
+		os << glue << '`' << key_ << "` >= " << p.lower;
+		glue = " AND ";
+	}
+	if (p.has_upper) {
+		os << glue << '`' << key_ << "` < " << p.upper;
+		glue = " AND ";
+	}
+	if (!where_.empty()) {
+		os << glue << '(' << where_ << ')';
+	}
+	return os.str();
+}
+
+
+void
+PartitionedScan::plan()
+{
+	if (points_.empty() && num_partitions_ > 1) {
+		// Ask the server for the key range, and split it evenly
+		ScopedConnection conn(pool_);
+		Query q = conn->query();
+		q << "SELECT MIN(`" << key_ << "`), MAX(`" << key_ <<
+				"`) FROM `" << table_ << '`';
+		if (!where_.empty()) q << " WHERE (" << where_ << ')';
+		StoreQueryResult res = q.store();
+		if (res && !res.empty() && !res[0][0].is_null()) {
+			// Unsigned math, since hi - lo can overflow a longlong.  A
+			// span of 0 means the range covers every longlong value.
+			longlong lo = res[0][0], hi = res[0][1];
+			ulonglong span = ulonglong(hi) - ulonglong(lo) + 1;
+			ulonglong step, extra;
+			if (span) {
+				step = span / num_partitions_;
+				extra = span % num_partitions_;
+			}
+			else {
+				step = ~ulonglong(0) / num_partitions_;
+				extra = ~ulonglong(0) % num_partitions_ + 1;
+				if (extra == num_partitions_) {
+					++step;
+					extra = 0;
+				}
+			}
+			for (size_t i = 1; i < num_partitions_; ++i) {
+				longlong p = longlong(ulonglong(lo) + step * i +
+						extra * i / num_partitions_);
+				if (points_.empty() || p > points_.back()) {
+					points_.push_back(p);
+				}
+			}
+		}
+	}
+
+	partitions_.assign(points_.size() + 1, Partition());
+	for (size_t i = 0; i < points_.size(); ++i) {
+		partitions_[i].upper = points_[i];
+		partitions_[i].has_upper = true;
+		partitions_[i + 1].lower = points_[i];
+		partitions_[i + 1].has_lower = true;
+	}
+}
+
+
+void
+PartitionedScan::release_inline()
+{
+	res_ = UseQueryResult();
+	if (conn_) {
+		pool_.release(conn_);
+		conn_ = 0;
+	}
+}
+
+
+void
+PartitionedScan::scan_partition(Connection& conn, size_t i)
+{
+	Query q = conn.query(partition_query(i));
+	UseQueryResult res = q.use();
+	ulonglong rows = 0;
+
+	if (sink_) {
+		while (Row row = res.fetch_row()) {
+			sink_->row(i, row);
+			++rows;
+
+			// Check for cancellation now and then, not every row
+			if ((rows % batch_rows_) == 0) {
+				ScopedLock lock(mutex_);
+				if (failed_ || cancelled_) break;
+			}
+		}
+	}
+	else {
+		{
+			// First worker to get a result set provides the field info
+			// fetch_row() builds its Rows with.  Deep copies, so the
+			// consumer doesn't share reference counts with us.
+			ScopedLock lock(mutex_);
+			if (!names_) {
+				names_ = new FieldNames(*res.field_names());
+				types_ = new FieldTypes(*res.field_types());
+			}
+		}
+
+		bool more = true;
+		while (more) {
+			RowBatch* batch = new RowBatch;
+			more = batch->fill(res, batch_rows_);
+			if (!more && res.driver()->errnum()) {
+				string error = res.driver()->error();
+				delete batch;
+				throw UseQueryError(error.c_str());
+			}
+			rows += batch->size();
+
+			ScopedLock lock(mutex_);
+			while (queue_.size() >= 2 * threads_.size() && !failed_ &&
+					!cancelled_) {
+				space_ready_.wait(mutex_);
+			}
+			if (failed_ || cancelled_ || batch->empty()) {
+				delete batch;
+				if (failed_ || cancelled_) break;
+			}
+			else {
+				queue_.push_back(batch);
+				data_ready_.signal();
+			}
+		}
+	}
+
+	ScopedLock lock(mutex_);
+	partitions_[i].rows = rows;
+}
+
+
+void
+PartitionedScan::set_boundaries(const std::vector<longlong>& points)
+{
+	points_ = points;
+}
+
+
+void
+PartitionedScan::start()
+{
+	if (partitions_.empty()) plan();
+
+	running_ = threads_.size();
+	for (size_t i = 0; i < threads_.size(); ++i) {
+		threads_[i]->start();
+	}
+
+	if (threads_.empty() && sink_) {
+		// No thread support, so for_each() mode runs it all here
+		running_ = 1;
+		work(false);
+	}
+}
+
+
+void
+PartitionedScan::wait()
+{
+	for (size_t i = 0; i < threads_.size(); ++i) {
+		threads_[i]->join();
+	}
+
+	if (failed_) {
+		throw WorkerFailed(failure_);
+	}
+}
+
+
+void
+PartitionedScan::work(bool own_thread)
+{
+	try {
+		ScopedConnection conn(pool_);
+		internal::ThreadScope scope(*conn, own_thread);
+
+		for (;;) {
+			size_t i;
+			{
+				ScopedLock lock(mutex_);
+				if (failed_ || cancelled_ ||
+						next_partition_ == partitions_.size()) {
+					break;
+				}
+				i = next_partition_++;
+			}
+
+			scan_partition(*conn, i);
+		}
+	}
+	catch (const std::exception& e) {
+		ScopedLock lock(mutex_);
+		fail(e.what());
+	}
+	catch (...) {
+		ScopedLock lock(mutex_);
+		fail("unknown exception");
+	}
+
+	ScopedLock lock(mutex_);
+	--running_;
+	data_ready_.signal();
+}
+
+} // end namespace libtabula
@@ -0,0 +1,330 @@
+/// \file partscan.h
+/// \brief Declares the PartitionedScan class, which reads a table in
+/// parallel over several pooled connections.
+
+/***********************************************************************
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#if !defined(LIBTABULA_PARTSCAN_H)
+#define LIBTABULA_PARTSCAN_H
+
+#include "common.h"
+
+#include "beemutex.h"
+#include "noexceptions.h"
+#include "rowbatch.h"
+#include "thread.h"
+
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace libtabula {
+
+#if !defined(DOXYGEN_IGNORE)
+// Make Doxygen ignore this
+class LIBTABULA_EXPORT Connection;
+class LIBTABULA_EXPORT ConnectionPool;
+#endif
+
+/// \brief Reads a whole table in parallel by splitting it into ranges
+/// of a numeric key column and reading each range on its own pooled
+/// connection.
+///
+/// A single "use" query over a huge table is limited to what one
+/// server thread can read and one connection can carry.  This class
+/// breaks the table up into key ranges, and runs one range query per
+/// worker thread, each on a Connection grabbed from a ConnectionPool.
+///
+/// By default, the key ranges are computed by asking the server for
+/// the key column's \c MIN() and \c MAX() values and dividing that
+/// range evenly.  If your keys are unevenly distributed, call
+/// set_boundaries() to give your own split points instead.  The first
+/// and last partitions are open-ended, so rows added beyond the old
+/// key range while the scan runs still get picked up.
+///
+/// There are two ways to get at the rows:
+///
+/// - for_each() calls your functor on the worker threads with the
+///   partition number and each Row in that partition.  Rows within one
+///   partition arrive in the order the server sends them, but calls
+///   for different partitions interleave arbitrarily.
+///
+/// - start() followed by repeated calls to fetch_row() merges the
+///   partitions into a single stream on the calling thread, in
+///   no particular order.  The workers hand rows over in batches
+///   through a bounded queue, so they wait for you if you fall behind.
+///
+/// \code
+///   libtabula::PartitionedScan scan(pool, "stock", "id", 8);
+///   scan.start();
+///   while (libtabula::Row row = scan.fetch_row()) {
+///       ...
+///   }
+/// \endcode
+///
+/// If anything goes wrong on a worker -- a query error, or an
+/// exception thrown from your for_each() functor -- the remaining
+/// workers stop at the next batch boundary, and you get WorkerFailed
+/// with the original error message.
+class LIBTABULA_EXPORT PartitionedScan : public OptionalExceptions
+{
+public:
+	/// \brief Information about one key range of the scan
+	struct Partition
+	{
+		longlong lower;			///< lowest key value in the range
+		longlong upper;			///< one past the highest key value
+		bool has_lower;			///< false if no lower bound
+		bool has_upper;			///< false if no upper bound
+		ulonglong rows;			///< rows read from this partition
+
+		Partition() : lower(0), upper(0), has_lower(false),
+				has_upper(false), rows(0) { }
+	};
+
+	/// \brief Set up a scan of the named table
+	///
+	/// \param pool where to get connections from; it must allow at
+	///     least \c threads connections at once
+	/// \param table name of the table to scan
+	/// \param key_column name of a numeric column to partition on,
+	///     ideally the primary key
+	/// \param partitions number of key ranges to split the table into
+	/// \param threads number of worker threads, and so connections, to
+	///     use; 0 means one per partition.  Without thread support, the
+	///     scan runs on the caller's thread instead, one partition at a
+	///     time, on a single connection.
+	PartitionedScan(ConnectionPool& pool, const std::string& table,
+			const std::string& key_column, size_t partitions = 4,
+			size_t threads = 0);
+
+	/// \brief Set up a scan of the named table
+	///
+	/// This overload keeps a string literal table name from matching
+	/// the SSQLS ctor template below.
+	PartitionedScan(ConnectionPool& pool, const char* table,
+			const std::string& key_column, size_t partitions = 4,
+			size_t threads = 0);
+
+	/// \brief Set up a scan of the table an SSQLS maps to
+	template <class SSQLS>
+	PartitionedScan(ConnectionPool& pool, const SSQLS& ssqls,
+			const std::string& key_column, size_t partitions = 4,
+			size_t threads = 0) :
+	pool_(pool)
+	{
+		init(ssqls.table(), key_column, partitions, threads);
+	}
+
+	/// \brief Stop the scan, if it's running, and destroy the object
+	~PartitionedScan();
+
+	/// \brief Give the split points between partitions yourself,
+	/// instead of having the scan derive them from MIN() and MAX()
+	///
+	/// The points must be in ascending order.  There will be one more
+	/// partition than there are points.  Must be called before the
+	/// scan is planned.
+	void set_boundaries(const std::vector<longlong>& points);
+
+	/// \brief Select only the given columns
+	///
+	/// \param columns a SQL column list, like "id, name"; defaults
+	///     to "*"
+	void set_columns(const std::string& columns) { columns_ = columns; }
+
+	/// \brief Add a condition every row must meet, on top of the key
+	/// range conditions
+	///
+	/// \param where a SQL boolean expression; it is parenthesized and
+	///     ANDed with the key range conditions
+	void set_where(const std::string& where) { where_ = where; }
+
+	/// \brief Set the number of rows the workers hand to fetch_row() at
+	/// a time, in merged mode
+	void set_batch_rows(size_t rows) { batch_rows_ = rows ? rows : 1; }
+
+	/// \brief Call a functor for every row in the table, from the
+	/// worker threads
+	///
+	/// The functor is called as <tt>fn(size_t partition, const
+	/// Row&)</tt>, from several threads at once, so it must be
+	/// thread-safe.  Returns once every partition has been read.
+	///
+	/// \return a copy of the passed functor
+	template <class Function>
+	Function for_each(Function fn)
+	{
+		FunctorRowSink<Function> sink(fn);
+		sink_ = &sink;
+		try {
+			start();
+			wait();
+		}
+		catch (...) {
+			sink_ = 0;
+			throw;
+		}
+		sink_ = 0;
+		return fn;
+	}
+
+	/// \brief Work out the key ranges for the scan, without starting it
+	///
+	/// If you didn't call set_boundaries(), this queries the server
+	/// for the key column's range.  start() and for_each() call this
+	/// for you if you haven't, but you might want to call it yourself
+	/// to look at the plan through partitions() and partition_query().
+	void plan();
+
+	/// \brief Start the worker threads in merged mode
+	///
+	/// Call fetch_row() to get the rows.  Without thread support, this
+	/// only plans the scan, and fetch_row() reads the partitions itself.
+	void start();
+
+	/// \brief Returns the next row from any partition, or a falsy
+	/// Row when all partitions are exhausted
+	Row fetch_row();
+
+	/// \brief Stop the scan early
+	///
+	/// Blocks until the workers notice, which they do between batches.
+	/// Note that each worker's connection still has to read and discard
+	/// the rest of its current result set before it goes back to the
+	/// pool; that's a limitation of the MySQL protocol.
+	void cancel();
+
+	/// \brief Returns the key ranges the scan uses
+	///
+	/// Row counts are only meaningful after the scan finishes.  The
+	/// list is empty until plan() is called, explicitly or not.
+	const std::vector<Partition>& partitions() const
+			{ return partitions_; }
+
+	/// \brief Returns the SQL query used to read the given partition
+	std::string partition_query(size_t i) const;
+
+private:
+	/// \brief Interface to the for_each() functor, so the worker code
+	/// needn't be a template
+	class RowSink
+	{
+	public:
+		virtual ~RowSink() { }
+		virtual void row(size_t partition, const Row& row) = 0;
+	};
+
+	/// \brief RowSink implementation wrapping a for_each() functor
+	template <class Function>
+	class FunctorRowSink : public RowSink
+	{
+	public:
+		FunctorRowSink(Function& fn) : fn_(fn) { }
+		void row(size_t partition, const Row& row) { fn_(partition, row); }
+	private:
+		Function& fn_;
+	};
+
+	/// \brief The Thread::Runnable for each worker thread
+	class Worker : public Thread::Runnable
+	{
+	public:
+		Worker(PartitionedScan& s) : s_(s) { }
+		void run() { s_.work(true); }
+	private:
+		PartitionedScan& s_;
+	};
+
+	friend class Worker;
+
+	PartitionedScan(const PartitionedScan&);
+	PartitionedScan& operator =(const PartitionedScan&);
+
+	/// \brief Common part of the ctors
+	void init(const std::string& table, const std::string& key_column,
+			size_t partitions, size_t threads);
+
+	/// \brief Read one partition on a worker thread
+	void scan_partition(Connection& conn, size_t i);
+
+	/// \brief Read the next batch into current_ on the caller's
+	/// thread, for when there are no worker threads.  Returns false
+	/// when there are no more batches, or the read failed.
+	bool fill_inline();
+
+	/// \brief Give back the connection fill_inline() reads from
+	void release_inline();
+
+	/// \brief Join the workers, and throw if one failed
+	void wait();
+
+	/// \brief Body of each worker thread
+	///
+	/// \param own_thread true when called on one of our worker
+	///     threads, false when for_each() calls it on the caller's
+	///     thread because there's no thread support
+	void work(bool own_thread);
+
+	/// \brief Record a worker failure and wake everyone up.  Mutex
+	/// must be held.
+	void fail(const std::string& why);
+
+	ConnectionPool& pool_;
+	std::string table_;
+	std::string key_;
+	std::string columns_;
+	std::string where_;
+	size_t num_partitions_;
+	size_t batch_rows_;
+	std::vector<longlong> points_;
+	std::vector<Partition> partitions_;
+	RowSink* sink_;				///< non-null in for_each() mode
+
+	std::vector<Worker*> workers_;
+	std::vector<Thread*> threads_;
+
+	BeecryptMutex mutex_;		///< guards everything below
+	Condition data_ready_;		///< a batch was queued, or a worker quit
+	Condition space_ready_;		///< fetch_row() took a batch
+	std::deque<RowBatch*> queue_;	///< batches waiting for fetch_row()
+	size_t next_partition_;		///< next partition for a worker to take
+	size_t running_;			///< workers still running
+	bool cancelled_;
+	bool failed_;
+	std::string failure_;
+	RefCountedPointer<FieldNames> names_;	///< for Rows in merged mode
+	RefCountedPointer<FieldTypes> types_;
+
+	RowBatch* current_;			///< batch fetch_row() is working on
+	size_t pos_;				///< next row within current_
+
+	Connection* conn_;			///< fill_inline()'s connection
+	UseQueryResult res_;		///< partition fill_inline() is reading
+	size_t partition_;			///< ...and its index
+};
+
+} // end namespace libtabula
+
+#endif // !defined(LIBTABULA_PARTSCAN_H)
@@ -32,10 +32,63 @@
 #include "autoflag.h"
 #include "dbdriver.h"
 #include "connection.h"
+#include "observer.h"
+#include "slowlog.h"
 #include "sql_types.h"
+#include "stmtcache.h"
 
 namespace libtabula {
 
+// Times a query for its connection's SlowQueryLog and the installed
+// QueryObserver, if there are any, and reports to them when it goes
+// out of scope.  When there are neither, this costs a couple of tests
+// and branches at each end.
+class QueryTimer
+{
+public:
+	QueryTimer(Connection* conn, const char* sql, size_t length) :
+	conn_(conn),
+	log_(conn->slow_query_log()),
+	obs_(QueryObserver::installed()),
+	sql_(sql),
+	length_(length),
+	start_(timing() ? Stopwatch::now() : 0),
+	rows_(0)
+	{
+	}
+
+	~QueryTimer()
+	{
+		if (log_) {
+			log_->query_done(*conn_, sql_, length_, start_, rows_,
+					conn_->errnum());
+		}
+		if (obs_) {
+			QueryEvent ev(QueryEvent::ev_query, conn_->driver(), conn_);
+			ev.elapsed = ev.start - start_;
+			ev.start = start_;
+			ev.sql = sql_;
+			ev.sql_length = ev.bytes = length_;
+			ev.rows = rows_;
+			ev.errnum = conn_->errnum();
+			obs_->observe(ev);
+		}
+	}
+
+	bool timing() const { return log_ || obs_; }
+	void rows(ulonglong n) { rows_ = n; }
+
+private:
+	Connection* conn_;
+	SlowQueryLog* log_;
+	QueryObserver* obs_;
+	const char* sql_;
+	size_t length_;
+	ulonglong start_;
+	ulonglong rows_;
+};
+
+
 // Force insertfrom() policy template instantiation.  Required to make 
 // VC++ happy.
 Query::RowCountInsertPolicy<Transaction> RowCountInsertPolicyI(0);
@@ -52,7 +105,9 @@ std::ostream(0),
 OptionalExceptions(te),
 template_defaults(this),
 conn_(c),
-copacetic_(true)
+copacetic_(true),
+max_rows_(c ? c->max_result_rows() : 0),
+max_bytes_(c ? c->max_result_bytes() : 0)
 {
 	// Set up our internal IOStreams string buffer
 	init(&sbuffer_);
@@ -96,6 +151,13 @@ Query::affected_rows()
 }
 
 
+bool
+Query::array_binding() const
+{
+	return conn_ && conn_->driver()->array_binding();
+}
+
+
 int
 Query::errnum() const
 {
@@ -110,6 +172,23 @@ Query::error() const
 }
 
 
+Fingerprint
+Query::fingerprint() const
+{
+	if (parse_elems_.empty()) {
+		return Fingerprint(sbuffer_.str());
+	}
+
+	std::string sql;
+	for (std::vector<SQLParseElement>::const_iterator it =
+			parse_elems_.begin(); it != parse_elems_.end(); ++it) {
+		sql += it->before;
+		if (it->num >= 0) sql += '?';
+	}
+	return Fingerprint(sql);
+}
+
+
 size_t
 Query::escape_string(std::string* ps, const char* original,
 		size_t length) const
@@ -128,11 +207,58 @@ Query::escape_string(char* escaped, const char* original,
 }
 
 
+UseQueryResult
+Query::cursor(unsigned long fetch_size)
+{
+	AutoFlag<> af(template_defaults.processing_);
+	return cursor(str(template_defaults), fetch_size);
+}
+
+
+UseQueryResult
+Query::cursor(SQLQueryParms& p, unsigned long fetch_size)
+{
+	AutoFlag<> af(template_defaults.processing_);
+	return cursor(str(p), fetch_size);
+}
+
+
+UseQueryResult
+Query::cursor(const std::string& sql, unsigned long fetch_size)
+{
+	QueryTimer timer(conn_, sql.data(), sql.length());
+	DBDriver* dbd = conn_->driver();
+	std::string error;
+	int errnum = 0;
+	if (ResultBase::Impl* pres = dbd->open_cursor(sql, fetch_size,
+			error, errnum)) {
+		copacetic_ = true;
+		if (parse_elems_.size() == 0) reset();	// not tquery
+		return UseQueryResult(pres, dbd, throw_exceptions());
+	}
+
+	// As with use(), no result set isn't an error in itself
+	copacetic_ = (errnum == 0);
+	if (copacetic_) {
+		if (parse_elems_.size() == 0) reset();	// not tquery
+		return UseQueryResult();
+	}
+	else if (throw_exceptions()) {
+		throw BadQuery(error, errnum);
+	}
+	else {
+		return UseQueryResult();
+	}
+}
+
+
 bool
 Query::exec(const std::string& str)
 {
+	QueryTimer timer(conn_, str.data(), str.length());
 	if ((copacetic_ = conn_->driver()->execute(str.data(),
 			static_cast<unsigned long>(str.length()))) == true) {
+		if (timer.timing()) timer.rows(affected_rows());
 		if (parse_elems_.size() == 0) {
 			// Not a template query, so auto-reset
 			reset();
@@ -148,6 +274,26 @@ Query::exec(const std::string& str)
 }
 
 
+bool
+Query::exec_array(const std::string& sql, const ParamArray& params)
+{
+	// The statement is the same for every batch, so it comes from the
+	// connection's statement cache, which prepares it only once.
+	std::string error;
+	int errnum = 0;
+	if ((copacetic_ = conn_->statements().exec_array(sql, params, error,
+			errnum)) == true) {
+		return true;
+	}
+	else if (throw_exceptions()) {
+		throw BadQuery(error, errnum);
+	}
+	else {
+		return false;
+	}
+}
+
+
 SimpleResult 
 Query::execute() 
 { 
@@ -193,12 +339,16 @@ Query::execute(const char* str, size_t len)
 		AutoFlag<> af(template_defaults.processing_);
 		return execute(SQLQueryParms() << sql_text(str, len));
 	}
+
+	QueryTimer timer(conn_, str, len);
 	if ((copacetic_ = conn_->driver()->execute(str, len)) == true) {
 		if (parse_elems_.size() == 0) {
 			// Not a template query, so auto-reset
 			reset();
 		}
-		return SimpleResult(conn_, insert_id(), affected_rows());
+		SimpleResult res(conn_, insert_id(), affected_rows());
+		timer.rows(res.rows());
+		return res;
 	}
 	else if (throw_exceptions()) {
 		throw BadQuery(error(), errnum());
@@ -216,6 +366,13 @@ Query::insert_id()
 }
 
 
+ulonglong
+Query::max_allowed_packet()
+{
+	return conn_->max_allowed_packet();
+}
+
+
 bool
 Query::more_results()
 {
@@ -230,6 +387,8 @@ Query::operator=(const Query& rhs)
 	template_defaults = rhs.template_defaults;
 	conn_ = rhs.conn_;
 	copacetic_ = rhs.copacetic_;
+	max_rows_ = rhs.max_rows_;
+	max_bytes_ = rhs.max_bytes_;
 
 	*this << rhs.sbuffer_.str();
 
@@ -466,6 +625,26 @@ Query::result_empty()
 }
 
 
+SpillQueryResult
+Query::spill(size_t budget)
+{
+	if (UseQueryResult res = use()) {
+		return SpillQueryResult(res, budget, throw_exceptions());
+	}
+	return SpillQueryResult();
+}
+
+
+SpillQueryResult
+Query::spill(SQLQueryParms& p, size_t budget)
+{
+	if (UseQueryResult res = use(p)) {
+		return SpillQueryResult(res, budget, throw_exceptions());
+	}
+	return SpillQueryResult();
+}
+
+
 StoreQueryResult 
 Query::store() 
 { 
@@ -494,12 +673,25 @@ Query::store(const char* str, size_t len)
 		return store(SQLQueryParms() << sql_text(str, len));
 	}
 
+	QueryTimer timer(conn_, str, len);
 	DBDriver* dbd = conn_->driver();
 	if ((copacetic_ = dbd->execute(str, len)) == true) {
-		if (ResultBase::Impl* pres = dbd->store_result()) {
+		if (max_rows_ || max_bytes_) {
+			// Read the rows one at a time, so we can stop early
+			if (ResultBase::Impl* pres = dbd->use_result()) {
+				if (parse_elems_.size() == 0) reset();	// not tquery
+				StoreQueryResult res(pres, dbd, max_rows_, max_bytes_,
+						throw_exceptions());
+				copacetic_ = res;
+				timer.rows(res.num_rows());
+				return res;
+			}
+		}
+		else if (ResultBase::Impl* pres = dbd->store_result()) {
 			if (parse_elems_.size() == 0) reset();	// not tquery
-			return StoreQueryResult(pres, dbd->num_rows(*pres), dbd,
-					throw_exceptions());
+			ulonglong rows = dbd->num_rows(*pres);
+			timer.rows(rows);
+			return StoreQueryResult(pres, rows, dbd, throw_exceptions());
 		}
 	}
 
@@ -607,11 +799,13 @@ Query::use(const char* str, size_t len)
 		return use(SQLQueryParms() << sql_text(str, len));
 	}
 
+	QueryTimer timer(conn_, str, len);
 	DBDriver* dbd = conn_->driver();
 	if ((copacetic_ = dbd->execute(str, len)) == true) {
 		if (ResultBase::Impl* pres = dbd->use_result()) {
 			if (parse_elems_.size() == 0) reset();	// not tquery
-			return UseQueryResult(pres, dbd, throw_exceptions());
+			return UseQueryResult(pres, dbd, throw_exceptions(),
+					max_rows_, max_bytes_);
 		}
 	}
 
@@ -31,13 +31,19 @@
 #include "common.h"
 
 #include "exceptions.h"
+#include "fingerprint.h"
 #include "noexceptions.h"
+#include "parallel.h"
+#include "paramarray.h"
 #include "qparms.h"
 #include "querydef.h"
+#include "readahead.h"
 #include "result.h"
 #include "row.h"
+#include "spillresult.h"
 #include "sqlstream.h"
 #include "stadapter.h"
+#include "stopwatch.h"
 #include "transaction.h"
 
 #include <deque>
@@ -45,6 +51,7 @@
 #include <list>
 #include <map>
 #include <set>
+#include <sstream>
 #include <vector>
 
 #ifdef HAVE_EXT_SLIST
@@ -203,6 +210,19 @@ public:
 	/// extra to say, so use either, as makes sense in your program.
 	const char* error() const;
 
+	/// \brief Returns the fingerprint of the query
+	///
+	/// For a template query, this comes straight from the parsed
+	/// template, with each parameter counted as a literal value, so
+	/// it doesn't matter what values have been given, and nothing is
+	/// escaped or quoted.  This matches the fingerprint of the built
+	/// query, so long as the template's parameters hold values rather
+	/// than names or other SQL.  For any other query, it's the
+	/// fingerprint of str().
+	///
+	/// \sa Fingerprint
+	Fingerprint fingerprint() const;
+
 	/// \brief Get ID generated for an AUTO_INCREMENT column in the
 	/// previous INSERT query.
 	///
@@ -215,6 +235,13 @@ public:
 	/// to get the ID in this case.
 	ulonglong insert_id();
 
+	/// \brief Returns the row limit given to set_result_limits(), or 0
+	ulonglong max_result_rows() const { return max_rows_; }
+
+	/// \brief Returns the memory limit given to set_result_limits(),
+	/// or 0
+	ulonglong max_result_bytes() const { return max_bytes_; }
+
 	/// \brief Assign another query's state to this object
 	///
 	/// The same caveats apply to this operator as apply to the copy
@@ -275,6 +302,38 @@ public:
 	/// Wraps DBDriver::result_empty()
 	bool result_empty();
 
+	/// \brief Limit the size of result sets from store() and use()
+	///
+	/// \param max_rows the most rows a result set may have, or 0 for
+	///     no limit
+	/// \param max_bytes the most memory a result set's rows may take
+	///     up, or 0 for no limit
+	///
+	/// A new Query starts out with its Connection's limits.  When a
+	/// result set goes over one of them, we ask the server to stop
+	/// running the query, so it doesn't go on sending rows, and throw
+	/// ResultTooLarge.  If exceptions are disabled, you get a false
+	/// result set from store(), or a false Row from the "use" result
+	/// set's fetch_row(), instead.
+	///
+	/// Asking the server to stop only works if the Connection had
+	/// limits of its own when it connected; see
+	/// Connection::set_result_limits() for why.  Otherwise the rest of
+	/// the rows are read and thrown away.
+	///
+	/// The memory limit is on StoreQueryResult::memory_usage() for
+	/// store(), and on the sum of Row::memory_usage() for every row
+	/// fetched for use().  While a limit is set, store() reads the
+	/// result set a row at a time, as use() does, instead of having
+	/// the driver read it all in first.  That's what lets it stop
+	/// early, but it means the connection is busy until store()
+	/// returns, and some drivers are a little slower that way.
+	void set_result_limits(ulonglong max_rows, ulonglong max_bytes = 0)
+	{
+		max_rows_ = max_rows;
+		max_bytes_ = max_bytes;
+	}
+
 	/// \brief Get built query as a C++ string
 	std::string str() { return str(template_defaults); }
 
@@ -446,6 +505,68 @@ public:
 	/// from plain C strings and other useful data types implicitly.
 	UseQueryResult use(const char* str, size_t len);
 
+	/// \brief Execute a query that can return rows, reading them
+	/// through a server-side cursor
+	///
+	/// Like use(), this returns an object that walks through the rows
+	/// one at a time without holding the whole result set in memory.
+	/// The difference is that the server keeps the result set, and
+	/// sends us \c fetch_size rows each time we run out.  This costs a
+	/// round trip per batch of rows, and the server has to build the
+	/// result set before we get any of it, but it doesn't tie up the
+	/// connection: you can run other queries on it, even while the
+	/// UseQueryResult is still open.
+	///
+	/// Raise \c fetch_size to trade memory for fewer round trips.
+	///
+	/// \param fetch_size number of rows to fetch from the server at
+	///     once
+	///
+	/// \return a UseQueryResult to walk through the rows, or a falsy
+	///     one if the query failed and exceptions are disabled, or it
+	///     returns no result set
+	///
+	/// \sa use()
+	UseQueryResult cursor(unsigned long fetch_size = 100);
+
+	/// \brief Execute a template query that can return rows, reading
+	/// them through a server-side cursor
+	///
+	/// \param p parameters to use in the template query
+	/// \param fetch_size number of rows to fetch from the server at
+	///     once
+	UseQueryResult cursor(SQLQueryParms& p, unsigned long fetch_size = 100);
+
+	/// \brief Execute the given query, reading its rows through a
+	/// server-side cursor
+	///
+	/// Unlike use(const SQLTypeAdapter&), \c sql is always the whole
+	/// query, even if this object is set up as a template query.
+	UseQueryResult cursor(const std::string& sql,
+			unsigned long fetch_size = 100);
+
+	/// \brief Execute a query that can return rows, storing them
+	/// within a memory budget
+	///
+	/// This reads the result set as use() does, into a SpillQueryResult
+	/// that moves the rows to a temporary file once they take more than
+	/// \c budget bytes.  See its documentation for details.
+	///
+	/// \param budget most bytes of row data to hold in memory
+	///
+	/// \return the rows, or a falsy SpillQueryResult if the query failed
+	///     and exceptions are disabled, or it returns no result set
+	///
+	/// \sa store(), use()
+	SpillQueryResult spill(size_t budget);
+
+	/// \brief Execute a template query that can return rows, storing
+	/// them within a memory budget
+	///
+	/// \param p parameters to use in the template query
+	/// \param budget most bytes of row data to hold in memory
+	SpillQueryResult spill(SQLQueryParms& p, size_t budget);
+
 	/// \brief Execute a query that can return a result set
 	///
 	/// Use one of the store() overloads to execute a query and retrieve
@@ -582,6 +703,140 @@ public:
 		return fn;
 	}
 
+	/// \brief Execute the query, and call a functor for each returned
+	/// row, reading rows from the server on a background thread
+	///
+	/// Just like for_each(const SQLTypeAdapter&, Function), except that
+	/// it wraps the "use" query result in a ReadAheadResult, so the
+	/// next batch of rows is coming in over the network while \c fn
+	/// is processing the current one.  This is a win for long scans
+	/// where \c fn does enough work per row that the network would
+	/// otherwise sit idle.
+	///
+	/// If \c fn throws, the background thread is stopped before the
+	/// exception propagates out of this function.
+	///
+	/// \param query the query string
+	/// \param fn the functor called for each row
+	/// \param batch_rows number of rows the background thread reads
+	///     at a time
+	/// \param batches number of batches it may read ahead of \c fn
+	/// \return a copy of the passed functor
+	template <typename Function>
+	Function for_each_read_ahead(const SQLTypeAdapter& query, Function fn,
+			size_t batch_rows = 256, size_t batches = 2)
+	{	
+		libtabula::UseQueryResult res = use(query);
+		if (res) {
+			libtabula::ReadAheadResult rar(res, batch_rows, batches);
+			libtabula::NoExceptions ne(rar);
+			while (libtabula::Row row = rar.fetch_row()) {
+				fn(row);
+			}
+		}
+
+		return fn;
+	}
+
+	/// \brief Execute the query, and call a functor for each returned
+	/// row, reading rows from the server on a background thread
+	///
+	/// Just like for_each_read_ahead(const SQLTypeAdapter&, Function,
+	/// size_t, size_t), but it uses the query string held by the Query
+	/// object already.
+	template <typename Function>
+	Function for_each_read_ahead(Function fn, size_t batch_rows = 256,
+			size_t batches = 2)
+	{	
+		libtabula::UseQueryResult res = use();
+		if (res) {
+			libtabula::ReadAheadResult rar(res, batch_rows, batches);
+			libtabula::NoExceptions ne(rar);
+			while (libtabula::Row row = rar.fetch_row()) {
+				fn(row);
+			}
+		}
+
+		return fn;
+	}
+
+	/// \brief Execute the query, and call a functor for each returned
+	/// row from a pool of worker threads
+	///
+	/// This thread reads rows from the server in batches of
+	/// \c batch_rows, and hands each batch to the next idle worker,
+	/// which calls \c fn on each row in the batch.  No more than twice
+	/// \c n_workers batches are in memory at once; if the workers fall
+	/// behind, we stop reading until one catches up.
+	///
+	/// Because several workers call \c fn at the same time, on
+	/// different rows, in no particular order, \c fn must be safe to
+	/// call that way.  Each worker has its own copy of the result set's
+	/// field name list, so the Row objects it creates are safe to copy
+	/// within that worker, but don't hand them to another thread.
+	///
+	/// If \c fn throws, we stop reading, wait for the other workers
+	/// to finish their current batch, and throw WorkerFailed with the
+	/// original exception's message.
+	///
+	/// \param query the query string
+	/// \param fn the functor called for each row
+	/// \param n_workers number of worker threads
+	/// \param batch_rows number of rows handed to a worker at a time
+	/// \return a copy of the passed functor
+	///
+	/// \sa for_each_parallel_ordered()
+	template <typename Function>
+	Function for_each_parallel(const SQLTypeAdapter& query, Function fn,
+			size_t n_workers = 4, size_t batch_rows = 256)
+	{	
+		libtabula::UseQueryResult res = use(query);
+		if (res) {
+			libtabula::ParallelForEach<Function> pfe(res, fn, n_workers,
+					batch_rows);
+			libtabula::NoExceptions ne(pfe);
+			pfe.run();
+		}
+
+		return fn;
+	}
+
+	/// \brief Execute the query, call a functor for each returned row
+	/// from a pool of worker threads, and pass the results back to this
+	/// thread in result set order
+	///
+	/// This is like for_each_parallel(), except that each call to
+	/// \c fn returns a value, which we pass to \c sink on the calling
+	/// thread in the same order as the rows they came from.  Use this
+	/// when the expensive part of the per-row work can run in any
+	/// order, but its results have to come out in order.
+	///
+	/// \c Function must declare its return type as \c result_type,
+	/// with a \c typedef.  \c sink is
+	/// only called on this thread, so it needn't be thread-safe.
+	///
+	/// \param query the query string
+	/// \param fn the functor called for each row
+	/// \param sink the functor called for each of \c fn's results
+	/// \param n_workers number of worker threads
+	/// \param batch_rows number of rows handed to a worker at a time
+	/// \return a copy of the passed sink functor
+	template <typename Function, typename Sink>
+	Sink for_each_parallel_ordered(const SQLTypeAdapter& query,
+			Function fn, Sink sink, size_t n_workers = 4,
+			size_t batch_rows = 256)
+	{	
+		libtabula::UseQueryResult res = use(query);
+		if (res) {
+			libtabula::OrderedParallelForEach<Function, Sink> opfe(res,
+					fn, sink, n_workers, batch_rows);
+			libtabula::NoExceptions ne(opfe);
+			opfe.run();
+		}
+
+		return sink;
+	}
+
 	/// \brief Execute a query, conditionally storing each row in a
 	/// container
 	///
@@ -1051,6 +1306,13 @@ public:
 	/// \param policy insert policy object, see insertpolicy.h for
 	/// details
 	///
+	/// If the database driver supports array binding (see
+	/// DBDriver::array_binding()) each batch goes to the server as a
+	/// single prepared statement with arrays of parameter values
+	/// instead of as a multi-row INSERT statement, which saves the
+	/// server from parsing all those values as SQL.  Otherwise, or if
+	/// this Query has no connection, it builds INSERT statements.
+	///
 	/// \sa insert()
 	template <class Iter, class InsertPolicy>
 	Query& insertfrom(Iter first, Iter last, InsertPolicy& policy)
@@ -1063,7 +1325,11 @@ public:
 		if (first == last) {
 			return *this;   // empty set!
 		}
+		else if (array_binding()) {
+			return insertfrom_array(first, last, policy);
+		}
 
+		prepare_policy(policy);
 		typename InsertPolicy::access_controller ac(*conn_);
 		
 		for (Iter it = first; it != last; ++it) {
@@ -1084,7 +1350,7 @@ public:
 			else {
 				// Execute what we've built up already, if there is anything
 				if (!empty) {
-					if (!exec()) {
+					if (!exec_batch(policy)) {
 						success = false;
 						break;
 					}
@@ -1114,7 +1380,7 @@ public:
 		}
 
 		// We might need to execute the last query here.
-		if (success && !empty && !exec()) {
+		if (success && !empty && !exec_batch(policy)) {
 			success = false;
 		}
 
@@ -1152,6 +1418,7 @@ public:
 			return *this;   // empty set!
 		}
 
+		prepare_policy(policy);
 		typename InsertPolicy::access_controller ac(*conn_);
 
 		for (Iter it = first; it != last; ++it) {
@@ -1172,7 +1439,7 @@ public:
 			else {
 				// Execute what we've built up already, if there is anything
 				if (!empty) {
-					if (!exec()) {
+					if (!exec_batch(policy)) {
 						success = false;
 						break;
 					}
@@ -1202,7 +1469,7 @@ public:
 		}
 
 		// We might need to execute the last query here.
-		if (success && !empty && !exec()) {
+		if (success && !empty && !exec_batch(policy)) {
 			success = false;
 		}
 
@@ -1274,6 +1541,252 @@ public:
 		return *this;
 	}	
 
+	/// \brief Insert a new row, or update the existing row if it
+	/// matches on a unique index.
+	///
+	/// This function builds an \c INSERT \c ... \c ON \c DUPLICATE
+	/// \c KEY \c UPDATE SQL query.  Every field but the SSQLS's key
+	/// fields -- the ones \c sql_use_compare selects -- is set from
+	/// \c v when the row already exists.  Unlike replace(), this
+	/// doesn't delete and reinsert existing rows, which is much
+	/// cheaper on tables with secondary indexes, triggers, or foreign
+	/// keys.
+	///
+	/// \param v new row
+	///
+	/// \sa insert(), replace(), upsertfrom()
+	template <class T>
+	Query& upsert(const T& v)
+	{
+		reset();
+
+		LIBTABULA_QUERY_THISPTR << std::setprecision(16) <<
+				"INSERT INTO `" << v.table() << "` (" <<
+				v.field_list() << ") VALUES (" << v.value_list() <<
+				')' << upsert_clause(v);
+		return *this;
+	}
+
+	/// \brief Insert multiple new rows, or update existing ones if
+	/// they match on a unique index.
+	///
+	/// Builds a multi-row version of the query upsert(const T&) builds,
+	/// using items from a range within an STL container.
+	///
+	/// \param first iterator pointing to first element in range to
+	///    insert/update
+	/// \param last iterator pointing to one past the last element to
+	///    insert/update
+	///
+	/// \sa insert(), replace(), upsertfrom()
+	template <class Iter>
+	Query& upsert(Iter first, Iter last)
+	{
+		reset();
+		if (first != last) {
+			// Build SQL for first item in the container.  It's special
+			// because we need the table name and field list.
+			LIBTABULA_QUERY_THISPTR << std::setprecision(16) <<
+					"INSERT INTO `" << first->table() << "` (" <<
+					first->field_list() << ") VALUES (" <<
+					first->value_list() << ')';
+
+			// Now insert any remaining container elements.  Be careful
+			// hacking on the iterator use here: we want it to work
+			// with containers providing only a forward iterator.
+			Iter it = first;
+			while (++it != last) {
+				LIBTABULA_QUERY_THISPTR << ",(" << it->value_list() << ')';
+			}
+
+			LIBTABULA_QUERY_THISPTR << upsert_clause(*first);
+		}
+
+		return *this;
+	}
+
+	/// \brief Insert multiple new rows or update existing ones, using
+	/// an insert policy to control how the statements are created
+	/// using items from an STL container.
+	///
+	/// This is to upsert(Iter, Iter) as insertfrom() is to
+	/// insert(Iter, Iter).  The policy is told about the \c ON
+	/// \c DUPLICATE \c KEY \c UPDATE clause's length up front, so
+	/// size-based policies keep the whole statement within their
+	/// limits.
+	///
+	/// \param first iterator pointing to first element in range to
+	///    insert/update
+	/// \param last iterator pointing to one past the last element to
+	///    insert/update
+	/// \param policy insert policy object, see insertpolicy.h for
+	/// details
+	///
+	/// \sa insertfrom(), replacefrom(), upsert()
+	template <class Iter, class InsertPolicy>
+	Query& upsertfrom(Iter first, Iter last, InsertPolicy& policy)
+	{
+		bool success = true;
+		bool empty = true;
+
+		reset();
+
+		if (first == last) {
+			return *this;   // empty set!
+		}
+
+		const std::string update = upsert_clause(*first);
+		prepare_policy(policy);
+		typename InsertPolicy::access_controller ac(*conn_);
+
+		for (Iter it = first; it != last; ++it) {
+			int size = empty ? 0 : int(tellp()) + int(update.size());
+			if (policy.can_add(size, *it)) {
+				if (empty) {
+					LIBTABULA_QUERY_THISPTR << std::setprecision(16) <<
+						"INSERT INTO `" << it->table() << "` (" <<
+						it->field_list() << ") VALUES (";
+				}
+				else {
+					LIBTABULA_QUERY_THISPTR << ",(";
+				}
+
+				LIBTABULA_QUERY_THISPTR << it->value_list() << ')';
+
+				empty = false;
+			}
+			else {
+				// Execute what we've built up already, if there is anything
+				if (!empty) {
+					LIBTABULA_QUERY_THISPTR << update;
+					if (!exec_batch(policy)) {
+						success = false;
+						break;
+					}
+
+					empty = true;
+				}
+
+				// If we _still_ can't add, the policy is too strict
+				if (policy.can_add(0, *it)) {
+					LIBTABULA_QUERY_THISPTR << std::setprecision(16) <<
+						"INSERT INTO `" << it->table() << "` (" <<
+						it->field_list() << ") VALUES (" <<
+						it->value_list() << ')';
+
+					empty = false;
+				}
+				else {
+					// At this point all we can do is give up
+					if (throw_exceptions()) {
+						throw BadInsertPolicy("Insert policy is too strict");
+					}
+
+					success = false;
+					break;
+				}
+			}
+		}
+
+		// We might need to execute the last query here.
+		if (success && !empty) {
+			LIBTABULA_QUERY_THISPTR << update;
+			if (!exec_batch(policy)) {
+				success = false;
+			}
+		}
+
+		if (success) {
+			ac.commit();
+		}
+		else {
+			ac.rollback();
+		}
+
+		return *this;
+	}
+
+	/// \brief Delete the rows matching a range of SSQLS objects, in
+	/// chunks
+	///
+	/// This builds statements like <tt>DELETE FROM `t` WHERE `id` IN
+	/// (1,2,3)</tt> from the key fields of the objects in the range,
+	/// or <tt>WHERE (`a`,`b`) IN ((1,'x'),(2,'y'))</tt> if the SSQLS has
+	/// a compound key.  The insert policy decides how many keys go into
+	/// each statement, just as it decides how many rows go into each
+	/// statement with insertfrom(), so a large key set won't run into
+	/// the server's packet size limit.
+	///
+	/// The policy's access controller decides how the chunks are
+	/// grouped into transactions.  With Transaction, it's all or
+	/// nothing.  With NoTransaction, each chunk commits on its own,
+	/// so no single statement holds its row locks for long.
+	///
+	/// \param first iterator pointing to first object whose row is to
+	///    be deleted
+	/// \param last iterator pointing to one past the last object whose
+	///    row is to be deleted
+	/// \param policy insert policy object, see insertpolicy.h for
+	///    details
+	/// \param chunks if not 0, rows affected by each statement sent
+	///    are stored here
+	///
+	/// \return total rows affected
+	///
+	/// \sa update_where_in()
+	template <class Iter, class InsertPolicy>
+	ulonglong remove_from(Iter first, Iter last, InsertPolicy& policy,
+			std::vector<ulonglong>* chunks = 0)
+	{
+		if (first == last) {
+			reset();
+			if (chunks) chunks->clear();
+			return 0;   // empty set!
+		}
+
+		std::ostringstream head;
+		head << "DELETE FROM `" << first->table() << "` WHERE " <<
+				key_column(*first) << " IN (";
+		return keyed_batches(first, last, policy, head.str(), chunks);
+	}
+
+	/// \brief Update the rows matching a range of SSQLS objects, in
+	/// chunks
+	///
+	/// This is like remove_from(), except that it builds statements
+	/// like <tt>UPDATE `t` SET <i>set</i> WHERE `id` IN (1,2,3)</tt>.
+	/// Only the objects' key fields are used; every matching row gets
+	/// the same change.
+	///
+	/// \param first iterator pointing to first object whose row is to
+	///    be updated
+	/// \param last iterator pointing to one past the last object whose
+	///    row is to be updated
+	/// \param set the SET clause, such as <tt>"status = 'done'"</tt>
+	/// \param policy insert policy object, see insertpolicy.h for
+	///    details
+	/// \param chunks if not 0, rows affected by each statement sent
+	///    are stored here
+	///
+	/// \return total rows affected
+	///
+	/// \sa remove_from()
+	template <class Iter, class InsertPolicy>
+	ulonglong update_where_in(Iter first, Iter last, const std::string& set,
+			InsertPolicy& policy, std::vector<ulonglong>* chunks = 0)
+	{
+		if (first == last) {
+			reset();
+			if (chunks) chunks->clear();
+			return 0;   // empty set!
+		}
+
+		std::ostringstream head;
+		head << "UPDATE `" << first->table() << "` SET " << set <<
+				" WHERE " << key_column(*first) << " IN (";
+		return keyed_batches(first, last, policy, head.str(), chunks);
+	}
+
 #if !defined(DOXYGEN_IGNORE)
 	// Declare the remaining overloads.  These are hidden down here partly
 	// to keep the above code clear, but also so that we may hide them
@@ -1302,6 +1815,10 @@ private:
 	/// \brief If true, last query succeeded
 	bool copacetic_;
 
+	/// \brief Limits given to set_result_limits()
+	ulonglong max_rows_;
+	ulonglong max_bytes_;
+
 	/// \brief List of template query parameters
 	std::vector<SQLParseElement> parse_elems_;
 
@@ -1315,6 +1832,298 @@ private:
 	/// \brief String buffer for storing assembled query
 	std::stringbuf sbuffer_;
 
+	/// \brief Build the ON DUPLICATE KEY UPDATE clause for upsert()
+	/// and upsertfrom()
+	///
+	/// Each non-key field is set to the value the statement tried to
+	/// insert.  If every field is a key field, we name the first key
+	/// field instead, making the update a no-op.
+	template <class T>
+	static std::string upsert_clause(const T& v)
+	{
+		std::ostringstream fields, keys;
+		fields << v.field_list();
+		keys << ',' << v.field_list(",", sql_use_compare) << ',';
+		const std::string all = fields.str(), key = keys.str();
+
+		std::string clause;
+		size_t start = 0;
+		while (start < all.size()) {
+			size_t end = all.find(',', start);
+			if (end == std::string::npos) end = all.size();
+			std::string f = all.substr(start, end - start);
+			if (key.find(',' + f + ',') == std::string::npos) {
+				clause += clause.empty() ? " ON DUPLICATE KEY UPDATE " : ",";
+				clause += f + " = VALUES(" + f + ')';
+			}
+			start = end + 1;
+		}
+
+		if (clause.empty()) {
+			std::string f = key.substr(1, key.find(',', 1) - 1);
+			clause = " ON DUPLICATE KEY UPDATE " + f + " = " + f;
+		}
+		return clause;
+	}
+
+	/// \brief Returns the key field list for remove_from() and
+	/// update_where_in(), in parentheses if there's more than one
+	template <class T>
+	static std::string key_column(const T& v)
+	{
+		std::ostringstream os;
+		os << v.field_list(",", sql_use_compare);
+		std::string keys = os.str();
+		return keys.find(',') == std::string::npos ? keys :
+				'(' + keys + ')';
+	}
+
+	/// \brief Send the statements for remove_from() and
+	/// update_where_in()
+	///
+	/// Each statement is \c head followed by a comma-separated list of
+	/// key values and a closing parenthesis.
+	template <class Iter, class InsertPolicy>
+	ulonglong keyed_batches(Iter first, Iter last, InsertPolicy& policy,
+			const std::string& head, std::vector<ulonglong>* chunks)
+	{
+		bool success = true;
+		bool empty = true;
+		bool compound = key_column(*first)[0] == '(';
+		ulonglong total = 0;
+
+		reset();
+		if (chunks) chunks->clear();
+
+		prepare_policy(policy);
+		typename InsertPolicy::access_controller ac(*conn_);
+
+		for (Iter it = first; it != last; ++it) {
+			int size = empty ? 0 : int(tellp()) + 1;
+			if (!policy.can_add(size, *it)) {
+				// Execute what we've built up already, if there is anything
+				if (!empty) {
+					if (!exec_keyed_batch(policy, total, chunks)) {
+						success = false;
+						break;
+					}
+
+					empty = true;
+				}
+
+				// If we _still_ can't add, the policy is too strict
+				if (!policy.can_add(0, *it)) {
+					if (throw_exceptions()) {
+						throw BadInsertPolicy("Insert policy is too strict");
+					}
+
+					success = false;
+					break;
+				}
+			}
+
+			if (empty) {
+				LIBTABULA_QUERY_THISPTR << std::setprecision(16) << head;
+			}
+			else {
+				LIBTABULA_QUERY_THISPTR << ',';
+			}
+
+			if (compound) {
+				LIBTABULA_QUERY_THISPTR << '(' <<
+						it->value_list(",", sql_use_compare) << ')';
+			}
+			else {
+				LIBTABULA_QUERY_THISPTR <<
+						it->value_list(",", sql_use_compare);
+			}
+
+			empty = false;
+		}
+
+		// We might need to execute the last query here.
+		if (success && !empty && !exec_keyed_batch(policy, total, chunks)) {
+			success = false;
+		}
+
+		if (success) {
+			ac.commit();
+		}
+		else {
+			ac.rollback();
+		}
+
+		return total;
+	}
+
+	/// \brief Close and execute one statement built by keyed_batches(),
+	/// and add up the rows it affected
+	template <class InsertPolicy>
+	bool exec_keyed_batch(InsertPolicy& policy, ulonglong& total,
+			std::vector<ulonglong>* chunks)
+	{
+		LIBTABULA_QUERY_THISPTR << ')';
+		if (!exec_batch(policy)) return false;
+
+		ulonglong rows = affected_rows();
+		total += rows;
+		if (chunks) chunks->push_back(rows);
+		return true;
+	}
+
+	/// \brief Returns true if insertfrom() can send its batches as
+	/// parameter arrays instead of INSERT statement text
+	bool array_binding() const;
+
+	/// \brief Run a statement once for each row of \c params through
+	/// the connection's StatementCache, handling errors as exec() does
+	bool exec_array(const std::string& sql, const ParamArray& params);
+
+	/// \brief Add an SSQLS's field values to a ParamArray as one row
+	template <class T>
+	static void add_array_row(const T& v, ParamArray& params)
+	{
+		// value_list() wants a stream, but the manipulator sends each
+		// value to the ParamArray instead, so nothing gets written.
+		std::ostringstream unused;
+		unused << v.value_list("", param_array_type0(&params));
+	}
+
+	/// \brief The insertfrom() implementation used when the driver
+	/// supports array binding
+	template <class Iter, class InsertPolicy>
+	Query& insertfrom_array(Iter first, Iter last, InsertPolicy& policy)
+	{
+		// Build the statement, with a placeholder for each field
+		ParamArray probe;
+		add_array_row(*first, probe);
+		ParamArray params(probe.values());
+		std::ostringstream stmt;
+		stmt << "INSERT INTO `" << first->table() << "` (" <<
+				first->field_list() << ") VALUES (";
+		for (size_t i = 0; i < params.columns(); ++i) {
+			stmt << (i ? ",?" : "?");
+		}
+		stmt << ')';
+		const std::string sql(stmt.str());
+
+		bool success = true;
+		prepare_policy(policy);
+		typename InsertPolicy::access_controller ac(*conn_);
+
+		for (Iter it = first; it != last; ++it) {
+			if (!policy.can_add(array_batch_size(sql, params), *it)) {
+				// Execute what we've built up already, if anything
+				if (!params.empty()) {
+					if (!exec_array_batch(policy, sql, params)) {
+						success = false;
+						break;
+					}
+					params.clear();
+				}
+
+				// If we _still_ can't add, the policy is too strict
+				if (!policy.can_add(0, *it)) {
+					if (throw_exceptions()) {
+						throw BadInsertPolicy("Insert policy is too strict");
+					}
+
+					success = false;
+					break;
+				}
+			}
+
+			add_array_row(*it, params);
+		}
+
+		// We might need to execute the last batch here.
+		if (success && !params.empty() &&
+				!exec_array_batch(policy, sql, params)) {
+			success = false;
+		}
+
+		if (success) {
+			ac.commit();
+		} 
+		else {
+			ac.rollback();
+		}
+
+		return *this;
+	}
+
+	/// \brief Returns the size insertfrom_array() gives its policy for
+	/// the batch built so far, 0 if there's nothing in it yet, like
+	/// the INSERT statement text path would
+	static int array_batch_size(const std::string& sql,
+			const ParamArray& params)
+	{
+		return params.empty() ? 0 : int(sql.size() + params.bytes());
+	}
+
+	/// \brief Execute one batch built by insertfrom_array(), and tell
+	/// the policy how it went
+	template <class InsertPolicy>
+	bool exec_array_batch(InsertPolicy& policy, const std::string& sql,
+			const ParamArray& params)
+	{
+		size_t bytes = size_t(array_batch_size(sql, params));
+		Stopwatch timer;
+		if (!exec_array(sql, params)) return false;
+		policy_executed(policy, bytes, timer.elapsed());
+		return true;
+	}
+
+	/// \brief Execute one statement built by insertfrom() or
+	/// replacefrom(), and tell the policy how it went
+	template <class InsertPolicy>
+	bool exec_batch(InsertPolicy& policy)
+	{
+		size_t bytes = size_t(tellp());
+		Stopwatch timer;
+		if (!exec()) return false;
+		policy_executed(policy, bytes, timer.elapsed());
+		return true;
+	}
+
+	/// \brief Give an insert policy what it needs from the server
+	/// before insertfrom() or replacefrom() starts using it
+	///
+	/// Only AdaptiveInsertPolicy needs anything, so this does nothing.
+	template <class InsertPolicy>
+	void prepare_policy(InsertPolicy&) { }
+
+	/// \brief Look up the server's packet size limit for an
+	/// AdaptiveInsertPolicy, if it wasn't given one
+	template <class AccessController>
+	void prepare_policy(AdaptiveInsertPolicy<AccessController>& policy)
+	{
+		if (!policy.max_packet_known()) {
+			if (ulonglong max = max_allowed_packet()) {
+				policy.set_max_packet(size_t(max));
+			}
+		}
+	}
+
+	/// \brief Calls Connection::max_allowed_packet(), which we can't
+	/// do inline since Connection isn't declared yet
+	ulonglong max_allowed_packet();
+
+	/// \brief Tell an insert policy about an executed statement
+	///
+	/// Only AdaptiveInsertPolicy cares, so this does nothing.
+	template <class InsertPolicy>
+	static void policy_executed(InsertPolicy&, size_t, ulonglong) { }
+
+	/// \brief Tell an AdaptiveInsertPolicy about an executed statement
+	template <class AccessController>
+	static void policy_executed(
+			AdaptiveInsertPolicy<AccessController>& policy, size_t bytes,
+			ulonglong usec)
+	{
+		policy.executed(bytes, usec);
+	}
+
 	/// \brief Process a parameterized query list.
 	void proc(SQLQueryParms& p);
 
@@ -0,0 +1,263 @@
+/***********************************************************************
+ querystats.cpp - Implements the Histogram and QueryStats classes.
+
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#define LIBTABULA_NOT_HEADER
+#include "querystats.h"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace libtabula {
+
+// Histogram buckets: values below sub_buckets get one each, and each
+// power of two above that is split into sub_buckets of them
+static const unsigned sub_bits = 5;
+static const ulonglong sub_buckets = 1 << sub_bits;
+
+
+// Orders statements by total execution time, longest first
+struct BusiestFirst
+{
+	bool operator()(const QueryStats::Statement& a,
+			const QueryStats::Statement& b) const
+	{
+		return a.latency.total() > b.latency.total();
+	}
+};
+
+
+//// Histogram /////////////////////////////////////////////////////////
+
+size_t
+Histogram::bucket(ulonglong value)
+{
+	if (value < sub_buckets) return size_t(value);
+
+	// Keep the top sub_bits + 1 bits of the value: the leading 1 picks
+	// the power of two, and the rest pick the bucket within it
+	unsigned shift = 0;
+	while ((value >> shift) >= 2 * sub_buckets) ++shift;
+	return size_t((shift + 1) * sub_buckets +
+			(value >> shift) - sub_buckets);
+}
+
+
+ulonglong
+Histogram::bucket_top(size_t index)
+{
+	if (index < sub_buckets) return index;
+
+	unsigned shift = unsigned(index / sub_buckets - 1);
+	ulonglong leading = index % sub_buckets + sub_buckets;
+	return ((leading + 1) << shift) - 1;
+}
+
+
+void
+Histogram::clear()
+{
+	counts_.clear();
+	count_ = total_ = min_ = max_ = 0;
+}
+
+
+void
+Histogram::merge(const Histogram& other)
+{
+	if (other.count_ == 0) return;
+
+	if (counts_.size() < other.counts_.size()) {
+		counts_.resize(other.counts_.size());
+	}
+	for (size_t i = 0; i < other.counts_.size(); ++i) {
+		counts_[i] += other.counts_[i];
+	}
+
+	if (count_ == 0 || other.min_ < min_) min_ = other.min_;
+	if (other.max_ > max_) max_ = other.max_;
+	count_ += other.count_;
+	total_ += other.total_;
+}
+
+
+ulonglong
+Histogram::percentile(double pct) const
+{
+	if (count_ == 0) return 0;
+
+	// Find the bucket holding the value ranked pct percent of the way
+	// up, counting from 1
+	double rank = pct / 100 * count_;
+	ulonglong want = rank < 1 ? 1 : ulonglong(rank);
+	if (want < rank) ++want;
+	if (want > count_) want = count_;
+
+	ulonglong seen = 0;
+	for (size_t i = 0; i < counts_.size(); ++i) {
+		seen += counts_[i];
+		if (seen >= want) return std::min(bucket_top(i), max_);
+	}
+	return max_;
+}
+
+
+void
+Histogram::record(ulonglong value)
+{
+	size_t i = bucket(value);
+	if (i >= counts_.size()) counts_.resize(i + 1);
+	++counts_[i];
+
+	if (count_ == 0 || value < min_) min_ = value;
+	if (value > max_) max_ = value;
+	++count_;
+	total_ += value;
+}
+
+
+//// QueryStats ////////////////////////////////////////////////////////
+
+Histogram
+QueryStats::grab_latency() const
+{
+	ScopedLock lock(mutex_);
+	return grab_latency_;
+}
+
+
+Histogram
+QueryStats::hold_time() const
+{
+	ScopedLock lock(mutex_);
+	return hold_time_;
+}
+
+
+void
+QueryStats::observe(const QueryEvent& ev)
+{
+	// Timeline events add nothing to the totals we keep, and ev_row
+	// comes too often to be worth taking the lock for
+	if (ev.kind == QueryEvent::ev_query ||
+			ev.kind == QueryEvent::ev_first_row ||
+			ev.kind == QueryEvent::ev_row) {
+		return;
+	}
+
+	Fingerprint fp;
+	if (ev.kind == QueryEvent::ev_execute && ev.sql) {
+		fp = Fingerprint(ev.sql, ev.sql_length);
+	}
+
+	ScopedLock lock(mutex_);
+
+	switch (ev.kind) {
+		case QueryEvent::ev_execute: {
+			Statement& s = statement(fp);
+			++s.calls;
+			if (ev.errnum) ++s.errors;
+			s.bytes += ev.bytes;
+			s.rows += ev.rows;
+			s.latency.record(ev.elapsed);
+			last_[ev.driver] = &s;
+			break;
+		}
+
+		case QueryEvent::ev_store:
+		case QueryEvent::ev_use:
+		case QueryEvent::ev_fetch: {
+			// Charge the rows to whatever the driver ran last
+			DriverMap::iterator it = last_.find(ev.driver);
+			if (it != last_.end()) {
+				Statement& s = *it->second;
+				if (ev.errnum) ++s.errors;
+				s.rows += ev.rows;
+				s.fetch_time += ev.elapsed;
+			}
+			break;
+		}
+
+		case QueryEvent::ev_grab:
+			grab_latency_.record(ev.elapsed);
+			break;
+
+		case QueryEvent::ev_release:
+			if (ev.elapsed) hold_time_.record(ev.elapsed);
+			break;
+
+		default:
+			break;
+	}
+}
+
+
+void
+QueryStats::reset()
+{
+	ScopedLock lock(mutex_);
+	statements_.clear();
+	last_.clear();
+	grab_latency_.clear();
+	hold_time_.clear();
+}
+
+
+QueryStats::Statement&
+QueryStats::statement(const Fingerprint& fp)
+{
+	StatementMap::iterator it = statements_.find(fp.digest());
+	if (it != statements_.end()) return it->second;
+
+	// New statement.  If there's no room for it, lump it in with the
+	// other overflow, under digest 0 and the empty string.
+	if (statements_.size() >= max_statements_) {
+		return statements_[0];
+	}
+	Statement& s = statements_[fp.digest()];
+	s.sql = fp.text();
+	s.digest = fp.digest();
+	return s;
+}
+
+
+vector<QueryStats::Statement>
+QueryStats::statements() const
+{
+	vector<Statement> v;
+	{
+		ScopedLock lock(mutex_);
+		v.reserve(statements_.size());
+		for (StatementMap::const_iterator it = statements_.begin();
+				it != statements_.end(); ++it) {
+			v.push_back(it->second);
+		}
+	}
+
+	stable_sort(v.begin(), v.end(), BusiestFirst());
+	return v;
+}
+
+} // end namespace libtabula
@@ -0,0 +1,210 @@
+/// \file querystats.h
+/// \brief Declares the QueryStats class, a QueryObserver that keeps
+/// latency histograms for each statement, and the Histogram class it
+/// keeps them in.
+
+/***********************************************************************
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#if !defined(LIBTABULA_QUERYSTATS_H)
+#define LIBTABULA_QUERYSTATS_H
+
+#include "common.h"
+
+#include "beemutex.h"
+#include "fingerprint.h"
+#include "observer.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace libtabula {
+
+/// \brief Counts values in logarithmic buckets, for percentiles
+///
+/// This works like an HDR histogram: each power of two is split into
+/// 32 buckets, so any value read back, such as a percentile, is within
+/// about 3% of a value that was recorded, over the whole range of a
+/// 64-bit integer.  Values below 32 are counted exactly.  Buckets are
+/// only allocated up to the largest value seen, so a histogram of
+/// query times in microseconds takes a few kilobytes at most.
+class LIBTABULA_EXPORT Histogram
+{
+public:
+	/// \brief Create an empty histogram
+	Histogram() :
+	count_(0),
+	total_(0),
+	min_(0),
+	max_(0)
+	{
+	}
+
+	/// \brief Count one value
+	void record(ulonglong value);
+
+	/// \brief Add another histogram's counts to this one's
+	void merge(const Histogram& other);
+
+	/// \brief Forget all the values recorded so far
+	void clear();
+
+	/// \brief Returns the number of values recorded
+	ulonglong count() const { return count_; }
+
+	/// \brief Returns the sum of the values recorded
+	ulonglong total() const { return total_; }
+
+	/// \brief Returns the smallest value recorded, or 0 if none
+	ulonglong min() const { return min_; }
+
+	/// \brief Returns the largest value recorded, or 0 if none
+	ulonglong max() const { return max_; }
+
+	/// \brief Returns the mean of the values recorded, or 0 if none
+	double mean() const { return count_ ? double(total_) / count_ : 0; }
+
+	/// \brief Returns the value at the given percentile
+	///
+	/// This is the top of the bucket holding the value that \c pct
+	/// percent of the recorded values are at or below, so
+	/// \c percentile(50) is the median and \c percentile(100) is the
+	/// same as max().  Returns 0 if no values have been recorded.
+	ulonglong percentile(double pct) const;
+
+private:
+	/// \brief Returns the index of the bucket a value goes in
+	static size_t bucket(ulonglong value);
+
+	/// \brief Returns the largest value that goes in a bucket
+	static ulonglong bucket_top(size_t index);
+
+	std::vector<ulonglong> counts_;
+	ulonglong count_;
+	ulonglong total_;
+	ulonglong min_;
+	ulonglong max_;
+};
+
+
+/// \brief A QueryObserver that keeps statistics on each statement
+///
+/// Install one of these to find out which statements a program runs,
+/// how often, and how long they take:
+///
+/// \code
+///   libtabula::QueryStats stats;
+///   libtabula::QueryObserver::install(&stats);
+///   ...
+///   std::vector<libtabula::QueryStats::Statement> s = stats.statements();
+///   for (size_t i = 0; i < s.size(); ++i) {
+///       std::cout << s[i].latency.percentile(99) << " us: " <<
+///               s[i].sql << std::endl;
+///   }
+/// \endcode
+///
+/// Statements are grouped by their Fingerprint, so queries that
+/// differ only in their literal values count as one statement.  A
+/// program that builds its SQL some other way, such as with names
+/// chosen at run time, can still produce any number of distinct
+/// statements, so past \c max_statements of them, the rest are
+/// lumped together under an empty \c sql string.
+///
+/// All the methods are thread-safe.  Each executed query costs a
+/// fingerprint, worked out before taking the lock; after that, each
+/// event costs one lock of a mutex and a map lookup.
+class LIBTABULA_EXPORT QueryStats : public QueryObserver
+{
+public:
+	/// \brief What's known about one statement
+	struct Statement
+	{
+		std::string sql;		///< the statement's normalized text
+		ulonglong digest;		///< Fingerprint::digest() of the text
+		ulonglong calls;		///< times executed
+		ulonglong errors;		///< times it failed
+		ulonglong bytes;		///< bytes of SQL sent
+		ulonglong rows;			///< rows returned or affected
+		ulonglong fetch_time;	///< microseconds storing or fetching rows
+		Histogram latency;		///< microseconds to execute, per call
+
+		Statement() :
+		digest(0),
+		calls(0),
+		errors(0),
+		bytes(0),
+		rows(0),
+		fetch_time(0)
+		{
+		}
+	};
+
+	/// \brief Create the object
+	///
+	/// \param max_statements the most distinct statements to track
+	explicit QueryStats(size_t max_statements = 1000) :
+	max_statements_(max_statements)
+	{
+	}
+
+	/// \brief Record an event
+	void observe(const QueryEvent& ev);
+
+	/// \brief Returns a copy of the statistics for every statement
+	/// seen so far, busiest first by total execution time
+	std::vector<Statement> statements() const;
+
+	/// \brief Returns a histogram of how long ConnectionPool::grab()
+	/// calls took
+	Histogram grab_latency() const;
+
+	/// \brief Returns a histogram of how long connections were held
+	/// between ConnectionPool::grab() and release()
+	Histogram hold_time() const;
+
+	/// \brief Forget everything recorded so far
+	void reset();
+
+private:
+	typedef std::map<ulonglong, Statement> StatementMap;
+	typedef std::map<const DBDriver*, Statement*> DriverMap;
+
+	// Returns the entry for a statement
+	Statement& statement(const Fingerprint& fp);
+
+	size_t max_statements_;
+	StatementMap statements_;
+	DriverMap last_;		///< statement last executed on each driver
+	Histogram grab_latency_;
+	Histogram hold_time_;
+	mutable BeecryptMutex mutex_;
+
+	// Not copyable
+	QueryStats(const QueryStats&);
+	QueryStats& operator=(const QueryStats&);
+};
+
+} // end namespace libtabula
+
+#endif // !defined(LIBTABULA_QUERYSTATS_H)
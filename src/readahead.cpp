@@ -0,0 +1,187 @@
+/***********************************************************************
+ readahead.cpp - Implements the ReadAheadResult class.
+
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#define LIBTABULA_NOT_HEADER
+#include "readahead.h"
+
+#include "dbdriver.h"
+
+namespace libtabula {
+
+
+ReadAheadResult::ReadAheadResult(const UseQueryResult& res,
+		size_t batch_rows, size_t batches) :
+OptionalExceptions(res.throw_exceptions()),
+res_(res),
+batch_rows_(batch_rows ? batch_rows : 1),
+ring_(batches < 2 ? 2 : batches),
+head_(0),
+filled_(0),
+done_(false),
+cancelled_(false),
+consumer_waits_(0),
+producer_waits_(0),
+pos_(0),
+holding_(false),
+thread_(*this)
+{
+	// A failed query gives us a result set with no impl, and we can't
+	// do anything without threads.  fetch_row() handles both cases by
+	// passing through to the wrapped result set.
+	if (res_ && res_.driver() && Thread::supported()) {
+		thread_.start();
+	}
+}
+
+
+ReadAheadResult::~ReadAheadResult()
+{
+	cancel();
+}
+
+
+void
+ReadAheadResult::cancel()
+{
+	if (thread_.running()) {
+		{
+			ScopedLock lock(mutex_);
+			cancelled_ = true;
+			space_ready_.signal();
+		}
+		thread_.join();
+	}
+	else {
+		cancelled_ = true;
+	}
+}
+
+
+Row
+ReadAheadResult::fetch_row()
+{
+	if (!thread_.running()) {
+		// Either we never started the thread, or we've already joined
+		// it; see the bottom of this function.
+		if (done_ || cancelled_) {
+			if (!error_.empty() && !cancelled_ && throw_exceptions()) {
+				throw UseQueryError(error_.c_str());
+			}
+			return Row();
+		}
+		else if (throw_exceptions()) {
+			return res_.fetch_row();
+		}
+		else {
+			NoExceptions ne(res_);
+			return res_.fetch_row();
+		}
+	}
+
+	for (;;) {
+		if (holding_) {
+			const RowBatch& b = ring_[head_];
+			if (pos_ < b.size()) {
+				return b.row(pos_++, res_.field_names(),
+						*res_.field_types(), throw_exceptions());
+			}
+
+			// Finished with this batch, so hand it back to the reader
+			ScopedLock lock(mutex_);
+			head_ = (head_ + 1) % ring_.size();
+			--filled_;
+			holding_ = false;
+			space_ready_.signal();
+		}
+
+		{
+			ScopedLock lock(mutex_);
+			while (filled_ == 0 && !done_) {
+				++consumer_waits_;
+				data_ready_.wait(mutex_);
+			}
+			if (filled_ > 0) {
+				holding_ = true;
+				pos_ = 0;
+				continue;
+			}
+		}
+
+		// Ring is empty and the reader is done, so reap it and report
+		// its status through the not-running path above.
+		thread_.join();
+		return fetch_row();
+	}
+}
+
+
+void
+ReadAheadResult::run()
+{
+	DBDriver* driver = res_.driver();
+	driver->thread_start();
+
+	for (;;) {
+		size_t slot;
+		{
+			ScopedLock lock(mutex_);
+			while (filled_ == ring_.size() && !cancelled_) {
+				++producer_waits_;
+				space_ready_.wait(mutex_);
+			}
+			if (cancelled_) break;
+			slot = (head_ + filled_) % ring_.size();
+		}
+
+		// We own ring_[slot] until we bump filled_, so we can fill it
+		// without holding the lock.  That's the whole point.
+		RowBatch& b = ring_[slot];
+		bool more;
+		std::string error;
+		try {
+			more = b.fill(res_, batch_rows_);
+			if (!more && driver->errnum()) {
+				error = driver->error();
+			}
+		}
+		catch (const std::exception& e) {
+			more = false;
+			error = e.what();
+		}
+
+		ScopedLock lock(mutex_);
+		if (!b.empty()) ++filled_;
+		if (!more) {
+			done_ = true;
+			error_ = error;
+		}
+		data_ready_.signal();
+		if (!more) break;
+	}
+
+	driver->thread_end();
+}
+
+} // end namespace libtabula
@@ -0,0 +1,162 @@
+/// \file readahead.h
+/// \brief Declares the ReadAheadResult class, which fetches the rows
+/// of a "use" query on a background thread.
+
+/***********************************************************************
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#if !defined(LIBTABULA_READAHEAD_H)
+#define LIBTABULA_READAHEAD_H
+
+#include "common.h"
+
+#include "beemutex.h"
+#include "noexceptions.h"
+#include "result.h"
+#include "rowbatch.h"
+#include "thread.h"
+
+#include <string>
+#include <vector>
+
+namespace libtabula {
+
+/// \brief Wraps a UseQueryResult, reading rows from the server on a
+/// background thread while the caller processes earlier rows.
+///
+/// Plain UseQueryResult::fetch_row() reads each row from the network
+/// on demand, so the socket sits idle while your code processes a row,
+/// and your code sits idle while the next row arrives.  This class
+/// overlaps the two: a background thread pulls raw rows from the DBMS
+/// into a bounded ring of row batches, while your thread turns the
+/// previous batch into Row objects.  When the ring is full, the
+/// background thread waits for you to catch up, so memory use is
+/// bounded by \c batch_rows times \c batches rows.
+///
+/// The background thread only copies raw field data.  All Row objects
+/// are built on the thread calling fetch_row(), because they share the
+/// result set's reference-counted FieldNames list, which isn't safe to
+/// touch from two threads at once.
+///
+/// You must not use the Connection the result set came from until
+/// this object is destroyed or cancel() returns.  That's no different
+/// from the rules for UseQueryResult itself, just easier to forget
+/// when another thread is doing the reading.
+///
+/// If you stop fetching rows before the end of the result set, the
+/// dtor or cancel() stops the background thread cleanly.  The rows it
+/// didn't read stay with the C API, which discards them when the last
+/// copy of the UseQueryResult goes away, just as if you'd stopped
+/// early using UseQueryResult directly.
+///
+/// If the library was built without thread support, this class falls
+/// back to calling UseQueryResult::fetch_row() directly.
+///
+/// \sa Query::for_each_read_ahead()
+class LIBTABULA_EXPORT ReadAheadResult : public OptionalExceptions,
+		private Thread::Runnable
+{
+public:
+	/// \brief Start reading ahead on the given result set
+	///
+	/// \param res the result set to read from; we keep a copy of it,
+	///     so the object you pass can go away before we do
+	/// \param batch_rows number of rows to read per batch
+	/// \param batches number of batches in the ring; values below 2
+	///     are treated as 2, since that's the smallest ring that lets
+	///     the two threads work at the same time
+	ReadAheadResult(const UseQueryResult& res, size_t batch_rows = 256,
+			size_t batches = 2);
+
+	/// \brief Stop the background thread and destroy the object
+	~ReadAheadResult();
+
+	/// \brief Returns the next row in the result set
+	///
+	/// Returns a falsy Row at the end of the result set.  If the
+	/// background thread hit an error, you get UseQueryError at the
+	/// end of the rows it did manage to fetch, unless exceptions are
+	/// disabled, in which case it just looks like the end of the
+	/// result set.  Call error() to tell the two apart.
+	Row fetch_row();
+
+	/// \brief Stop reading ahead
+	///
+	/// Blocks until the background thread notices and exits, which is
+	/// never longer than the time it takes to finish the batch it's
+	/// working on.  Subsequent fetch_row() calls return a falsy Row.
+	void cancel();
+
+	/// \brief Returns the error message the background thread stopped
+	/// on, or an empty string if there was none
+	const std::string& error() const { return error_; }
+
+	/// \brief Returns the wrapped result set, for access to its field
+	/// information
+	const UseQueryResult& result() const { return res_; }
+
+	/// \brief Returns the number of times fetch_row() had to wait for
+	/// the background thread to fill a batch
+	///
+	/// If this is high relative to the number of batches read, your
+	/// code is outrunning the network, and read-ahead isn't buying
+	/// much.  If consumer_waits() is low but producer_waits() is high,
+	/// the ring is full most of the time and you might as well shrink
+	/// it to save memory.
+	ulonglong consumer_waits() const { return consumer_waits_; }
+
+	/// \brief Returns the number of times the background thread had
+	/// to wait for fetch_row() to free up a slot in the ring
+	ulonglong producer_waits() const { return producer_waits_; }
+
+private:
+	ReadAheadResult(const ReadAheadResult&);				// can't copy
+	ReadAheadResult& operator =(const ReadAheadResult&);	// can't assign
+
+	/// \brief Body of the background thread
+	void run();
+
+	UseQueryResult res_;		///< the result set we're reading
+	size_t batch_rows_;			///< rows per batch
+	std::vector<RowBatch> ring_;	///< the batch ring
+
+	BeecryptMutex mutex_;		///< guards everything below
+	Condition data_ready_;		///< signalled when a batch is filled
+	Condition space_ready_;		///< signalled when a batch is freed
+	size_t head_;				///< index of the oldest filled batch
+	size_t filled_;				///< number of filled batches
+	bool done_;					///< background thread has finished
+	bool cancelled_;			///< consumer asked thread to stop
+	std::string error_;			///< why the background thread stopped
+	ulonglong consumer_waits_;
+	ulonglong producer_waits_;
+
+	size_t pos_;				///< consumer's next row within ring_[head_]
+	bool holding_;				///< consumer is working on ring_[head_]
+
+	Thread thread_;				///< the background reader
+};
+
+} // end namespace libtabula
+
+#endif // !defined(LIBTABULA_READAHEAD_H)
@@ -0,0 +1,819 @@
+/***********************************************************************
+ replaydriver.cpp - Implements the ReplayDriver class.
+
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#define LIBTABULA_NOT_HEADER
+#include "replaydriver.h"
+
+#include "binio.h"
+#include "exceptions.h"
+#include "result.h"
+#include "row.h"
+#include "sqlstream.h"
+
+#include <stdio.h>
+#include <string.h>
+
+using namespace std;
+
+namespace libtabula {
+
+static const char magic[] = "LTREPLAY";
+static const size_t magic_length = 8;
+
+// Length we record for SQL nulls
+static const unsigned long null_length = ~0UL;
+
+// Value of current_ when there's no last statement
+static const size_t no_statement = size_t(-1);
+
+// Error number for statements that aren't in the recording; it's the
+// one the MySQL C API uses for errors it can't otherwise classify
+static const int unknown_error = 2000;
+
+// Result set of one recorded statement
+class ReplayDriver::ResultImpl : public ResultBase::Impl
+{
+public:
+	ResultImpl(const RefCountedPointer<Recording>& rec, size_t index) :
+	recording_(rec),
+	index_(index),
+	next_(0)
+	{
+	}
+
+	const char* const* fetch()
+	{
+		const Statement& st = statement();
+		if (next_ >= st.rows.size()) return 0;
+
+		const vector<unsigned long>& lengths = st.lengths[next_];
+		const char* p = st.rows[next_].data();
+		raw_.resize(lengths.size());
+		lengths_.resize(lengths.size());
+		for (size_t i = 0; i < lengths.size(); ++i) {
+			if (lengths[i] == null_length) {
+				raw_[i] = 0;
+				lengths_[i] = 0;
+			}
+			else {
+				raw_[i] = p;
+				lengths_[i] = lengths[i];
+				p += lengths[i] + 1;
+			}
+		}
+
+		++next_;
+		return raw_.empty() ? 0 : &raw_[0];
+	}
+
+	const unsigned long* lengths() const
+	{
+		return lengths_.empty() ? 0 : &lengths_[0];
+	}
+
+	const Statement& statement() const
+	{
+		return recording_->statements[index_];
+	}
+
+private:
+	RefCountedPointer<Recording> recording_;
+	size_t index_;
+	size_t next_;
+	vector<const char*> raw_;
+	vector<unsigned long> lengths_;
+};
+
+
+// Append n to out in decimal, zero-padded to at least width digits
+static void
+put_decimal(string& out, unsigned long n, int width = 1)
+{
+	char buf[24];
+	char* p = buf + sizeof(buf);
+	do {
+		*--p = char('0' + n % 10);
+		n /= 10;
+		--width;
+	}
+	while (n || width > 0);
+	out.append(p, buf + sizeof(buf) - p);
+}
+
+
+ReplayDriver::ReplayDriver(bool te) :
+DBDriver(te),
+live_(0),
+recording_(new Recording),
+next_(0),
+current_(no_statement),
+errnum_(0)
+{
+}
+
+
+ReplayDriver::ReplayDriver(DBDriver* live, bool te) :
+DBDriver(te),
+live_(live),
+recording_(new Recording),
+next_(0),
+current_(no_statement),
+errnum_(0)
+{
+}
+
+
+ReplayDriver::ReplayDriver(DBDriver* live,
+		const RefCountedPointer<Recording>& rec, bool te) :
+DBDriver(te),
+live_(live),
+recording_(rec),
+next_(0),
+current_(no_statement),
+errnum_(0)
+{
+}
+
+
+ReplayDriver::~ReplayDriver()
+{
+	delete live_;
+}
+
+
+void
+ReplayDriver::add(const std::string& sql, ulonglong affected_rows,
+		ulonglong insert_id, int errnum, const std::string& error)
+{
+	recording_->statements.push_back(Statement());
+	Statement& st = recording_->statements.back();
+	st.sql = sql;
+	st.affected_rows = affected_rows;
+	st.insert_id = insert_id;
+	st.errnum = errnum;
+	st.error = error;
+}
+
+
+void
+ReplayDriver::add(const std::string& sql, const StoreQueryResult& res)
+{
+	add(sql, res.num_rows());
+	Statement& st = recording_->statements.back();
+	st.has_result = true;
+	for (size_t i = 0; i < res.num_fields(); ++i) {
+		st.fields.push_back(res.field(static_cast<unsigned int>(i)));
+	}
+
+	st.rows.resize(res.num_rows());
+	st.lengths.resize(res.num_rows());
+	for (size_t r = 0; r < res.num_rows(); ++r) {
+		const Row& row = res[r];
+		for (size_t i = 0; i < res.num_fields(); ++i) {
+			if (row[i].is_null()) {
+				st.lengths[r].push_back(null_length);
+			}
+			else {
+				st.rows[r].append(row[i].data(), row[i].length());
+				st.rows[r] += '\0';
+				st.lengths[r].push_back(
+						static_cast<unsigned long>(row[i].length()));
+			}
+		}
+	}
+}
+
+
+ulonglong
+ReplayDriver::affected_rows()
+{
+	if (live_) return live_->affected_rows();
+	return current_ < size() ?
+			recording_->statements[current_].affected_rows : 0;
+}
+
+
+std::string
+ReplayDriver::client_version() const
+{
+	return live_ ? live_->client_version() : string("libtabula replay");
+}
+
+
+DBDriver*
+ReplayDriver::clone()
+{
+	ReplayDriver* other = new ReplayDriver(live_ ? live_->clone() : 0,
+			recording_, throw_exceptions());
+	other->is_connected_ = live_ ? other->live_->connected() :
+			is_connected_;
+	return other;
+}
+
+
+bool
+ReplayDriver::connect(const char* host, const char* socket_name,
+		unsigned int port, const char* db, const char* user,
+		const char* password)
+{
+	if (live_) {
+		is_connected_ = live_->connect(host, socket_name, port, db, user,
+				password);
+		if (is_connected_) {
+			recording_->server_version = live_->server_version();
+		}
+	}
+	else {
+		is_connected_ = true;
+	}
+	return is_connected_;
+}
+
+
+bool
+ReplayDriver::connection_lost(int errnum) const
+{
+	return live_ && live_->connection_lost(errnum);
+}
+
+
+void
+ReplayDriver::disconnect()
+{
+	if (live_) live_->disconnect();
+	is_connected_ = false;
+}
+
+
+int
+ReplayDriver::errnum()
+{
+	if (errnum_) return errnum_;
+	if (live_) return live_->errnum();
+	return current_ < size() ? recording_->statements[current_].errnum : 0;
+}
+
+
+const char*
+ReplayDriver::error()
+{
+	if (!error_.empty()) return error_.c_str();
+	if (live_) return live_->error();
+	return current_ < size() ?
+			recording_->statements[current_].error.c_str() : "";
+}
+
+
+size_t
+ReplayDriver::escape_string(char* to, const char* from, size_t length)
+{
+	if (live_) return live_->escape_string(to, from, length);
+	return SQLStream::escape_string_generic(to, from, length);
+}
+
+
+size_t
+ReplayDriver::escape_string(std::string* ps, const char* original,
+		size_t length)
+{
+	if (live_) return live_->escape_string(ps, original, length);
+	return SQLStream::escape_string_generic(ps, original, length);
+}
+
+
+bool
+ReplayDriver::execute(const char* qstr, size_t length)
+{
+	errnum_ = 0;
+	error_.clear();
+
+	vector<Statement>& sts = recording_->statements;
+	if (live_) {
+		bool ok = live_->execute(qstr, length);
+		add(string(qstr, length), live_->affected_rows(),
+				live_->insert_id(), live_->errnum(),
+				ok ? string() : string(live_->error()));
+		current_ = sts.size() - 1;
+		next_ = sts.size();
+		return ok;
+	}
+
+	// Search forward from where the last search left off, wrapping
+	// around at the end
+	for (size_t n = 0; n < sts.size(); ++n) {
+		size_t i = (next_ + n) % sts.size();
+		if (sts[i].sql.length() == length &&
+				memcmp(sts[i].sql.data(), qstr, length) == 0) {
+			current_ = i;
+			next_ = i + 1;
+			return sts[i].errnum == 0;
+		}
+	}
+
+	current_ = no_statement;
+	errnum_ = unknown_error;
+	error_ = "Statement not in recording: " + string(qstr, length);
+	return false;
+}
+
+
+bool
+ReplayDriver::execute_array(PreparedStatement&, const ParamArray&,
+		std::string& error, int& errnum)
+{
+	error = "ReplayDriver doesn't support array binding";
+	errnum = unknown_error;
+	return false;
+}
+
+
+bool
+ReplayDriver::execute_prepared(PreparedStatement&, const SQLQueryParms&,
+		ResultBase::Impl*& result, std::string& error, int& errnum)
+{
+	result = 0;
+	error = "ReplayDriver doesn't support prepared statements";
+	errnum = unknown_error;
+	return false;
+}
+
+
+bool
+ReplayDriver::fail(const std::string& why)
+{
+	error_ = why;
+	if (throw_exceptions()) throw BadSnapshot(why);
+	return false;
+}
+
+
+void
+ReplayDriver::fetch_fields(Fields& fl, ResultBase::Impl& impl) const
+{
+	const Fields& fields = dynamic_cast<ResultImpl&>(impl).statement().fields;
+	fl.assign(fields.begin(), fields.end());
+}
+
+
+const unsigned long*
+ReplayDriver::fetch_lengths(ResultBase::Impl& impl) const
+{
+	return dynamic_cast<ResultImpl&>(impl).lengths();
+}
+
+
+const char* const*
+ReplayDriver::fetch_raw_row(ResultBase::Impl& impl)
+{
+	return dynamic_cast<ResultImpl&>(impl).fetch();
+}
+
+
+Row
+ReplayDriver::fetch_row(ResultBase& res)
+{
+	if (const char* const* raw = fetch_raw_row(res.impl())) {
+		Row::size_type size = res.num_fields();
+		Row::Impl* pd = new Row::Impl;
+		pd->reserve(size);
+		const unsigned long* lengths = fetch_lengths(res.impl());
+		for (Row::size_type i = 0; i < size; ++i) {
+			bool is_null = raw[i] == 0;
+			pd->push_back(Row::value_type(
+					is_null ? "NULL" : raw[i],
+					is_null ? 4 : lengths[i],
+					res.field_type(int(i)).base_type(),
+					is_null));
+		}
+
+		return Row(pd, res.field_names(), throw_exceptions());
+	}
+
+	// Running off the end of the rows isn't an error
+	return Row();
+}
+
+
+void
+ReplayDriver::generate(const std::string& sql, const Fields& fields,
+		ulonglong rows, unsigned long seed)
+{
+	add(sql, rows);
+	Statement& st = recording_->statements.back();
+	st.has_result = true;
+	st.fields = fields;
+	st.rows.resize(size_t(rows));
+	st.lengths.resize(size_t(rows));
+
+	// A plain linear congruential generator, so the values don't
+	// depend on the platform's rand()
+	unsigned long state = seed;
+	for (size_t r = 0; r < st.rows.size(); ++r) {
+		string& out = st.rows[r];
+		bool first_integer = true;
+		for (size_t i = 0; i < fields.size(); ++i) {
+			state = (state * 1103515245UL + 12345UL) & 0xFFFFFFFFUL;
+			unsigned long x = state >> 8;
+			const FieldType& type = fields[i].type();
+			if (type.is_null() && x % 10 == 0) {
+				st.lengths[r].push_back(null_length);
+				continue;
+			}
+
+			size_t start = out.length();
+			switch (type.base_type()) {
+				case FieldType::ft_integer:
+					put_decimal(out, first_integer ? r + 1 : x % 1000000);
+					first_integer = false;
+					break;
+
+				case FieldType::ft_boolean:
+					put_decimal(out, x % 2);
+					break;
+
+				case FieldType::ft_real:
+				case FieldType::ft_decimal:
+					put_decimal(out, x % 100000);
+					out += '.';
+					put_decimal(out, (x >> 4) % 100, 2);
+					break;
+
+				case FieldType::ft_date:
+				case FieldType::ft_datetime:
+				case FieldType::ft_timestamp:
+					out += "2018-";
+					put_decimal(out, x % 12 + 1, 2);
+					out += '-';
+					put_decimal(out, (x >> 4) % 28 + 1, 2);
+					if (type.base_type() == FieldType::ft_date) break;
+					out += ' ';
+					// fall through
+
+				case FieldType::ft_time:
+					put_decimal(out, (x >> 8) % 24, 2);
+					out += ':';
+					put_decimal(out, (x >> 2) % 60, 2);
+					out += ':';
+					put_decimal(out, (x >> 6) % 60, 2);
+					break;
+
+				case FieldType::ft_text:
+				case FieldType::ft_blob:
+				case FieldType::ft_enum:
+				case FieldType::ft_set: {
+					size_t most = fields[i].length();
+					if (most == 0 || most > 32) most = 32;
+					for (size_t n = 1 + x % most; n > 0; --n) {
+						state = (state * 1103515245UL + 12345UL) &
+								0xFFFFFFFFUL;
+						out += char('a' + (state >> 8) % 26);
+					}
+					break;
+				}
+
+				default:
+					break;
+			}
+			st.lengths[r].push_back(
+					static_cast<unsigned long>(out.length() - start));
+			out += '\0';
+		}
+	}
+}
+
+
+ulonglong
+ReplayDriver::insert_id()
+{
+	if (live_) return live_->insert_id();
+	return current_ < size() ? recording_->statements[current_].insert_id : 0;
+}
+
+
+bool
+ReplayDriver::load(const std::string& path)
+{
+	error_.clear();
+
+	FILE* f = fopen(path.c_str(), "rb");
+	if (!f) return fail("Failed to read recording " + path);
+	string data;
+	char block[65536];
+	size_t n;
+	while ((n = fread(block, 1, sizeof(block), f)) > 0) {
+		data.append(block, n);
+	}
+	bool ok_read = !ferror(f);
+	fclose(f);
+	if (!ok_read) return fail("Failed to read recording " + path);
+
+	internal::BinaryReader in(data.data(), data.size());
+	const char* m = in.bytes(magic_length);
+	if (!m || memcmp(m, magic, magic_length) != 0) {
+		return fail(path + " is not a query recording");
+	}
+	else if (in.number(4) != version) {
+		return fail(path + " is from an unknown recording format version");
+	}
+
+	RefCountedPointer<Recording> rec(new Recording);
+	rec->server_version = in.text();
+	size_t count = size_t(in.number(4));
+	for (size_t s = 0; in.ok() && s < count; ++s) {
+		rec->statements.push_back(Statement());
+		Statement& st = rec->statements.back();
+		st.sql = in.text();
+		st.errnum = static_cast<int>(in.number(4));
+		st.error = in.text();
+		st.affected_rows = in.number(8);
+		st.insert_id = in.number(8);
+		st.has_result = in.number(1) != 0;
+		if (!st.has_result) continue;
+
+		size_t num_fields = size_t(in.number(4));
+		size_t num_rows = size_t(in.number(8));
+		for (size_t i = 0; in.ok() && i < num_fields; ++i) {
+			string name = in.text();
+			string table = in.text();
+			string db = in.text();
+			unsigned int id = static_cast<unsigned int>(in.number(2));
+			size_t length = size_t(in.number(8));
+			size_t max_length = size_t(in.number(8));
+			unsigned int decimals = static_cast<unsigned int>(in.number(4));
+			st.fields.push_back(Field(name.c_str(), table.c_str(),
+					db.c_str(), FieldType(FieldType::Base(id & 0xFF),
+					id >> 8), length, max_length, decimals));
+		}
+
+		size_t bitmap_bytes = (num_fields + 7) / 8;
+		for (size_t r = 0; in.ok() && r < num_rows; ++r) {
+			const char* nulls = in.bytes(bitmap_bytes);
+			st.rows.push_back(string());
+			st.lengths.push_back(vector<unsigned long>());
+			for (size_t i = 0; nulls && i < num_fields; ++i) {
+				if (nulls[i / 8] & (1 << (i % 8))) {
+					st.lengths.back().push_back(null_length);
+				}
+				else {
+					unsigned long len =
+							static_cast<unsigned long>(in.number(4));
+					const char* p = in.bytes(len + 1);
+					if (!p) break;
+					st.rows.back().append(p, len + 1);
+					st.lengths.back().push_back(len);
+				}
+			}
+		}
+	}
+
+	if (!in.ok()) return fail("Recording " + path + " is truncated");
+
+	recording_ = rec;
+	next_ = 0;
+	current_ = no_statement;
+	return true;
+}
+
+
+int
+ReplayDriver::num_fields(ResultBase::Impl& impl) const
+{
+	return static_cast<int>(
+			dynamic_cast<ResultImpl&>(impl).statement().fields.size());
+}
+
+
+ulonglong
+ReplayDriver::num_rows(ResultBase::Impl& impl) const
+{
+	return dynamic_cast<ResultImpl&>(impl).statement().rows.size();
+}
+
+
+ResultBase::Impl*
+ReplayDriver::open_cursor(const std::string&, unsigned long,
+		std::string& error, int& errnum)
+{
+	error = "ReplayDriver doesn't support cursors";
+	errnum = unknown_error;
+	return 0;
+}
+
+
+DBDriver::PreparedStatement*
+ReplayDriver::prepare(const std::string&, std::string& error, int& errnum)
+{
+	error = "ReplayDriver doesn't support prepared statements";
+	errnum = unknown_error;
+	return 0;
+}
+
+
+bool
+ReplayDriver::ping()
+{
+	return live_ ? live_->ping() : true;
+}
+
+
+ResultBase::Impl*
+ReplayDriver::result()
+{
+	if (current_ >= size()) return 0;
+	Statement& st = recording_->statements[current_];
+
+	if (live_ && !st.has_result) {
+		// Read the whole result set in, so we can record it
+		ResultBase::Impl* pres = live_->store_result();
+		if (!pres) {
+			st.errnum = live_->errnum();
+			if (st.errnum) st.error = live_->error();
+			return 0;
+		}
+
+		live_->fetch_fields(st.fields, *pres);
+		while (const char* const* raw = live_->fetch_raw_row(*pres)) {
+			const unsigned long* lengths = live_->fetch_lengths(*pres);
+			st.rows.push_back(string());
+			st.lengths.push_back(vector<unsigned long>());
+			for (size_t i = 0; i < st.fields.size(); ++i) {
+				if (raw[i]) {
+					st.rows.back().append(raw[i], lengths[i]);
+					st.rows.back() += '\0';
+					st.lengths.back().push_back(lengths[i]);
+				}
+				else {
+					st.lengths.back().push_back(null_length);
+				}
+			}
+		}
+		delete pres;
+
+		st.has_result = true;
+		st.affected_rows = live_->affected_rows();
+	}
+
+	return st.has_result ? new ResultImpl(recording_, current_) : 0;
+}
+
+
+bool
+ReplayDriver::result_empty()
+{
+	if (live_) return live_->result_empty();
+	return current_ >= size() || !recording_->statements[current_].has_result;
+}
+
+
+bool
+ReplayDriver::save(const std::string& path)
+{
+	error_.clear();
+
+	string temp = path + ".tmp";
+	FILE* f = fopen(temp.c_str(), "wb");
+	if (!f) return fail("Failed to create recording " + temp);
+
+	internal::BinaryWriter out(f);
+	out.bytes(magic, magic_length);
+	out.number(version, 4);
+	out.text(recording_->server_version);
+	out.number(size(), 4);
+	for (size_t s = 0; s < size(); ++s) {
+		const Statement& st = recording_->statements[s];
+		out.text(st.sql);
+		out.number(static_cast<unsigned int>(st.errnum), 4);
+		out.text(st.error);
+		out.number(st.affected_rows, 8);
+		out.number(st.insert_id, 8);
+		out.number(st.has_result ? 1 : 0, 1);
+		if (!st.has_result) continue;
+
+		out.number(st.fields.size(), 4);
+		out.number(st.rows.size(), 8);
+		for (size_t i = 0; i < st.fields.size(); ++i) {
+			const Field& fld = st.fields[i];
+			out.text(fld.name());
+			out.text(fld.table());
+			out.text(fld.db());
+			out.number(fld.type().id(), 2);
+			out.number(fld.length(), 8);
+			out.number(fld.max_length(), 8);
+			out.number(fld.decimals(), 4);
+		}
+
+		string nulls;
+		for (size_t r = 0; r < st.rows.size(); ++r) {
+			const vector<unsigned long>& lengths = st.lengths[r];
+			nulls.assign((lengths.size() + 7) / 8, '\0');
+			for (size_t i = 0; i < lengths.size(); ++i) {
+				if (lengths[i] == null_length) {
+					nulls[i / 8] |= char(1 << (i % 8));
+				}
+			}
+			out.bytes(nulls.data(), nulls.size());
+
+			const char* p = st.rows[r].data();
+			for (size_t i = 0; i < lengths.size(); ++i) {
+				if (lengths[i] != null_length) {
+					out.number(lengths[i], 4);
+					out.bytes(p, lengths[i] + 1);
+					p += lengths[i] + 1;
+				}
+			}
+		}
+	}
+
+	bool ok = out.flush();
+	ok = fclose(f) == 0 && ok;
+#if defined(LIBTABULA_PLATFORM_WINDOWS)
+	// rename() won't replace an existing file here
+	if (ok) remove(path.c_str());
+#endif
+	if (!ok || rename(temp.c_str(), path.c_str()) != 0) {
+		remove(temp.c_str());
+		return fail("Failed to write recording " + path);
+	}
+
+	return true;
+}
+
+
+bool
+ReplayDriver::select_db(const char* db)
+{
+	return live_ ? live_->select_db(db) : true;
+}
+
+
+std::string
+ReplayDriver::server_version()
+{
+	return live_ ? live_->server_version() : recording_->server_version;
+}
+
+
+bool
+ReplayDriver::set_option(Option* o)
+{
+	return live_ ? live_->set_option(o) : DBDriver::set_option(o);
+}
+
+
+size_t
+ReplayDriver::size() const
+{
+	return recording_->statements.size();
+}
+
+
+bool
+ReplayDriver::statement_lost(int errnum) const
+{
+	return live_ && live_->statement_lost(errnum);
+}
+
+
+bool
+ReplayDriver::thread_aware()
+{
+	return live_ ? live_->thread_aware() : true;
+}
+
+
+void
+ReplayDriver::thread_end()
+{
+	if (live_) live_->thread_end();
+}
+
+
+bool
+ReplayDriver::thread_start()
+{
+	return live_ ? live_->thread_start() : true;
+}
+
+} // end namespace libtabula
@@ -0,0 +1,380 @@
+/// \file replaydriver.h
+/// \brief Declares the ReplayDriver class, a DBDriver that records
+/// query results to a file and plays them back later without a
+/// database server.
+
+/***********************************************************************
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#if !defined(LIBTABULA_REPLAYDRIVER_H)
+#define LIBTABULA_REPLAYDRIVER_H
+
+#include "common.h"
+
+#include "dbdriver.h"
+#include "field.h"
+#include "refcounted.h"
+
+#include <string>
+#include <vector>
+
+namespace libtabula {
+
+/// \brief A DBDriver that records what a real driver's queries
+/// return, and replays it later without a database server
+///
+/// This is for tests and benchmarks that exercise the code between
+/// your program and the server: result set construction, Row and
+/// String conversions, SSQLS population and so forth.  With a live
+/// server, the network and the server's own work swamp these costs,
+/// and make them vary from run to run.  Replaying a recording instead
+/// gives the same results, in the same amount of client-side work,
+/// every time.
+///
+/// Give one of these to a Connection in place of the driver it would
+/// otherwise create.  To record, wrap the real driver:
+///
+/// \code
+///   libtabula::ReplayDriver* rec = new libtabula::ReplayDriver(
+///           new libtabula::MySQLDriver);
+///   libtabula::Connection conn(rec);
+///   conn.connect("test", "localhost", "user", "pass");
+///   ... run queries as usual ...
+///   rec->save("stock.replay");
+/// \endcode
+///
+/// Then later, with no server at all:
+///
+/// \code
+///   libtabula::ReplayDriver* play = new libtabula::ReplayDriver;
+///   play->load("stock.replay");
+///   libtabula::Connection conn(play);
+///   libtabula::StoreQueryResult res =
+///           conn.query("SELECT * FROM stock").store();
+/// \endcode
+///
+/// For each statement, the recording holds its SQL text, error number
+/// and message, affected row count, insert ID, and if it returned a
+/// result set, the field information and every row.  On replay, each
+/// statement executed is matched by its exact text against the
+/// recording, searching forward from the statement after the last one
+/// matched and wrapping around at the end, so a program that runs the
+/// same statements it ran while recording gets the same answers in the
+/// same order, and a benchmark can run one statement over and over.  A
+/// statement that isn't in the recording fails with an error.
+///
+/// You can also add statements to the recording by hand with add(),
+/// or have generate() make up a result set of any size with a given
+/// set of fields.
+///
+/// While recording, "use" queries' rows are all read from the real
+/// driver before use_result() returns.  Multiple result sets, cursors
+/// and array binding aren't recorded; the driver says they're
+/// unsupported in both modes.  Copies of a Connection using this
+/// driver share its recording; while recording, don't use them from
+/// more than one thread at a time.
+///
+/// The file format is versioned, and load() refuses files with a
+/// version it doesn't know.  It uses the same conventions as Snapshot:
+/// little-endian integers, and strings as a 32-bit length and the
+/// text.  A file holds the 8 bytes \c LTREPLAY, the format version as
+/// a 32-bit integer, the server version string and a 32-bit statement
+/// count, then for each statement:
+///
+/// - its SQL, 32-bit error number and error message
+/// - its affected row count and insert ID as 64-bit integers
+/// - a byte that's 1 if it returned a result set, else 0
+/// - for a result set, the field and row counts as 32- and 64-bit
+///   integers; then the fields and rows as in a Snapshot, except
+///   that each field also has its decimals as a 32-bit integer
+class LIBTABULA_EXPORT ReplayDriver : public DBDriver
+{
+public:
+	/// \brief The format version save() writes
+	static const unsigned int version = 1;
+
+	/// \brief Create a driver that replays statements added later with
+	/// load(), add() or generate()
+	///
+	/// \param te if true, throw exceptions on errors
+	explicit ReplayDriver(bool te = true);
+
+	/// \brief Create a driver that passes everything through to a real
+	/// driver, recording the results
+	///
+	/// \param live the driver to record; we take ownership of it
+	/// \param te if true, throw exceptions on errors
+	explicit ReplayDriver(DBDriver* live, bool te = true);
+
+	/// \brief Destroy the object, and the live driver, if any
+	~ReplayDriver();
+
+	/// \brief Add a statement that doesn't return a result set to the
+	/// recording
+	///
+	/// \param sql the statement's text, as it will be executed
+	/// \param affected_rows what affected_rows() should return after it
+	/// \param insert_id what insert_id() should return after it
+	/// \param errnum if nonzero, the statement fails with this error
+	/// \param error the error message to go with errnum
+	void add(const std::string& sql, ulonglong affected_rows = 0,
+			ulonglong insert_id = 0, int errnum = 0,
+			const std::string& error = std::string());
+
+	/// \brief Add a statement that returns a copy of the given result
+	/// set to the recording
+	void add(const std::string& sql, const StoreQueryResult& res);
+
+	/// \brief Add a statement that returns a made-up result set to the
+	/// recording
+	///
+	/// \param sql the statement's text, as it will be executed
+	/// \param fields the result set's fields; their types decide what
+	///     sort of data each column gets
+	/// \param rows the number of rows to make
+	/// \param seed starting point for the pseudorandom values; the
+	///     same seed always gives the same rows
+	///
+	/// Integer columns get values between 0 and 999999, except that
+	/// the first one gets 1, 2, 3... so it can serve as an ID.
+	/// Floating-point and decimal columns get values with two digits
+	/// after the decimal point, and date and time columns get values
+	/// within 2018.  Text, blob, enum and set columns get letters, up
+	/// to the field's length or 32, whichever is less.  Columns whose
+	/// type allows nulls are null about one time in ten.
+	void generate(const std::string& sql, const Fields& fields,
+			ulonglong rows, unsigned long seed = 1);
+
+	/// \brief Replace the recording with one saved by save()
+	///
+	/// \return false on error, if exceptions are disabled; otherwise,
+	///     throws BadSnapshot
+	bool load(const std::string& path);
+
+	/// \brief Save the recording to a file, replacing any file already
+	/// there
+	///
+	/// \return false on error, if exceptions are disabled; otherwise,
+	///     throws BadSnapshot
+	bool save(const std::string& path);
+
+	/// \brief Returns true if we're recording a live driver, false if
+	/// we're replaying
+	bool recording() const { return live_ != 0; }
+
+	/// \brief Start matching statements from the start of the
+	/// recording again
+	void rewind() { next_ = 0; }
+
+	/// \brief Returns the number of statements in the recording
+	size_t size() const;
+
+	/// \brief Returns the live driver's affected row count, or the
+	/// one recorded for the last statement
+	ulonglong affected_rows();
+
+	/// \brief Returns the live driver's client library version, or a
+	/// made-up one
+	std::string client_version() const;
+
+	/// \brief Connect the live driver, or just pretend to
+	bool connect(const char* host, const char* socket_name,
+			unsigned int port, const char* db, const char* user,
+			const char* password);
+
+	/// \brief Return a new driver sharing our recording; when
+	/// recording, it wraps a clone of our live driver
+	DBDriver* clone();
+
+	/// \brief Disconnect the live driver, if any
+	void disconnect();
+
+	/// \brief Returns the last error message
+	const char* error();
+
+	/// \brief Returns the last error number
+	int errnum();
+
+	/// \brief Asks the live driver whether the error means the
+	/// connection dropped; always false when replaying
+	bool connection_lost(int errnum) const;
+
+	/// \brief Asks the live driver whether the error means a prepared
+	/// statement is gone; always false when replaying
+	bool statement_lost(int errnum) const;
+
+	/// \brief SQL-escape a string, using the live driver's rules if we
+	/// have one, else SQLStream::escape_string_generic()
+	size_t escape_string(char* to, const char* from, size_t length);
+
+	/// \brief SQL-escape a string
+	///
+	/// \see DBDriver::escape_string(std::string*, const char*, size_t)
+	size_t escape_string(std::string* ps, const char* original,
+			size_t length);
+
+	/// \brief Run the statement on the live driver and record what
+	/// happened, or look it up in the recording
+	bool execute(const char* qstr, size_t length);
+
+	/// \brief Always fails; cursors aren't recorded
+	ResultBase::Impl* open_cursor(const std::string& sql,
+			unsigned long fetch_size, std::string& error, int& errnum);
+
+	/// \brief Always false; array binding isn't recorded
+	bool array_binding() { return false; }
+
+	/// \brief Always fails; array binding isn't recorded
+	bool execute_array(PreparedStatement& stmt, const ParamArray& params,
+			std::string& error, int& errnum);
+
+	/// \brief Always fails; prepared statements aren't recorded
+	PreparedStatement* prepare(const std::string& sql,
+			std::string& error, int& errnum);
+
+	/// \brief Always fails; prepared statements aren't recorded
+	bool execute_prepared(PreparedStatement& stmt,
+			const SQLQueryParms& params, ResultBase::Impl*& result,
+			std::string& error, int& errnum);
+
+	/// \brief Fill out a Fields list from a recorded result set
+	void fetch_fields(Fields& fl, ResultBase::Impl& impl) const;
+
+	/// \brief Returns the lengths of the fields in the current row
+	const unsigned long* fetch_lengths(ResultBase::Impl& impl) const;
+
+	/// \brief Returns the next row from a recorded result set
+	Row fetch_row(ResultBase& res);
+
+	/// \brief Returns the next row from a recorded result set, without
+	/// wrapping it in a Row object
+	const char* const* fetch_raw_row(ResultBase::Impl& impl);
+
+	/// \brief Does nothing; recorded result sets go away with the last
+	/// result object referring to them
+	void free_result(ResultBase::Impl&) const { }
+
+	/// \brief Returns the live driver's insert ID, or the one recorded
+	/// for the last statement
+	ulonglong insert_id();
+
+	/// \brief Always false; multiple result sets aren't recorded
+	bool more_results() { return false; }
+
+	/// \brief Always says there are no more results
+	nr_code next_result() { return nr_last_result; }
+
+	/// \brief Returns the number of fields in a recorded result set
+	int num_fields(ResultBase::Impl& impl) const;
+
+	/// \brief Returns the number of rows in a recorded result set
+	ulonglong num_rows(ResultBase::Impl& impl) const;
+
+	/// \brief Pings the live driver; always true when replaying
+	bool ping();
+
+	/// \brief Returns true if the last statement didn't return a
+	/// result set
+	bool result_empty();
+
+	/// \brief Asks the live driver to switch databases; always
+	/// succeeds when replaying
+	bool select_db(const char* db);
+
+	/// \brief Returns the live driver's server version, or the one
+	/// recorded
+	std::string server_version();
+
+	/// \brief Passes the option on to the live driver, if any
+	bool set_option(Option* o);
+
+	/// \brief Returns the last statement's result set
+	ResultBase::Impl* store_result() { return result(); }
+
+	/// \brief Asks the live driver; always true when replaying
+	bool thread_aware();
+
+	/// \brief Passes the call on to the live driver, if any
+	void thread_end();
+
+	/// \brief Passes the call on to the live driver, if any
+	bool thread_start();
+
+	/// \brief Returns the last statement's result set, which when
+	/// recording has already been read in whole from the live driver
+	ResultBase::Impl* use_result() { return result(); }
+
+private:
+	/// \brief A statement and what it did
+	struct Statement
+	{
+		std::string sql;
+		int errnum;
+		std::string error;
+		ulonglong affected_rows;
+		ulonglong insert_id;
+		bool has_result;
+		Fields fields;
+		std::vector<std::string> rows;	///< values, each null-terminated
+		std::vector< std::vector<unsigned long> > lengths;	///< ~0 for nulls
+
+		Statement() :
+		errnum(0),
+		affected_rows(0),
+		insert_id(0),
+		has_result(false)
+		{
+		}
+	};
+
+	/// \brief Everything recorded, shared among clones of one driver
+	struct Recording
+	{
+		std::string server_version;
+		std::vector<Statement> statements;
+	};
+
+	class ResultImpl;
+
+	/// \brief Common part of the ctors and clone()
+	ReplayDriver(DBDriver* live, const RefCountedPointer<Recording>& rec,
+			bool te);
+
+	/// \brief Record why something failed, and throw if we're supposed
+	/// to
+	bool fail(const std::string& why);
+
+	/// \brief Implementation of store_result() and use_result()
+	ResultBase::Impl* result();
+
+	DBDriver* live_;
+	RefCountedPointer<Recording> recording_;
+	size_t next_;					///< where to start the next search
+	size_t current_;				///< last statement executed
+	int errnum_;					///< for execute() failures
+	std::string error_;
+};
+
+} // end namespace libtabula
+
+#endif // !defined(LIBTABULA_REPLAYDRIVER_H)
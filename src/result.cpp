@@ -28,10 +28,37 @@
 #include "result.h"
 
 #include "dbdriver.h"
+#include "observer.h"
+
+#include <sstream>
+
+#include <string.h>
 
 
 namespace libtabula {
 
+// Returns true if a result set with the given number of rows taking up
+// the given memory has gone over one of the limits.  If so, asks the
+// server to stop sending rows, and if exceptions are enabled, throws
+// ResultTooLarge.
+static bool
+over_limit(DBDriver* dbd, bool te, ulonglong rows, ulonglong bytes,
+		ulonglong max_rows, ulonglong max_bytes)
+{
+	const bool too_many = max_rows && rows > max_rows;
+	if (!too_many && !(max_bytes && bytes > max_bytes)) return false;
+
+	dbd->cancel_query();
+	if (te) {
+		std::ostringstream os;
+		os << "Result set went over its limit of ";
+		if (too_many) os << max_rows << " rows";
+		else os << max_bytes << " bytes";
+		throw ResultTooLarge(os.str(), rows, bytes);
+	}
+	return true;
+}
+
 
 ResultBase::ResultBase(Impl* res, DBDriver* driver, bool te) :
 OptionalExceptions(te),
@@ -46,13 +73,24 @@ current_field_(0)
 }
 
 
+ResultBase::ResultBase(const Fields& fields, bool te) :
+OptionalExceptions(te),
+fields_(fields),
+driver_(0),
+current_field_(0)
+{
+	names_ = new FieldNames(this);
+	types_ = new FieldTypes(this);
+}
+
+
 ResultBase&
 ResultBase::copy(const ResultBase& other)
 {
 	if (this != &other) {
 		set_exceptions(other.throw_exceptions());
 
-		if (other.driver_) {
+		if (other.driver_ || other.names_) {
 			driver_ = other.driver_;
 			fields_ = other.fields_;
 			names_ = other.names_;
@@ -72,6 +110,27 @@ ResultBase::copy(const ResultBase& other)
 }
 
 
+size_t
+ResultBase::memory_usage() const
+{
+	size_t n = fields_.capacity() * sizeof(Field);
+	for (Fields::const_iterator it = fields_.begin(); it != fields_.end();
+			++it) {
+		n += strlen(it->name()) + strlen(it->table()) + strlen(it->db());
+	}
+	if (names_) {
+		n += sizeof(FieldNames) + names_->capacity() * sizeof(std::string);
+		for (size_t i = 0; i < names_->size(); ++i) {
+			n += (*names_)[i].capacity();
+		}
+	}
+	if (types_) {
+		n += sizeof(FieldTypes) + types_->capacity() * sizeof(FieldType);
+	}
+	return n;
+}
+
+
 int
 ResultBase::field_num(const std::string& i) const
 {
@@ -103,6 +162,69 @@ copacetic_(true)
 }
 
 
+StoreQueryResult::StoreQueryResult(Impl* res, DBDriver* dbd,
+		ulonglong max_rows, ulonglong max_bytes, bool te) :
+ResultBase(res, dbd, te),
+pimpl_(res),
+copacetic_(true)
+{
+	// Read raw rows, as SpillQueryResult does; DBDriver::fetch_row()
+	// can throw at the end of the rows, and hides errors from us.
+	ulonglong bytes = ResultBase::memory_usage();
+	const size_t fields = num_fields();
+	while (const char* const* raw = dbd->fetch_raw_row(*res)) {
+		const unsigned long* lengths = dbd->fetch_lengths(*res);
+		Row::Impl* pd = new Row::Impl;
+		pd->reserve(fields);
+		for (size_t i = 0; i < fields; ++i) {
+			bool is_null = raw[i] == 0;
+			pd->push_back(Row::value_type(
+					is_null ? "NULL" : raw[i],
+					is_null ? 4 : lengths[i],
+					field_type(int(i)).base_type(),
+					is_null));
+		}
+		Row row(pd, field_names(), te);
+
+		bytes += sizeof(Row) + row.memory_usage();
+		if (over_limit(dbd, te, size() + 1, bytes, max_rows, max_bytes)) {
+			clear();
+			pimpl_ = 0;
+			copacetic_ = false;
+			return;
+		}
+		push_back(row);
+	}
+
+	// Running out of rows because the connection dropped isn't the
+	// same as reaching the end of them
+	if (dbd->errnum() != 0) {
+		clear();
+		pimpl_ = 0;
+		copacetic_ = false;
+		if (te) throw BadQuery(dbd->error(), dbd->errnum());
+	}
+}
+
+
+StoreQueryResult::StoreQueryResult(const Fields& fields, bool te) :
+ResultBase(fields, te),
+copacetic_(true)
+{
+}
+
+
+size_t
+StoreQueryResult::memory_usage() const
+{
+	size_t n = ResultBase::memory_usage() + capacity() * sizeof(Row);
+	for (const_iterator it = begin(); it != end(); ++it) {
+		n += it->memory_usage();
+	}
+	return n;
+}
+
+
 StoreQueryResult&
 StoreQueryResult::copy(const StoreQueryResult& other)
 {
@@ -116,9 +238,14 @@ StoreQueryResult::copy(const StoreQueryResult& other)
 }
 
 
-UseQueryResult::UseQueryResult(Impl* res, DBDriver* dbd, bool te) :
+UseQueryResult::UseQueryResult(Impl* res, DBDriver* dbd, bool te,
+		ulonglong max_rows, ulonglong max_bytes) :
 ResultBase(res, dbd, te),
-pimpl_(res)
+pimpl_(res),
+max_rows_(max_rows),
+max_bytes_(max_bytes),
+rows_(0),
+bytes_(0)
 {
 }
 
@@ -134,6 +261,10 @@ UseQueryResult::copy(const UseQueryResult& other)
 		else {
 			pimpl_ = 0;
 		}
+		max_rows_ = other.max_rows_;
+		max_bytes_ = other.max_bytes_;
+		rows_ = other.rows_;
+		bytes_ = other.bytes_;
 	}
 
 	return *this;
@@ -149,6 +280,21 @@ UseQueryResult::fetch_lengths() const
 
 Row
 UseQueryResult::fetch_row()
+{
+	QueryObserver* obs = QueryObserver::installed();
+	if (!obs) return fetch_row_impl();
+
+	QueryEvent ev(QueryEvent::ev_row, driver_);
+	Row row = fetch_row_impl();
+	ev.finish();
+	ev.rows = row ? 1 : 0;
+	obs->observe(ev);
+	return row;
+}
+
+
+Row
+UseQueryResult::fetch_row_impl()
 {
 	if (!pimpl_) {
 		if (throw_exceptions()) {
@@ -162,6 +308,14 @@ UseQueryResult::fetch_row()
 	if (Row row = driver_->fetch_row(*this)) {
 		const unsigned long* lengths = fetch_lengths();
 		if (lengths) {
+			if (max_rows_ || max_bytes_) {
+				bytes_ += row.memory_usage();
+				if (over_limit(driver_, throw_exceptions(), ++rows_,
+						bytes_, max_rows_, max_bytes_)) {
+					pimpl_ = 0;
+					return Row();
+				}
+			}
 			return row;
 		}
 		else {
@@ -151,6 +151,10 @@ public:
 	const RefCountedPointer<FieldTypes>& field_types() const
 			{ return types_; }
 
+	/// \brief Returns the bytes of memory the result set's field
+	/// information takes up
+	size_t memory_usage() const;
+
 	/// \brief Access the driver-level implementation result set info
 	///
 	/// This is primarily for the benefit of the DBDriver subclass,
@@ -171,12 +175,17 @@ public:
 protected:
 	/// \brief Create empty object
 	ResultBase() :
+	driver_(0),
 	current_field_(0)
 	{
 	}
 	
 	/// \brief Create the object, fully initialized
 	ResultBase(Impl* pri, DBDriver* driver, bool te);
+
+	/// \brief Create an object with the given fields, which didn't
+	/// come from a DBDriver
+	ResultBase(const Fields& fields, bool te);
 	
 	/// \brief Create object as a copy of another ResultBase
 	ResultBase(const ResultBase& other) :
@@ -253,6 +262,28 @@ public:
 	/// \brief Fully initialize object
 	StoreQueryResult(Impl* pri, size_t rows, DBDriver* dbd, bool te);
 
+	/// \brief Initialize object from a "use" query's result set,
+	/// reading rows until they run out or there are too many
+	///
+	/// Query::store() uses this instead of the ctor above when there's
+	/// a limit on the result set's size, so it can stop the server
+	/// sending rows as soon as it's had too many.  If the rows go over
+	/// \c max_rows in number or \c max_bytes in memory_usage(), it
+	/// asks the server to stop and throws ResultTooLarge, or if
+	/// exceptions are disabled, leaves the result set empty and false
+	/// in bool context.  Zero means no limit.  If the rows stop
+	/// because of an error, it throws BadQuery, or likewise leaves
+	/// the result set empty and false.
+	StoreQueryResult(Impl* pri, DBDriver* dbd, ulonglong max_rows,
+			ulonglong max_bytes, bool te);
+
+	/// \brief Create an empty result set with the given fields, for
+	/// filling with rows from somewhere other than a DBDriver
+	///
+	/// Snapshot::load() uses this.  Such a result set has no
+	/// driver-level implementation info, so don't call impl() on it.
+	StoreQueryResult(const Fields& fields, bool te = true);
+
 	/// \brief Destroy result set
 	~StoreQueryResult() { }
 
@@ -262,6 +293,16 @@ public:
 	/// not end-user code.
 	Impl& impl() const { return *pimpl_; }
 
+	/// \brief Returns an estimate of the bytes of memory this result
+	/// set takes up
+	///
+	/// This adds up the data buffers of every field in every row, the
+	/// rows' vectors of String objects, the Row objects themselves, and
+	/// the field information.  It's an estimate because it can't know
+	/// what the heap adds to each allocation, and because rows shared
+	/// with copies of this result set count in full toward each.
+	size_t memory_usage() const;
+
 	/// \brief Returns the number of rows in this result set
 	list_type::size_type num_rows() const { return size(); }
 
@@ -301,7 +342,11 @@ class LIBTABULA_EXPORT UseQueryResult : public ResultBase
 public:
 	/// \brief Default constructor
 	UseQueryResult() :
-	ResultBase()
+	ResultBase(),
+	max_rows_(0),
+	max_bytes_(0),
+	rows_(0),
+	bytes_(0)
 	{
 	}
 	
@@ -313,7 +358,15 @@ public:
 	}
 	
 	/// \brief Create the object, fully initialized
-	UseQueryResult(Impl* pri, DBDriver* dbd, bool te);
+	///
+	/// If \c max_rows or \c max_bytes is nonzero, fetch_row() asks
+	/// the server to stop sending rows and throws ResultTooLarge once
+	/// it has read more than that many rows, or rows taking up more
+	/// than that much memory in all, as counted by Row::memory_usage().
+	/// If exceptions are disabled, it returns a false Row instead, as
+	/// at the end of the result set.
+	UseQueryResult(Impl* pri, DBDriver* dbd, bool te,
+			ulonglong max_rows = 0, ulonglong max_bytes = 0);
 	
 	/// \brief Destroy object
 	~UseQueryResult() { }
@@ -387,7 +440,14 @@ private:
 	/// \brief Copy another ResultBase object's contents into this one.
 	UseQueryResult& copy(const UseQueryResult& other);
 
+	/// \brief fetch_row() without the QueryObserver hook
+	Row fetch_row_impl();
+
 	RefCountedPointer<Impl> pimpl_;		///< Driver-level result set info
+	ulonglong max_rows_;				///< row limit, or 0
+	ulonglong max_bytes_;				///< memory limit, or 0
+	ulonglong rows_;					///< rows fetched, if limited
+	ulonglong bytes_;					///< their memory_usage()
 };
 
 
@@ -0,0 +1,445 @@
+/***********************************************************************
+ resultwriter.cpp - Implements the ResultWriter class and the format
+	subclasses built on it.
+
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#define LIBTABULA_NOT_HEADER
+#include "resultwriter.h"
+
+#include "dbdriver.h"
+#include "exceptions.h"
+
+#include <errno.h>
+
+#if defined(LIBTABULA_PLATFORM_WINDOWS)
+#	include <io.h>
+#else
+#	include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace libtabula {
+
+// Write some of the given data to a file descriptor, returning the
+// number of bytes written, or -1 on error.
+static long
+write_some(int fd, const char* data, size_t length)
+{
+#if defined(LIBTABULA_PLATFORM_WINDOWS)
+	if (length > 0x40000000) length = 0x40000000;
+	return _write(fd, data, (unsigned int)length);
+#else
+	return (long)::write(fd, data, length);
+#endif
+}
+
+
+//// ResultWriter //////////////////////////////////////////////////////
+
+ResultWriter::ResultWriter(int fd, size_t buffer_size, bool te) :
+OptionalExceptions(te),
+fd_(fd),
+buffer_(buffer_size ? buffer_size : 1),
+pos_(0),
+bytes_(0),
+rows_(0)
+{
+}
+
+
+ResultWriter::~ResultWriter()
+{
+	// Can't let an exception out of a dtor
+	try {
+		drain();
+	}
+	catch (...) {
+	}
+}
+
+
+void
+ResultWriter::begin(const Fields&)
+{
+}
+
+
+void
+ResultWriter::end()
+{
+}
+
+
+void
+ResultWriter::drain()
+{
+	const char* p = &buffer_[0];
+	size_t left = pos_;
+	pos_ = 0;		// drop the data on error, rather than retrying it
+
+	while (left > 0) {
+		long n = write_some(fd_, p, left);
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			throw ExportFailed(string("Failed to write result set: ") +
+					strerror(errno));
+		}
+		p += n;
+		left -= n;
+		bytes_ += n;
+	}
+}
+
+
+bool
+ResultWriter::fail(const std::string& why)
+{
+	error_ = why;
+	if (throw_exceptions()) throw ExportFailed(why);
+	return false;
+}
+
+
+bool
+ResultWriter::flush()
+{
+	try {
+		drain();
+		return true;
+	}
+	catch (const ExportFailed& e) {
+		return fail(e.what());
+	}
+}
+
+
+void
+ResultWriter::put_long(const char* data, size_t length)
+{
+	drain();
+	if (length < buffer_.size()) {
+		memcpy(&buffer_[0], data, length);
+		pos_ = length;
+	}
+	else {
+		// Bigger than the whole buffer, so don't bother copying it
+		while (length > 0) {
+			long n = write_some(fd_, data, length);
+			if (n < 0) {
+				if (errno == EINTR) continue;
+				throw ExportFailed(string("Failed to write result set: ") +
+						strerror(errno));
+			}
+			data += n;
+			length -= n;
+			bytes_ += n;
+		}
+	}
+}
+
+
+bool
+ResultWriter::write(const UseQueryResult& res)
+{
+	DBDriver* dbd = res.driver();
+	if (!dbd) {
+		error_ = "Results not fetched";
+		if (throw_exceptions()) throw UseQueryError(error_.c_str());
+		return false;
+	}
+
+	ResultBase::Impl& impl = res.impl();
+	size_t count = res.num_fields();
+	try {
+		begin(res.fields());
+		while (const char* const* raw = dbd->fetch_raw_row(impl)) {
+			row(raw, dbd->fetch_lengths(impl), count);
+			++rows_;
+		}
+		end();
+		drain();
+	}
+	catch (const ExportFailed& e) {
+		// Read the rest so the connection can be used again
+		while (dbd->fetch_raw_row(impl)) { }
+		return fail(e.what());
+	}
+
+	if (dbd->errnum() != 0) {
+		error_ = dbd->error();
+		if (throw_exceptions()) throw BadQuery(error_, dbd->errnum());
+		return false;
+	}
+
+	return true;
+}
+
+
+bool
+ResultWriter::write(const StoreQueryResult& res)
+{
+	size_t count = res.num_fields();
+	vector<const char*> raw(count);
+	vector<unsigned long> lengths(count);
+	try {
+		begin(res.fields());
+		for (size_t i = 0; i < res.num_rows(); ++i) {
+			const Row& r = res[i];
+			for (size_t j = 0; j < count; ++j) {
+				const String& s = r[j];
+				raw[j] = s.is_null() ? 0 : s.data();
+				lengths[j] = (unsigned long)s.length();
+			}
+			row(count ? &raw[0] : 0, count ? &lengths[0] : 0, count);
+			++rows_;
+		}
+		end();
+		drain();
+		return true;
+	}
+	catch (const ExportFailed& e) {
+		return fail(e.what());
+	}
+}
+
+
+//// CSVWriter /////////////////////////////////////////////////////////
+
+void
+CSVWriter::begin(const Fields& fields)
+{
+	if (!header_) return;
+
+	for (size_t i = 0; i < fields.size(); ++i) {
+		if (i) put(',');
+		const char* name = fields[i].name();
+		field(name, strlen(name));
+	}
+	put("\r\n", 2);
+}
+
+
+void
+CSVWriter::field(const char* data, size_t length)
+{
+	const char* end = data + length;
+	const char* p = data;
+	for ( ; p != end; ++p) {
+		if (*p == ',' || *p == '"' || *p == '\n' || *p == '\r') break;
+	}
+	if (p == end) {
+		put(data, length);
+		return;
+	}
+
+	put('"');
+	while (const char* q = static_cast<const char*>(
+			memchr(data, '"', end - data))) {
+		put(data, q - data + 1);
+		put('"');
+		data = q + 1;
+	}
+	put(data, end - data);
+	put('"');
+}
+
+
+void
+CSVWriter::row(const char* const* raw, const unsigned long* lengths,
+		size_t count)
+{
+	for (size_t i = 0; i < count; ++i) {
+		if (i) put(',');
+		if (raw[i]) field(raw[i], lengths[i]);
+	}
+	put("\r\n", 2);
+}
+
+
+//// TSVWriter /////////////////////////////////////////////////////////
+
+void
+TSVWriter::begin(const Fields& fields)
+{
+	if (!header_) return;
+
+	for (size_t i = 0; i < fields.size(); ++i) {
+		if (i) put('\t');
+		const char* name = fields[i].name();
+		field(name, strlen(name));
+	}
+	put('\n');
+}
+
+
+void
+TSVWriter::field(const char* data, size_t length)
+{
+	const char* end = data + length;
+	const char* run = data;
+	for (const char* p = data; p != end; ++p) {
+		char escape;
+		switch (*p) {
+			case '\t': escape = 't'; break;
+			case '\n': escape = 'n'; break;
+			case '\r': escape = 'r'; break;
+			case '\\': escape = '\\'; break;
+			case '\0': escape = '0'; break;
+			default: continue;
+		}
+		put(run, p - run);
+		put('\\');
+		put(escape);
+		run = p + 1;
+	}
+	put(run, end - run);
+}
+
+
+void
+TSVWriter::row(const char* const* raw, const unsigned long* lengths,
+		size_t count)
+{
+	for (size_t i = 0; i < count; ++i) {
+		if (i) put('\t');
+		if (raw[i]) {
+			field(raw[i], lengths[i]);
+		}
+		else {
+			put("\\N", 2);
+		}
+	}
+	put('\n');
+}
+
+
+//// JSONLinesWriter ///////////////////////////////////////////////////
+
+// Returns true if c has to be escaped inside a JSON string
+static inline bool
+json_special(unsigned char c)
+{
+	return c < 0x20 || c == '"' || c == '\\';
+}
+
+
+// Puts the JSON escape sequence for c, one of the characters
+// json_special() picks out, into out, returning its length
+static size_t
+json_escape(unsigned char c, char* out)
+{
+	static const char hex[] = "0123456789abcdef";
+
+	out[0] = '\\';
+	switch (c) {
+		case '"':  out[1] = '"'; return 2;
+		case '\\': out[1] = '\\'; return 2;
+		case '\b': out[1] = 'b'; return 2;
+		case '\f': out[1] = 'f'; return 2;
+		case '\n': out[1] = 'n'; return 2;
+		case '\r': out[1] = 'r'; return 2;
+		case '\t': out[1] = 't'; return 2;
+		default:
+			out[1] = 'u';
+			out[2] = out[3] = '0';
+			out[4] = hex[c >> 4];
+			out[5] = hex[c & 15];
+			return 6;
+	}
+}
+
+
+void
+JSONLinesWriter::begin(const Fields& fields)
+{
+	// Work out each member's name and how to write its values once,
+	// rather than on every row.
+	names_.clear();
+	numeric_.clear();
+	for (size_t i = 0; i < fields.size(); ++i) {
+		string name(i ? ",\"" : "{\"");
+		for (const char* p = fields[i].name(); *p; ++p) {
+			if (json_special(*p)) {
+				char esc[6];
+				name.append(esc, json_escape(*p, esc));
+			}
+			else {
+				name += *p;
+			}
+		}
+		name += "\":";
+		names_.push_back(name);
+
+		FieldType::Base b = fields[i].type().base_type();
+		numeric_.push_back(b == FieldType::ft_integer ||
+				b == FieldType::ft_real || b == FieldType::ft_decimal);
+	}
+}
+
+
+void
+JSONLinesWriter::quoted(const char* data, size_t length)
+{
+	put('"');
+	const char* end = data + length;
+	const char* run = data;
+	for (const char* p = data; p != end; ++p) {
+		if (!json_special(*p)) continue;
+
+		put(run, p - run);
+		char esc[6];
+		put(esc, json_escape(*p, esc));
+		run = p + 1;
+	}
+	put(run, end - run);
+	put('"');
+}
+
+
+void
+JSONLinesWriter::row(const char* const* raw, const unsigned long* lengths,
+		size_t count)
+{
+	if (count == 0) {
+		put("{}\n", 3);
+		return;
+	}
+
+	for (size_t i = 0; i < count; ++i) {
+		put(names_[i].data(), names_[i].length());
+		if (!raw[i]) {
+			put("null", 4);
+		}
+		else if (numeric_[i] && lengths[i] > 0) {
+			put(raw[i], lengths[i]);
+		}
+		else {
+			quoted(raw[i], lengths[i]);
+		}
+	}
+	put("}\n", 2);
+}
+
+} // end namespace libtabula
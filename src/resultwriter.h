@@ -0,0 +1,301 @@
+/// \file resultwriter.h
+/// \brief Declares the ResultWriter classes, which stream a "use"
+/// query's result set out to a file descriptor as CSV, TSV or JSON
+/// Lines.
+
+/***********************************************************************
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#if !defined(LIBTABULA_RESULTWRITER_H)
+#define LIBTABULA_RESULTWRITER_H
+
+#include "common.h"
+
+#include "noexceptions.h"
+#include "result.h"
+
+#include <string>
+#include <vector>
+
+#include <string.h>
+
+namespace libtabula {
+
+/// \brief Base class for the result set exporters
+///
+/// A ResultWriter reads a "use" query's rows straight from the
+/// database driver and formats them into one large buffer, which it
+/// writes to a file descriptor each time it fills.  No Row or String
+/// objects get built along the way, and no iostreams are involved, so
+/// exporting a big result set costs little more than copying its bytes
+/// around:
+///
+/// \code
+///   libtabula::Query q = conn.query("SELECT * FROM stock");
+///   libtabula::CSVWriter out(STDOUT_FILENO);
+///   out.write(q.use());
+/// \endcode
+///
+/// The subclasses decide the format.  Anything left in the buffer is
+/// written out by flush(), which write() calls when it reaches the end
+/// of the result set, and by the destructor.  The writer doesn't own
+/// the file descriptor, and never closes it.
+///
+/// On failure, these classes throw UseQueryError if given a result set
+/// that wasn't fetched, BadQuery if the connection fails partway
+/// through, or ExportFailed if the file descriptor can't be written to.
+/// If exceptions are disabled, write() and flush() return false instead,
+/// and error() says why.
+class LIBTABULA_EXPORT ResultWriter : public OptionalExceptions
+{
+public:
+	/// \brief Destroy the writer, flushing its buffer
+	///
+	/// Errors at this point are ignored, so call flush() yourself if
+	/// you need to know about them.
+	virtual ~ResultWriter();
+
+	/// \brief Returns the number of bytes written to the file
+	/// descriptor so far
+	ulonglong bytes() const { return bytes_; }
+
+	/// \brief Returns the reason the last write() or flush() failed
+	const std::string& error() const { return error_; }
+
+	/// \brief Write out whatever is in the buffer
+	///
+	/// \return false on error, if exceptions are disabled
+	bool flush();
+
+	/// \brief Returns the number of rows written so far, over all
+	/// calls to write()
+	ulonglong rows() const { return rows_; }
+
+	/// \brief Write a result set out, then flush the buffer
+	///
+	/// This consumes the result set, reading all of its rows.
+	///
+	/// \return false on error, if exceptions are disabled
+	bool write(const UseQueryResult& res);
+
+	/// \brief Write a stored result set out, then flush the buffer
+	///
+	/// \return false on error, if exceptions are disabled
+	bool write(const StoreQueryResult& res);
+
+protected:
+	/// \brief Create the object
+	///
+	/// \param fd file descriptor to write to
+	/// \param buffer_size how much output to collect before writing
+	/// \param te if true, throw exceptions on errors
+	ResultWriter(int fd, size_t buffer_size, bool te);
+
+	/// \brief Called once per write(), before the first row
+	///
+	/// The default does nothing.  Subclasses that write a header line
+	/// do it here.
+	virtual void begin(const Fields& fields);
+
+	/// \brief Called once per write(), after the last row
+	///
+	/// The default does nothing.  Subclasses that write a trailer, or
+	/// hold rows back to write them in groups, do it here.
+	virtual void end();
+
+	/// \brief Format one row into the buffer
+	///
+	/// \param raw the row's fields, with 0 for SQL null
+	/// \param lengths the length of each field in \c raw
+	/// \param count the number of fields
+	virtual void row(const char* const* raw, const unsigned long* lengths,
+			size_t count) = 0;
+
+	/// \brief Append a single character to the buffer
+	void put(char c)
+	{
+		if (pos_ == buffer_.size()) drain();
+		buffer_[pos_++] = c;
+	}
+
+	/// \brief Append a block of characters to the buffer
+	void put(const char* data, size_t length)
+	{
+		if (length <= buffer_.size() - pos_) {
+			memcpy(&buffer_[pos_], data, length);
+			pos_ += length;
+		}
+		else {
+			put_long(data, length);
+		}
+	}
+
+	/// \brief Append a null-terminated string to the buffer
+	void put(const char* str) { put(str, strlen(str)); }
+
+private:
+	ResultWriter(const ResultWriter&);
+	ResultWriter& operator =(const ResultWriter&);
+
+	/// \brief Write the buffer's contents to the file descriptor,
+	/// throwing ExportFailed on error
+	void drain();
+
+	/// \brief Record why an operation failed, and throw if we're
+	/// supposed to
+	bool fail(const std::string& why);
+
+	/// \brief put() for blocks that don't fit in what's left of the
+	/// buffer
+	void put_long(const char* data, size_t length);
+
+	int fd_;
+	std::vector<char> buffer_;
+	size_t pos_;				///< end of the data in buffer_
+	ulonglong bytes_;
+	ulonglong rows_;
+	std::string error_;
+};
+
+
+/// \brief Writes result sets as comma-separated values, per RFC 4180
+///
+/// Fields are quoted only when they contain a comma, a double quote,
+/// or a line break, and double quotes inside them are doubled.  Lines
+/// end with CR LF.  CSV has no way to tell SQL null from an empty
+/// string, so both come out as an empty field.
+class LIBTABULA_EXPORT CSVWriter : public ResultWriter
+{
+public:
+	/// \brief Create the object
+	///
+	/// \param fd file descriptor to write to
+	/// \param buffer_size how much output to collect before writing
+	/// \param te if true, throw exceptions on errors
+	explicit CSVWriter(int fd, size_t buffer_size = 1 << 20, bool te = true) :
+	ResultWriter(fd, buffer_size, te),
+	header_(true)
+	{
+	}
+
+	/// \brief Set whether to write a line of field names before each
+	/// result set
+	///
+	/// This is on by default.
+	void set_header(bool header) { header_ = header; }
+
+protected:
+	void begin(const Fields& fields);
+	void row(const char* const* raw, const unsigned long* lengths,
+			size_t count);
+
+private:
+	/// \brief Append one field, quoting it if needed
+	void field(const char* data, size_t length);
+
+	bool header_;
+};
+
+
+/// \brief Writes result sets as tab-separated values, escaped the way
+/// MySQL's \c SELECT \c INTO \c OUTFILE does by default
+///
+/// Tabs, newlines, carriage returns, backslashes and null bytes in the
+/// data become \c \\t, \c \\n, \c \\r, \c \\\\ and \c \\0, and SQL null
+/// is written as \c \\N, so <tt>LOAD DATA INFILE</tt> can read the
+/// output back in unchanged.
+class LIBTABULA_EXPORT TSVWriter : public ResultWriter
+{
+public:
+	/// \brief Create the object
+	///
+	/// \param fd file descriptor to write to
+	/// \param buffer_size how much output to collect before writing
+	/// \param te if true, throw exceptions on errors
+	explicit TSVWriter(int fd, size_t buffer_size = 1 << 20, bool te = true) :
+	ResultWriter(fd, buffer_size, te),
+	header_(false)
+	{
+	}
+
+	/// \brief Set whether to write a line of field names before each
+	/// result set
+	///
+	/// This is off by default.
+	void set_header(bool header) { header_ = header; }
+
+protected:
+	void begin(const Fields& fields);
+	void row(const char* const* raw, const unsigned long* lengths,
+			size_t count);
+
+private:
+	/// \brief Append one field, escaping it
+	void field(const char* data, size_t length);
+
+	bool header_;
+};
+
+
+/// \brief Writes result sets as JSON Lines, one object per row
+///
+/// Each row becomes a JSON object on a line of its own, with members
+/// named after the fields.  Integer, floating-point and decimal fields
+/// come out as JSON numbers, SQL null as \c null, and everything else
+/// as strings.  Data is passed through as-is other than the escaping
+/// JSON requires, so it should be UTF-8; binary columns aren't
+/// converted to anything JSON can carry.
+class LIBTABULA_EXPORT JSONLinesWriter : public ResultWriter
+{
+public:
+	/// \brief Create the object
+	///
+	/// \param fd file descriptor to write to
+	/// \param buffer_size how much output to collect before writing
+	/// \param te if true, throw exceptions on errors
+	explicit JSONLinesWriter(int fd, size_t buffer_size = 1 << 20,
+			bool te = true) :
+	ResultWriter(fd, buffer_size, te)
+	{
+	}
+
+protected:
+	void begin(const Fields& fields);
+	void row(const char* const* raw, const unsigned long* lengths,
+			size_t count);
+
+private:
+	/// \brief Append a JSON string literal
+	void quoted(const char* data, size_t length);
+
+	/// \brief Per field: the quoted, escaped name and the colon after
+	/// it, with the comma before it for all but the first
+	std::vector<std::string> names_;
+
+	/// \brief Per field: true if its values are written as numbers
+	std::vector<bool> numeric_;
+};
+
+} // end namespace libtabula
+
+#endif // !defined(LIBTABULA_RESULTWRITER_H)
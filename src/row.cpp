@@ -166,6 +166,21 @@ Row::field_num(const char* name) const
 }
 
 
+Row::size_type
+Row::memory_usage() const
+{
+	if (!initialized_) return 0;
+
+	// The Impl, its reference count, and its array of Strings
+	size_type n = sizeof(Impl) + sizeof(size_t) +
+			data_->capacity() * sizeof(value_type);
+	for (const_iterator it = data_->begin(); it != data_->end(); ++it) {
+		n += it->memory_usage();
+	}
+	return n;
+}
+
+
 Row&
 Row::operator =(const Row& rhs)
 {
@@ -307,6 +307,13 @@ public:
 	/// in container without resizing.
 	size_type max_size() const { return initialized_ ? data_->max_size() : 0; }
 
+	/// \brief Returns the bytes of memory the row's data takes up
+	///
+	/// This counts the row's vector of String objects and each one's
+	/// data buffer, but not the Row object itself, nor the field
+	/// names, which are shared with the result set.
+	size_type memory_usage() const;
+
 	/// \brief Assignment operator
 	Row& operator =(const Row& rhs);
 
@@ -0,0 +1,95 @@
+/***********************************************************************
+ rowbatch.cpp - Implements the RowBatch class.
+
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#define LIBTABULA_NOT_HEADER
+#include "rowbatch.h"
+
+#include "dbdriver.h"
+
+namespace libtabula {
+
+
+void
+RowBatch::clear()
+{
+	data_.clear();
+	offsets_.clear();
+	lengths_.clear();
+	nulls_.clear();
+	rows_ = 0;
+}
+
+
+bool
+RowBatch::fill(const UseQueryResult& res, size_t max_rows)
+{
+	DBDriver* driver = res.driver();
+	ResultBase::Impl& impl = res.impl();
+
+	clear();
+	fields_ = res.num_fields();
+	while (rows_ < max_rows) {
+		const char* const* raw = driver->fetch_raw_row(impl);
+		if (!raw) return false;
+
+		const unsigned long* lengths = driver->fetch_lengths(impl);
+		for (size_t i = 0; i < fields_; ++i) {
+			offsets_.push_back(data_.size());
+			if (raw[i]) {
+				data_.append(raw[i], lengths[i]);
+				lengths_.push_back(lengths[i]);
+				nulls_.push_back(0);
+			}
+			else {
+				lengths_.push_back(0);
+				nulls_.push_back(1);
+			}
+		}
+		++rows_;
+	}
+
+	return true;
+}
+
+
+Row
+RowBatch::row(size_t i, const RefCountedPointer<FieldNames>& names,
+		const FieldTypes& types, bool te) const
+{
+	Row::Impl* pd = new Row::Impl;
+	pd->reserve(fields_);
+	for (size_t f = 0, j = i * fields_; f < fields_; ++f, ++j) {
+		bool is_null = nulls_[j] != 0;
+		pd->push_back(Row::value_type(
+				is_null ? "NULL" : data_.data() + offsets_[j],
+				is_null ? 4 : lengths_[j],
+				types[f].base_type(),
+				is_null));
+	}
+
+	return Row(pd, names, te);
+}
+
+} // end namespace libtabula
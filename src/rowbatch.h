@@ -0,0 +1,103 @@
+/// \file rowbatch.h
+/// \brief Declares the RowBatch class, a block of raw rows read from
+/// a "use" query result set.
+
+/***********************************************************************
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#if !defined(LIBTABULA_ROWBATCH_H)
+#define LIBTABULA_ROWBATCH_H
+
+#include "common.h"
+
+#include "field_types.h"
+#include "result.h"
+#include "row.h"
+
+#include <string>
+#include <vector>
+
+namespace libtabula {
+
+/// \brief A block of rows copied out of a result set in raw form.
+///
+/// This is the unit of work the library's multithreaded row readers
+/// hand between threads.  Filling a batch touches only the DBDriver
+/// and the raw result set, and building a Row from one touches only
+/// the FieldNames pointer you pass, so one thread can fill batches
+/// while others turn them into Row objects.
+///
+/// Fields are stored row-major: the data for field \c f of row \c r is
+/// at index <tt>r * num_fields + f</tt> in the per-field vectors.
+class LIBTABULA_EXPORT RowBatch
+{
+public:
+	/// \brief Create an empty batch
+	RowBatch() :
+	fields_(0),
+	rows_(0)
+	{
+	}
+
+	/// \brief Empty the batch, keeping its allocated memory for reuse
+	void clear();
+
+	/// \brief Read up to \c max_rows rows from the given result set
+	/// into this batch, replacing its previous contents
+	///
+	/// \return false if we reached the end of the result set or hit an
+	/// error; check the driver's errnum() to tell the two apart.  The
+	/// batch may hold rows even when this returns false.
+	bool fill(const UseQueryResult& res, size_t max_rows);
+
+	/// \brief Build a Row object from one of the rows in this batch
+	///
+	/// \param i index of the row within the batch
+	/// \param names field name list to give the Row; must not be shared
+	///     with Row objects in use on another thread
+	/// \param types field types of the result set the batch came from
+	/// \param te if true, the Row throws exceptions on errors
+	Row row(size_t i, const RefCountedPointer<FieldNames>& names,
+			const FieldTypes& types, bool te = true) const;
+
+	/// \brief Returns the number of rows in the batch
+	size_t size() const { return rows_; }
+
+	/// \brief Returns true if the batch has no rows
+	bool empty() const { return rows_ == 0; }
+
+	/// \brief Returns the number of bytes of field data in the batch
+	size_t bytes() const { return data_.size(); }
+
+private:
+	std::string data_;					///< all field data, packed
+	std::vector<size_t> offsets_;		///< field start within data_
+	std::vector<unsigned long> lengths_;	///< field lengths
+	std::vector<char> nulls_;			///< nonzero if SQL null
+	size_t fields_;						///< fields per row
+	size_t rows_;						///< rows in this batch
+};
+
+} // end namespace libtabula
+
+#endif // !defined(LIBTABULA_ROWBATCH_H)
@@ -0,0 +1,182 @@
+/***********************************************************************
+ singleflight.cpp - Implements the SingleFlight class.
+
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#define LIBTABULA_NOT_HEADER
+#include "singleflight.h"
+
+#include "query.h"
+
+using namespace std;
+
+namespace libtabula {
+
+
+SingleFlight::Result::Result(Flight* flight) :
+flight_(flight)
+{
+	ScopedLock lock(flight_->mutex);
+	++flight_->refs;
+}
+
+
+SingleFlight::Result::Result(const Result& other) :
+flight_(other.flight_)
+{
+	if (flight_) {
+		ScopedLock lock(flight_->mutex);
+		++flight_->refs;
+	}
+}
+
+
+SingleFlight::Result&
+SingleFlight::Result::operator =(const Result& rhs)
+{
+	if (flight_ != rhs.flight_) {
+		release();
+		flight_ = rhs.flight_;
+		if (flight_) {
+			ScopedLock lock(flight_->mutex);
+			++flight_->refs;
+		}
+	}
+	return *this;
+}
+
+
+const StoreQueryResult&
+SingleFlight::Result::operator *() const
+{
+	static const StoreQueryResult empty;
+	return flight_ ? flight_->res : empty;
+}
+
+
+void
+SingleFlight::Result::release()
+{
+	if (!flight_) return;
+
+	bool last;
+	{
+		ScopedLock lock(flight_->mutex);
+		last = --flight_->refs == 0;
+	}
+	if (last) delete flight_;
+	flight_ = 0;
+}
+
+
+ulonglong
+SingleFlight::collapsed() const
+{
+	ScopedLock lock(mutex_);
+	return collapsed_;
+}
+
+
+ulonglong
+SingleFlight::executions() const
+{
+	ScopedLock lock(mutex_);
+	return executions_;
+}
+
+
+SingleFlight::Result
+SingleFlight::store(Query& q)
+{
+	return store(q.str(), q, 0);
+}
+
+
+SingleFlight::Result
+SingleFlight::store(Query& q, SQLQueryParms& p)
+{
+	return store(q.str(p), q, &p);
+}
+
+
+SingleFlight::Result
+SingleFlight::store(const std::string& sql, Query& q, SQLQueryParms* p)
+{
+	Result result;
+	bool leader;
+	{
+		ScopedLock lock(mutex_);
+		map<string, Flight*>::iterator it = flights_.find(sql);
+		leader = it == flights_.end();
+		if (leader) {
+			Flight* flight = new Flight;
+			flights_[sql] = flight;
+			result = Result(flight);
+			++executions_;
+		}
+		else {
+			result = Result(it->second);
+			++collapsed_;
+		}
+	}
+
+	Flight& flight = *result.flight_;
+	if (leader) {
+		try {
+			flight.res = p ? q.store(*p) : q.store();
+			if (!q) {
+				flight.failed = true;
+				flight.error = q.error();
+				flight.errnum = q.errnum();
+			}
+		}
+		catch (const BadQuery& e) {
+			flight.failed = true;
+			flight.error = e.what();
+			flight.errnum = e.errnum();
+		}
+		catch (const std::exception& e) {
+			flight.failed = true;
+			flight.error = e.what();
+		}
+
+		ScopedLock lock(mutex_);
+		flights_.erase(sql);
+		flight.done = true;
+		landed_.broadcast();
+	}
+	else {
+		if (!p) q.reset();		// as if we'd run it
+
+		ScopedLock lock(mutex_);
+		while (!flight.done) landed_.wait(mutex_);
+	}
+
+	if (flight.failed) {
+		if (throw_exceptions()) throw BadQuery(flight.error, flight.errnum);
+		return Result();
+	}
+	return result;
+}
+
+} // end namespace libtabula
@@ -0,0 +1,187 @@
+/// \file singleflight.h
+/// \brief Declares the SingleFlight class, which lets concurrent
+/// identical queries share one execution.
+
+/***********************************************************************
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#if !defined(LIBTABULA_SINGLEFLIGHT_H)
+#define LIBTABULA_SINGLEFLIGHT_H
+
+#include "common.h"
+
+#include "beemutex.h"
+#include "noexceptions.h"
+#include "result.h"
+#include "thread.h"
+
+#include <map>
+#include <string>
+
+namespace libtabula {
+
+#if !defined(DOXYGEN_IGNORE)
+// Make Doxygen ignore this
+class LIBTABULA_EXPORT Query;
+class LIBTABULA_EXPORT SQLQueryParms;
+#endif
+
+/// \brief Lets threads running the same read query at the same time
+/// share a single execution of it
+///
+/// When a popular cache entry expires, every thread that wanted it
+/// tends to run the same expensive query at once.  Send those queries
+/// through a SingleFlight instead of calling Query::store() directly:
+/// the first thread to ask runs the query, and any thread asking for
+/// the same SQL text before it finishes waits for it and gets the same
+/// result.  Once a query finishes, the next call runs it again; this
+/// is not a cache.
+///
+/// \code
+///   libtabula::SingleFlight flights;
+///   ...
+///   // on any thread, with its own connection:
+///   libtabula::Query q = conn.query();
+///   q << "SELECT * FROM stock WHERE weight > 1";
+///   libtabula::SingleFlight::Result res = flights.store(q);
+///   for (size_t i = 0; i < res->num_rows(); ++i) {
+///       cout << (*res)[i]["item"] << endl;
+///   }
+/// \endcode
+///
+/// Queries are matched by their SQL text alone, so use a separate
+/// SingleFlight for each database, and only send it statements that
+/// don't change anything.
+class LIBTABULA_EXPORT SingleFlight : public OptionalExceptions
+{
+private:
+	/// \brief One execution of a query, shared by every caller that
+	/// asked for it while it ran
+	struct Flight
+	{
+		StoreQueryResult res;	///< the result, once done
+		BeecryptMutex mutex;	///< guards refs
+		size_t refs;			///< Result objects pointing here
+		bool done;				///< query has finished
+		bool failed;			///< query failed
+		std::string error;		///< why it failed
+		int errnum;
+
+		Flight() : refs(0), done(false), failed(false), errnum(0) { }
+	};
+
+public:
+	/// \brief A read-only handle to a shared query result
+	///
+	/// Copies of a Result refer to the same StoreQueryResult, which
+	/// lives until the last one is destroyed.  They may be copied and
+	/// destroyed on any thread.
+	///
+	/// The StoreQueryResult itself may be in use on several threads
+	/// at once, so only read it through the const reference you get
+	/// here.  In particular, don't copy Row or StoreQueryResult
+	/// objects out of it: their reference counts aren't thread-safe.
+	/// Convert the fields you need to plain values instead.
+	class LIBTABULA_EXPORT Result
+	{
+	public:
+		/// \brief Create an empty handle
+		Result() : flight_(0) { }
+
+		/// \brief Create another handle to the same result
+		Result(const Result& other);
+
+		/// \brief Destroy the handle, and the result if this was the
+		/// last one
+		~Result() { release(); }
+
+		/// \brief Make this handle refer to the same result as
+		/// another
+		Result& operator =(const Result& rhs);
+
+		/// \brief Returns the shared result
+		const StoreQueryResult& operator *() const;
+
+		/// \brief Returns the shared result
+		const StoreQueryResult* operator ->() const
+				{ return &operator *(); }
+
+	private:
+		friend class SingleFlight;
+
+		explicit Result(Flight* flight);
+		void release();
+
+		Flight* flight_;
+	};
+
+	/// \brief Create the object
+	SingleFlight() : executions_(0), collapsed_(0) { }
+
+	/// \brief Run a query, or wait for the same query already running
+	/// on another thread and share its result
+	///
+	/// \param q a query that isn't a template query.  If this call
+	///     runs it, the query is reset afterward as with
+	///     Query::store(); otherwise, it is reset without running.
+	///
+	/// On failure, throws BadQuery if exceptions are enabled on this
+	/// object, else returns an empty result.  Every caller sharing the
+	/// execution sees the same failure.
+	Result store(Query& q);
+
+	/// \brief Run a template query, or wait for the same query with
+	/// the same parameters already running on another thread and
+	/// share its result
+	Result store(Query& q, SQLQueryParms& p);
+
+	/// \brief Returns the number of queries actually run
+	ulonglong executions() const;
+
+	/// \brief Returns the number of calls that shared another call's
+	/// execution instead of running their own query
+	ulonglong collapsed() const;
+
+private:
+	friend class Result;
+
+	SingleFlight(const SingleFlight&);
+	SingleFlight& operator =(const SingleFlight&);
+
+	/// \brief Code common to both store() overloads
+	///
+	/// \param sql text of the query, to match concurrent calls by
+	/// \param q the query to run, if no one else is running it
+	/// \param p template parameters, or 0 if \c q isn't a template
+	Result store(const std::string& sql, Query& q, SQLQueryParms* p);
+
+	mutable BeecryptMutex mutex_;		///< guards everything below
+	Condition landed_;					///< a flight finished
+	std::map<std::string, Flight*> flights_;	///< queries now running
+	ulonglong executions_;
+	ulonglong collapsed_;
+};
+
+} // end namespace libtabula
+
+#endif // !defined(LIBTABULA_SINGLEFLIGHT_H)
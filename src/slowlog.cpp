@@ -0,0 +1,340 @@
+/***********************************************************************
+ slowlog.cpp - Implements the SlowQueryLog class.
+
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#define LIBTABULA_NOT_HEADER
+#include "slowlog.h"
+
+#include "connection.h"
+#include "cpool.h"
+#include "exceptions.h"
+#include "fingerprint.h"
+#include "query.h"
+#include "scopedconnection.h"
+#include "utility.h"
+#include "mysql/driver.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+#include <errno.h>
+#include <string.h>
+
+using namespace std;
+
+namespace libtabula {
+
+// Turns a connection's slow query logging off for as long as it
+// lives, so the connection goes back to its pool as it came out, even
+// if a query on it throws
+class LogSuspender
+{
+public:
+	LogSuspender(Connection& conn) :
+	conn_(conn),
+	log_(conn.slow_query_log())
+	{
+		conn_.set_slow_query_log(0);
+	}
+
+	~LogSuspender() { conn_.set_slow_query_log(log_); }
+
+private:
+	Connection& conn_;
+	SlowQueryLog* log_;
+};
+
+
+// Returns true if MySQL can EXPLAIN a statement with this fingerprint
+static bool
+explainable(const string& fp)
+{
+	static const char* const verbs[] = {
+		"select", "insert", "update", "delete", "replace"
+	};
+	for (size_t i = 0; i < sizeof(verbs) / sizeof(verbs[0]); ++i) {
+		size_t n = strlen(verbs[i]);
+		if (fp.compare(0, n, verbs[i]) == 0 &&
+				(fp.length() == n || fp[n] == ' ')) {
+			return true;
+		}
+	}
+	return false;
+}
+
+
+SlowQueryLog::SlowQueryLog(const char* path, ulonglong threshold,
+		size_t capacity) :
+file_(fopen(path, "a")),
+threshold_(threshold),
+sample_every_(0),
+pool_(0),
+ring_(capacity ? capacity : 1),
+head_(0),
+count_(0),
+writing_(false),
+stopping_(false),
+written_(0),
+dropped_(0),
+thread_(*this)
+{
+	if (!file_) {
+		throw ExportFailed(string("Can't open slow query log ") + path +
+				": " + strerror(errno));
+	}
+
+	if (Thread::supported()) {
+		thread_.start();
+	}
+}
+
+
+SlowQueryLog::~SlowQueryLog()
+{
+	if (thread_.running()) {
+		{
+			ScopedLock lock(mutex_);
+			stopping_ = true;
+			queued_.signal();
+		}
+		thread_.join();
+	}
+	else {
+		flush();
+	}
+
+	fclose(file_);
+}
+
+
+ulonglong
+SlowQueryLog::dropped() const
+{
+	ScopedLock lock(mutex_);
+	return dropped_;
+}
+
+
+void
+SlowQueryLog::Entry::swap(Entry& other)
+{
+	std::swap(when, other.when);
+	std::swap(elapsed, other.elapsed);
+	std::swap(rows, other.rows);
+	std::swap(conn_id, other.conn_id);
+	std::swap(errnum, other.errnum);
+	sql.swap(other.sql);
+}
+
+
+string
+SlowQueryLog::error() const
+{
+	ScopedLock lock(mutex_);
+	return error_;
+}
+
+
+string
+SlowQueryLog::explain(const string& sql)
+{
+	ConnectionPool* pool = pool_;
+	if (!pool) return string();
+
+	try {
+		ScopedConnection conn(*pool);
+
+		// Don't log the EXPLAIN itself, if the pool's connections are
+		// logging to us
+		LogSuspender suspended(*conn);
+
+		Query q = conn->query();
+		q << "EXPLAIN FORMAT=JSON " << sql;
+		StoreQueryResult res = q.store();
+
+		if (res.num_rows() > 0 && res.num_fields() > 0) {
+			return string(res[0][0].data(), res[0][0].length());
+		}
+	}
+	catch (...) {
+		// The query may not be explainable after all, or the pool's
+		// server may be down.  Either way, log the query without it.
+	}
+	return string();
+}
+
+
+void
+SlowQueryLog::flush()
+{
+	if (thread_.running()) {
+		ScopedLock lock(mutex_);
+		while (count_ > 0 || writing_) {
+			idle_.wait(mutex_);
+		}
+	}
+	else {
+		vector<Entry> batch;
+		{
+			ScopedLock lock(mutex_);
+			take(batch);
+		}
+		write(batch);
+	}
+}
+
+
+void
+SlowQueryLog::record(Connection& conn, const char* sql, size_t length,
+		ulonglong elapsed, ulonglong rows, int errnum)
+{
+	try {
+		// Build the entry before taking the lock, so all we do while
+		// holding it is swap the entry into the ring
+		Entry e;
+		e.when = time(0);
+		e.elapsed = elapsed;
+		e.rows = rows;
+		e.errnum = errnum;
+		e.sql.assign(sql, length);
+		if (MySQLDriver* md = dynamic_cast<MySQLDriver*>(conn.driver())) {
+			e.conn_id = md->thread_id();
+		}
+
+		ScopedLock lock(mutex_);
+		if (count_ == ring_.size()) {
+			++dropped_;
+			return;
+		}
+		ring_[(head_ + count_++) % ring_.size()].swap(e);
+		queued_.signal();
+	}
+	catch (...) {
+		// Out of memory, most likely; not worth failing the query for
+	}
+}
+
+
+void
+SlowQueryLog::run()
+{
+	vector<Entry> batch;
+	for (;;) {
+		{
+			ScopedLock lock(mutex_);
+			writing_ = false;
+			idle_.broadcast();
+			while (count_ == 0 && !stopping_) {
+				queued_.wait(mutex_);
+			}
+			if (count_ == 0) break;		// stopping, and nothing left
+			take(batch);
+			writing_ = true;
+		}
+
+		write(batch);
+	}
+}
+
+
+void
+SlowQueryLog::take(vector<Entry>& batch)
+{
+	batch.resize(count_);
+	for (size_t i = 0; i < count_; ++i) {
+		batch[i].swap(ring_[(head_ + i) % ring_.size()]);
+	}
+	head_ = (head_ + count_) % ring_.size();
+	count_ = 0;
+}
+
+
+// gmtime(), but safe to call from the logging thread while other
+// threads call it, too
+static void
+safe_gmtime(struct tm* ptm, const time_t t)
+{
+#if defined(LIBTABULA_HAVE_LOCALTIME_S)
+	// The VC++ 2005 and up RTL has gmtime_s() alongside localtime_s()
+	gmtime_s(ptm, &t);
+#elif defined(HAVE_GMTIME_R)
+	gmtime_r(&t, ptm);
+#else
+	memcpy(ptm, gmtime(&t), sizeof(tm));
+#endif
+}
+
+
+void
+SlowQueryLog::write(const vector<Entry>& batch)
+{
+	ostringstream os;
+	os.imbue(std::locale::classic());
+	for (size_t i = 0; i < batch.size(); ++i) {
+		const Entry& e = batch[i];
+		Fingerprint fp(e.sql);
+
+		struct tm utc;
+		safe_gmtime(&utc, e.when);
+		char when[32];
+		strftime(when, sizeof(when), "%Y-%m-%dT%H:%M:%SZ", &utc);
+		os << "{\"time\":\"" << when << "\",\"conn_id\":" << e.conn_id <<
+				",\"elapsed_us\":" << e.elapsed << ",\"rows\":" <<
+				e.rows << ",\"errnum\":" << e.errnum <<
+				",\"digest\":\"" << hex << setw(16) << setfill('0') <<
+				fp.digest() << dec << "\",\"fingerprint\":";
+		internal::json_string(os, fp.text());
+		os << ",\"sql\":";
+		internal::json_string(os, e.sql);
+		if (explainable(fp.text())) {
+			string plan = explain(e.sql);
+			if (!plan.empty()) os << ",\"explain\":" << plan;
+		}
+		os << "}\n";
+	}
+
+	const string out = os.str();
+	bool ok = fwrite(out.data(), 1, out.length(), file_) == out.length() &&
+			fflush(file_) == 0;
+
+	ScopedLock lock(mutex_);
+	if (ok) {
+		written_ += batch.size();
+	}
+	else if (error_.empty()) {
+		error_ = string("Failed to write slow query log: ") +
+				strerror(errno);
+	}
+}
+
+
+ulonglong
+SlowQueryLog::written() const
+{
+	ScopedLock lock(mutex_);
+	return written_;
+}
+
+} // end namespace libtabula
@@ -0,0 +1,199 @@
+/// \file slowlog.h
+/// \brief Declares the SlowQueryLog class, which records queries that
+/// take too long, and a sample of the rest, to a file.
+
+/***********************************************************************
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#if !defined(LIBTABULA_SLOWLOG_H)
+#define LIBTABULA_SLOWLOG_H
+
+#include "common.h"
+
+#include "stopwatch.h"
+#include "thread.h"
+
+#include <string>
+#include <vector>
+
+#include <stdio.h>
+#include <time.h>
+
+namespace libtabula {
+
+#if !defined(DOXYGEN_IGNORE)
+class LIBTABULA_EXPORT Connection;
+class LIBTABULA_EXPORT ConnectionPool;
+#endif
+
+/// \brief Records slow queries, and a sample of all queries, to a file
+///
+/// Give one of these to Connection::set_slow_query_log(), and every
+/// query run through that connection's Query objects is timed, from
+/// sending it to having its result set in hand.  Queries that take at
+/// least the threshold time are logged, as is roughly one query in
+/// every set_sample_every() regardless of time.
+///
+/// Each query is logged as one line of JSON, with the time it was
+/// run, the server's ID for the connection, how long it took in
+/// microseconds, the rows it returned or affected, its error number,
+/// and both its SQL text and its Fingerprint.  The SQL text is the
+/// query as sent, so it includes any template parameters' values.
+/// If set_explain() has been called, queries that MySQL can explain
+/// also get the output of \c EXPLAIN \c FORMAT=JSON, run on another
+/// connection from the given pool.
+///
+/// The query's own thread only copies the details into a ring
+/// buffer.  A background thread does the rest, so neither the file
+/// nor the \c EXPLAIN holds up the query.  If the ring fills faster
+/// than it can be written, further queries are dropped and counted.
+/// In builds without thread support, the log is written out only
+/// when you call flush(), and when the object is destroyed.
+///
+/// A connection's log must outlive its use by that connection, and
+/// one log can be shared by any number of connections.
+class LIBTABULA_EXPORT SlowQueryLog : private Thread::Runnable
+{
+public:
+	/// \brief Create the object, opening the file and starting the
+	/// background thread
+	///
+	/// \param path file to append the log to
+	/// \param threshold log queries taking at least this many
+	/// microseconds
+	/// \param capacity most queries to hold waiting to be written
+	///
+	/// Throws ExportFailed if the file can't be opened.
+	explicit SlowQueryLog(const char* path, ulonglong threshold = 100000,
+			size_t capacity = 1024);
+
+	/// \brief Write out anything still waiting, then stop the
+	/// background thread and close the file
+	~SlowQueryLog();
+
+	/// \brief Also log about one in every \c n queries, however long
+	/// they take
+	///
+	/// 0, the default, turns sampling off.  Queries are picked by the
+	/// low bits of their start time, so no state is shared between
+	/// the threads running them.
+	void set_sample_every(unsigned long n) { sample_every_ = n; }
+
+	/// \brief Run \c EXPLAIN \c FORMAT=JSON on each logged \c SELECT,
+	/// \c INSERT, \c UPDATE, \c DELETE or \c REPLACE, on a connection
+	/// grabbed from the given pool
+	///
+	/// Pass 0 to stop.  The \c EXPLAIN runs on the background thread,
+	/// and isn't itself logged.  Bear in mind that it shows the plan
+	/// the server would choose now, which may not be the one it chose
+	/// when the query ran.
+	void set_explain(ConnectionPool* pool) { pool_ = pool; }
+
+	/// \brief Block until everything logged so far has been written
+	void flush();
+
+	/// \brief Returns the number of queries written to the log
+	ulonglong written() const;
+
+	/// \brief Returns the number of queries dropped because the ring
+	/// buffer was full
+	ulonglong dropped() const;
+
+	/// \brief Returns the first error writing the file, or an empty
+	/// string if there hasn't been one
+	std::string error() const;
+
+	/// \brief Log a query if it took long enough, or is sampled
+	///
+	/// \internal Query calls this after running each query, if its
+	/// connection has a log.  It doesn't throw.
+	void query_done(Connection& conn, const char* sql, size_t length,
+			ulonglong start, ulonglong rows, int errnum)
+	{
+		ulonglong elapsed = Stopwatch::now() - start;
+		if (elapsed >= threshold_ ||
+				(sample_every_ && start % sample_every_ == 0)) {
+			record(conn, sql, length, elapsed, rows, errnum);
+		}
+	}
+
+private:
+	/// \brief One query waiting to be written
+	struct Entry
+	{
+		time_t when;
+		ulonglong elapsed;
+		ulonglong rows;
+		unsigned long conn_id;
+		int errnum;
+		std::string sql;
+
+		Entry() : when(0), elapsed(0), rows(0), conn_id(0), errnum(0) { }
+		void swap(Entry& other);
+	};
+
+	/// \brief Copy a query's details into the ring buffer
+	void record(Connection& conn, const char* sql, size_t length,
+			ulonglong elapsed, ulonglong rows, int errnum);
+
+	/// \brief Take everything out of the ring buffer
+	///
+	/// The caller must hold mutex_.
+	void take(std::vector<Entry>& batch);
+
+	/// \brief Write entries to the file
+	void write(const std::vector<Entry>& batch);
+
+	/// \brief Get the EXPLAIN output for a query, or an empty string
+	std::string explain(const std::string& sql);
+
+	/// \brief Body of the background thread
+	void run();
+
+	FILE* file_;
+	ulonglong threshold_;
+	unsigned long sample_every_;
+	ConnectionPool* pool_;
+
+	std::vector<Entry> ring_;
+	size_t head_;				///< oldest entry in ring_
+	size_t count_;				///< entries waiting in ring_
+	bool writing_;				///< background thread has a batch
+	bool stopping_;				///< dtor wants the thread to exit
+	ulonglong written_;
+	ulonglong dropped_;
+	std::string error_;
+
+	mutable BeecryptMutex mutex_;
+	Condition queued_;			///< signalled when entries are added
+	Condition idle_;			///< signalled when a batch is written
+	Thread thread_;
+
+	// Not copyable
+	SlowQueryLog(const SlowQueryLog&);
+	SlowQueryLog& operator=(const SlowQueryLog&);
+};
+
+} // end namespace libtabula
+
+#endif // !defined(LIBTABULA_SLOWLOG_H)
@@ -0,0 +1,259 @@
+/***********************************************************************
+ snapshot.cpp - Implements the Snapshot class.
+
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#define LIBTABULA_NOT_HEADER
+#include "snapshot.h"
+
+#include "binio.h"
+#include "exceptions.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#if defined(HAVE_MMAP)
+#	include <fcntl.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace libtabula {
+
+static const char magic[] = "LTSNAPSH";
+static const size_t magic_length = 8;
+
+// The contents of a snapshot file, in memory
+class SnapshotData : public SQLBufferOwner
+{
+public:
+	SnapshotData() :
+	data_(0),
+	size_(0),
+	mapped_(false)
+	{
+	}
+
+	~SnapshotData()
+	{
+#if defined(HAVE_MMAP)
+		if (mapped_) {
+			munmap(const_cast<char*>(data_), size_);
+			return;
+		}
+#endif
+		delete[] data_;
+	}
+
+	const char* data() const { return data_; }
+
+	bool open(const std::string& path)
+	{
+#if defined(HAVE_MMAP)
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) return false;
+
+		struct stat st;
+		bool ok = false;
+		if (fstat(fd, &st) == 0 && st.st_size > 0 &&
+				off_t(size_t(st.st_size)) == st.st_size) {
+			void* p = mmap(0, size_t(st.st_size), PROT_READ, MAP_PRIVATE,
+					fd, 0);
+			if (p != MAP_FAILED) {
+				data_ = static_cast<const char*>(p);
+				size_ = size_t(st.st_size);
+				ok = mapped_ = true;
+			}
+		}
+		::close(fd);
+		if (ok) return true;
+#endif
+
+		// No mmap, or it failed; read the whole file instead
+		FILE* f = fopen(path.c_str(), "rb");
+		if (!f) return false;
+
+		string contents;
+		char block[65536];
+		size_t n;
+		while ((n = fread(block, 1, sizeof(block), f)) > 0) {
+			contents.append(block, n);
+		}
+		bool ok_read = !ferror(f);
+		fclose(f);
+		if (!ok_read) return false;
+
+		char* p = new char[contents.size() + 1];
+		memcpy(p, contents.data(), contents.size());
+		data_ = p;
+		size_ = contents.size();
+		return true;
+	}
+
+	size_t size() const { return size_; }
+
+private:
+	const char* data_;
+	size_t size_;
+	bool mapped_;
+};
+
+
+bool
+Snapshot::fail(const std::string& why)
+{
+	error_ = why;
+	if (throw_exceptions()) throw BadSnapshot(why);
+	return false;
+}
+
+
+StoreQueryResult
+Snapshot::load(const std::string& path)
+{
+	error_.clear();
+
+	SnapshotData* pd = new SnapshotData;
+	RefCountedPointer<SQLBufferOwner> owner(pd);
+	if (!pd->open(path)) {
+		fail("Failed to read snapshot " + path);
+		return StoreQueryResult();
+	}
+
+	internal::BinaryReader in(pd->data(), pd->size());
+	const char* m = in.bytes(magic_length);
+	if (!m || memcmp(m, magic, magic_length) != 0) {
+		fail(path + " is not a result set snapshot");
+		return StoreQueryResult();
+	}
+	else if (in.number(4) != version) {
+		fail(path + " is from an unknown snapshot format version");
+		return StoreQueryResult();
+	}
+
+	size_t num_fields = size_t(in.number(4));
+	ulonglong num_rows = in.number(8);
+	Fields fields;
+	for (size_t i = 0; in.ok() && i < num_fields; ++i) {
+		string name = in.text();
+		string table = in.text();
+		string db = in.text();
+		unsigned int id = static_cast<unsigned int>(in.number(2));
+		size_t length = size_t(in.number(8));
+		size_t max_length = size_t(in.number(8));
+		fields.push_back(Field(name.c_str(), table.c_str(), db.c_str(),
+				FieldType(FieldType::Base(id & 0xFF), id >> 8),
+				length, max_length));
+	}
+
+	StoreQueryResult res(fields, throw_exceptions());
+	const FieldTypes& types = *res.field_types();
+	size_t bitmap_bytes = (num_fields + 7) / 8;
+	for (ulonglong r = 0; in.ok() && r < num_rows; ++r) {
+		const char* nulls = in.bytes(bitmap_bytes);
+		Row::Impl* row = new Row::Impl;
+		row->reserve(num_fields);
+		for (size_t i = 0; nulls && i < num_fields; ++i) {
+			FieldType::Base type = types[i].base_type();
+			if (nulls[i / 8] & (1 << (i % 8))) {
+				row->push_back(String("NULL", 4, type, true, owner));
+			}
+			else {
+				size_t n = size_t(in.number(4));
+				const char* p = in.bytes(n + 1);
+				if (!p) break;
+				row->push_back(String(p, n, type, false, owner));
+			}
+		}
+		res.push_back(Row(row, res.field_names(), throw_exceptions()));
+	}
+
+	if (!in.ok()) {
+		fail("Snapshot " + path + " is truncated");
+		return StoreQueryResult();
+	}
+
+	return res;
+}
+
+
+bool
+Snapshot::save(const StoreQueryResult& res, const std::string& path)
+{
+	error_.clear();
+
+	string temp = path + ".tmp";
+	FILE* f = fopen(temp.c_str(), "wb");
+	if (!f) return fail("Failed to create snapshot " + temp);
+
+	internal::BinaryWriter out(f);
+	out.bytes(magic, magic_length);
+	out.number(version, 4);
+	out.number(res.num_fields(), 4);
+	out.number(res.num_rows(), 8);
+	for (size_t i = 0; i < res.num_fields(); ++i) {
+		const Field& fld = res.field(static_cast<unsigned int>(i));
+		out.text(fld.name());
+		out.text(fld.table());
+		out.text(fld.db());
+		out.number(fld.type().id(), 2);
+		out.number(fld.length(), 8);
+		out.number(fld.max_length(), 8);
+	}
+
+	string nulls;
+	for (size_t r = 0; r < res.num_rows(); ++r) {
+		const Row& row = res[r];
+		nulls.assign((res.num_fields() + 7) / 8, '\0');
+		for (size_t i = 0; i < res.num_fields(); ++i) {
+			if (row[i].is_null()) nulls[i / 8] |= char(1 << (i % 8));
+		}
+		out.bytes(nulls.data(), nulls.size());
+
+		for (size_t i = 0; i < res.num_fields(); ++i) {
+			if (!row[i].is_null()) {
+				out.number(row[i].length(), 4);
+				out.bytes(row[i].data(), row[i].length());
+				out.bytes("", 1);
+			}
+		}
+	}
+
+	bool ok = out.flush();
+	ok = fclose(f) == 0 && ok;
+#if defined(LIBTABULA_PLATFORM_WINDOWS)
+	// rename() won't replace an existing file here
+	if (ok) remove(path.c_str());
+#endif
+	if (!ok || rename(temp.c_str(), path.c_str()) != 0) {
+		remove(temp.c_str());
+		return fail("Failed to write snapshot " + path);
+	}
+
+	return true;
+}
+
+} // end namespace libtabula
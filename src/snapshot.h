@@ -0,0 +1,112 @@
+/// \file snapshot.h
+/// \brief Declares the Snapshot class, which saves result sets to
+/// files in a binary form and loads them back.
+
+/***********************************************************************
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#if !defined(LIBTABULA_SNAPSHOT_H)
+#define LIBTABULA_SNAPSHOT_H
+
+#include "common.h"
+
+#include "noexceptions.h"
+#include "result.h"
+
+#include <string>
+
+namespace libtabula {
+
+/// \brief Saves a StoreQueryResult to a file, and loads it back
+///
+/// This is for keeping query results on local disk between runs of a
+/// program, as for a cache that should start warm.  Saving writes the
+/// result set in one pass, to a temporary file next to the named one
+/// that it then renames, so a reader never sees half a snapshot.
+/// Loading maps the file into memory where the platform allows it, or
+/// else reads it in whole, and builds a StoreQueryResult whose String
+/// objects point into that memory rather than holding copies of the
+/// data.  The memory stays around until the last String pointing into
+/// it is gone.
+///
+/// \code
+///   libtabula::Snapshot snap;
+///   snap.save(query.store(), "/var/cache/app/stock.snap");
+///   ...
+///   libtabula::StoreQueryResult res =
+///           snap.load("/var/cache/app/stock.snap");
+/// \endcode
+///
+/// The format is versioned, and load() refuses files with a version it
+/// doesn't know.  All integers are little-endian.  A file holds:
+///
+/// - the 8 bytes \c LTSNAPSH, then the format version, field count and
+///   row count as 32-, 32- and 64-bit integers
+/// - for each field, its name, table and database names, each as a
+///   32-bit length followed by the text; then its FieldType::id() as a
+///   16-bit integer, and its length and max_length as 64-bit integers
+/// - for each row, a bitmap with one bit per field, set for SQL nulls;
+///   then for each non-null field, a 32-bit length, the data, and a
+///   null byte
+///
+/// Only the field information listed above survives the trip.
+class LIBTABULA_EXPORT Snapshot : public OptionalExceptions
+{
+public:
+	/// \brief The format version save() writes
+	static const unsigned int version = 1;
+
+	/// \brief Create the object
+	///
+	/// \param te if true, throw BadSnapshot on errors
+	explicit Snapshot(bool te = true) :
+	OptionalExceptions(te)
+	{
+	}
+
+	/// \brief Returns the reason the last load() or save() failed
+	const std::string& error() const { return error_; }
+
+	/// \brief Load a result set saved by save()
+	///
+	/// \return the result set, or a falsy one on error if exceptions
+	///     are disabled
+	StoreQueryResult load(const std::string& path);
+
+	/// \brief Save a result set to a file, replacing any file already
+	/// there
+	///
+	/// \return false on error, if exceptions are disabled
+	bool save(const StoreQueryResult& res, const std::string& path);
+
+private:
+	/// \brief Record why an operation failed, and throw if we're
+	/// supposed to
+	bool fail(const std::string& why);
+
+	std::string error_;
+};
+
+} // end namespace libtabula
+
+#endif // !defined(LIBTABULA_SNAPSHOT_H)
@@ -0,0 +1,310 @@
+/***********************************************************************
+ spillresult.cpp - Implements the SpillQueryResult class.
+
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#define LIBTABULA_NOT_HEADER
+#include "spillresult.h"
+
+#include "dbdriver.h"
+#include "exceptions.h"
+
+#include <stdio.h>
+
+#if defined(HAVE_MMAP)
+#	include <sys/mman.h>
+#endif
+
+using namespace std;
+
+namespace libtabula {
+
+// Each field is packed as a 4-byte little-endian length followed by
+// the data, with a length of all ones standing for SQL null.
+static const unsigned long null_length = 0xFFFFFFFFUL;
+
+
+class SpillQueryResult::Storage
+{
+public:
+	explicit Storage(size_t budget) :
+	budget_(budget),
+	file_(0),
+	file_bytes_(0),
+	map_(0),
+	peak_(0)
+	{
+	}
+
+	~Storage()
+	{
+#if defined(HAVE_MMAP)
+		if (map_) munmap(const_cast<char*>(map_), size_t(file_bytes_));
+#endif
+		if (file_) fclose(file_);
+	}
+
+	// Pack a row, spilling to the file if we're over budget
+	bool add(const char* const* raw, const unsigned long* lengths,
+			size_t fields)
+	{
+		offsets_.push_back(file_bytes_ + buf_.size());
+		for (size_t i = 0; i < fields; ++i) {
+			unsigned long len = raw[i] ? lengths[i] : null_length;
+			for (int b = 0; b < 4; ++b) {
+				buf_ += char((len >> (8 * b)) & 0xFF);
+			}
+			if (raw[i]) buf_.append(raw[i], lengths[i]);
+		}
+
+		note_peak();
+		return buf_.size() <= budget_ || flush();
+	}
+
+	// Called after the last add(), to get ready for row()
+	bool finish()
+	{
+		if (!file_) return true;		// all in memory
+		if (!flush() || fflush(file_) != 0) return false;
+
+		string().swap(buf_);			// give the memory back
+#if defined(HAVE_MMAP)
+		if (file_bytes_ > 0 && ulonglong(size_t(file_bytes_)) == file_bytes_) {
+			void* p = mmap(0, size_t(file_bytes_), PROT_READ, MAP_PRIVATE,
+					fileno(file_), 0);
+			if (p != MAP_FAILED) map_ = static_cast<const char*>(p);
+		}
+#endif
+		return true;
+	}
+
+	ulonglong disk_bytes() const { return file_bytes_; }
+
+	const string& error() const { return error_; }
+
+	size_t peak() const { return peak_; }
+
+	// Return a pointer to the packed form of row i, reading it into
+	// scratch if the file isn't mapped
+	const char* row(size_t i, vector<char>& scratch)
+	{
+		if (!file_) return buf_.data() + offsets_[i];
+		if (map_) return map_ + offsets_[i];
+
+		ulonglong end = i + 1 < offsets_.size() ?
+				offsets_[i + 1] : file_bytes_;
+		scratch.resize(size_t(end - offsets_[i]) + 1);
+#if defined(LIBTABULA_PLATFORM_WINDOWS)
+		int seek = _fseeki64(file_, __int64(offsets_[i]), SEEK_SET);
+#else
+		int seek = fseeko(file_, off_t(offsets_[i]), SEEK_SET);
+#endif
+		if (seek != 0 || fread(&scratch[0], 1, scratch.size() - 1, file_) !=
+				scratch.size() - 1) {
+			return 0;
+		}
+		return &scratch[0];
+	}
+
+	size_t size() const { return offsets_.size(); }
+
+private:
+	// Append the buffered rows to the file, creating it if needed
+	bool flush()
+	{
+		if (!file_ && !(file_ = tmpfile())) {
+			error_ = "Failed to create temporary file for result set";
+			return false;
+		}
+		if (!buf_.empty() &&
+				fwrite(buf_.data(), 1, buf_.size(), file_) != buf_.size()) {
+			error_ = "Failed to write result set to temporary file";
+			return false;
+		}
+
+		file_bytes_ += buf_.size();
+		buf_.clear();
+		return true;
+	}
+
+	void note_peak()
+	{
+		size_t bytes = buf_.capacity() +
+				offsets_.capacity() * sizeof(ulonglong);
+		if (bytes > peak_) peak_ = bytes;
+	}
+
+	size_t budget_;
+	string buf_;				///< packed rows not in the file
+	vector<ulonglong> offsets_;	///< where each row starts
+	FILE* file_;
+	ulonglong file_bytes_;		///< bytes written to file_
+	const char* map_;			///< file_ mapped into memory, if we could
+	size_t peak_;
+	string error_;
+};
+
+
+SpillQueryResult::SpillQueryResult() :
+ResultBase(),
+copacetic_(false)
+{
+}
+
+
+SpillQueryResult::SpillQueryResult(const SpillQueryResult& other) :
+ResultBase(),
+copacetic_(false)
+{
+	copy(other);
+}
+
+
+SpillQueryResult::SpillQueryResult(const UseQueryResult& res,
+		size_t budget, bool te) :
+ResultBase(res),
+source_(res),
+storage_(new Storage(budget)),
+copacetic_(false)
+{
+	set_exceptions(te);
+
+	DBDriver* dbd = res.driver();
+	Impl& impl = res.impl();
+	size_t fields = num_fields();
+	bool stored = true;
+	while (const char* const* raw = dbd->fetch_raw_row(impl)) {
+		if (!storage_->add(raw, dbd->fetch_lengths(impl), fields)) {
+			// Read the rest so the connection can be used again
+			while (dbd->fetch_raw_row(impl)) { }
+			stored = false;
+			break;
+		}
+	}
+
+	if (!stored || !storage_->finish()) {
+		if (te) throw UseQueryError(storage_->error().c_str());
+	}
+	else if (dbd->errnum() != 0) {
+		if (te) throw BadQuery(dbd->error(), dbd->errnum());
+	}
+	else {
+		copacetic_ = true;
+	}
+}
+
+
+SpillQueryResult::~SpillQueryResult()
+{
+}
+
+
+Row
+SpillQueryResult::at(size_type i) const
+{
+	if (i >= size()) {
+		throw BadIndex("SpillQueryResult", int(i), int(size()) - 1);
+	}
+	return operator [](i);
+}
+
+
+SpillQueryResult&
+SpillQueryResult::copy(const SpillQueryResult& other)
+{
+	if (this != &other) {
+		ResultBase::copy(other);
+		source_ = other.source_;
+		storage_ = other.storage_;
+		copacetic_ = other.copacetic_;
+	}
+
+	return *this;
+}
+
+
+ulonglong
+SpillQueryResult::disk_bytes() const
+{
+	return storage_ ? storage_->disk_bytes() : 0;
+}
+
+
+size_t
+SpillQueryResult::peak_bytes() const
+{
+	return storage_ ? storage_->peak() : 0;
+}
+
+
+SpillQueryResult::size_type
+SpillQueryResult::size() const
+{
+	return storage_ ? storage_->size() : 0;
+}
+
+
+Row
+SpillQueryResult::operator [](size_type i) const
+{
+	vector<char> scratch;
+	const unsigned char* p = reinterpret_cast<const unsigned char*>(
+			storage_->row(i, scratch));
+	if (!p) {
+		if (throw_exceptions()) {
+			throw UseQueryError("Failed to read result set from "
+					"temporary file");
+		}
+		return Row();
+	}
+
+	size_t fields = num_fields();
+	Row::Impl* pd = new Row::Impl;
+	pd->reserve(fields);
+	for (size_t f = 0; f < fields; ++f) {
+		unsigned long len = 0;
+		for (int b = 0; b < 4; ++b) {
+			len |= static_cast<unsigned long>(*p++) << (8 * b);
+		}
+
+		bool is_null = len == null_length;
+		pd->push_back(Row::value_type(
+				is_null ? "NULL" : reinterpret_cast<const char*>(p),
+				is_null ? 4 : len,
+				field_type(int(f)).base_type(),
+				is_null));
+		if (!is_null) p += len;
+	}
+
+	return Row(pd, field_names(), throw_exceptions());
+}
+
+
+const Row&
+SpillQueryResult::const_iterator::operator *() const
+{
+	if (!row_) row_ = (*res_)[i_];
+	return row_;
+}
+
+} // end namespace libtabula
@@ -0,0 +1,231 @@
+/// \file spillresult.h
+/// \brief Declares the SpillQueryResult class, a stored result set
+/// that moves to a temporary file once it outgrows a memory budget.
+
+/***********************************************************************
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#if !defined(LIBTABULA_SPILLRESULT_H)
+#define LIBTABULA_SPILLRESULT_H
+
+#include "common.h"
+
+#include "result.h"
+#include "row.h"
+
+#include <iterator>
+#include <vector>
+
+namespace libtabula {
+
+/// \brief A random-access result set with a cap on the memory it uses
+///
+/// StoreQueryResult keeps the whole result set in memory, and while
+/// it's being built there are two copies of it: one in the C API's
+/// result structure and one in the Row objects.  A report query that
+/// returns more than you expected can take all the memory your program
+/// has.
+///
+/// Query::spill() returns one of these instead.  It reads the rows in
+/// sequence, as with Query::use(), packing them into a compact binary
+/// form.  As long as the packed rows fit in the memory budget you give,
+/// they stay in memory.  Once they outgrow it, they move to an
+/// anonymous temporary file, and later rows are appended to that file
+/// through a buffer no larger than the budget.  When all rows are in,
+/// the file is memory-mapped where the platform allows it, so reading
+/// rows back doesn't take a system call each.
+///
+/// You index and iterate over rows as with StoreQueryResult, except
+/// that a Row is built from the packed form each time you ask for it,
+/// so you get it by value rather than by reference.  Copies of a
+/// SpillQueryResult share the same packed rows.
+///
+/// The budget covers the packed row data only.  There is also an
+/// 8-byte offset per row, which peak_bytes() includes.
+///
+/// Reading rows from a file that couldn't be memory-mapped changes
+/// the file position, so don't read from one SpillQueryResult on
+/// several threads at once.
+class LIBTABULA_EXPORT SpillQueryResult : public ResultBase
+{
+private:
+	/// \brief Pointer to bool data member, for use by safe bool
+	/// conversion operator.
+	///
+	/// \see http://www.artima.com/cppsource/safebool.html
+	typedef bool SpillQueryResult::*private_bool_type;
+
+	/// \brief Packed rows, in memory or on disk; defined in
+	/// spillresult.cpp
+	class Storage;
+
+public:
+	/// \brief Iterator over the rows of a SpillQueryResult
+	///
+	/// Dereferencing this builds the Row, which the iterator holds
+	/// until it moves.
+	class LIBTABULA_EXPORT const_iterator
+	{
+	public:
+		typedef std::random_access_iterator_tag iterator_category;
+		typedef Row value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef const Row* pointer;
+		typedef const Row& reference;
+
+		/// \brief Create an iterator that points nowhere
+		const_iterator() : res_(0), i_(0) { }
+
+		/// \brief Returns the row this iterator points to
+		const Row& operator *() const;
+
+		/// \brief Returns the row this iterator points to
+		const Row* operator ->() const { return &operator *(); }
+
+		const_iterator& operator ++() { ++i_; row_ = Row(); return *this; }
+		const_iterator operator ++(int)
+				{ const_iterator t(*this); ++*this; return t; }
+		const_iterator& operator --() { --i_; row_ = Row(); return *this; }
+		const_iterator operator --(int)
+				{ const_iterator t(*this); --*this; return t; }
+		const_iterator& operator +=(std::ptrdiff_t n)
+				{ i_ += n; row_ = Row(); return *this; }
+		const_iterator& operator -=(std::ptrdiff_t n)
+				{ i_ -= n; row_ = Row(); return *this; }
+		const_iterator operator +(std::ptrdiff_t n) const
+				{ const_iterator t(*this); return t += n; }
+		const_iterator operator -(std::ptrdiff_t n) const
+				{ const_iterator t(*this); return t -= n; }
+		std::ptrdiff_t operator -(const const_iterator& rhs) const
+				{ return std::ptrdiff_t(i_) - std::ptrdiff_t(rhs.i_); }
+		Row operator [](std::ptrdiff_t n) const { return *(*this + n); }
+
+		bool operator ==(const const_iterator& rhs) const
+				{ return i_ == rhs.i_ && res_ == rhs.res_; }
+		bool operator !=(const const_iterator& rhs) const
+				{ return !(*this == rhs); }
+		bool operator <(const const_iterator& rhs) const
+				{ return i_ < rhs.i_; }
+
+	private:
+		friend class SpillQueryResult;
+
+		const_iterator(const SpillQueryResult* res, size_t i) :
+		res_(res),
+		i_(i)
+		{
+		}
+
+		const SpillQueryResult* res_;
+		size_t i_;
+		mutable Row row_;		///< built on first dereference
+	};
+
+	typedef const_iterator iterator;	///< rows are read-only
+	typedef size_t size_type;			///< type of row indices
+
+	/// \brief Default constructor
+	SpillQueryResult();
+
+	/// \brief Initialize object as a copy of another SpillQueryResult
+	SpillQueryResult(const SpillQueryResult& other);
+
+	/// \brief Read all rows of a "use" query's result set
+	///
+	/// \param res result set to read to its end
+	/// \param budget most bytes of packed row data to keep in memory
+	/// \param te if true, throw exceptions on errors
+	SpillQueryResult(const UseQueryResult& res, size_t budget,
+			bool te = true);
+
+	/// \brief Destroy the result set, and its temporary file if this
+	/// was the last copy using it
+	~SpillQueryResult();
+
+	/// \brief Copy another SpillQueryResult object's data into this
+	/// object
+	SpillQueryResult& operator =(const SpillQueryResult& rhs)
+			{ return this != &rhs ? copy(rhs) : *this; }
+
+	/// \brief Returns the given row, throwing BadIndex if it doesn't
+	/// exist
+	Row at(size_type i) const;
+
+	/// \brief Returns an iterator pointing to the first row
+	const_iterator begin() const { return const_iterator(this, 0); }
+
+	/// \brief Returns an iterator pointing past the last row
+	const_iterator end() const { return const_iterator(this, size()); }
+
+	/// \brief Returns the number of bytes of packed row data written
+	/// to the temporary file, 0 if it never spilled
+	ulonglong disk_bytes() const;
+
+	/// \brief Returns true if there are no rows
+	bool empty() const { return size() == 0; }
+
+	/// \brief Access the driver-level implementation result set info
+	///
+	/// This is primarily for the benefit of the DBDriver subclass,
+	/// not end-user code.
+	Impl& impl() const { return source_.impl(); }
+
+	/// \brief Returns the number of rows in this result set
+	size_type num_rows() const { return size(); }
+
+	/// \brief Returns the most memory this result set used at once
+	/// for packed rows, buffers, and row offsets, in bytes
+	size_t peak_bytes() const;
+
+	/// \brief Returns the number of rows in this result set
+	size_type size() const;
+
+	/// \brief Returns true if the rows moved to a temporary file
+	bool spilled() const { return disk_bytes() > 0; }
+
+	/// \brief Returns the given row
+	///
+	/// Unlike StoreQueryResult, this doesn't check the index.
+	Row operator [](size_type i) const;
+
+	/// \brief Test whether the query that created this result succeeded
+	///
+	/// \see StoreQueryResult::operator private_bool_type()
+	operator private_bool_type() const
+	{
+		return copacetic_ ? &SpillQueryResult::copacetic_ : 0;
+	}
+
+private:
+	/// \brief Copy another SpillQueryResult object's contents into
+	/// this one.
+	SpillQueryResult& copy(const SpillQueryResult& other);
+
+	UseQueryResult source_;				///< result set the rows came from
+	RefCountedPointer<Storage> storage_;	///< the packed rows
+	bool copacetic_;				///< true if initialized from good result
+};
+
+} // end namespace libtabula
+
+#endif // !defined(LIBTABULA_SPILLRESULT_H)
@@ -78,7 +78,8 @@ SQLBuffer::quote_q() const
 void
 SQLBuffer::replace_buffer(const char* pd, size_type length)
 {
-	delete[] data_;
+	if (!borrowed_) delete[] data_;
+	borrowed_ = false;
 	data_ = 0;
 	length_ = 0;
 
@@ -35,6 +35,19 @@
 
 namespace libtabula {
 
+/// \brief Base class for objects owning memory that SQLBuffer can
+/// refer to instead of copying it
+///
+/// A BorrowedSQLBuffer holds a reference to the owner, so the memory
+/// lives as long as any String using it.
+class SQLBufferOwner
+{
+public:
+	/// \brief Destroy the owner, and with it the memory it owns
+	virtual ~SQLBufferOwner() { }
+};
+
+
 /// \brief Holds SQL data in string form plus type information for use
 /// in converting the string to compatible C++ data types.
 
@@ -60,18 +73,19 @@ public:
 	/// to work for both C strings and binary data.
 	SQLBuffer(const char* data, size_type length, FieldType type,
 			bool is_null) : data_(), length_(), type_(type),
-			is_null_(is_null)
+			is_null_(is_null), borrowed_(false), has_owner_(false)
 			{ replace_buffer(data, length); }
 
 	/// \brief Initialize object as a copy of a C++ string object
 	SQLBuffer(const std::string& s, FieldType type, bool is_null) :
-			data_(), length_(), type_(type), is_null_(is_null)
+			data_(), length_(), type_(type), is_null_(is_null),
+			borrowed_(false), has_owner_(false)
 	{
 		replace_buffer(s.data(), static_cast<size_type>(s.length()));
 	}
 
 	/// \brief Destructor
-	~SQLBuffer() { delete[] data_; }
+	~SQLBuffer() { if (!borrowed_) delete[] data_; }
 
 	/// \brief Replace contents of buffer with copy of given C string
 	SQLBuffer& assign(const char* data, size_type length,
@@ -96,6 +110,14 @@ public:
 	/// easily as a C string.
 	size_type length() const { return length_; }
 
+	/// \brief Returns the bytes of memory this object takes up,
+	/// including its copy of the data, if it has one
+	size_type memory_usage() const;
+
+	/// \brief Returns true if this object is really a
+	/// BorrowedSQLBuffer
+	bool has_owner() const { return has_owner_; }
+
 	/// \brief Returns true if type of buffer's contents is string
 	bool is_string() { return type_ == string_type; }
 
@@ -117,6 +139,18 @@ public:
 	/// \brief Return the SQL type of the data held in the buffer
 	const FieldType& type() const { return type_; }
 
+protected:
+	/// \brief Initialize object to refer to a buffer belonging to
+	/// another object, without copying it
+	///
+	/// Only BorrowedSQLBuffer uses this; it holds the reference to the
+	/// buffer's owner, so the rest of us don't pay for it.
+	SQLBuffer(const char* data, size_type length, FieldType type,
+			bool is_null, bool) : data_(data), length_(length),
+			type_(type), is_null_(is_null), borrowed_(true),
+			has_owner_(true)
+			{ }
+
 private:
 	SQLBuffer(const SQLBuffer&);
 	SQLBuffer& operator=(const SQLBuffer&);
@@ -131,6 +165,65 @@ private:
 	size_type length_;		///< bytes in buffer, without trailing null
 	FieldType type_;		///< type of data in the buffer
 	bool is_null_;			///< if true, string represents a SQL null
+	bool borrowed_;			///< if true, data_ isn't ours to delete
+	bool has_owner_;		///< if true, we're a BorrowedSQLBuffer
+};
+
+
+/// \brief An SQLBuffer referring to memory belonging to an
+/// SQLBufferOwner, instead of holding a copy of its own
+///
+/// Snapshot uses this to build rows that point into a memory-mapped
+/// file.  The owner reference lives here rather than in SQLBuffer to
+/// keep the common case small.
+
+class BorrowedSQLBuffer : public SQLBuffer
+{
+public:
+	/// \brief Initialize object to refer to a buffer belonging to
+	/// \c owner, without copying it
+	///
+	/// The buffer must be followed by a null terminator, as with
+	/// SQLBuffer's copying ctors, and must not change while \c owner
+	/// lives.
+	BorrowedSQLBuffer(const char* data, size_type length, FieldType type,
+			bool is_null, const RefCountedPointer<SQLBufferOwner>& owner) :
+			SQLBuffer(data, length, type, is_null, true),
+			owner_(owner)
+			{ }
+
+private:
+	RefCountedPointer<SQLBufferOwner> owner_;	///< owner of the buffer
+};
+
+
+inline SQLBuffer::size_type
+SQLBuffer::memory_usage() const
+{
+	return (has_owner_ ? sizeof(BorrowedSQLBuffer) : sizeof(*this)) +
+			(borrowed_ ? 0 : length_ + 1);
+}
+
+
+// Functor to delete an SQLBuffer as the type it really is.
+//
+// This overrides RefCountedPointer's default destroyer, which would
+// delete a BorrowedSQLBuffer through a pointer to its base class.
+// SQLBuffer has no virtual dtor because the vtable pointer would cost
+// every String as much as the owner reference we're avoiding.
+template <>
+struct RefCountedPointerDestroyer<SQLBuffer>
+{
+	/// \brief Functor implementation
+	void operator()(SQLBuffer* doomed) const
+	{
+		if (doomed && doomed->has_owner()) {
+			delete static_cast<BorrowedSQLBuffer*>(doomed);
+		}
+		else {
+			delete doomed;
+		}
+	}
 };
 
 
@@ -0,0 +1,194 @@
+/***********************************************************************
+ stmtcache.cpp - Implements the StatementCache class.
+
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#define LIBTABULA_NOT_HEADER
+#include "stmtcache.h"
+
+#include "connection.h"
+#include "exceptions.h"
+#include "qparms.h"
+
+using namespace std;
+
+namespace libtabula {
+
+
+StatementCache::StatementCache(Connection& conn, size_t max_statements) :
+OptionalExceptions(conn.throw_exceptions()),
+conn_(conn),
+max_statements_(max_statements ? max_statements : 1),
+hits_(0),
+misses_(0),
+evictions_(0),
+reprepares_(0)
+{
+}
+
+
+StatementCache::~StatementCache()
+{
+	clear();
+}
+
+
+void
+StatementCache::clear()
+{
+	while (!lru_.empty()) {
+		discard(lru_.begin());
+	}
+}
+
+
+void
+StatementCache::discard(List::iterator it)
+{
+	delete it->stmt;
+	index_.erase(it->sql);
+	lru_.erase(it);
+}
+
+
+bool
+StatementCache::exec(const std::string& sql)
+{
+	return exec(sql, SQLQueryParms());
+}
+
+
+bool
+StatementCache::exec(const std::string& sql, const SQLQueryParms& p)
+{
+	string error;
+	int errnum = 0;
+	return run(sql, &p, 0, 0, error, errnum) || fail(error, errnum);
+}
+
+
+bool
+StatementCache::exec_array(const std::string& sql, const ParamArray& params,
+		std::string& error, int& errnum)
+{
+	return run(sql, 0, &params, 0, error, errnum);
+}
+
+
+bool
+StatementCache::fail(const std::string& error, int errnum)
+{
+	if (throw_exceptions()) throw BadQuery(error, errnum);
+	return false;
+}
+
+
+StatementCache::List::iterator
+StatementCache::prepare(const std::string& sql, std::string& error,
+		int& errnum)
+{
+	map<string, List::iterator>::iterator it = index_.find(sql);
+	if (it != index_.end()) {
+		++hits_;
+		lru_.splice(lru_.begin(), lru_, it->second);
+		return it->second;
+	}
+
+	++misses_;
+	while (lru_.size() >= max_statements_) {
+		discard(--lru_.end());
+		++evictions_;
+	}
+
+	DBDriver::PreparedStatement* stmt = conn_.driver()->prepare(sql,
+			error, errnum);
+	if (!stmt) return lru_.end();
+
+	lru_.push_front(Statement(sql, stmt));
+	index_[sql] = lru_.begin();
+	return lru_.begin();
+}
+
+
+bool
+StatementCache::run(const std::string& sql, const SQLQueryParms* p,
+		const ParamArray* a, StoreQueryResult* res, std::string& error,
+		int& errnum)
+{
+	DBDriver* dbd = conn_.driver();
+	for (int attempt = 0; ; ++attempt) {
+		List::iterator it = prepare(sql, error, errnum);
+		if (it == lru_.end()) return false;
+
+		ResultBase::Impl* pres = 0;
+		if (a ? dbd->execute_array(*it->stmt, *a, error, errnum) :
+				dbd->execute_prepared(*it->stmt, *p, pres, error,
+					errnum)) {
+			if (res && pres) {
+				*res = StoreQueryResult(pres, size_t(dbd->num_rows(*pres)),
+						dbd, throw_exceptions());
+			}
+			else {
+				delete pres;
+			}
+			return true;
+		}
+
+		// If the statement is gone or the server wants it prepared
+		// again, do that and retry, but only once.
+		if (attempt > 0 || !dbd->statement_lost(errnum)) return false;
+		discard(it);
+		++reprepares_;
+	}
+}
+
+
+void
+StatementCache::set_max_statements(size_t n)
+{
+	max_statements_ = n ? n : 1;
+	while (lru_.size() > max_statements_) {
+		discard(--lru_.end());
+		++evictions_;
+	}
+}
+
+
+StoreQueryResult
+StatementCache::store(const std::string& sql)
+{
+	return store(sql, SQLQueryParms());
+}
+
+
+StoreQueryResult
+StatementCache::store(const std::string& sql, const SQLQueryParms& p)
+{
+	StoreQueryResult res;
+	string error;
+	int errnum = 0;
+	if (!run(sql, &p, 0, &res, error, errnum)) fail(error, errnum);
+	return res;
+}
+
+} // end namespace libtabula
@@ -0,0 +1,223 @@
+/// \file stmtcache.h
+/// \brief Declares the StatementCache class, which keeps server-side
+/// prepared statements around for reuse.
+
+/***********************************************************************
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#if !defined(LIBTABULA_STMTCACHE_H)
+#define LIBTABULA_STMTCACHE_H
+
+#include "common.h"
+
+#include "dbdriver.h"
+#include "noexceptions.h"
+#include "result.h"
+
+#include <list>
+#include <map>
+#include <string>
+
+namespace libtabula {
+
+#if !defined(DOXYGEN_IGNORE)
+// Make Doxygen ignore this
+class LIBTABULA_EXPORT Connection;
+class ParamArray;
+class LIBTABULA_EXPORT SQLQueryParms;
+#endif
+
+/// \brief A per-connection cache of server-side prepared statements
+///
+/// The first time you run a given statement through this class, it
+/// has the server prepare it, then runs it.  Later runs of the same
+/// statement text reuse the prepared statement, so the server doesn't
+/// parse and plan it again.  Mark parameters in the statement with
+/// \c ?, and pass their values in an SQLQueryParms:
+///
+/// \code
+///   libtabula::SQLQueryParms p;
+///   p << id;
+///   libtabula::StoreQueryResult res = conn.statements().store(
+///           "SELECT * FROM stock WHERE id = ?", p);
+/// \endcode
+///
+/// The parameter values are bound to the statement directly, rather
+/// than being quoted into the SQL, so each run takes a single round
+/// trip to the server.
+///
+/// Each Connection has one of these, which you get with
+/// Connection::statements().  Since it belongs to the Connection,
+/// connections kept in a ConnectionPool keep their prepared statements
+/// from one grab to the next.
+///
+/// Prepared statements use server memory, and the server limits how
+/// many can exist at once across all sessions; see its
+/// \c max_prepared_stmt_count variable.  So, the cache holds at most a
+/// fixed number of statements, 100 by default, and closes the least
+/// recently used one to make room for a new one.
+///
+/// If the statement is gone, as happens after ReconnectOption
+/// reconnects behind our back, or the server says it needs to be
+/// prepared again, as happens after some schema changes, we prepare
+/// it again and retry once.
+class LIBTABULA_EXPORT StatementCache : public OptionalExceptions
+{
+public:
+	/// \brief Create an empty cache
+	///
+	/// \param conn connection to prepare statements on
+	/// \param max_statements most prepared statements to keep
+	StatementCache(Connection& conn, size_t max_statements = 100);
+
+	/// \brief Destroy the cache, closing its statements
+	~StatementCache();
+
+	/// \brief Close all of the cached statements
+	///
+	/// Connection calls this when it disconnects, since the statements
+	/// go away with the session.
+	void clear();
+
+	/// \brief Run a statement that takes no parameters and returns no
+	/// rows
+	///
+	/// \return false on failure, if exceptions are disabled
+	bool exec(const std::string& sql);
+
+	/// \brief Run a statement that returns no rows
+	///
+	/// \return false on failure, if exceptions are disabled
+	bool exec(const std::string& sql, const SQLQueryParms& p);
+
+	/// \brief Run a statement once for each row of parameter values,
+	/// in one round trip
+	///
+	/// This is how Query::insertfrom() sends its batches when the
+	/// driver supports it; see DBDriver::execute_array().  Unlike the
+	/// other methods here, this leaves it to the caller to throw.
+	///
+	/// \param sql statement with one \c ? placeholder per column of
+	///     \c params
+	/// \param params parameter values
+	/// \param error set to the reason for failure, if any
+	/// \param errnum set to the DBMS error number on failure
+	///
+	/// \retval true if the statement ran for every row
+	bool exec_array(const std::string& sql, const ParamArray& params,
+			std::string& error, int& errnum);
+
+	/// \brief Set the most statements to keep, closing any over the
+	/// new limit
+	void set_max_statements(size_t n);
+
+	/// \brief Returns the number of statements in the cache
+	size_t size() const { return lru_.size(); }
+
+	/// \brief Run a statement that takes no parameters and returns
+	/// rows
+	///
+	/// \return the result, or an empty result on failure if exceptions
+	///     are disabled
+	StoreQueryResult store(const std::string& sql);
+
+	/// \brief Run a statement that returns rows
+	///
+	/// \return the result, or an empty result on failure if exceptions
+	///     are disabled
+	StoreQueryResult store(const std::string& sql, const SQLQueryParms& p);
+
+	/// \brief Returns the number of times a statement was found in
+	/// the cache
+	ulonglong hits() const { return hits_; }
+
+	/// \brief Returns the number of times a statement had to be
+	/// prepared because it wasn't in the cache
+	ulonglong misses() const { return misses_; }
+
+	/// \brief Returns the number of statements closed to make room
+	/// for others
+	ulonglong evictions() const { return evictions_; }
+
+	/// \brief Returns the number of times a cached statement had to
+	/// be prepared again because it was lost or invalidated
+	ulonglong reprepares() const { return reprepares_; }
+
+private:
+	/// \brief One prepared statement
+	struct Statement
+	{
+		std::string sql;					///< the statement text
+		DBDriver::PreparedStatement* stmt;	///< the driver's handle
+
+		Statement(const std::string& s, DBDriver::PreparedStatement* p) :
+		sql(s),
+		stmt(p)
+		{
+		}
+	};
+
+	typedef std::list<Statement> List;
+
+	StatementCache(const StatementCache&);
+	StatementCache& operator =(const StatementCache&);
+
+	/// \brief Remove a statement from the cache, closing it
+	void discard(List::iterator it);
+
+	/// \brief Throw BadQuery if exceptions are enabled, else return
+	/// false
+	bool fail(const std::string& error, int errnum);
+
+	/// \brief Returns the cache entry for \c sql, preparing the
+	/// statement if needed, and marks it most recently used
+	///
+	/// \return lru_.end() on failure, with the reason in the arguments
+	List::iterator prepare(const std::string& sql, std::string& error,
+			int& errnum);
+
+	/// \brief Run a statement, preparing it first if needed
+	///
+	/// \param p parameter values for a single run, or 0 if \c a is
+	///     given instead
+	/// \param a rows of parameter values for execute_array()
+	/// \param res where to put the rows, or 0 if it returns none
+	/// \param error set to the reason for failure, if any
+	/// \param errnum set to the DBMS error number on failure
+	bool run(const std::string& sql, const SQLQueryParms* p,
+			const ParamArray* a, StoreQueryResult* res,
+			std::string& error, int& errnum);
+
+	Connection& conn_;
+	size_t max_statements_;
+	List lru_;				///< most recently used first
+	std::map<std::string, List::iterator> index_;	///< by text
+	ulonglong hits_;
+	ulonglong misses_;
+	ulonglong evictions_;
+	ulonglong reprepares_;
+};
+
+} // end namespace libtabula
+
+#endif // !defined(LIBTABULA_STMTCACHE_H)
@@ -0,0 +1,61 @@
+/***********************************************************************
+ stopwatch.cpp - Implements the Stopwatch class.
+
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#define LIBTABULA_NOT_HEADER
+#include "stopwatch.h"
+
+#if defined(LIBTABULA_PLATFORM_WINDOWS)
+#	include <windows.h>
+#elif defined(HAVE_CLOCK_GETTIME)
+#	include <time.h>
+#else
+#	include <sys/time.h>
+#endif
+
+namespace libtabula {
+
+ulonglong
+Stopwatch::now()
+{
+#if defined(LIBTABULA_PLATFORM_WINDOWS)
+	static LARGE_INTEGER freq;
+	if (freq.QuadPart == 0) QueryPerformanceFrequency(&freq);
+	LARGE_INTEGER ticks;
+	QueryPerformanceCounter(&ticks);
+	return ulonglong(ticks.QuadPart / freq.QuadPart) * 1000000 +
+			ulonglong(ticks.QuadPart % freq.QuadPart) * 1000000 /
+			freq.QuadPart;
+#elif defined(HAVE_CLOCK_GETTIME)
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ulonglong(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+#else
+	timeval tv;
+	gettimeofday(&tv, 0);
+	return ulonglong(tv.tv_sec) * 1000000 + tv.tv_usec;
+#endif
+}
+
+} // end namespace libtabula
@@ -0,0 +1,67 @@
+/// \file stopwatch.h
+/// \brief Declares the Stopwatch class, a simple high-resolution
+/// elapsed time counter.
+
+/***********************************************************************
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#if !defined(LIBTABULA_STOPWATCH_H)
+#define LIBTABULA_STOPWATCH_H
+
+#include "common.h"
+
+namespace libtabula {
+
+/// \brief Measures elapsed wall-clock time in microseconds
+///
+/// This uses the platform's monotonic clock where there is one, so
+/// the readings aren't thrown off by changes to the system time.  It
+/// is meant for timing things like query round trips, not for telling
+/// the time of day.
+class LIBTABULA_EXPORT Stopwatch
+{
+public:
+	/// \brief Create the object and start timing
+	Stopwatch() { restart(); }
+
+	/// \brief Start timing again from zero
+	void restart() { start_ = now(); }
+
+	/// \brief Returns the microseconds elapsed since construction or
+	/// the last restart()
+	ulonglong elapsed() const { return now() - start_; }
+
+	/// \brief Returns the current reading of the underlying clock, in
+	/// microseconds
+	///
+	/// The zero point is arbitrary, so this is only useful for taking
+	/// differences between two readings.
+	static ulonglong now();
+
+private:
+	ulonglong start_;
+};
+
+} // end namespace libtabula
+
+#endif // !defined(LIBTABULA_STOPWATCH_H)
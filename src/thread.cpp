@@ -0,0 +1,346 @@
+/***********************************************************************
+ thread.cpp - Implements the Thread and Condition classes.  The
+	structure follows beemutex.cpp: one implementation per supported
+	platform threading API, with the classes becoming inert if no
+	supported API is available.
+
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#define LIBTABULA_NOT_HEADER
+#include "thread.h"
+
+#include "common.h"
+
+#include <errno.h>
+#include <string.h>
+
+#define ACTUALLY_DOES_SOMETHING
+#if defined(HAVE_PTHREAD)
+#	include <pthread.h>
+#	include <sys/time.h>
+#elif defined(LIBTABULA_PLATFORM_WINDOWS)
+#	include <windows.h>
+#else
+// No supported thread type found, so classes become no-ops.
+#	undef ACTUALLY_DOES_SOMETHING
+#endif
+
+
+namespace libtabula {
+
+#if defined(HAVE_PTHREAD)
+	typedef pthread_t bc_thread_t;
+	typedef pthread_cond_t bc_cond_t;
+	typedef pthread_mutex_t bc_mutex_t;
+	typedef pthread_key_t bc_key_t;
+#elif defined(LIBTABULA_PLATFORM_WINDOWS)
+	typedef HANDLE bc_thread_t;
+	typedef HANDLE bc_cond_t;		// a semaphore; see Condition::wait()
+	typedef HANDLE bc_mutex_t;
+	typedef DWORD bc_key_t;
+#endif
+
+#if defined(ACTUALLY_DOES_SOMETHING)
+	static bc_thread_t* thread_ptr(void* p)
+			{ return static_cast<bc_thread_t*>(p); }
+	static bc_cond_t* cond_ptr(void* p)
+			{ return static_cast<bc_cond_t*>(p); }
+	static bc_mutex_t* mutex_ptr(void* p)
+			{ return static_cast<bc_mutex_t*>(p); }
+	static bc_key_t* key_ptr(void* p)
+			{ return static_cast<bc_key_t*>(p); }
+
+	// Trampoline from the platform thread API's C calling convention
+	// to Thread::Runnable::run().
+#	if defined(HAVE_PTHREAD)
+		static void* thread_entry(void* p)
+#	else
+		static DWORD WINAPI thread_entry(LPVOID p)
+#	endif
+		{
+			static_cast<Thread::Runnable*>(p)->run();
+			return 0;
+		}
+#endif
+
+
+//// Thread ////////////////////////////////////////////////////////////
+
+Thread::Thread(Runnable& r) :
+runnable_(r),
+#if defined(ACTUALLY_DOES_SOMETHING)
+pthread_(new bc_thread_t),
+#else
+pthread_(0),
+#endif
+running_(false)
+{
+}
+
+
+Thread::~Thread()
+{
+	join();
+#if defined(ACTUALLY_DOES_SOMETHING)
+	delete thread_ptr(pthread_);
+#endif
+}
+
+
+void
+Thread::join()
+{
+	if (!running_) return;
+
+#if defined(HAVE_PTHREAD)
+	pthread_join(*thread_ptr(pthread_), 0);
+#elif defined(LIBTABULA_PLATFORM_WINDOWS)
+	WaitForSingleObject(*thread_ptr(pthread_), INFINITE);
+	CloseHandle(*thread_ptr(pthread_));
+#endif
+	running_ = false;
+}
+
+
+void
+Thread::start()
+{
+	if (running_) {
+		throw ThreadFailed("Thread::start() called twice");
+	}
+
+#if defined(HAVE_PTHREAD)
+	int rc = pthread_create(thread_ptr(pthread_), 0, thread_entry,
+			&runnable_);
+	if (rc) throw ThreadFailed(strerror(rc));
+#elif defined(LIBTABULA_PLATFORM_WINDOWS)
+	*thread_ptr(pthread_) = CreateThread(0, 0, thread_entry,
+			&runnable_, 0, 0);
+	if (!*thread_ptr(pthread_)) throw ThreadFailed("CreateThread failed");
+#else
+	throw ThreadFailed("libtabula built without thread support");
+#endif
+	running_ = true;
+}
+
+
+bool
+Thread::supported()
+{
+#if defined(ACTUALLY_DOES_SOMETHING)
+	return true;
+#else
+	return false;
+#endif
+}
+
+
+//// Condition /////////////////////////////////////////////////////////
+
+Condition::Condition() :
+#if defined(ACTUALLY_DOES_SOMETHING)
+pcond_(new bc_cond_t),
+#else
+pcond_(0),
+#endif
+waiters_(0)
+{
+#if defined(HAVE_PTHREAD)
+	int rc = pthread_cond_init(cond_ptr(pcond_), 0);
+	if (rc) {
+		delete cond_ptr(pcond_);
+		throw MutexFailed(strerror(rc));
+	}
+#elif defined(LIBTABULA_PLATFORM_WINDOWS)
+	*cond_ptr(pcond_) = CreateSemaphore(0, 0, LONG_MAX, 0);
+	if (!*cond_ptr(pcond_)) {
+		delete cond_ptr(pcond_);
+		throw MutexFailed("CreateSemaphore failed");
+	}
+#endif
+}
+
+
+Condition::~Condition()
+{
+#if defined(HAVE_PTHREAD)
+	pthread_cond_destroy(cond_ptr(pcond_));
+#elif defined(LIBTABULA_PLATFORM_WINDOWS)
+	CloseHandle(*cond_ptr(pcond_));
+#endif
+#if defined(ACTUALLY_DOES_SOMETHING)
+	delete cond_ptr(pcond_);
+#endif
+}
+
+
+void
+Condition::wait(BeecryptMutex& mutex)
+{
+#if defined(HAVE_PTHREAD)
+	int rc = pthread_cond_wait(cond_ptr(pcond_), mutex_ptr(mutex.pmutex_));
+	if (rc) throw MutexFailed(strerror(rc));
+#elif defined(LIBTABULA_PLATFORM_WINDOWS)
+	wait(mutex, INFINITE);
+#else
+	(void)mutex;
+#endif
+}
+
+
+bool
+Condition::wait(BeecryptMutex& mutex, unsigned long msec)
+{
+#if defined(HAVE_PTHREAD)
+	struct timeval now;
+	gettimeofday(&now, 0);
+	struct timespec until;
+	until.tv_sec = now.tv_sec + msec / 1000;
+	until.tv_nsec = now.tv_usec * 1000 + (msec % 1000) * 1000000;
+	if (until.tv_nsec >= 1000000000) {
+		until.tv_sec += 1;
+		until.tv_nsec -= 1000000000;
+	}
+
+	int rc = pthread_cond_timedwait(cond_ptr(pcond_),
+			mutex_ptr(mutex.pmutex_), &until);
+	if (rc == ETIMEDOUT) return false;
+	if (rc) throw MutexFailed(strerror(rc));
+	return true;
+#elif defined(LIBTABULA_PLATFORM_WINDOWS)
+	// Classic semaphore-based emulation: we count waiters under the
+	// caller's mutex, then release the mutex and start waiting on the
+	// semaphore in a single atomic step so a signal() can't slip in
+	// between the two and get lost.  A wakeup left over from a timed
+	// out waiter can cause a later spurious wakeup, which the condition
+	// variable contract already permits.
+	++waiters_;
+	DWORD rc = SignalObjectAndWait(*mutex_ptr(mutex.pmutex_),
+			*cond_ptr(pcond_), DWORD(msec), FALSE);
+	mutex.lock();
+	if (rc == WAIT_TIMEOUT) {
+		if (waiters_ > 0) --waiters_;
+		return false;
+	}
+	if (rc != WAIT_OBJECT_0) throw MutexFailed("SignalObjectAndWait failed");
+	return true;
+#else
+	(void)mutex;
+	(void)msec;
+	return true;
+#endif
+}
+
+
+void
+Condition::signal()
+{
+#if defined(HAVE_PTHREAD)
+	pthread_cond_signal(cond_ptr(pcond_));
+#elif defined(LIBTABULA_PLATFORM_WINDOWS)
+	if (waiters_ > 0) {
+		--waiters_;
+		ReleaseSemaphore(*cond_ptr(pcond_), 1, 0);
+	}
+#endif
+}
+
+
+void
+Condition::broadcast()
+{
+#if defined(HAVE_PTHREAD)
+	pthread_cond_broadcast(cond_ptr(pcond_));
+#elif defined(LIBTABULA_PLATFORM_WINDOWS)
+	if (waiters_ > 0) {
+		ReleaseSemaphore(*cond_ptr(pcond_), LONG(waiters_), 0);
+		waiters_ = 0;
+	}
+#endif
+}
+
+
+//// ThreadLocal ///////////////////////////////////////////////////////
+
+ThreadLocal::ThreadLocal() :
+#if defined(ACTUALLY_DOES_SOMETHING)
+pkey_(new bc_key_t)
+#else
+pkey_(0)
+#endif
+{
+#if defined(HAVE_PTHREAD)
+	int rc = pthread_key_create(key_ptr(pkey_), 0);
+	if (rc) {
+		delete key_ptr(pkey_);
+		throw ThreadFailed(strerror(rc));
+	}
+#elif defined(LIBTABULA_PLATFORM_WINDOWS)
+	*key_ptr(pkey_) = TlsAlloc();
+	if (*key_ptr(pkey_) == TLS_OUT_OF_INDEXES) {
+		delete key_ptr(pkey_);
+		throw ThreadFailed("TlsAlloc failed");
+	}
+#endif
+}
+
+
+ThreadLocal::~ThreadLocal()
+{
+#if defined(HAVE_PTHREAD)
+	pthread_key_delete(*key_ptr(pkey_));
+#elif defined(LIBTABULA_PLATFORM_WINDOWS)
+	TlsFree(*key_ptr(pkey_));
+#endif
+#if defined(ACTUALLY_DOES_SOMETHING)
+	delete key_ptr(pkey_);
+#endif
+}
+
+
+void*
+ThreadLocal::get() const
+{
+#if defined(HAVE_PTHREAD)
+	return pthread_getspecific(*key_ptr(pkey_));
+#elif defined(LIBTABULA_PLATFORM_WINDOWS)
+	return TlsGetValue(*key_ptr(pkey_));
+#else
+	return pkey_;
+#endif
+}
+
+
+void
+ThreadLocal::set(void* p)
+{
+#if defined(HAVE_PTHREAD)
+	pthread_setspecific(*key_ptr(pkey_), p);
+#elif defined(LIBTABULA_PLATFORM_WINDOWS)
+	TlsSetValue(*key_ptr(pkey_), p);
+#else
+	pkey_ = p;
+#endif
+}
+
+} // end namespace libtabula
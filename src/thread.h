@@ -0,0 +1,182 @@
+/// \file thread.h
+/// \brief Declares the Thread, Condition and ThreadLocal classes, thin
+/// wrappers around the platform threading primitives.
+///
+/// Like BeecryptMutex, these classes exist for the library's own
+/// internal use, for features like ReadAheadResult which overlap
+/// network I/O with row processing.  They're exported because the
+/// library's templates need them, not because we intend them to
+/// become a general-purpose threading library.
+
+/***********************************************************************
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#if !defined(LIBTABULA_THREAD_H)
+#define LIBTABULA_THREAD_H
+
+#include "beemutex.h"
+
+namespace libtabula {
+
+/// \brief Wrapper around platform-specific threads.
+///
+/// You give the ctor a Runnable, then call start() to run it on a new
+/// thread.  The dtor joins the thread if you haven't already done so,
+/// so a Thread object going out of scope never leaves a thread running
+/// against a destroyed Runnable.
+///
+/// If the library was built without thread support, supported()
+/// returns false and start() throws ThreadFailed.  Code that has a
+/// sensible single-threaded fallback should check supported() first.
+class LIBTABULA_EXPORT Thread
+{
+public:
+	/// \brief Interface for the code run by a Thread
+	class Runnable
+	{
+	public:
+		virtual ~Runnable() { }
+
+		/// \brief The body of the thread
+		///
+		/// Exceptions must not escape this function: there is nobody
+		/// on the other thread to catch them.  Catch them and stash
+		/// the details somewhere the joining thread can find them.
+		virtual void run() = 0;
+	};
+
+	/// \brief Create the thread object, but don't start the thread
+	explicit Thread(Runnable& r);
+
+	/// \brief Join the thread, if it's running
+	~Thread();
+
+	/// \brief Start running the Runnable on a new thread
+	///
+	/// Throws ThreadFailed if the thread can't be created, or if it
+	/// is already running.
+	void start();
+
+	/// \brief Block until the thread exits
+	///
+	/// Does nothing if the thread was never started or has already
+	/// been joined.
+	void join();
+
+	/// \brief Returns true if start() was called and join() hasn't
+	/// been yet
+	bool running() const { return running_; }
+
+	/// \brief Returns true if this build of the library can create
+	/// threads
+	static bool supported();
+
+private:
+	Thread(const Thread&);				// can't copy
+	Thread& operator =(const Thread&);	// can't assign
+
+	Runnable& runnable_;
+	void* pthread_;
+	bool running_;
+};
+
+
+/// \brief Wrapper around platform-specific condition variables.
+///
+/// A Condition is always used together with a BeecryptMutex, which
+/// must be locked by the calling thread when it calls wait(), and
+/// which should be locked when calling signal() or broadcast().  As
+/// with any condition variable, wakeups may be spurious, so always
+/// wait in a loop that rechecks the condition you're waiting for.
+class LIBTABULA_EXPORT Condition
+{
+public:
+	/// \brief Create the condition variable
+	///
+	/// Throws MutexFailed if the platform object can't be created.
+	Condition();
+
+	/// \brief Destroy the condition variable
+	///
+	/// Failures are quietly ignored.
+	~Condition();
+
+	/// \brief Atomically unlock the mutex and wait to be signalled,
+	/// then reacquire the mutex before returning
+	void wait(BeecryptMutex& mutex);
+
+	/// \brief Like wait(BeecryptMutex&), but give up after the given
+	/// number of milliseconds
+	///
+	/// \return false if the wait timed out
+	bool wait(BeecryptMutex& mutex, unsigned long msec);
+
+	/// \brief Wake one thread waiting on this condition
+	void signal();
+
+	/// \brief Wake all threads waiting on this condition
+	void broadcast();
+
+private:
+	Condition(const Condition&);				// can't copy
+	Condition& operator =(const Condition&);	// can't assign
+
+	void* pcond_;
+	unsigned long waiters_;		// only used by Windows version
+};
+
+
+/// \brief Wrapper around platform-specific thread-local storage.
+///
+/// Each thread sees its own copy of the pointer held by one of these,
+/// which starts out as 0.  The object doesn't own what the pointers
+/// point to; freeing that is up to the code that set them.  In builds
+/// without thread support, this is just a pointer.
+class LIBTABULA_EXPORT ThreadLocal
+{
+public:
+	/// \brief Create the thread-local slot
+	///
+	/// Throws ThreadFailed if the platform has run out of them.
+	ThreadLocal();
+
+	/// \brief Free the slot, but not what the threads' pointers
+	/// point to
+	~ThreadLocal();
+
+	/// \brief Returns the calling thread's pointer
+	void* get() const;
+
+	/// \brief Set the calling thread's pointer
+	void set(void* p);
+
+private:
+	ThreadLocal(const ThreadLocal&);				// can't copy
+	ThreadLocal& operator =(const ThreadLocal&);	// can't assign
+
+	void* pkey_;
+};
+
+} // end namespace libtabula
+
+#endif // !defined(LIBTABULA_THREAD_H)
@@ -0,0 +1,237 @@
+/***********************************************************************
+ trace.cpp - Implements the TraceRecorder class.
+
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#define LIBTABULA_NOT_HEADER
+#include "trace.h"
+
+#include "exceptions.h"
+#include "utility.h"
+
+#include <fstream>
+#include <sstream>
+
+using namespace std;
+
+namespace libtabula {
+
+// Span names and categories, indexed by QueryEvent::Kind
+static const char* const span_names[] = {
+	"execute", "store_result", "use_result", "fetch rows", "grab",
+	"hold", "query", "first row", "fetch_row"
+};
+static const char* const span_cats[] = {
+	"driver", "driver", "driver", "driver", "pool",
+	"pool", "query", "driver", "result"
+};
+
+
+TraceRecorder::TraceRecorder(size_t max_events, size_t max_sql,
+		QueryObserver* next) :
+max_events_(max_events),
+max_sql_(max_sql),
+next_(next)
+{
+}
+
+
+TraceRecorder::~TraceRecorder()
+{
+	for (size_t i = 0; i < buffers_.size(); ++i) {
+		delete buffers_[i];
+	}
+}
+
+
+TraceRecorder::Buffer&
+TraceRecorder::buffer()
+{
+	if (void* p = current_.get()) {
+		return *static_cast<Buffer*>(p);
+	}
+
+	ScopedLock lock(mutex_);
+	Buffer* pb = new Buffer(buffers_.size() + 1);
+	buffers_.push_back(pb);
+	current_.set(pb);
+	return *pb;
+}
+
+
+void
+TraceRecorder::clear()
+{
+	ScopedLock lock(mutex_);
+	for (size_t i = 0; i < buffers_.size(); ++i) {
+		ScopedLock block(buffers_[i]->mutex);
+		buffers_[i]->spans.clear();
+		buffers_[i]->dropped = 0;
+	}
+}
+
+
+ulonglong
+TraceRecorder::dropped() const
+{
+	ulonglong n = 0;
+	ScopedLock lock(mutex_);
+	for (size_t i = 0; i < buffers_.size(); ++i) {
+		ScopedLock block(buffers_[i]->mutex);
+		n += buffers_[i]->dropped;
+	}
+	return n;
+}
+
+
+void
+TraceRecorder::observe(const QueryEvent& ev)
+{
+	try {
+		Buffer& b = buffer();
+		ScopedLock lock(b.mutex);
+		if (b.spans.size() >= max_events_) {
+			++b.dropped;
+		}
+		else {
+			b.spans.push_back(Span());
+			Span& s = b.spans.back();
+			s.kind = ev.kind;
+			s.start = ev.start;
+			s.elapsed = ev.elapsed;
+			s.rows = ev.rows;
+			s.busy = 0;
+			s.errnum = ev.errnum;
+			s.id = ev.conn ? static_cast<const void*>(ev.conn) :
+					static_cast<const void*>(ev.driver);
+
+			if (ev.kind == QueryEvent::ev_fetch) {
+				// The event's elapsed time is the sum of the fetches,
+				// but the span runs from the first to the last row
+				s.busy = ev.elapsed;
+				s.elapsed = Stopwatch::now() - ev.start;
+			}
+			else if (ev.kind == QueryEvent::ev_release && ev.elapsed) {
+				// Show how long the connection was held instead
+				s.start = ev.start - ev.elapsed;
+			}
+
+			if (ev.sql) {
+				// Don't cut a UTF-8 character in half
+				size_t n = ev.sql_length;
+				if (n > max_sql_) {
+					n = max_sql_;
+					while (n > 0 && (ev.sql[n] & 0xC0) == 0x80) --n;
+				}
+				s.sql.assign(ev.sql, n);
+			}
+		}
+	}
+	catch (...) {
+		// Out of memory, most likely; observers mustn't throw
+	}
+
+	if (next_) next_->observe(ev);
+}
+
+
+void
+TraceRecorder::save(const char* path) const
+{
+	ofstream out(path);
+	if (out) write(out);
+	if (!out || !out.flush()) {
+		throw ExportFailed(string("Can't write trace to ") + path);
+	}
+}
+
+
+size_t
+TraceRecorder::size() const
+{
+	size_t n = 0;
+	ScopedLock lock(mutex_);
+	for (size_t i = 0; i < buffers_.size(); ++i) {
+		ScopedLock block(buffers_[i]->mutex);
+		n += buffers_[i]->spans.size();
+	}
+	return n;
+}
+
+
+void
+TraceRecorder::write(ostream& os) const
+{
+	ScopedLock lock(mutex_);
+
+	os << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+			"{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":1,"
+			"\"tid\":0,\"args\":{\"name\":\"libtabula\"}}";
+
+	for (size_t i = 0; i < buffers_.size(); ++i) {
+		const Buffer& b = *buffers_[i];
+		ScopedLock block(buffers_[i]->mutex);
+
+		os << ",\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,"
+				"\"tid\":" << b.tid << ",\"args\":{\"name\":\"thread " <<
+				b.tid << "\"}}";
+
+		for (size_t j = 0; j < b.spans.size(); ++j) {
+			const Span& s = b.spans[j];
+			const bool instant = s.kind == QueryEvent::ev_release &&
+					s.elapsed == 0;
+
+			os << ",\n{\"ph\":\"" << (instant ? "i" : "X") <<
+					"\",\"cat\":\"" << span_cats[s.kind] <<
+					"\",\"name\":\"" <<
+					(instant ? "release" : span_names[s.kind]) <<
+					"\",\"pid\":1,\"tid\":" << b.tid << ",\"ts\":" <<
+					s.start;
+			if (instant) {
+				os << ",\"s\":\"t\"";
+			}
+			else {
+				os << ",\"dur\":" << s.elapsed;
+			}
+
+			// The args object starts with a comma we have to skip
+			ostringstream args;
+			if (s.id) args << ",\"conn\":\"" << s.id << '"';
+			if (!s.sql.empty()) {
+				args << ",\"sql\":";
+				internal::json_string(args, s.sql);
+			}
+			if (s.rows) args << ",\"rows\":" << s.rows;
+			if (s.kind == QueryEvent::ev_fetch) {
+				args << ",\"fetch_us\":" << s.busy;
+			}
+			if (s.errnum) args << ",\"errnum\":" << s.errnum;
+			const string a = args.str();
+			os << ",\"args\":{" << (a.empty() ? a : a.substr(1)) << "}}";
+		}
+	}
+
+	os << "\n]}\n";
+}
+
+} // end namespace libtabula
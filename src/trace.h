@@ -0,0 +1,154 @@
+/// \file trace.h
+/// \brief Declares the TraceRecorder class, a QueryObserver that
+/// records a timeline of query and pool activity for viewing in
+/// Perfetto or chrome://tracing.
+
+/***********************************************************************
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#if !defined(LIBTABULA_TRACE_H)
+#define LIBTABULA_TRACE_H
+
+#include "common.h"
+
+#include "beemutex.h"
+#include "observer.h"
+#include "thread.h"
+
+#include <deque>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace libtabula {
+
+/// \brief A QueryObserver that records a timeline of everything it's
+/// told about, for writing out as a Chrome trace
+///
+/// Install one of these while the code you're interested in runs,
+/// then write() the result to a file and load it into Perfetto
+/// (ui.perfetto.dev) or chrome://tracing:
+///
+/// \code
+///   libtabula::TraceRecorder trace;
+///   libtabula::QueryObserver::install(&trace);
+///   ...
+///   libtabula::QueryObserver::install(0);
+///   trace.save("libtabula.trace.json");
+/// \endcode
+///
+/// Each thread gets a track of its own, on which you can see when it
+/// grabbed and released pool connections, when each Query call ran
+/// and within that, the time spent executing the statement and
+/// storing or starting to use its result set.  For "use" results,
+/// there's a span for the wait for the first row, one for each
+/// UseQueryResult::fetch_row() call, which covers both receiving the
+/// row and converting it to a Row object, and one from the first
+/// fetch to the last row.  Each span carries the SQL text, row count
+/// and error number, as applicable, and an ID for the connection.
+///
+/// Events go into a buffer for the thread they happened on, so
+/// threads don't contend with each other while recording.  Each
+/// buffer holds up to \c max_events spans; after that, further spans
+/// on that thread are counted in dropped() instead.  Like all
+/// observers, this one must outlive its installation.
+class LIBTABULA_EXPORT TraceRecorder : public QueryObserver
+{
+public:
+	/// \brief Create the object
+	///
+	/// \param max_events the most spans to keep for each thread
+	/// \param max_sql the most bytes of each query's text to keep
+	/// \param next an observer to pass every event on to after
+	/// recording it, such as the one this replaces
+	explicit TraceRecorder(size_t max_events = 1000000,
+			size_t max_sql = 256, QueryObserver* next = 0);
+
+	/// \brief Destroy the object
+	~TraceRecorder();
+
+	/// \brief Record an event
+	void observe(const QueryEvent& ev);
+
+	/// \brief Write everything recorded so far as a Chrome Trace
+	/// Event Format JSON document
+	void write(std::ostream& os) const;
+
+	/// \brief Write the trace to a file
+	///
+	/// Throws ExportFailed if the file can't be written.
+	void save(const char* path) const;
+
+	/// \brief Returns the number of spans recorded
+	size_t size() const;
+
+	/// \brief Returns the number of spans dropped because a thread's
+	/// buffer was full
+	ulonglong dropped() const;
+
+	/// \brief Forget everything recorded so far
+	void clear();
+
+private:
+	/// \brief One recorded span
+	struct Span
+	{
+		QueryEvent::Kind kind;
+		ulonglong start;
+		ulonglong elapsed;
+		ulonglong rows;
+		ulonglong busy;			///< for ev_fetch, time spent fetching
+		int errnum;
+		const void* id;			///< driver or connection
+		std::string sql;
+	};
+
+	/// \brief The spans recorded on one thread
+	struct Buffer
+	{
+		unsigned long tid;
+		std::deque<Span> spans;
+		ulonglong dropped;
+		BeecryptMutex mutex;	///< only contended by write() and clear()
+
+		explicit Buffer(unsigned long t) : tid(t), dropped(0) { }
+	};
+
+	/// \brief Returns the calling thread's buffer, creating it if need be
+	Buffer& buffer();
+
+	size_t max_events_;
+	size_t max_sql_;
+	QueryObserver* next_;
+	ThreadLocal current_;			///< each thread's Buffer
+	std::vector<Buffer*> buffers_;
+	mutable BeecryptMutex mutex_;	///< guards buffers_
+
+	// Not copyable
+	TraceRecorder(const TraceRecorder&);
+	TraceRecorder& operator=(const TraceRecorder&);
+};
+
+} // end namespace libtabula
+
+#endif // !defined(LIBTABULA_TRACE_H)
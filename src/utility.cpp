@@ -25,6 +25,10 @@
 
 #include "utility.h"
 
+#include "connection.h"
+
+#include <ostream>
+
 namespace libtabula {
 	namespace internal {
 		void str_to_lwr(std::string& s)
@@ -42,6 +46,44 @@ namespace libtabula {
 				ls += tolower(*mcs++);
 			}
 		}
+
+		void json_string(std::ostream& os, const std::string& s)
+		{
+			static const char hex[] = "0123456789abcdef";
+
+			os << '"';
+			for (size_t i = 0; i < s.length(); ++i) {
+				unsigned char c = s[i];
+				switch (c) {
+					case '"':	os << "\\\""; break;
+					case '\\':	os << "\\\\"; break;
+					case '\n':	os << "\\n"; break;
+					case '\r':	os << "\\r"; break;
+					case '\t':	os << "\\t"; break;
+					default:
+						if (c < 0x20) {
+							os << "\\u00" << hex[c >> 4] <<
+									hex[c & 15];
+						}
+						else {
+							os << s[i];
+						}
+				}
+			}
+			os << '"';
+		}
+
+		ThreadScope::ThreadScope(Connection& conn, bool active) :
+		conn_(conn),
+		active_(active)
+		{
+			if (active_) conn_.thread_start();
+		}
+
+		ThreadScope::~ThreadScope()
+		{
+			if (active_) conn_.thread_end();
+		}
 	} // end namespace internal
 } // end namespace libtabula
 
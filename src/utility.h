@@ -35,9 +35,12 @@
 
 #include <cctype>
 #include <cstring>
+#include <iosfwd>
 #include <string>
 
 namespace libtabula {
+	class LIBTABULA_EXPORT Connection;
+
 	/// \brief Namespace for holding things used only within libtabula
 	namespace internal {
 		/// \brief Lowercase a C++ string in place
@@ -46,6 +49,28 @@ namespace libtabula {
 		/// \brief Copy a C string into a C++ string, lowercasing
 		/// it along the way
 		void LIBTABULA_EXPORT str_to_lwr(std::string& ls, const char* mcs);
+
+		/// \brief Write a C++ string to a stream as a quoted JSON
+		/// string, escaping it as needed
+		void LIBTABULA_EXPORT json_string(std::ostream& os,
+				const std::string& s);
+
+		/// \brief Brackets a worker thread's use of the C API
+		/// through a connection, if \c active, ending it even if the
+		/// work throws
+		///
+		/// Only for threads the library started itself; threads
+		/// belonging to the caller are the caller's to set up.
+		class LIBTABULA_EXPORT ThreadScope
+		{
+		public:
+			ThreadScope(Connection& conn, bool active);
+			~ThreadScope();
+
+		private:
+			Connection& conn_;
+			bool active_;
+		};
 	} // end namespace libtabula::internal
 } // end namespace libtabula
 
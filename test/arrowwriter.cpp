@@ -0,0 +1,360 @@
+/***********************************************************************
+ test/arrowwriter.cpp - Tests the ArrowWriter class by writing result
+	sets out in the Arrow IPC stream format, then picking the stream
+	apart to check its messages and column data.
+
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#include "fakedriver.h"
+
+#include <arrowwriter.h>
+
+#include <iostream>
+#include <stdexcept>
+
+#include <stdio.h>
+
+using namespace std;
+
+
+// Reads just enough of an Arrow IPC stream, and the FlatBuffers
+// metadata in it, to check what ArrowWriter wrote
+class StreamReader
+{
+public:
+	explicit StreamReader(const string& s) :
+	s_(s),
+	next_(0),
+	root_(0),
+	body_(0)
+	{
+	}
+
+	// Move to the next message, returning false at the end of the
+	// stream
+	bool next()
+	{
+		size_t pos = next_;
+		if (u32(pos) != 0xFFFFFFFF) fail("missing continuation marker");
+		size_t length = u32(pos + 4);
+		if (length == 0) {
+			if (pos + 8 != s_.size()) fail("data after end of stream");
+			return false;
+		}
+		if (length % 8) fail("metadata not padded");
+
+		size_t meta = pos + 8;
+		root_ = meta + u32(meta);
+		body_ = meta + length;
+		next_ = body_ + size_t(u64(field(root_, 3)));
+		if (next_ > s_.size()) fail("message runs off the end");
+		return true;
+	}
+
+	// Returns the message header type and table
+	unsigned header_type() const { return u8(field(root_, 1)); }
+	size_t header() const { return deref(field(root_, 2)); }
+
+	// Returns the number of fields in the schema, and one's name
+	size_t schema_fields() const { return u32(deref(field(header(), 1))); }
+	string field_name(size_t i) const
+	{
+		size_t v = deref(field(header(), 1));
+		size_t f = deref(v + 4 + 4 * i);
+		size_t name = deref(field(f, 0));
+		return s_.substr(name + 4, u32(name));
+	}
+
+	// Returns the number of rows in a record batch, and the null
+	// count of one of its columns
+	size_t rows() const { return size_t(u64(field(header(), 0))); }
+	size_t nulls(size_t column) const
+	{
+		size_t v = deref(field(header(), 1));
+		return size_t(u64(v + 4 + 16 * column + 8));
+	}
+
+	// Returns one of a record batch's buffers
+	const char* buffer(size_t i, size_t& length) const
+	{
+		size_t v = deref(field(header(), 2));
+		if (i >= u32(v)) fail("no such buffer");
+		size_t offset = size_t(u64(v + 4 + 16 * i));
+		length = size_t(u64(v + 4 + 16 * i + 8));
+		if (offset % 8) fail("buffer not aligned");
+		return s_.data() + body_ + offset;
+	}
+
+	unsigned u8(size_t pos) const { return (unsigned char)s_.at(pos); }
+	unsigned u16(size_t pos) const { return u8(pos) | u8(pos + 1) << 8; }
+	unsigned long u32(size_t pos) const
+			{ return u16(pos) | (unsigned long)u16(pos + 2) << 16; }
+	libtabula::ulonglong u64(size_t pos) const
+			{ return u32(pos) | libtabula::ulonglong(u32(pos + 4)) << 32; }
+
+private:
+	// Returns the position of a table's field, or 0 if not present
+	size_t field(size_t table, unsigned slot) const
+	{
+		size_t vtable = table - long(u32(table));
+		if (4 + 2 * slot >= u16(vtable)) return 0;
+		unsigned offset = u16(vtable + 4 + 2 * slot);
+		return offset ? table + offset : 0;
+	}
+
+	// Follow a reference to another object
+	size_t deref(size_t pos) const
+	{
+		if (!pos) fail("missing field");
+		return pos + u32(pos);
+	}
+
+	void fail(const char* why) const
+	{
+		throw runtime_error(string("Bad Arrow stream: ") + why);
+	}
+
+	const string& s_;
+	size_t next_, root_, body_;
+};
+
+
+// Run a result set through an ArrowWriter into a temporary file, and
+// return what ended up in the file
+template <class Result>
+static string
+export_rows(const Result& res, size_t batch_rows)
+{
+	FILE* f = tmpfile();
+	if (!f) throw runtime_error("Failed to create temporary file");
+
+	{
+		libtabula::ArrowWriter out(fileno(f), 100);
+		out.set_batch_rows(batch_rows);
+		out.write(res);
+	}
+
+	string s;
+	char buf[4096];
+	rewind(f);
+	while (size_t n = fread(buf, 1, sizeof(buf), f)) s.append(buf, n);
+	fclose(f);
+	return s;
+}
+
+
+// Returns true if the given row of a column is valid, per its bitmap
+static bool
+valid(const char* bitmap, size_t bitmap_length, size_t row)
+{
+	return bitmap_length == 0 || (bitmap[row / 8] >> (row % 8)) & 1;
+}
+
+
+// Export FakeDriver's rows in batches, and check them
+static bool
+test_batches(int rows, size_t batch_rows)
+{
+	FakeDriver driver(rows);
+	string stream = export_rows(fake_use_result(driver), batch_rows);
+	StreamReader r(stream);
+
+	if (!r.next() || r.header_type() != 1 || r.schema_fields() != 2 ||
+			r.field_name(0) != "id" || r.field_name(1) != "name") {
+		cerr << "Bad schema message!" << endl;
+		return false;
+	}
+
+	int row = 0;
+	while (r.next()) {
+		size_t n = r.rows();
+		if (r.header_type() != 3 || n == 0 || n > batch_rows) {
+			cerr << "Bad record batch of " << n << " rows!" << endl;
+			return false;
+		}
+
+		size_t len[5];
+		const char* buf[5];
+		for (int i = 0; i < 5; ++i) buf[i] = r.buffer(i, len[i]);
+		if (r.nulls(0) != 0 || len[0] != 0 || len[1] != 8 * n ||
+				len[3] != 4 * (n + 1)) {
+			cerr << "Bad buffers in record batch at row " << row <<
+					'!' << endl;
+			return false;
+		}
+
+		for (size_t i = 0; i < n; ++i, ++row) {
+			size_t pos = buf[1] - stream.data() + 8 * i;
+			if (r.u64(pos) != libtabula::ulonglong(row)) {
+				cerr << "Row " << row << " has bad id " << r.u64(pos) <<
+						'!' << endl;
+				return false;
+			}
+
+			size_t off = buf[3] - stream.data() + 4 * i;
+			string name(buf[4] + r.u32(off), r.u32(off + 4) - r.u32(off));
+			ostringstream os;
+			if (row % 5) os << "row " << row;
+			if (valid(buf[2], len[2], i) != (row % 5 != 0) ||
+					name != os.str()) {
+				cerr << "Row " << row << " has bad name '" << name <<
+						"'!" << endl;
+				return false;
+			}
+		}
+	}
+
+	if (row != rows) {
+		cerr << "Got " << row << " rows, expected " << rows << '!' << endl;
+		return false;
+	}
+	return true;
+}
+
+
+// Export a stored result set with a column of each type that has to
+// be converted, and check the converted values
+static bool
+test_types()
+{
+	static const char* const values[][5] = {
+		{ "18446744073709551615", "-12.345", "1970-01-02",
+		  "1970-01-01 00:00:01.5", "1.5" },
+		{ "0", "99999.99", "0000-00-00", "1969-12-31 23:59:59", "-2e3" },
+		{ 0, 0, 0, 0, "junk" },
+	};
+	static const libtabula::FieldType::Base types[] = {
+		libtabula::FieldType::ft_integer,
+		libtabula::FieldType::ft_decimal,
+		libtabula::FieldType::ft_date,
+		libtabula::FieldType::ft_datetime,
+		libtabula::FieldType::ft_real,
+	};
+
+	libtabula::Fields fields;
+	for (int i = 0; i < 5; ++i) {
+		char name[] = { char('a' + i), '\0' };
+		fields.push_back(libtabula::Field(name, "t", "test",
+				libtabula::FieldType(types[i], i ?
+					libtabula::FieldType::tf_null :
+					libtabula::FieldType::tf_unsigned),
+				10, 0, i == 1 ? 2 : 0));
+	}
+
+	libtabula::StoreQueryResult res(fields);
+	for (int i = 0; i < 3; ++i) {
+		libtabula::Row::Impl* pd = new libtabula::Row::Impl;
+		for (int j = 0; j < 5; ++j) {
+			pd->push_back(values[i][j] ?
+					libtabula::String(values[i][j], types[j]) :
+					libtabula::String("NULL", 4, types[j], true));
+		}
+		res.push_back(libtabula::Row(pd, res.field_names()));
+	}
+
+	string stream = export_rows(res, 100);
+	StreamReader r(stream);
+	if (!r.next() || !r.next() || r.rows() != 3) {
+		cerr << "Didn't get one record batch of 3 rows!" << endl;
+		return false;
+	}
+
+	// Each column has a validity bitmap and a data buffer
+	size_t len[10];
+	size_t pos[10];
+	for (int i = 0; i < 10; ++i) {
+		pos[i] = r.buffer(i, len[i]) - stream.data();
+	}
+
+	static const libtabula::ulonglong expected[][3] = {
+		{ libtabula::ulonglong(-1), 0, 0 },			// integer
+		{ libtabula::ulonglong(-1234), 9999999, 0 },	// decimal, low half
+		{ 1, 0, 0 },								// date, in days
+		{ 1500000, libtabula::ulonglong(-1000000), 0 },	// datetime, in us
+	};
+	static const bool null[][3] = {
+		{ false, false, true },
+		{ false, false, true },
+		{ false, true, true },
+		{ false, false, true },
+		{ false, false, true },
+	};
+	static const size_t width[] = { 8, 16, 4, 8, 8 };
+	for (int c = 0; c < 5; ++c) {
+		for (int i = 0; i < 3; ++i) {
+			bool isnull = !valid(stream.data() + pos[2 * c], len[2 * c], i);
+			if (isnull != null[c][i]) {
+				cerr << "Column " << c << " row " << i << " should " <<
+						(null[c][i] ? "" : "not ") << "be null!" << endl;
+				return false;
+			}
+			if (isnull || c == 4) continue;
+
+			size_t p = pos[2 * c + 1] + width[c] * i;
+			libtabula::ulonglong v = width[c] != 4 ? r.u64(p) :
+					libtabula::ulonglong(libtabula::longlong(int(r.u32(p))));
+			if (v != expected[c][i]) {
+				cerr << "Column " << c << " row " << i << " is " << v <<
+						", expected " << expected[c][i] << '!' << endl;
+				return false;
+			}
+		}
+	}
+
+	// Check the high half of the negative decimal, and the doubles
+	union { double d; libtabula::ulonglong u; } d0, d1;
+	d0.u = r.u64(pos[9]);
+	d1.u = r.u64(pos[9] + 8);
+	if (r.u64(pos[3] + 8) != libtabula::ulonglong(-1) || d0.d != 1.5 ||
+			d1.d != -2000) {
+		cerr << "Decimal or floating-point column is wrong!" << endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+int
+main()
+{
+	try {
+		return	test_batches(0, 10) &&
+				test_batches(10, 10) &&
+				test_batches(1000, 300) &&
+				test_batches(1000, 1) &&
+				test_types() ? 0 : 1;
+	}
+	catch (const libtabula::Exception& e) {
+		cerr << "Unexpected libtabula exception: " << e.what() << endl;
+		return 2;
+	}
+	catch (const std::exception& e) {
+		cerr << "Unexpected exception: " << e.what() << endl;
+		return 2;
+	}
+	catch (...) {
+		cerr << "Unhandled exception caught by test/arrowwriter!" << endl;
+		return 2;
+	}
+}
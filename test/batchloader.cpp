@@ -0,0 +1,218 @@
+/***********************************************************************
+ test/batchloader.cpp - Tests the BatchLoader class against pooled
+	connections to a fake driver.
+
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#include "fakedriver.h"
+
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+
+// Hands out connections whose drivers serve rows with IDs 0 to 9, no
+// matter what they're asked for
+class TestConnectionPool : public libtabula::ConnectionPool
+{
+public:
+	~TestConnectionPool() { clear(); }
+
+	unsigned int max_idle_time() { return 60; }
+
+	// Returns every statement sent on any of our connections
+	vector<string> statements() const
+	{
+		vector<string> all;
+		for (size_t i = 0; i < drivers_.size(); ++i) {
+			all.insert(all.end(), drivers_[i]->statements().begin(),
+					drivers_[i]->statements().end());
+		}
+		return all;
+	}
+
+private:
+	libtabula::Connection* create()
+	{
+		FakeDriver* driver = new FakeDriver(10);
+		drivers_.push_back(driver);
+		return new libtabula::Connection(driver);
+	}
+
+	void destroy(libtabula::Connection* cp) { delete cp; }
+
+	vector<FakeDriver*> drivers_;
+};
+
+
+// Looks up one key on its own thread
+class Lookup : public libtabula::Thread::Runnable
+{
+public:
+	Lookup(libtabula::BatchLoader& loader, int key) :
+	loader_(loader),
+	key_(key),
+	found_(-1)
+	{
+	}
+
+	void run()
+	{
+		try {
+			if (libtabula::Row row = loader_.load(key_)) {
+				found_ = int(row["id"]);
+			}
+		}
+		catch (...) {
+			found_ = -2;
+		}
+	}
+
+	int key() const { return key_; }
+	int found() const { return found_; }
+
+private:
+	libtabula::BatchLoader& loader_;
+	int key_;
+	int found_;			///< ID of the row found, -1 if none, -2 on error
+};
+
+
+// Lookups from several threads at once go out as one query, and each
+// thread gets its own row
+static bool
+test_threads()
+{
+	if (!libtabula::Thread::supported()) return true;
+
+	static const int keys[] = { 1, 2, 3, 4, 7, 42 };
+	const size_t nkeys = sizeof(keys) / sizeof(keys[0]);
+
+	TestConnectionPool pool;
+	libtabula::BatchLoader loader(pool, "stock", "id", nkeys, 5000);
+	vector<Lookup*> lookups;
+	vector<libtabula::Thread*> threads;
+	for (size_t i = 0; i < nkeys; ++i) {
+		lookups.push_back(new Lookup(loader, keys[i]));
+		threads.push_back(new libtabula::Thread(*lookups.back()));
+		threads.back()->start();
+	}
+
+	bool ok = true;
+	for (size_t i = 0; i < nkeys; ++i) {
+		threads[i]->join();
+		int expected = keys[i] < 10 ? keys[i] : -1;
+		if (lookups[i]->found() != expected) {
+			cerr << "Lookup of key " << lookups[i]->key() << " found " <<
+					lookups[i]->found() << ", expected " << expected <<
+					'!' << endl;
+			ok = false;
+		}
+		delete threads[i];
+		delete lookups[i];
+	}
+
+	vector<string> sent = pool.statements();
+	if (loader.lookups() != nkeys || loader.queries() != 1 ||
+			sent.size() != 1 ||
+			sent[0].find("SELECT * FROM `stock` WHERE `id` IN (") != 0) {
+		cerr << loader.lookups() << " lookups took " << loader.queries() <<
+				" queries, expected " << nkeys << " in one!" << endl;
+		for (size_t i = 0; i < sent.size(); ++i) {
+			cerr << "    " << sent[i] << endl;
+		}
+		ok = false;
+	}
+
+	return ok;
+}
+
+
+// A Scope looks each key up only once, and a batch of one key still
+// goes out when the window is 0
+static bool
+test_scope()
+{
+	TestConnectionPool pool;
+	libtabula::BatchLoader loader(pool, "stock", "id", 10, 0);
+	libtabula::BatchLoader::Scope scope(loader);
+	libtabula::Row a = scope.load(3);
+	libtabula::Row b = scope.load(3);
+	libtabula::Row c = scope.load("O'Brien");
+
+	vector<string> sent = pool.statements();
+	if (!a || !b || string(a["name"]) != "row 3" || c ||
+			loader.lookups() != 2 || sent.size() != 2 ||
+			sent[0] != "SELECT * FROM `stock` WHERE `id` IN (3)" ||
+			sent[1] != "SELECT * FROM `stock` WHERE `id` IN ('O\\'Brien')") {
+		cerr << "Scope made " << loader.lookups() << " lookups for three "
+				"loads of two keys, or found the wrong rows!" << endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+// A key column the table doesn't have is an error, not a crash
+static bool
+test_bad_column()
+{
+	TestConnectionPool pool;
+	libtabula::BatchLoader loader(pool, "stock", "no_such_column", 10, 0);
+	try {
+		loader.load(1);
+		cerr << "Lookup on a missing key column succeeded!" << endl;
+		return false;
+	}
+	catch (const libtabula::BadQuery&) {
+	}
+
+	loader.disable_exceptions();
+	if (loader.load(1)) {
+		cerr << "Lookup on a missing key column found a row!" << endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+int
+main()
+{
+	try {
+		return	test_threads() &&
+				test_scope() &&
+				test_bad_column() ? 0 : 1;
+	}
+	catch (const libtabula::Exception& e) {
+		cerr << "Unexpected libtabula exception: " << e.what() << endl;
+		return 2;
+	}
+	catch (...) {
+		cerr << "Unhandled exception caught by test/batchloader!" << endl;
+		return 2;
+	}
+}
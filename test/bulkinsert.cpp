@@ -0,0 +1,175 @@
+/***********************************************************************
+ test/bulkinsert.cpp - Tests the way ParallelInsert splits its input
+	into partitions and statements.
+
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#include <libtabula.h>
+#define LIBTABULA_ALLOW_SSQLS_V1	// suppress deprecation warning
+#include <ssqls.h>
+
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+sql_create_2(widget, 1, 2,
+	libtabula::sql_int, id,
+	libtabula::sql_varchar, name)
+
+typedef vector<widget> Widgets;
+typedef libtabula::Query::RowCountInsertPolicy<libtabula::NoTransaction>
+		Policy;
+
+
+class TestConnectionPool : public libtabula::ConnectionPool
+{
+public:
+	~TestConnectionPool() { clear(); }
+
+	unsigned int max_idle_time() { return 1; }
+
+private:
+	libtabula::Connection* create() { return new libtabula::Connection; }
+	void destroy(libtabula::Connection* cp) { delete cp; }
+};
+
+
+// Exposes the statement building half of ParallelInsert, so we can
+// test it without a database server.
+class TestInsert : public libtabula::ParallelInsert<Widgets::const_iterator,
+		Policy>
+{
+public:
+	TestInsert(libtabula::ConnectionPool& pool, const Widgets& w,
+			const Policy& p, size_t connections) :
+	libtabula::ParallelInsert<Widgets::const_iterator, Policy>(pool,
+			w.begin(), w.end(), p, connections)
+	{
+	}
+
+	using libtabula::ParallelInsert<Widgets::const_iterator,
+			Policy>::partitions;
+	using libtabula::ParallelInsert<Widgets::const_iterator,
+			Policy>::render;
+};
+
+
+static bool
+test_partitions()
+{
+	Widgets w;
+	for (int i = 0; i < 10; ++i) w.push_back(widget(i, "w"));
+
+	TestConnectionPool pool;
+	Policy policy(2);
+	TestInsert ins(pool, w, policy, 3);
+	if (ins.partitions() != 3) {
+		cerr << "Got " << ins.partitions() << " partitions, not 3!" <<
+				endl;
+		return false;
+	}
+
+	// Partitions should cover rows 0-3, 4-6, and 7-9, each sent two
+	// rows at a time.
+	static const size_t expected[][2] = {
+		{ 0, 2 }, { 2, 2 }, { 4, 2 }, { 6, 1 }, { 7, 2 }, { 9, 1 }
+	};
+	libtabula::Query q(0);
+	size_t n = 0;
+	for (size_t i = 0; i < ins.partitions(); ++i) {
+		size_t first_row, rows;
+		while (ins.render(i, q, first_row, rows)) {
+			if (n == 6 || first_row != expected[n][0] ||
+					rows != expected[n][1]) {
+				cerr << "Statement " << n << " covers " << rows <<
+						" rows from " << first_row << '!' << endl;
+				return false;
+			}
+			++n;
+		}
+	}
+
+	return n == 6;
+}
+
+
+static bool
+test_statement()
+{
+	Widgets w;
+	w.push_back(widget(1, "one"));
+	w.push_back(widget(2, "two"));
+
+	TestConnectionPool pool;
+	Policy policy(10);
+	TestInsert ins(pool, w, policy, 1);
+	libtabula::Query q(0);
+	size_t first_row, rows;
+	ins.render(0, q, first_row, rows);
+
+	const char* expected = "INSERT INTO `widget` (`id`,`name`) "
+			"VALUES (1,'one'),(2,'two')";
+	if (q.str() != expected) {
+		cerr << "Statement is" << endl << "    " << q.str() << endl <<
+				"expected" << endl << "    " << expected << endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+static bool
+test_empty()
+{
+	Widgets w;
+	TestConnectionPool pool;
+	Policy policy(10);
+	TestInsert ins(pool, w, policy, 4);
+	if (ins.partitions() != 0 || !ins.run() || ins.stats().rows != 0) {
+		cerr << "Empty insert did something!" << endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+int
+main()
+{
+	try {
+		return	test_partitions() &&
+				test_statement() &&
+				test_empty() ? 0 : 1;
+	}
+	catch (const libtabula::Exception& e) {
+		cerr << "Unexpected libtabula exception: " << e.what() << endl;
+		return 2;
+	}
+	catch (...) {
+		cerr << "Unhandled exception caught by test/bulkinsert!" << endl;
+		return 2;
+	}
+}
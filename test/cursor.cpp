@@ -0,0 +1,258 @@
+/***********************************************************************
+ test/cursor.cpp - Tests Query::cursor(), and how the MySQL driver's
+	cursor result sets grow their buffers for long values.
+
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#include "fakedriver.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Our test cursor has no result set metadata
+static libtabula::RefCountedPointer<MYSQL_RES> no_metadata;
+
+
+// A cursor that stands in for the C API, handing out rows of two
+// columns with values no longer than each column's buffer allows,
+// as mysql_stmt_fetch() does, and whole values from
+// mysql_stmt_fetch_column().  A null pointer is a SQL null.
+class TestCursor : public libtabula::MySQLDriver::CursorImpl
+{
+public:
+	TestCursor(const vector< vector<const char*> >& rows) :
+	libtabula::MySQLDriver::CursorImpl(0, no_metadata, 2, 0, false),
+	data_(rows),
+	next_(0),
+	bound_(0),
+	bindings_(0),
+	refetches_(0)
+	{
+	}
+
+	int bindings() const { return bindings_; }
+	int refetches() const { return refetches_; }
+
+protected:
+	bool stmt_bind_result(MYSQL_BIND* binds)
+	{
+		bound_ = binds;
+		++bindings_;
+		return true;
+	}
+
+	int stmt_fetch()
+	{
+		if (next_ == data_.size()) return MYSQL_NO_DATA;
+
+		bool truncated = false;
+		for (unsigned int i = 0; i < 2; ++i) {
+			truncated = !copy(&bound_[i], data_[next_][i]) || truncated;
+		}
+		++next_;
+		return truncated ? MYSQL_DATA_TRUNCATED : 0;
+	}
+
+	bool stmt_fetch_column(MYSQL_BIND* bind, unsigned int column)
+	{
+		++refetches_;
+		return copy(bind, data_[next_ - 1][column]);
+	}
+
+private:
+	// Copy as much of the value as fits, returning false if it
+	// didn't all fit
+	static bool copy(MYSQL_BIND* bind, const char* value)
+	{
+		bind->is_null_value = value == 0;
+		if (!value) return true;
+
+		const unsigned long len = (unsigned long)strlen(value);
+		*bind->length = len;
+		char* buffer = static_cast<char*>(bind->buffer);
+		if (len < bind->buffer_length) {
+			memcpy(buffer, value, len + 1);
+			return true;
+		}
+		memcpy(buffer, value, bind->buffer_length);
+		return false;
+	}
+
+	vector< vector<const char*> > data_;
+	size_t next_;
+	MYSQL_BIND* bound_;
+	int bindings_;
+	int refetches_;
+};
+
+
+// A FakeDriver whose cursors read its rows, recording the fetch size
+// asked for.  Queries other than SELECTs return no rows, and queries
+// of a table called "missing" fail.
+class CursorDriver : public FakeDriver
+{
+public:
+	CursorDriver() :
+	FakeDriver(10),
+	fetch_size_(0)
+	{
+		disable_exceptions();	// fetch_row() throws at the end otherwise
+	}
+
+	libtabula::ResultBase::Impl* open_cursor(const string& sql,
+			unsigned long fetch_size, string& error, int& errnum)
+	{
+		execute(sql.data(), sql.length());
+		fetch_size_ = fetch_size;
+		errnum = 0;
+		if (sql.find("missing") != string::npos) {
+			error = "Table 'missing' doesn't exist";
+			errnum = 1146;		// ER_NO_SUCH_TABLE
+			return 0;
+		}
+		return sql.find("SELECT") == 0 ?
+				new libtabula::ResultBase::Impl : 0;
+	}
+
+	unsigned long fetch_size() const { return fetch_size_; }
+
+private:
+	unsigned long fetch_size_;
+};
+
+
+// Values longer than a column's buffer are fetched again, whole, into
+// a bigger one, which later rows keep using
+static bool
+test_regrowth()
+{
+	const string long1(300, 'x'), long2(1000, 'y');
+	const char* rows[][2] = {
+		{ "1", "short" },
+		{ "2", long1.c_str() },
+		{ "3", long1.c_str() },
+		{ "4", 0 },
+		{ "5", long2.c_str() },
+	};
+	vector< vector<const char*> > data;
+	for (size_t i = 0; i < sizeof(rows) / sizeof(rows[0]); ++i) {
+		data.push_back(vector<const char*>(rows[i], rows[i] + 2));
+	}
+
+	// Go through the driver, as UseQueryResult does
+	libtabula::MySQLDriver driver;
+	TestCursor cursor(data);
+	cursor.bind();
+	static const int refetches[] = { 0, 1, 1, 1, 2 };
+	for (size_t i = 0; i < data.size(); ++i) {
+		const char* const* raw = driver.fetch_raw_row(cursor);
+		const unsigned long* lengths = driver.fetch_lengths(cursor);
+		const char* expected = data[i][1];
+		if (!raw || string(raw[0]) != data[i][0] ||
+				(expected ? !raw[1] || lengths[1] != strlen(expected) ||
+					string(raw[1], lengths[1]) != expected : raw[1] != 0) ||
+				cursor.refetches() != refetches[i] ||
+				cursor.bindings() != 1 + refetches[i]) {
+			cerr << "Row " << i + 1 << " came back wrong, after " <<
+					cursor.refetches() << " refetches and " <<
+					cursor.bindings() << " bindings!" << endl;
+			return false;
+		}
+	}
+
+	if (driver.fetch_raw_row(cursor)) {
+		cerr << "Cursor returned rows past the end!" << endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+// Query::cursor() hands the query and fetch size to the driver, and
+// handles its results as use() does
+static bool
+test_query()
+{
+	CursorDriver* driver = new CursorDriver;
+	libtabula::Connection conn(driver);
+	libtabula::Query q = conn.query("SELECT * FROM stock");
+	libtabula::UseQueryResult res = q.cursor(50);
+	size_t rows = 0;
+	while (libtabula::Row row = res.fetch_row()) ++rows;
+	if (rows != 10 || driver->fetch_size() != 50 || !q.str().empty() ||
+			driver->statements().size() != 1 ||
+			driver->statements()[0] != "SELECT * FROM stock") {
+		cerr << "Cursor gave " << rows << " rows with fetch size " <<
+				driver->fetch_size() << '!' << endl;
+		return false;
+	}
+
+	// No result set isn't an error
+	q << "UPDATE stock SET num = 0";
+	q.cursor();
+	if (driver->fetch_size() != 100 || !q.str().empty() ||
+			driver->statements().size() != 2) {
+		cerr << "UPDATE through a cursor failed, or used fetch size " <<
+				driver->fetch_size() << '!' << endl;
+		return false;
+	}
+
+	// An error is
+	q << "SELECT * FROM missing";
+	try {
+		q.cursor();
+		cerr << "Cursor on a missing table succeeded!" << endl;
+		return false;
+	}
+	catch (const libtabula::BadQuery& e) {
+		if (e.errnum() != 1146) {
+			cerr << "Cursor failed with error " << e.errnum() << '!' <<
+					endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+int
+main()
+{
+	try {
+		return	test_regrowth() &&
+				test_query() ? 0 : 1;
+	}
+	catch (const libtabula::Exception& e) {
+		cerr << "Unexpected libtabula exception: " << e.what() << endl;
+		return 2;
+	}
+	catch (...) {
+		cerr << "Unhandled exception caught by test/cursor!" << endl;
+		return 2;
+	}
+}
@@ -0,0 +1,136 @@
+/***********************************************************************
+ test/fakedriver.h - Declares FakeDriver, a DBDriver that serves up a
+	synthetic result set, for the tests that need to exercise result
+	set handling without a database server.
+
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#if !defined(LIBTABULA_TEST_FAKEDRIVER_H)
+#define LIBTABULA_TEST_FAKEDRIVER_H
+
+#include <libtabula.h>
+#include <mysql/driver.h>
+
+#include <sstream>
+#include <string>
+#include <vector>
+#include <string.h>
+
+// A MySQLDriver that serves up a synthetic two-column result set:
+// an integer row number, and a string that's NULL on every 5th row.
+// If fail_at is nonzero, it pretends the connection dropped after
+// that many rows.  Statements "executed" through it are only kept,
+// for the test to check, and each one starts the result set over.
+class FakeDriver : public libtabula::MySQLDriver
+{
+public:
+	FakeDriver(int rows, int fail_at = 0) :
+	rows_(rows),
+	fail_at_(fail_at),
+	next_(0),
+	errnum_(0)
+	{
+		memset(fields_, 0, sizeof(fields_));
+		for (int i = 0; i < 2; ++i) {
+			fields_[i].table = fields_[i].db = const_cast<char*>("");
+		}
+		fields_[0].name = const_cast<char*>("id");
+		fields_[0].type = MYSQL_TYPE_LONG;
+		fields_[0].flags = NOT_NULL_FLAG;
+		fields_[1].name = const_cast<char*>("name");
+		fields_[1].type = MYSQL_TYPE_VAR_STRING;
+	}
+
+	bool execute(const char* qstr, size_t length)
+	{
+		statements_.push_back(std::string(qstr, length));
+		next_ = errnum_ = 0;
+		return true;
+	}
+
+	libtabula::ResultBase::Impl* store_result()
+			{ return new libtabula::ResultBase::Impl; }
+	libtabula::ResultBase::Impl* use_result()
+			{ return new libtabula::ResultBase::Impl; }
+	void free_result(libtabula::ResultBase::Impl&) const { }
+	libtabula::ulonglong num_rows(libtabula::ResultBase::Impl&) const
+			{ return rows_; }
+
+	const std::vector<std::string>& statements() const
+			{ return statements_; }
+
+	int errnum() { return errnum_; }
+	const char* error() { return errnum_ ? "fake connection lost" : ""; }
+
+	void fetch_fields(libtabula::Fields& fl,
+			libtabula::ResultBase::Impl&) const
+	{
+		fl.push_back(&fields_[0]);
+		fl.push_back(&fields_[1]);
+	}
+
+	const char* const* fetch_raw_row(libtabula::ResultBase::Impl&)
+	{
+		if (fail_at_ && next_ == fail_at_) {
+			errnum_ = CR_SERVER_LOST;
+			return 0;
+		}
+		if (next_ == rows_) return 0;
+
+		std::ostringstream os;
+		os << next_;
+		id_ = os.str();
+		name_ = "row " + id_;
+		lengths_[0] = (unsigned long)id_.length();
+		lengths_[1] = (unsigned long)name_.length();
+		raw_[0] = id_.c_str();
+		raw_[1] = next_ % 5 ? name_.c_str() : 0;
+		++next_;
+		return raw_;
+	}
+
+	const unsigned long* fetch_lengths(libtabula::ResultBase::Impl&) const
+			{ return lengths_; }
+
+	bool thread_start() { return true; }
+	void thread_end() { }
+
+private:
+	int rows_, fail_at_, next_, errnum_;
+	MYSQL_FIELD fields_[2];
+	std::string id_, name_;
+	std::vector<std::string> statements_;
+	const char* raw_[2];
+	unsigned long lengths_[2];
+};
+
+
+// Returns a "use" query result set reading from the given driver
+inline libtabula::UseQueryResult
+fake_use_result(FakeDriver& driver)
+{
+	return libtabula::UseQueryResult(new libtabula::ResultBase::Impl,
+			&driver, true);
+}
+
+#endif // !defined(LIBTABULA_TEST_FAKEDRIVER_H)
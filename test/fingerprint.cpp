@@ -0,0 +1,144 @@
+/***********************************************************************
+ test/fingerprint.cpp - Tests the Fingerprint class on statements with
+	all the sorts of literals, comments and spacing it has to see past,
+	and Query::fingerprint() on plain and template queries.
+
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#include <libtabula.h>
+
+#include <iostream>
+
+using namespace std;
+
+
+// Fingerprint each statement and compare the normalized text to what
+// we expected
+static bool
+test_normalize()
+{
+	static const char* const cases[][2] = {
+		{ "SELECT * FROM stock WHERE id IN (1, 2, 3) AND "
+				"name = 'Pickle Relish'",
+		  "select * from stock where id in(...) and name = ?" },
+		{ "select *\n  from `stock`   -- any comment\n"
+				"  where id in (42) and name='Hot Mustard'",
+		  "select * from stock where id in(...) and name = ?" },
+		{ "INSERT INTO stock (item, num) VALUES ('a', 1), ('b', -2),"
+				"('c',3.5e2)",
+		  "insert into stock(item, num) values(...)" },
+		{ "SELECT a.b, COUNT(*) FROM t1 AS a WHERE x >= -1.5 AND "
+				"y <> 0x1F /* why */ LIMIT 10;",
+		  "select a.b, count(*) from t1 as a where x >= ? and y <> ? "
+				"limit ?" },
+		{ "SELECT x - 1, x-1, f(y, 2) FROM t",
+		  "select x - ?, x - ?, f(y, ?) from t" },
+		{ "SELECT `my table`.`Col` FROM `my table` # trailing",
+		  "select `my table`.col from `my table`" },
+		{ "SELECT 'it''s', \"q\\\"uote\", X'0A', _utf8'x', N'y', ?, "
+				".5 FROM t",
+		  "select ?, ?, ?, ?, ?, ?, ? from t" },
+		{ "SELECT 1abc, t.2d FROM t2",
+		  "select 1abc, t.2d from t2" },
+		{ "SELECT * FROM t WHERE (a = 1 OR b IN (2)) AND c IS NULL",
+		  "select * from t where(a = ? or b in(...)) and c is null" },
+		{ "  ", "" },
+	};
+
+	for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+		libtabula::Fingerprint fp(cases[i][0]);
+		if (fp.text() != cases[i][1]) {
+			cerr << "Fingerprint of \"" << cases[i][0] << "\" is \"" <<
+					fp.text() << "\", expected \"" << cases[i][1] <<
+					"\"!" << endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+// Check that the digests depend on the normalized text alone
+static bool
+test_digest()
+{
+	libtabula::Fingerprint a(string("SELECT * FROM t WHERE a = 1"));
+	libtabula::Fingerprint b(string("select * from t where a=2"));
+	libtabula::Fingerprint c(string("select * from t where b = 1"));
+	libtabula::Fingerprint empty(string(""));
+
+	// The FNV-1a offset basis, which is the hash of nothing
+	const libtabula::ulonglong basis =
+			(libtabula::ulonglong(0xcbf29ce4) << 32) | 0x84222325;
+
+	if (a != b || a.digest() != b.digest() || a == c ||
+			a.digest() == c.digest() || empty.digest() != basis) {
+		cerr << "Fingerprint digests are wrong!" << endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+// Fingerprint a template query, and the same query built by hand
+static bool
+test_query()
+{
+	libtabula::Connection conn;
+	libtabula::Query tq = conn.query("SELECT * FROM stock "
+			"WHERE id = %0 AND name = %1q:name");
+	tq.parse();
+	libtabula::Query pq = conn.query("select * from stock "
+			"where id = 7 and name = 'Hot Mustard'");
+
+	libtabula::Fingerprint tf = tq.fingerprint(), pf = pq.fingerprint();
+	if (tf.text() != "select * from stock where id = ? and name = ?" ||
+			tf != pf) {
+		cerr << "Query fingerprints \"" << tf.text() << "\" and \"" <<
+				pf.text() << "\" should be equal!" << endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+int
+main()
+{
+	try {
+		return	test_normalize() &&
+				test_digest() &&
+				test_query() ? 0 : 1;
+	}
+	catch (const libtabula::Exception& e) {
+		cerr << "Unexpected libtabula exception: " << e.what() << endl;
+		return 2;
+	}
+	catch (...) {
+		cerr << "Unhandled exception caught by test/fingerprint!" << endl;
+		return 2;
+	}
+}
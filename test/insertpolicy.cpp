@@ -90,11 +90,78 @@ test_row_count()
 }
 
 
+// Offer rows of the given size to a policy until it refuses one, then
+// tell it the statement took the given time.  Returns the number of
+// rows it accepted.
+static size_t
+fill_adaptive(libtabula::Query::AdaptiveInsertPolicy<>& ip, int row_size,
+		libtabula::ulonglong usec)
+{
+	libtabula::Row dummy;
+	int size = 0;
+	size_t rows = 0;
+	while (rows < UCHAR_MAX && ip.can_add(size, dummy)) {
+		size += row_size;
+		++rows;
+	}
+	ip.executed(size, usec);
+	return rows;
+}
+
+
+static bool
+test_adaptive_target()
+{
+	// Fast statements grow the row target by a quarter of the initial
+	// target, and slow ones halve it.
+	libtabula::Query::AdaptiveInsertPolicy<> ip(10, 100000, 8);
+	size_t r1 = fill_adaptive(ip, 10, 5000);
+	size_t r2 = fill_adaptive(ip, 10, 5000);
+	size_t r3 = fill_adaptive(ip, 10, 20000);
+	size_t r4 = fill_adaptive(ip, 10, 20000);
+	if (r1 != 8 || r2 != 10 || r3 != 12 || r4 != 6 ||
+			ip.row_target() != 3 || ip.decisions().size() != 4) {
+		std::cerr << "AdaptiveInsertPolicy allowed " << r1 << ", " <<
+				r2 << ", " << r3 << ", " << r4 << " rows, now allows " <<
+				ip.row_target() << '!' << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+static bool
+test_adaptive_packet()
+{
+	// With a 100 byte limit and 20 byte rows, the fourth row brings
+	// the statement to 80 bytes, leaving too little room for another.
+	libtabula::Query::AdaptiveInsertPolicy<> ip(10, 100, 1000);
+	size_t rows = fill_adaptive(ip, 20, 1);
+	if (rows != 4 || ip.row_target() != 1000) {
+		std::cerr << "AdaptiveInsertPolicy allowed " << rows << " rows "
+				"under packet limit, now allows " << ip.row_target() <<
+				'!' << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+static bool
+test_adaptive()
+{
+	return	test_adaptive_target() &&
+			test_adaptive_packet();
+}
+
+
 int
 main()
 {
 	try {
-		return test_row_count() ? 0 : 1;
+		return test_row_count() && test_adaptive() ? 0 : 1;
 	}
 	catch (...) {
 		std::cerr << "Unhandled exception caught by "
@@ -0,0 +1,177 @@
+/***********************************************************************
+ test/keyfilter.cpp - Tests the inline conditions KeyFilter builds for
+	small key sets.
+
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#include "fakedriver.h"
+
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+
+static bool
+check_where(const std::string& actual, const char* expected)
+{
+	if (actual != expected) {
+		cerr << "Key condition is" << endl << "    " << actual << endl <<
+				"expected" << endl << "    " << expected << endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+static bool
+test_inline()
+{
+	vector<int> ids;
+	for (int i = 1; i <= 3; ++i) ids.push_back(i * 10);
+
+	libtabula::Connection conn;
+	libtabula::KeyFilter keys(conn);
+	if (!check_where(keys.where("id"), "id IN (NULL)")) return false;
+
+	keys.add(ids.begin(), ids.end());
+	return check_where(keys.where("id"), "id IN (10,20,30)");
+}
+
+
+static bool
+test_strings()
+{
+	libtabula::Connection conn;
+	libtabula::KeyFilter keys(conn, "VARCHAR(40)");
+	keys.add("Acme");
+	keys.add("O'Brien");
+	return check_where(keys.where("`vendor`"),
+			"`vendor` IN ('Acme','O\\'Brien')");
+}
+
+
+static bool
+test_threshold()
+{
+	libtabula::Connection conn;
+	libtabula::KeyFilter keys(conn);
+	keys.set_threshold(2);
+	keys.add(1);
+	keys.add(2);
+	if (keys.uses_table()) {
+		cerr << "Key set at the threshold would use a table!" << endl;
+		return false;
+	}
+
+	keys.add(3);
+	if (!keys.uses_table()) {
+		cerr << "Key set over the threshold would be inline!" << endl;
+		return false;
+	}
+
+	keys.clear();
+	return keys.size() == 0 && !keys.uses_table();
+}
+
+
+// A FakeDriver on which INSERTs fail.  Its one row answers KeyFilter's
+// question about the server's packet size limit.
+class FailDriver : public FakeDriver
+{
+public:
+	FailDriver() :
+	FakeDriver(1),
+	errnum_(0)
+	{
+		disable_exceptions();	// fetch_row() throws at the end otherwise
+	}
+
+	bool execute(const char* qstr, size_t length)
+	{
+		FakeDriver::execute(qstr, length);
+		errnum_ = strncmp(qstr, "INSERT", 6) ? 0 : 1114;
+		return errnum_ == 0;
+	}
+
+	int errnum() { return errnum_; }
+	const char* error() { return errnum_ ? "The table is full" : ""; }
+
+private:
+	int errnum_;
+};
+
+
+// A failed upload drops the table, and doesn't leave where() using it
+static bool
+test_failed_upload()
+{
+	FailDriver* driver = new FailDriver;
+	libtabula::Connection conn(driver);
+	libtabula::KeyFilter keys(conn);
+	keys.set_threshold(1);
+	keys.add(1);
+	keys.add(2);
+
+	for (int i = 0; i < 2; ++i) {
+		size_t first = driver->statements().size();
+		try {
+			string cond = keys.where("id");
+			cerr << "Upload didn't fail, giving " << cond << '!' << endl;
+			return false;
+		}
+		catch (const libtabula::BadQuery&) {
+		}
+
+		const vector<string>& sent = driver->statements();
+		if (sent[first].find("CREATE TEMPORARY TABLE") != 0 ||
+				sent.back().find("DROP TEMPORARY TABLE") != 0) {
+			cerr << "Failed upload ran " << sent[first] << " ... " <<
+					sent.back() << '!' << endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+int
+main()
+{
+	try {
+		return	test_inline() &&
+				test_strings() &&
+				test_threshold() &&
+				test_failed_upload() ? 0 : 1;
+	}
+	catch (const libtabula::Exception& e) {
+		cerr << "Unexpected libtabula exception: " << e.what() << endl;
+		return 2;
+	}
+	catch (...) {
+		cerr << "Unhandled exception caught by test/keyfilter!" << endl;
+		return 2;
+	}
+}
@@ -0,0 +1,185 @@
+/***********************************************************************
+ test/keyset.cpp - Tests the chunk queries KeysetScan builds.
+
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#include <libtabula.h>
+#define LIBTABULA_ALLOW_SSQLS_V1	// suppress deprecation warning
+#include <ssqls.h>
+
+#include <iostream>
+
+using namespace std;
+
+// Key is the first field only
+sql_create_3(widget, 1, 0,
+	libtabula::sql_int, id,
+	libtabula::sql_varchar, name,
+	libtabula::sql_double, weight)
+
+// Key is the first two fields
+sql_create_3(part, 2, 0,
+	libtabula::sql_varchar, vendor,
+	libtabula::sql_int, num,
+	libtabula::sql_varchar, descr)
+
+
+static bool
+check_query(const std::string& actual, const char* expected)
+{
+	if (actual != expected) {
+		cerr << "Chunk query is" << endl << "    " << actual << endl <<
+				"expected" << endl << "    " << expected << endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+static bool
+test_single_key()
+{
+	libtabula::Connection conn;
+	libtabula::KeysetScan<widget> scan(conn, 100);
+	if (!check_query(scan.next_query(),
+			"SELECT * FROM `widget` ORDER BY `id` LIMIT 100")) {
+		return false;
+	}
+
+	widget w;
+	w.id = 42;
+	w.name = "ignored";
+	scan.resume_after(w);
+	return check_query(scan.next_query(),
+			"SELECT * FROM `widget` WHERE (`id`) > (42) "
+			"ORDER BY `id` LIMIT 100");
+}
+
+
+static bool
+test_compound_key()
+{
+	libtabula::Connection conn;
+	libtabula::KeysetScan<part> scan(conn, 50);
+	scan.set_where("descr LIKE 'gear%'");
+	if (!check_query(scan.next_query(), "SELECT * FROM `part` "
+			"WHERE (descr LIKE 'gear%') ORDER BY `vendor`,`num` LIMIT 50")) {
+		return false;
+	}
+
+	part p;
+	p.vendor = "Acme";
+	p.num = 7;
+	scan.resume_after(p);
+	return check_query(scan.next_query(), "SELECT * FROM `part` "
+			"WHERE (`vendor`,`num`) > ('Acme',7) AND (descr LIKE 'gear%') "
+			"ORDER BY `vendor`,`num` LIMIT 50");
+}
+
+
+// last() is the last row fetch() returned, not the last one it read
+// from the server, so resuming from it skips nothing, even once the
+// scan has read to the end of the table
+static bool
+test_resume()
+{
+	libtabula::Fields fields;
+	fields.push_back(libtabula::Field("id", "widget", "test",
+			libtabula::FieldType(libtabula::FieldType::ft_integer), 11, 0));
+	fields.push_back(libtabula::Field("name", "widget", "test",
+			libtabula::FieldType(libtabula::FieldType::ft_text), 20, 0));
+	fields.push_back(libtabula::Field("weight", "widget", "test",
+			libtabula::FieldType(libtabula::FieldType::ft_real), 22, 0, 2));
+	libtabula::ReplayDriver* rd = new libtabula::ReplayDriver;
+	rd->generate("SELECT * FROM `widget` ORDER BY `id` LIMIT 10", fields, 5);
+	libtabula::Connection conn(rd);
+
+	libtabula::KeysetScan<widget> scan(conn, 10);
+	widget w;
+	for (int i = 0; i < 2; ++i) scan.fetch(w);
+	if (w.id != 2 || scan.last().id != 2) {
+		cerr << "Fetched row " << w.id << ", but last() is row " <<
+				scan.last().id << '!' << endl;
+		return false;
+	}
+
+	if (!scan.done()) {
+		cerr << "Short chunk didn't end the scan!" << endl;
+		return false;
+	}
+	scan.resume_after(scan.last());
+	if (scan.done()) {
+		cerr << "Resumed scan still thinks it's done!" << endl;
+		return false;
+	}
+
+	libtabula::KeysetScan<widget> resumed(conn, 10);
+	resumed.resume_after(scan.last());
+	return check_query(resumed.next_query(),
+			"SELECT * FROM `widget` WHERE (`id`) > (2) "
+			"ORDER BY `id` LIMIT 10");
+}
+
+
+static bool
+test_chunk_limits()
+{
+	libtabula::Connection conn;
+	libtabula::KeysetScan<widget> scan(conn, 10);
+	scan.set_chunk_limits(100, 1000);
+	if (scan.chunk_rows() != 100) {
+		cerr << "Chunk size " << scan.chunk_rows() << " not raised to "
+				"the minimum!" << endl;
+		return false;
+	}
+
+	scan.set_chunk_limits(1, 20);
+	if (scan.chunk_rows() != 20) {
+		cerr << "Chunk size " << scan.chunk_rows() << " not lowered to "
+				"the maximum!" << endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+int
+main()
+{
+	try {
+		return	test_single_key() &&
+				test_compound_key() &&
+				test_resume() &&
+				test_chunk_limits() ? 0 : 1;
+	}
+	catch (const libtabula::Exception& e) {
+		cerr << "Unexpected libtabula exception: " << e.what() << endl;
+		return 2;
+	}
+	catch (...) {
+		cerr << "Unhandled exception caught by test/keyset!" << endl;
+		return 2;
+	}
+}
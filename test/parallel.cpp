@@ -0,0 +1,200 @@
+/***********************************************************************
+ test/parallel.cpp - Tests the ParallelForEach and
+	OrderedParallelForEach classes against a fake driver.
+
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#include "fakedriver.h"
+
+#include <iostream>
+#include <stdexcept>
+
+using namespace std;
+
+
+// Adds up the row IDs it sees; called from several threads at once
+struct Summer
+{
+	libtabula::BeecryptMutex* mutex;
+	long long* sum;
+	int* count;
+	int throw_at;
+
+	void operator()(const libtabula::Row& row)
+	{
+		int id = row["id"];
+		if (id == throw_at) throw runtime_error("summer gave up");
+
+		libtabula::ScopedLock lock(*mutex);
+		*sum += id;
+		++*count;
+	}
+};
+
+
+// Doubles the row ID; its results go to Checker in row order
+struct Doubler
+{
+	typedef long result_type;
+
+	long operator()(const libtabula::Row& row) const
+			{ return 2L * int(row[0]); }
+};
+
+
+struct Checker
+{
+	long next;
+	bool ok;
+
+	void operator()(long value)
+	{
+		if (ok && value != next) {
+			cerr << "Ordered result " << value << " arrived when " <<
+					next << " was expected!" << endl;
+			ok = false;
+		}
+		next += 2;
+	}
+};
+
+
+static bool
+test_unordered(int rows, size_t workers, size_t batch_rows)
+{
+	FakeDriver driver(rows);
+	libtabula::BeecryptMutex mutex;
+	long long sum = 0;
+	int count = 0;
+	Summer fn = { &mutex, &sum, &count, -1 };
+	libtabula::ParallelForEach<Summer> pfe(fake_use_result(driver), fn,
+			workers, batch_rows);
+	pfe.run();
+
+	if (count != rows || sum != (long long)rows * (rows - 1) / 2) {
+		cerr << "Unordered run over " << rows << " rows saw " << count <<
+				" rows summing to " << sum << '!' << endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+static bool
+test_ordered(int rows, size_t workers, size_t batch_rows)
+{
+	FakeDriver driver(rows);
+	Doubler fn;
+	Checker sink = { 0, true };
+	libtabula::OrderedParallelForEach<Doubler, Checker> opfe(
+			fake_use_result(driver), fn, sink, workers, batch_rows);
+	opfe.run();
+
+	if (sink.ok && sink.next != 2L * rows) {
+		cerr << "Ordered run over " << rows << " rows delivered " <<
+				sink.next / 2 << " results!" << endl;
+		return false;
+	}
+
+	return sink.ok;
+}
+
+
+static bool
+test_worker_exception()
+{
+	FakeDriver driver(100000);
+	libtabula::BeecryptMutex mutex;
+	long long sum = 0;
+	int count = 0;
+	Summer fn = { &mutex, &sum, &count, 500 };
+	libtabula::ParallelForEach<Summer> pfe(fake_use_result(driver), fn,
+			4, 16);
+	try {
+		pfe.run();
+		cerr << "Worker exception didn't propagate!" << endl;
+		return false;
+	}
+	catch (const libtabula::WorkerFailed& e) {
+		if (string(e.what()) != "summer gave up") {
+			cerr << "Bad worker exception message '" << e.what() <<
+					"'!" << endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+static bool
+test_fetch_error()
+{
+	FakeDriver driver(1000, 600);
+	libtabula::BeecryptMutex mutex;
+	long long sum = 0;
+	int count = 0;
+	Summer fn = { &mutex, &sum, &count, -1 };
+	libtabula::ParallelForEach<Summer> pfe(fake_use_result(driver), fn,
+			3, 50);
+	try {
+		pfe.run();
+		cerr << "Fetch error didn't propagate!" << endl;
+		return false;
+	}
+	catch (const libtabula::UseQueryError&) {
+		if (count != 600) {
+			cerr << "Processed " << count << " rows before the fetch "
+					"error, expected 600!" << endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+int
+main()
+{
+	try {
+		return	test_unordered(0, 4, 16) &&
+				test_unordered(1, 4, 16) &&
+				test_unordered(10000, 1, 100) &&
+				test_unordered(10000, 4, 7) &&
+				test_ordered(0, 4, 16) &&
+				test_ordered(10000, 1, 100) &&
+				test_ordered(10000, 8, 3) &&
+				test_worker_exception() &&
+				test_fetch_error() ? 0 : 1;
+	}
+	catch (const libtabula::Exception& e) {
+		cerr << "Unexpected libtabula exception: " << e.what() << endl;
+		return 2;
+	}
+	catch (...) {
+		cerr << "Unhandled exception caught by test/parallel!" << endl;
+		return 2;
+	}
+}
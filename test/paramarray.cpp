@@ -0,0 +1,198 @@
+/***********************************************************************
+ test/paramarray.cpp - Tests the ParamArray class, pulling SSQLS
+	field values into one for array binding, and insertfrom()'s use
+	of them.
+
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#include "fakedriver.h"
+#include <paramarray.h>
+#define LIBTABULA_ALLOW_SSQLS_V1	// suppress deprecation warning
+#include <ssqls.h>
+
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+using namespace std;
+
+sql_create_3(widget, 1, 3,
+	libtabula::sql_int, id,
+	libtabula::sql_varchar, name,
+	libtabula::sql_double_null, weight)
+
+
+static bool
+check_value(const libtabula::ParamArray& pa, size_t row, size_t col,
+		const char* expected, bool null = false)
+{
+	if (pa.is_null(row, col) != null) {
+		cerr << "Value " << row << ',' << col << " is " <<
+				(null ? "not " : "") << "null!" << endl;
+		return false;
+	}
+	else if (pa.value(row, col) != expected) {
+		cerr << "Value " << row << ',' << col << " is '" <<
+				pa.value(row, col) << "', expected '" << expected <<
+				"'!" << endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+static bool
+test_capture()
+{
+	libtabula::ParamArray pa(3);
+	widget w1(1, "O'Brien", 1.5);
+	widget w2(2, "two", libtabula::null);
+
+	// Values go into the ParamArray unquoted and unescaped, and
+	// nothing goes to the stream.
+	ostringstream os;
+	os << w1.value_list("", libtabula::param_array_type0(&pa));
+	os << w2.value_list("", libtabula::param_array_type0(&pa));
+	if (!os.str().empty()) {
+		cerr << "Stream got '" << os.str() << "'!" << endl;
+		return false;
+	}
+	else if (pa.rows() != 2 || pa.values() != 6) {
+		cerr << "Got " << pa.rows() << " rows, " << pa.values() <<
+				" values; expected 2 and 6!" << endl;
+		return false;
+	}
+	else if (pa.bytes() != 1 + 7 + 3 + 1 + 3) {
+		cerr << "Got " << pa.bytes() << " bytes!" << endl;
+		return false;
+	}
+
+	return	check_value(pa, 0, 0, "1") &&
+			check_value(pa, 0, 1, "O'Brien") &&
+			check_value(pa, 0, 2, "1.5") &&
+			check_value(pa, 1, 0, "2") &&
+			check_value(pa, 1, 1, "two") &&
+			check_value(pa, 1, 2, "", true);
+}
+
+
+static bool
+test_clear()
+{
+	libtabula::ParamArray pa(2);
+	pa.add(1);
+	pa.add("x");
+	pa.clear();
+	if (!pa.empty() || pa.rows() != 0 || pa.bytes() != 0 ||
+			pa.columns() != 2) {
+		cerr << "ParamArray::clear() didn't!" << endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+// A FakeDriver that takes parameter arrays, recording the statements
+// it prepares and the rows in each array it runs
+class ArrayDriver : public FakeDriver
+{
+public:
+	ArrayDriver() : FakeDriver(0) { }
+
+	bool array_binding() { return true; }
+
+	PreparedStatement* prepare(const string& sql, string&, int&)
+	{
+		prepared_.push_back(sql);
+		return new PreparedStatement;
+	}
+
+	bool execute_array(PreparedStatement&,
+			const libtabula::ParamArray& params, string&, int&)
+	{
+		batches_.push_back(params.rows());
+		return true;
+	}
+
+	const vector<size_t>& batches() const { return batches_; }
+	const vector<string>& prepared() const { return prepared_; }
+
+private:
+	vector<size_t> batches_;
+	vector<string> prepared_;
+};
+
+
+// insertfrom() prepares its INSERT once and runs it for each batch,
+// and a later call reuses it
+static bool
+test_insertfrom()
+{
+	vector<widget> v;
+	for (int i = 1; i <= 5; ++i) v.push_back(widget(i, "w", 1.5));
+
+	ArrayDriver* driver = new ArrayDriver;
+	libtabula::Connection conn(driver);
+	libtabula::Query q = conn.query();
+	libtabula::Query::RowCountInsertPolicy<libtabula::NoTransaction>
+			policy(2);
+	q.insertfrom(v.begin(), v.end(), policy);
+	q.insertfrom(v.begin(), v.begin() + 1, policy);
+
+	const vector<size_t>& b = driver->batches();
+	const vector<string>& p = driver->prepared();
+	if (b.size() != 4 || b[0] != 2 || b[1] != 2 || b[2] != 1 ||
+			b[3] != 1 || p.size() != 1 || p[0] !=
+			"INSERT INTO `widget` (`id`,`name`,`weight`) "
+			"VALUES (?,?,?)") {
+		cerr << "Sent " << b.size() << " batches after " << p.size() <<
+				" prepares!" << endl;
+		for (size_t i = 0; i < p.size(); ++i) {
+			cerr << "    " << p[i] << endl;
+		}
+		return false;
+	}
+
+	return true;
+}
+
+
+int
+main()
+{
+	try {
+		return	test_capture() &&
+				test_clear() &&
+				test_insertfrom() ? 0 : 1;
+	}
+	catch (const libtabula::Exception& e) {
+		cerr << "Unexpected libtabula exception: " << e.what() << endl;
+		return 2;
+	}
+	catch (...) {
+		cerr << "Unhandled exception caught by test/paramarray!" << endl;
+		return 2;
+	}
+}
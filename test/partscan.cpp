@@ -0,0 +1,192 @@
+/***********************************************************************
+ test/partscan.cpp - Tests the query planning part of the
+	PartitionedScan class.  Running the scan needs a database server,
+	so that's left to the examples.
+
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#include "fakedriver.h"
+
+#include <iostream>
+
+using namespace std;
+
+
+class TestConnectionPool : public libtabula::ConnectionPool
+{
+public:
+	~TestConnectionPool() { clear(); }
+
+	unsigned int max_idle_time() { return 1; }
+
+private:
+	libtabula::Connection* create() { return new libtabula::Connection; }
+	void destroy(libtabula::Connection* cp) { delete cp; }
+};
+
+
+// A FakeDriver whose one row is the MIN() and MAX() of a key column
+// covering every longlong value
+class FullRangeDriver : public FakeDriver
+{
+public:
+	FullRangeDriver() :
+	FakeDriver(1)
+	{
+		disable_exceptions();	// fetch_row() throws at the end otherwise
+		raw_[0] = "-9223372036854775808";
+		raw_[1] = "9223372036854775807";
+		lengths_[0] = (unsigned long)strlen(raw_[0]);
+		lengths_[1] = (unsigned long)strlen(raw_[1]);
+	}
+
+	const char* const* fetch_raw_row(libtabula::ResultBase::Impl& impl)
+			{ return FakeDriver::fetch_raw_row(impl) ? raw_ : 0; }
+
+	const unsigned long* fetch_lengths(libtabula::ResultBase::Impl&) const
+			{ return lengths_; }
+
+private:
+	const char* raw_[2];
+	unsigned long lengths_[2];
+};
+
+
+// Hands out connections on a FullRangeDriver
+class FullRangeConnectionPool : public TestConnectionPool
+{
+private:
+	libtabula::Connection* create()
+			{ return new libtabula::Connection(new FullRangeDriver); }
+};
+
+
+static bool
+check_query(const libtabula::PartitionedScan& scan, size_t i,
+		const char* expected)
+{
+	if (scan.partition_query(i) != expected) {
+		cerr << "Partition " << i << " query is" << endl << "    " <<
+				scan.partition_query(i) << endl << "expected" << endl <<
+				"    " << expected << endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+static bool
+test_boundaries()
+{
+	TestConnectionPool pool;
+	libtabula::PartitionedScan scan(pool, "stock", "id", 99);
+	std::vector<libtabula::longlong> points;
+	points.push_back(100);
+	points.push_back(200);
+	scan.set_boundaries(points);
+	scan.plan();
+
+	if (scan.partitions().size() != 3) {
+		cerr << "Two split points gave " << scan.partitions().size() <<
+				" partitions!" << endl;
+		return false;
+	}
+
+	return	check_query(scan, 0,
+				"SELECT * FROM `stock` WHERE `id` < 100") &&
+			check_query(scan, 1,
+				"SELECT * FROM `stock` WHERE `id` >= 100 AND `id` < 200") &&
+			check_query(scan, 2,
+				"SELECT * FROM `stock` WHERE `id` >= 200");
+}
+
+
+static bool
+test_columns_and_where()
+{
+	TestConnectionPool pool;
+	libtabula::PartitionedScan scan(pool, std::string("stock"), "id");
+	scan.set_boundaries(std::vector<libtabula::longlong>(1, 42));
+	scan.set_columns("id, item");
+	scan.set_where("weight > 1");
+	scan.plan();
+
+	return	check_query(scan, 0, "SELECT id, item FROM `stock` "
+				"WHERE `id` < 42 AND (weight > 1)") &&
+			check_query(scan, 1, "SELECT id, item FROM `stock` "
+				"WHERE `id` >= 42 AND (weight > 1)");
+}
+
+
+static bool
+test_single_partition()
+{
+	TestConnectionPool pool;
+	libtabula::PartitionedScan scan(pool, "stock", "id", 1);
+	scan.plan();
+
+	return	scan.partitions().size() == 1 &&
+			check_query(scan, 0, "SELECT * FROM `stock`");
+}
+
+
+// A key range as wide as a longlong can be splits evenly, instead of
+// overflowing
+static bool
+test_full_range()
+{
+	FullRangeConnectionPool pool;
+	libtabula::PartitionedScan scan(pool, "stock", "id", 4);
+	scan.plan();
+
+	return	scan.partitions().size() == 4 &&
+			check_query(scan, 0, "SELECT * FROM `stock` "
+				"WHERE `id` < -4611686018427387904") &&
+			check_query(scan, 1, "SELECT * FROM `stock` "
+				"WHERE `id` >= -4611686018427387904 AND `id` < 0") &&
+			check_query(scan, 2, "SELECT * FROM `stock` "
+				"WHERE `id` >= 0 AND `id` < 4611686018427387904") &&
+			check_query(scan, 3, "SELECT * FROM `stock` "
+				"WHERE `id` >= 4611686018427387904");
+}
+
+
+int
+main()
+{
+	try {
+		return	test_boundaries() &&
+				test_columns_and_where() &&
+				test_single_partition() &&
+				test_full_range() ? 0 : 1;
+	}
+	catch (const libtabula::Exception& e) {
+		cerr << "Unexpected libtabula exception: " << e.what() << endl;
+		return 2;
+	}
+	catch (...) {
+		cerr << "Unhandled exception caught by test/partscan!" << endl;
+		return 2;
+	}
+}
@@ -0,0 +1,241 @@
+/***********************************************************************
+ test/querystats.cpp - Tests the Histogram class's percentiles, and
+	the QueryStats observer, fed both made-up events and the real ones
+	from a ConnectionPool.
+
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#include <connection.h>
+#include <cpool.h>
+#include <querystats.h>
+
+#include <iostream>
+#include <string.h>
+
+using namespace std;
+
+
+class TestConnectionPool : public libtabula::ConnectionPool
+{
+public:
+	~TestConnectionPool() { clear(); }
+
+private:
+	libtabula::Connection* create() { return new libtabula::Connection; }
+	void destroy(libtabula::Connection* cp) { delete cp; }
+	unsigned int max_idle_time() { return 60; }
+};
+
+
+// Returns true if got is within 1/32 of expected
+static bool
+close_to(libtabula::ulonglong got, libtabula::ulonglong expected)
+{
+	libtabula::ulonglong diff = got > expected ? got - expected :
+			expected - got;
+	return diff <= expected / 32;
+}
+
+
+// Fill a histogram with 1 to 100000 and check its percentiles
+static bool
+test_histogram()
+{
+	libtabula::Histogram h, odd;
+	if (h.percentile(50) != 0 || h.max() != 0) {
+		cerr << "Empty histogram isn't empty!" << endl;
+		return false;
+	}
+
+	for (libtabula::ulonglong i = 1; i <= 100000; ++i) {
+		(i % 2 ? odd : h).record(i);
+	}
+	h.merge(odd);
+
+	if (h.count() != 100000 || h.min() != 1 || h.max() != 100000 ||
+			h.total() != libtabula::ulonglong(100000) * 100001 / 2) {
+		cerr << "Histogram counted " << h.count() << " values from " <<
+				h.min() << " to " << h.max() << '!' << endl;
+		return false;
+	}
+
+	static const double pcts[] = { 1, 25, 50, 90, 99, 99.9 };
+	for (size_t i = 0; i < sizeof(pcts) / sizeof(pcts[0]); ++i) {
+		libtabula::ulonglong want = libtabula::ulonglong(pcts[i] * 1000);
+		libtabula::ulonglong got = h.percentile(pcts[i]);
+		if (!close_to(got, want)) {
+			cerr << "Percentile " << pcts[i] << " is " << got <<
+					", expected about " << want << '!' << endl;
+			return false;
+		}
+	}
+	if (h.percentile(100) != 100000 || h.percentile(0) != 1) {
+		cerr << "Histogram ends are wrong!" << endl;
+		return false;
+	}
+
+	libtabula::Histogram big;
+	big.record(~libtabula::ulonglong(0));
+	big.record(31);
+	if (big.percentile(100) != ~libtabula::ulonglong(0) ||
+			big.percentile(50) != 31) {
+		cerr << "Histogram can't handle extreme values!" << endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+// Make up an event as a driver would report it
+static libtabula::QueryEvent
+event(libtabula::QueryEvent::Kind kind, const void* driver,
+		const char* sql, libtabula::ulonglong elapsed,
+		libtabula::ulonglong rows = 0, int errnum = 0)
+{
+	libtabula::QueryEvent ev(kind,
+			static_cast<const libtabula::DBDriver*>(driver));
+	ev.sql = sql;
+	ev.sql_length = sql ? strlen(sql) : 0;
+	ev.bytes = ev.sql_length;
+	ev.elapsed = elapsed;
+	ev.rows = rows;
+	ev.errnum = errnum;
+	return ev;
+}
+
+
+// Feed QueryStats the events two drivers interleaving their queries
+// would produce
+static bool
+test_statements()
+{
+	const char* const select = "SELECT * FROM stock";
+	const char* const updates[] = {
+		"UPDATE stock SET num = 0 WHERE id = 1",
+		"update stock set num=42 where id=-5 -- another one",
+	};
+	int d1, d2;		// just for their addresses
+
+	libtabula::QueryStats stats(2);
+	for (int i = 0; i < 10; ++i) {
+		stats.observe(event(libtabula::QueryEvent::ev_execute, &d1,
+				select, 100 + i));
+		stats.observe(event(libtabula::QueryEvent::ev_execute, &d2,
+				updates[i % 2], 10, 3, i == 9 ? 1205 : 0));
+		stats.observe(event(libtabula::QueryEvent::ev_use, &d1, 0, 1));
+		stats.observe(event(libtabula::QueryEvent::ev_fetch, &d1, 0, 50,
+				5));
+	}
+	stats.observe(event(libtabula::QueryEvent::ev_execute, &d2,
+			"SELECT 1", 1));
+	stats.observe(event(libtabula::QueryEvent::ev_execute, &d2,
+			"SELECT 'two'", 1));
+
+	vector<libtabula::QueryStats::Statement> s = stats.statements();
+	if (s.size() != 3 || s[0].sql != "select * from stock" ||
+			s[1].sql != "update stock set num = ? where id = ?" ||
+			s[1].digest != libtabula::Fingerprint(updates[0]).digest() ||
+			!s[2].sql.empty()) {
+		cerr << "Got " << s.size() << " statements, in the wrong "
+				"order!" << endl;
+		return false;
+	}
+	if (s[0].calls != 10 || s[0].rows != 50 || s[0].fetch_time != 510 ||
+			s[0].errors != 0 || s[0].latency.max() != 109 ||
+			s[0].bytes != 10 * strlen(select)) {
+		cerr << "SELECT statistics are wrong!" << endl;
+		return false;
+	}
+	if (s[1].calls != 10 || s[1].rows != 30 || s[1].errors != 1 ||
+			s[1].latency.percentile(50) != 10) {
+		cerr << "UPDATE statistics are wrong!" << endl;
+		return false;
+	}
+	if (s[2].calls != 2) {
+		cerr << "Statements over the limit weren't lumped together!" <<
+				endl;
+		return false;
+	}
+
+	stats.reset();
+	if (!stats.statements().empty()) {
+		cerr << "QueryStats::reset() didn't!" << endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+// Install a QueryStats and check that it hears from a ConnectionPool
+static bool
+test_pool()
+{
+	libtabula::QueryStats stats;
+	TestConnectionPool pool;
+
+	libtabula::Connection* before = pool.grab();
+	if (libtabula::QueryObserver::install(&stats) != 0) {
+		cerr << "Some other observer was installed!" << endl;
+		return false;
+	}
+
+	libtabula::Connection* pc = pool.grab();
+	libtabula::Stopwatch sw;
+	while (sw.elapsed() < 1000) { }
+	pool.release(pc);
+	pool.release(before);		// grabbed unobserved, so no hold time
+
+	libtabula::QueryObserver::install(0);
+	pool.grab();				// not observed
+
+	libtabula::Histogram grab = stats.grab_latency();
+	libtabula::Histogram hold = stats.hold_time();
+	if (grab.count() != 1 || hold.count() != 1 || hold.min() < 1000) {
+		cerr << "Pool reported " << grab.count() << " grabs and " <<
+				hold.count() << " releases!" << endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+int
+main()
+{
+	try {
+		return	test_histogram() &&
+				test_statements() &&
+				test_pool() ? 0 : 1;
+	}
+	catch (const libtabula::Exception& e) {
+		cerr << "Unexpected libtabula exception: " << e.what() << endl;
+		return 2;
+	}
+	catch (...) {
+		cerr << "Unhandled exception caught by test/querystats!" << endl;
+		return 2;
+	}
+}
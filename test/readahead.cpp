@@ -0,0 +1,150 @@
+/***********************************************************************
+ test/readahead.cpp - Tests the ReadAheadResult class against a fake
+	driver, so we can check batching, ordering, cancellation and error
+	reporting without needing a database server.
+
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#include "fakedriver.h"
+
+#include <readahead.h>
+
+#include <iostream>
+
+using namespace std;
+
+
+// Read the whole result set through a ReadAheadResult and check that
+// every row arrived, in order, intact.
+static bool
+test_all_rows(int rows, size_t batch_rows, size_t batches)
+{
+	FakeDriver driver(rows);
+	libtabula::UseQueryResult res = fake_use_result(driver);
+	libtabula::ReadAheadResult rar(res, batch_rows, batches);
+
+	int i = 0;
+	while (libtabula::Row row = rar.fetch_row()) {
+		if (int(row["id"]) != i) {
+			cerr << "Expected row " << i << ", got " << row["id"] <<
+					'!' << endl;
+			return false;
+		}
+		if (i % 5 == 0) {
+			if (!row["name"].is_null()) {
+				cerr << "Row " << i << " should have a NULL name!" << endl;
+				return false;
+			}
+		}
+		else {
+			ostringstream os;
+			os << "row " << i;
+			if (string(row["name"]) != os.str()) {
+				cerr << "Row " << i << " has bad name " <<
+						row["name"] << '!' << endl;
+				return false;
+			}
+		}
+		++i;
+	}
+
+	if (i != rows) {
+		cerr << "Got " << i << " rows from ReadAheadResult(" <<
+				batch_rows << ", " << batches << "), expected " <<
+				rows << '!' << endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+// Stop early; the dtor has to shut the reader thread down even though
+// it's probably blocked waiting for us to drain the ring.
+static bool
+test_cancel()
+{
+	FakeDriver driver(10000);
+	libtabula::UseQueryResult res = fake_use_result(driver);
+	{
+		libtabula::ReadAheadResult rar(res, 16, 2);
+		for (int i = 0; i < 10; ++i) {
+			if (!rar.fetch_row()) {
+				cerr << "Early end of result set in cancel test!" << endl;
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+
+// The reader thread hits an error partway through; we should get all
+// the rows it read, then an exception.
+static bool
+test_error()
+{
+	FakeDriver driver(100, 42);
+	libtabula::UseQueryResult res = fake_use_result(driver);
+	libtabula::ReadAheadResult rar(res, 8, 3);
+
+	int i = 0;
+	try {
+		while (rar.fetch_row()) ++i;
+		cerr << "No exception from failed read-ahead!" << endl;
+		return false;
+	}
+	catch (const libtabula::UseQueryError&) {
+		if (i != 42) {
+			cerr << "Got " << i << " rows before the error, "
+					"expected 42!" << endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+int
+main()
+{
+	try {
+		return	test_all_rows(0, 16, 2) &&
+				test_all_rows(1, 16, 2) &&
+				test_all_rows(1000, 1, 2) &&
+				test_all_rows(1000, 7, 3) &&
+				test_all_rows(1000, 256, 2) &&
+				test_cancel() &&
+				test_error() ? 0 : 1;
+	}
+	catch (const libtabula::Exception& e) {
+		cerr << "Unexpected libtabula exception: " << e.what() << endl;
+		return 2;
+	}
+	catch (...) {
+		cerr << "Unhandled exception caught by test/readahead!" << endl;
+		return 2;
+	}
+}
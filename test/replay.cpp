@@ -0,0 +1,270 @@
+/***********************************************************************
+ test/replay.cpp - Tests the ReplayDriver class: generated result sets,
+	recording through another ReplayDriver standing in for a live
+	one, saving and loading recordings, and statements that fail.
+
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#include <libtabula.h>
+
+#include <iostream>
+#include <string>
+
+#include <stdio.h>
+
+using namespace std;
+
+static const char* path = "replay-test.replay";
+static const char* select_sql = "SELECT * FROM stock";
+static const char* insert_sql = "INSERT INTO stock (item) VALUES ('Pie')";
+
+
+// The stock table's fields, as the examples create it
+static libtabula::Fields
+stock_fields()
+{
+	libtabula::Fields fields;
+	fields.push_back(libtabula::Field("id", "stock", "test",
+			libtabula::FieldType(libtabula::FieldType::ft_integer,
+			libtabula::FieldType::tf_unsigned), 20, 0));
+	fields.push_back(libtabula::Field("item", "stock", "test",
+			libtabula::FieldType(libtabula::FieldType::ft_text), 20, 0));
+	fields.push_back(libtabula::Field("num", "stock", "test",
+			libtabula::FieldType(libtabula::FieldType::ft_integer,
+			libtabula::FieldType::tf_null), 11, 0));
+	fields.push_back(libtabula::Field("weight", "stock", "test",
+			libtabula::FieldType(libtabula::FieldType::ft_real), 22, 0, 2));
+	fields.push_back(libtabula::Field("sdate", "stock", "test",
+			libtabula::FieldType(libtabula::FieldType::ft_datetime), 19, 0));
+	return fields;
+}
+
+
+// Returns true if the two result sets hold the same fields and values
+static bool
+same(const libtabula::StoreQueryResult& a,
+		const libtabula::StoreQueryResult& b)
+{
+	if (a.num_rows() != b.num_rows() || a.num_fields() != b.num_fields()) {
+		return false;
+	}
+	for (size_t i = 0; i < a.num_fields(); ++i) {
+		const libtabula::Field& fa = a.field(static_cast<unsigned int>(i));
+		const libtabula::Field& fb = b.field(static_cast<unsigned int>(i));
+		if (string(fa.name()) != fb.name() || fa.type() != fb.type() ||
+				fa.decimals() != fb.decimals()) {
+			return false;
+		}
+	}
+	for (size_t r = 0; r < a.num_rows(); ++r) {
+		for (size_t i = 0; i < a.num_fields(); ++i) {
+			if (a[r][i].is_null() != b[r][i].is_null() ||
+					a[r][i].compare(b[r][i]) != 0) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+
+// Made-up rows come back through store() and use(), the same every
+// time for a given seed, and with the values we promised
+static bool
+test_generate()
+{
+	libtabula::ReplayDriver* rd = new libtabula::ReplayDriver;
+	rd->generate(select_sql, stock_fields(), 100);
+	rd->generate(select_sql, stock_fields(), 100);
+	rd->generate(select_sql, stock_fields(), 100, 2);
+	libtabula::Connection conn(rd);
+
+	libtabula::StoreQueryResult a = conn.query(select_sql).store();
+	libtabula::StoreQueryResult b = conn.query(select_sql).store();
+	libtabula::StoreQueryResult c = conn.query(select_sql).store();
+	if (a.num_rows() != 100 || !same(a, b) || same(a, c)) {
+		cerr << "Generated " << a.num_rows() << " rows, expected 100, "
+				"the same for each seed!" << endl;
+		return false;
+	}
+
+	size_t nulls = 0;
+	for (size_t r = 0; r < a.num_rows(); ++r) {
+		const libtabula::Row& row = a[r];
+		if (row["num"].is_null()) ++nulls;
+		libtabula::DateTime sdate = row["sdate"];
+		if (unsigned(row["id"]) != r + 1 || row["item"].length() < 1 ||
+				row["item"].length() > 20 || row["id"].is_null() ||
+				sdate.year() != 2018) {
+			cerr << "Generated row " << r << " is wrong: " << row["id"] <<
+					", " << row["item"] << ", " << row["sdate"] << endl;
+			return false;
+		}
+	}
+	if (nulls == 0 || nulls > 30) {
+		cerr << "Generated " << nulls << " nulls in 100 rows!" << endl;
+		return false;
+	}
+
+	// Wraps around to the first statement
+	libtabula::UseQueryResult res = conn.query(select_sql).use();
+	size_t rows = 0;
+	while (libtabula::Row row = res.fetch_row()) {
+		if (row.size() != 5 || row[0].compare(a[rows][0]) != 0) break;
+		++rows;
+	}
+	if (rows != 100) {
+		cerr << "Read " << rows << " rows with use(), expected 100!" <<
+				endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+// Record through a driver with canned answers standing in for a live
+// one, then save, load and replay the recording
+static bool
+test_record()
+{
+	libtabula::ReplayDriver* live = new libtabula::ReplayDriver;
+	live->generate(select_sql, stock_fields(), 10);
+	live->add(insert_sql, 1, 42);
+	libtabula::ReplayDriver* rec = new libtabula::ReplayDriver(live);
+	libtabula::StoreQueryResult recorded;
+	{
+		libtabula::Connection conn(rec);
+		conn.connect();
+		libtabula::Query q = conn.query(select_sql);
+		recorded = q.store();
+		if (!q.exec(insert_sql) || q.insert_id() != 42) {
+			cerr << "Recording driver didn't pass INSERT through!" << endl;
+			return false;
+		}
+		if (!rec->recording() || rec->size() != 2) {
+			cerr << "Recorded " << rec->size() << " statements, "
+					"expected 2!" << endl;
+			return false;
+		}
+		rec->save(path);
+	}
+
+	libtabula::ReplayDriver* play = new libtabula::ReplayDriver;
+	play->load(path);
+	remove(path);
+	libtabula::Connection conn(play);
+	libtabula::Query q = conn.query(select_sql);
+	libtabula::StoreQueryResult replayed = q.store();
+	if (!same(recorded, replayed) || replayed.num_rows() != 10) {
+		cerr << "Replayed result set differs from the recorded one!" <<
+				endl;
+		return false;
+	}
+	if (!q.exec(insert_sql) || q.insert_id() != 42 ||
+			q.affected_rows() != 1) {
+		cerr << "Replayed INSERT gave insert ID " << q.insert_id() <<
+				", expected 42!" << endl;
+		return false;
+	}
+
+	// A copy of the connection shares the recording
+	libtabula::Connection copy(conn);
+	if (copy.query(select_sql).store().num_rows() != 10) {
+		cerr << "Copied connection lost the recording!" << endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+// Statements that failed fail again, and ones we never saw fail too
+static bool
+test_errors()
+{
+	libtabula::ReplayDriver* rd = new libtabula::ReplayDriver;
+	rd->add("DROP TABLE nothing", 0, 0, 1051, "Unknown table 'nothing'");
+	libtabula::Connection conn(rd);
+
+	try {
+		conn.query("DROP TABLE nothing").exec();
+		cerr << "Replayed failing statement succeeded!" << endl;
+		return false;
+	}
+	catch (const libtabula::BadQuery& e) {
+		if (e.errnum() != 1051) {
+			cerr << "Replayed error " << e.errnum() << ", expected 1051!" <<
+					endl;
+			return false;
+		}
+	}
+
+	libtabula::Query q = conn.query();
+	q.disable_exceptions();
+	if (q.exec("SELECT 1") || conn.errnum() == 0) {
+		cerr << "Unrecorded statement didn't fail!" << endl;
+		return false;
+	}
+
+	try {
+		rd->load("no/such/dir/test.replay");
+		cerr << "Loaded a recording that doesn't exist!" << endl;
+		return false;
+	}
+	catch (const libtabula::BadSnapshot&) {
+	}
+
+	if (FILE* f = fopen(path, "wb")) {
+		fputs("LTSNAPSH", f);
+		fclose(f);
+	}
+	rd->disable_exceptions();
+	bool loaded = rd->load(path);
+	remove(path);
+	if (loaded || rd->size() != 1) {
+		cerr << "Loaded a file that isn't a recording!" << endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+int
+main()
+{
+	try {
+		return	test_generate() &&
+				test_record() &&
+				test_errors() ? 0 : 1;
+	}
+	catch (const libtabula::Exception& e) {
+		cerr << "Unexpected libtabula exception: " << e.what() << endl;
+		return 2;
+	}
+	catch (...) {
+		cerr << "Unhandled exception caught by test/replay!" << endl;
+		return 2;
+	}
+}
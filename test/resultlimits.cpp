@@ -0,0 +1,254 @@
+/***********************************************************************
+ test/resultlimits.cpp - Tests result set memory accounting, and the
+	row and memory limits on store() and use() queries, against
+	result sets made up by ReplayDriver and FakeDriver.
+
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#include "fakedriver.h"
+
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+static const char* small_sql = "SELECT * FROM stock LIMIT 100";
+static const char* large_sql = "SELECT * FROM stock";
+
+
+// Returns a Connection whose driver makes up 100 and 1000 rows for
+// the two queries above
+static libtabula::Connection*
+connection()
+{
+	libtabula::Fields fields;
+	fields.push_back(libtabula::Field("id", "stock", "test",
+			libtabula::FieldType(libtabula::FieldType::ft_integer), 20, 0));
+	fields.push_back(libtabula::Field("item", "stock", "test",
+			libtabula::FieldType(libtabula::FieldType::ft_text), 20, 0));
+	fields.push_back(libtabula::Field("sdate", "stock", "test",
+			libtabula::FieldType(libtabula::FieldType::ft_datetime), 19, 0));
+
+	libtabula::ReplayDriver* rd = new libtabula::ReplayDriver;
+	rd->generate(small_sql, fields, 100);
+	rd->generate(large_sql, fields, 1000);
+	return new libtabula::Connection(rd);
+}
+
+
+// memory_usage() counts at least the data, and grows with the rows
+static bool
+test_usage()
+{
+	libtabula::Connection* conn = connection();
+	libtabula::StoreQueryResult small = conn->query(small_sql).store();
+	libtabula::StoreQueryResult large = conn->query(large_sql).store();
+	delete conn;
+
+	size_t data = 0;
+	for (size_t i = 0; i < large.num_rows(); ++i) {
+		for (size_t j = 0; j < large[i].size(); ++j) {
+			data += large[i][j].length();
+		}
+	}
+
+	if (large.memory_usage() <= data ||
+			large.memory_usage() < 5 * small.memory_usage() ||
+			small[0].memory_usage() <= sizeof(libtabula::String) * 3) {
+		cerr << "Result sets of 100 and 1000 rows use " <<
+				small.memory_usage() << " and " << large.memory_usage() <<
+				" bytes, holding " << data << " bytes of data!" << endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+// Row limits, set on the connection and on the query
+static bool
+test_rows()
+{
+	libtabula::Connection* conn = connection();
+	conn->set_result_limits(100);
+	libtabula::Query q = conn->query();
+
+	bool ok = q.store(small_sql).num_rows() == 100;
+	try {
+		q.store(large_sql);
+		cerr << "Stored 1000 rows with a limit of 100!" << endl;
+		ok = false;
+	}
+	catch (const libtabula::ResultTooLarge& e) {
+		if (e.rows() != 101) {
+			cerr << "Gave up on store() after " << e.rows() <<
+					" rows, expected 101!" << endl;
+			ok = false;
+		}
+	}
+
+	q.set_result_limits(10);
+	libtabula::UseQueryResult res = q.use(small_sql);
+	size_t rows = 0;
+	try {
+		while (res.fetch_row()) ++rows;
+		cerr << "Fetched all rows with a limit of 10!" << endl;
+		ok = false;
+	}
+	catch (const libtabula::ResultTooLarge&) {
+		if (rows != 10) {
+			cerr << "Fetched " << rows << " rows, expected 10!" << endl;
+			ok = false;
+		}
+	}
+
+	q.set_result_limits(0);
+	if (q.store(large_sql).num_rows() != 1000) {
+		cerr << "Clearing the limit didn't!" << endl;
+		ok = false;
+	}
+
+	delete conn;
+	return ok;
+}
+
+
+// Memory limits, with exceptions disabled
+static bool
+test_bytes()
+{
+	libtabula::Connection* conn = connection();
+	const size_t usage = conn->query(small_sql).store().memory_usage();
+
+	libtabula::Query q = conn->query();
+	q.disable_exceptions();
+	q.set_result_limits(0, usage);
+	bool ok = true;
+	if (q.store(small_sql).num_rows() != 100) {
+		cerr << "A limit of " << usage << " bytes stopped a result set "
+				"of that size!" << endl;
+		ok = false;
+	}
+
+	libtabula::StoreQueryResult res = q.store(large_sql);
+	if (res || res.num_rows() != 0 || !(!q)) {
+		cerr << "A limit of " << usage << " bytes didn't stop a result "
+				"set ten times that size!" << endl;
+		ok = false;
+	}
+
+	delete conn;
+	return ok;
+}
+
+
+// A limited store() reads to the end of the rows without tripping
+// over the driver's end-of-rows handling, and reports a connection
+// dropped partway through as an error
+static bool
+test_driver_errors()
+{
+	libtabula::Connection conn(new FakeDriver(10));
+	conn.set_result_limits(100);
+	libtabula::StoreQueryResult res = conn.query(small_sql).store();
+	if (!res || res.num_rows() != 10 || !res[0][1].is_null() ||
+			string(res[1][1]) != "row 1") {
+		cerr << "Limited store() of 10 rows got " << res.num_rows() <<
+				", or the wrong ones!" << endl;
+		return false;
+	}
+
+	libtabula::Connection lost(new FakeDriver(10, 5));
+	lost.set_result_limits(100);
+	libtabula::Query q = lost.query(small_sql);
+	try {
+		q.store();
+		cerr << "Limited store() ignored a dropped connection!" << endl;
+		return false;
+	}
+	catch (const libtabula::BadQuery& e) {
+		if (e.errnum() != CR_SERVER_LOST) {
+			cerr << "Dropped connection gave error " << e.errnum() <<
+					'!' << endl;
+			return false;
+		}
+	}
+
+	q.disable_exceptions();
+	res = q.store(small_sql);
+	if (res || res.num_rows() != 0 || !(!q)) {
+		cerr << "Limited store() with exceptions disabled kept " <<
+				res.num_rows() << " rows from a dropped connection!" <<
+				endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+// The driver only keeps what it needs to cancel a query when the
+// connection is made with limits on
+static bool
+test_cancellable()
+{
+	FakeDriver* driver = new FakeDriver(0);
+	libtabula::Connection conn(driver, false);
+	conn.connect("test", "localhost");
+	if (driver->cancellable()) {
+		cerr << "Connection without limits made the driver " <<
+				"cancellable!" << endl;
+		return false;
+	}
+
+	conn.set_result_limits(100);
+	conn.connect("test", "localhost");
+	if (!driver->cancellable()) {
+		cerr << "Connection with limits didn't make the driver " <<
+				"cancellable!" << endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+int
+main()
+{
+	try {
+		return	test_usage() &&
+				test_rows() &&
+				test_bytes() &&
+				test_driver_errors() &&
+				test_cancellable() ? 0 : 1;
+	}
+	catch (const libtabula::Exception& e) {
+		cerr << "Unexpected libtabula exception: " << e.what() << endl;
+		return 2;
+	}
+	catch (...) {
+		cerr << "Unhandled exception caught by test/resultlimits!" << endl;
+		return 2;
+	}
+}
@@ -0,0 +1,302 @@
+/***********************************************************************
+ test/resultwriter.cpp - Tests the CSV, TSV and JSON Lines result
+	writers against a fake driver, including the escaping each format
+	needs and what happens when the output can't be written.
+
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#include "fakedriver.h"
+
+#include <resultwriter.h>
+
+#include <iostream>
+#include <stdexcept>
+
+#include <stdio.h>
+
+using namespace std;
+
+
+// A FakeDriver whose name column holds values that need escaping in
+// one format or another, rather than "row N"
+class EscapeDriver : public FakeDriver
+{
+public:
+	EscapeDriver() :
+	FakeDriver(0),
+	next_(0)
+	{
+	}
+
+	const char* const* fetch_raw_row(libtabula::ResultBase::Impl&)
+	{
+		static const char* const values[] = {
+			"plain", "a,b", "say \"hi\"", "two\nlines", "tab\there",
+			"back\\slash", "nul\0byte", "bell\007", ""
+		};
+		static const unsigned long lengths[] = {
+			5, 3, 8, 9, 8, 10, 8, 5, 0
+		};
+
+		if (next_ == sizeof(lengths) / sizeof(lengths[0])) return 0;
+
+		os_.str("");
+		os_ << next_;
+		id_ = os_.str();
+		raw_[0] = id_.c_str();
+		raw_[1] = values[next_];
+		lengths_[0] = (unsigned long)id_.length();
+		lengths_[1] = lengths[next_];
+		++next_;
+		return raw_;
+	}
+
+	const unsigned long* fetch_lengths(libtabula::ResultBase::Impl&) const
+			{ return lengths_; }
+
+private:
+	size_t next_;
+	ostringstream os_;
+	string id_;
+	const char* raw_[2];
+	unsigned long lengths_[2];
+};
+
+
+// A FakeDriver with one row, whose column names need escaping in JSON
+class NameDriver : public FakeDriver
+{
+public:
+	NameDriver() :
+	FakeDriver(1)
+	{
+		memset(fields_, 0, sizeof(fields_));
+		for (int i = 0; i < 2; ++i) {
+			fields_[i].table = fields_[i].db = const_cast<char*>("");
+		}
+		fields_[0].name = const_cast<char*>("tab\there");
+		fields_[0].type = MYSQL_TYPE_LONG;
+		fields_[1].name = const_cast<char*>("say \"hi\"\001");
+		fields_[1].type = MYSQL_TYPE_VAR_STRING;
+	}
+
+	void fetch_fields(libtabula::Fields& fl,
+			libtabula::ResultBase::Impl&) const
+	{
+		fl.push_back(&fields_[0]);
+		fl.push_back(&fields_[1]);
+	}
+
+private:
+	MYSQL_FIELD fields_[2];
+};
+
+
+// Run a result set through a writer into a temporary file, and return
+// what ended up in the file
+template <class Writer>
+static string
+export_rows(FakeDriver& driver, size_t buffer_size)
+{
+	FILE* f = tmpfile();
+	if (!f) throw runtime_error("Failed to create temporary file");
+
+	libtabula::UseQueryResult res = fake_use_result(driver);
+	{
+		Writer out(fileno(f), buffer_size);
+		out.write(res);
+	}
+
+	string s;
+	char buf[4096];
+	rewind(f);
+	while (size_t n = fread(buf, 1, sizeof(buf), f)) s.append(buf, n);
+	fclose(f);
+	return s;
+}
+
+
+// Compare a writer's output to what we expected
+static bool
+check(const char* what, const string& got, const string& expected)
+{
+	if (got == expected) return true;
+
+	cerr << what << " output is wrong!  Expected:" << endl <<
+			expected << "Got:" << endl << got << endl;
+	return false;
+}
+
+
+// Export FakeDriver's rows in each format, through a buffer small
+// enough that it has to be flushed many times
+static bool
+test_plain(size_t buffer_size)
+{
+	const int rows = 100;
+	ostringstream csv, tsv, json;
+	csv << "id,name\r\n";
+	for (int i = 0; i < rows; ++i) {
+		csv << i << ',';
+		tsv << i << '\t';
+		json << "{\"id\":" << i << ",\"name\":";
+		if (i % 5) {
+			csv << "row " << i;
+			tsv << "row " << i;
+			json << "\"row " << i << '"';
+		}
+		else {
+			tsv << "\\N";
+			json << "null";
+		}
+		csv << "\r\n";
+		tsv << '\n';
+		json << "}\n";
+	}
+
+	FakeDriver d1(rows), d2(rows), d3(rows);
+	return	check("CSV", export_rows<libtabula::CSVWriter>(d1,
+					buffer_size), csv.str()) &&
+			check("TSV", export_rows<libtabula::TSVWriter>(d2,
+					buffer_size), tsv.str()) &&
+			check("JSON Lines", export_rows<libtabula::JSONLinesWriter>(d3,
+					buffer_size), json.str());
+}
+
+
+// Export values that need escaping
+static bool
+test_escaping()
+{
+	static const char csv_text[] = "id,name\r\n"
+			"0,plain\r\n"
+			"1,\"a,b\"\r\n"
+			"2,\"say \"\"hi\"\"\"\r\n"
+			"3,\"two\nlines\"\r\n"
+			"4,tab\there\r\n"
+			"5,back\\slash\r\n"
+			"6,nul\0byte\r\n"
+			"7,bell\007\r\n"
+			"8,\r\n";
+	const string csv(csv_text, sizeof(csv_text) - 1);
+	const string tsv("0\tplain\n"
+			"1\ta,b\n"
+			"2\tsay \"hi\"\n"
+			"3\ttwo\\nlines\n"
+			"4\ttab\\there\n"
+			"5\tback\\\\slash\n"
+			"6\tnul\\0byte\n"
+			"7\tbell\007\n"
+			"8\t\n");
+	const string json("{\"id\":0,\"name\":\"plain\"}\n"
+			"{\"id\":1,\"name\":\"a,b\"}\n"
+			"{\"id\":2,\"name\":\"say \\\"hi\\\"\"}\n"
+			"{\"id\":3,\"name\":\"two\\nlines\"}\n"
+			"{\"id\":4,\"name\":\"tab\\there\"}\n"
+			"{\"id\":5,\"name\":\"back\\\\slash\"}\n"
+			"{\"id\":6,\"name\":\"nul\\u0000byte\"}\n"
+			"{\"id\":7,\"name\":\"bell\\u0007\"}\n"
+			"{\"id\":8,\"name\":\"\"}\n");
+
+	// Member names are escaped the same way as values
+	const string names("{\"tab\\there\":0,\"say \\\"hi\\\"\\u0001\":null}\n");
+
+	EscapeDriver d1, d2, d3;
+	NameDriver d4;
+	return	check("Escaped CSV", export_rows<libtabula::CSVWriter>(d1,
+					1 << 20), csv) &&
+			check("Escaped TSV", export_rows<libtabula::TSVWriter>(d2,
+					3), tsv) &&
+			check("Escaped JSON Lines",
+					export_rows<libtabula::JSONLinesWriter>(d3, 1 << 20),
+					json) &&
+			check("Escaped JSON Lines names",
+					export_rows<libtabula::JSONLinesWriter>(d4, 1 << 20),
+					names);
+}
+
+
+// The output can't be written, or the connection drops partway through
+static bool
+test_errors()
+{
+	FakeDriver d1(100);
+	libtabula::UseQueryResult r1 = fake_use_result(d1);
+	libtabula::CSVWriter quiet(-1, 64, false);
+	if (quiet.write(r1) || quiet.error().empty()) {
+		cerr << "Writing to a bad file descriptor succeeded!" << endl;
+		return false;
+	}
+
+	FakeDriver d2(100);
+	libtabula::UseQueryResult r2 = fake_use_result(d2);
+	try {
+		libtabula::TSVWriter out(-1, 64);
+		out.write(r2);
+		cerr << "No exception from writing to a bad file descriptor!" <<
+				endl;
+		return false;
+	}
+	catch (const libtabula::ExportFailed&) {
+	}
+
+	FakeDriver d3(100, 42);
+	libtabula::UseQueryResult r3 = fake_use_result(d3);
+	FILE* f = tmpfile();
+	try {
+		libtabula::JSONLinesWriter out(fileno(f));
+		out.write(r3);
+		cerr << "No exception from failed export!" << endl;
+		fclose(f);
+		return false;
+	}
+	catch (const libtabula::BadQuery&) {
+		fclose(f);
+		return true;
+	}
+}
+
+
+int
+main()
+{
+	try {
+		return	test_plain(1 << 20) &&
+				test_plain(1) &&
+				test_plain(10) &&
+				test_escaping() &&
+				test_errors() ? 0 : 1;
+	}
+	catch (const libtabula::Exception& e) {
+		cerr << "Unexpected libtabula exception: " << e.what() << endl;
+		return 2;
+	}
+	catch (const std::exception& e) {
+		cerr << "Unexpected exception: " << e.what() << endl;
+		return 2;
+	}
+	catch (...) {
+		cerr << "Unhandled exception caught by test/resultwriter!" << endl;
+		return 2;
+	}
+}
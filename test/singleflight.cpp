@@ -0,0 +1,210 @@
+/***********************************************************************
+ test/singleflight.cpp - Tests that the SingleFlight class runs a
+	query once for all the threads asking for it at the same time.
+
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#include "fakedriver.h"
+
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+static const char* select_sql = "SELECT * FROM stock";
+
+
+// Holds every query back until the test opens it
+struct Gate
+{
+	libtabula::BeecryptMutex mutex;
+	libtabula::Condition opened;
+	bool open;
+
+	Gate() : open(false) { }
+};
+
+
+// A FakeDriver whose statements wait at the gate
+class GateDriver : public FakeDriver
+{
+public:
+	GateDriver(Gate& gate) :
+	FakeDriver(10),
+	gate_(gate)
+	{
+		disable_exceptions();	// fetch_row() throws at the end otherwise
+	}
+
+	bool execute(const char* qstr, size_t length)
+	{
+		libtabula::ScopedLock lock(gate_.mutex);
+		while (!gate_.open) gate_.opened.wait(gate_.mutex);
+		return FakeDriver::execute(qstr, length);
+	}
+
+private:
+	Gate& gate_;
+};
+
+
+// Runs the query through the SingleFlight on its own connection and
+// thread
+class Caller : public libtabula::Thread::Runnable
+{
+public:
+	Caller(libtabula::SingleFlight& flights, Gate& gate) :
+	flights_(flights),
+	driver_(new GateDriver(gate)),
+	conn_(driver_),
+	rows_(0)
+	{
+	}
+
+	void run()
+	{
+		try {
+			libtabula::Query q = conn_.query(select_sql);
+			libtabula::SingleFlight::Result res = flights_.store(q);
+			rows_ = res->num_rows();
+			if (!q.str().empty()) rows_ = 0;	// wasn't reset
+		}
+		catch (...) {
+			rows_ = 0;
+		}
+	}
+
+	size_t rows() const { return rows_; }
+	size_t statements() const { return driver_->statements().size(); }
+
+private:
+	libtabula::SingleFlight& flights_;
+	GateDriver* driver_;		///< owned by conn_
+	libtabula::Connection conn_;
+	size_t rows_;
+};
+
+
+// Starts the callers, waits until all of them are inside store(),
+// then lets the query run
+static bool
+fly(libtabula::SingleFlight& flights, size_t callers)
+{
+	const libtabula::ulonglong before =
+			flights.executions() + flights.collapsed();
+	Gate gate;
+	vector<Caller*> c;
+	vector<libtabula::Thread*> threads;
+	for (size_t i = 0; i < callers; ++i) {
+		c.push_back(new Caller(flights, gate));
+		threads.push_back(new libtabula::Thread(*c.back()));
+		threads.back()->start();
+	}
+
+	{
+		libtabula::ScopedLock lock(gate.mutex);
+		for (int tries = 0; tries < 1000 && flights.executions() +
+				flights.collapsed() < before + callers; ++tries) {
+			gate.opened.wait(gate.mutex, 10);
+		}
+		gate.open = true;
+		gate.opened.broadcast();
+	}
+
+	bool ok = true;
+	size_t statements = 0;
+	for (size_t i = 0; i < callers; ++i) {
+		threads[i]->join();
+		if (c[i]->rows() != 10) ok = false;
+		statements += c[i]->statements();
+		delete threads[i];
+		delete c[i];
+	}
+
+	if (!ok || statements != 1) {
+		cerr << callers << " callers ran " << statements << " queries, "
+				"expected 1, or didn't all get its 10 rows!" << endl;
+		return false;
+	}
+	return true;
+}
+
+
+// Several callers share one execution, and the next round runs the
+// query again rather than reusing the last result
+static bool
+test_collapse()
+{
+	if (!libtabula::Thread::supported()) return true;
+
+	libtabula::SingleFlight flights;
+	if (!fly(flights, 5) || !fly(flights, 3)) return false;
+
+	if (flights.executions() != 2 || flights.collapsed() != 6) {
+		cerr << "Counted " << flights.executions() << " executions and " <<
+				flights.collapsed() << " collapsed calls, expected 2 "
+				"and 6!" << endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+// A lone caller just runs the query
+static bool
+test_single()
+{
+	Gate gate;
+	gate.open = true;
+	libtabula::Connection conn(new GateDriver(gate));
+	libtabula::Query q = conn.query(select_sql);
+	libtabula::SingleFlight flights;
+	libtabula::SingleFlight::Result res = flights.store(q);
+	if (res->num_rows() != 10 || flights.executions() != 1 ||
+			flights.collapsed() != 0) {
+		cerr << "Lone caller got " << res->num_rows() << " rows, and " <<
+				flights.executions() << " executions!" << endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+int
+main()
+{
+	try {
+		return	test_single() &&
+				test_collapse() ? 0 : 1;
+	}
+	catch (const libtabula::Exception& e) {
+		cerr << "Unexpected libtabula exception: " << e.what() << endl;
+		return 2;
+	}
+	catch (...) {
+		cerr << "Unhandled exception caught by test/singleflight!" << endl;
+		return 2;
+	}
+}
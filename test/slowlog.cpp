@@ -0,0 +1,294 @@
+/***********************************************************************
+ test/slowlog.cpp - Tests the SlowQueryLog class, feeding it queries
+	directly so we don't need a database server.
+
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#include "fakedriver.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <stdio.h>
+
+using namespace std;
+
+static const char* path = "slowlog-test.log";
+
+
+// Read the log back in, one string per line
+static vector<string>
+read_log()
+{
+	vector<string> lines;
+	if (FILE* f = fopen(path, "r")) {
+		char buf[1024];
+		while (fgets(buf, sizeof(buf), f)) {
+			lines.push_back(buf);
+		}
+		fclose(f);
+	}
+	return lines;
+}
+
+
+// Log queries on both sides of the threshold, and check that only the
+// slow one is written, with everything we expect in it
+static bool
+test_threshold()
+{
+	remove(path);
+	libtabula::Connection conn(false);
+	{
+		libtabula::SlowQueryLog log(path, 1000);
+		const string slow("SELECT * FROM stock WHERE name = 'Hot \"Dog\"'\n");
+		const string fast("SELECT 1");
+		libtabula::ulonglong now = libtabula::Stopwatch::now();
+
+		log.query_done(conn, slow.data(), slow.length(), now - 5000, 3, 0);
+		log.query_done(conn, fast.data(), fast.length(), now, 1, 0);
+		log.flush();
+		if (log.written() != 1 || log.dropped() != 0 ||
+				!log.error().empty()) {
+			cerr << "Slow query log wrote " << log.written() <<
+					", dropped " << log.dropped() <<
+					", expected 1 and 0!" << endl;
+			return false;
+		}
+	}
+
+	vector<string> lines = read_log();
+	remove(path);
+	static const char* const expected[] = {
+		"{\"time\":\"",
+		"\"rows\":3,",
+		"\"errnum\":0,",
+		"\"fingerprint\":\"select * from stock where name = ?\"",
+		"\"sql\":\"SELECT * FROM stock WHERE name = 'Hot \\\"Dog\\\"'\\n\"}",
+	};
+	if (lines.size() != 1) {
+		cerr << "Slow query log has " << lines.size() <<
+				" lines, expected 1!" << endl;
+		return false;
+	}
+	for (size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); ++i) {
+		if (lines[0].find(expected[i]) == string::npos) {
+			cerr << "Slow query log line " << lines[0] <<
+					"doesn't contain " << expected[i] << '!' << endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+// With sampling on, fast queries are logged too
+static bool
+test_sampling()
+{
+	remove(path);
+	libtabula::Connection conn(false);
+	{
+		libtabula::SlowQueryLog log(path, 1000000);
+		const string sql("UPDATE stock SET num = 1");
+		libtabula::ulonglong now = libtabula::Stopwatch::now();
+
+		log.query_done(conn, sql.data(), sql.length(), now, 0, 0);
+		log.set_sample_every(1);
+		log.query_done(conn, sql.data(), sql.length(), now, 0, 1064);
+		log.query_done(conn, sql.data(), sql.length(), now, 0, 0);
+		log.set_sample_every(0);
+		log.query_done(conn, sql.data(), sql.length(), now, 0, 0);
+	}
+
+	vector<string> lines = read_log();
+	remove(path);
+	if (lines.size() != 2 ||
+			lines[0].find("\"errnum\":1064,") == string::npos) {
+		cerr << "Sampled slow query log has " << lines.size() <<
+				" lines, expected 2!" << endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+// Overfill a tiny ring buffer.  Whether any are dropped depends on how
+// fast the background thread is, but none may be lost.
+static bool
+test_overflow()
+{
+	remove(path);
+	libtabula::Connection conn(false);
+	libtabula::SlowQueryLog log(path, 0, 1);
+	const string sql("DELETE FROM stock");
+	const size_t n = 1000;
+	for (size_t i = 0; i < n; ++i) {
+		log.query_done(conn, sql.data(), sql.length(),
+				libtabula::Stopwatch::now(), 0, 0);
+	}
+	log.flush();
+	remove(path);
+
+	if (log.written() + log.dropped() != n) {
+		cerr << "Slow query log wrote " << log.written() <<
+				" and dropped " << log.dropped() << ", expected " <<
+				n << " in all!" << endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+// A FakeDriver on which every statement fails, as an EXPLAIN of a
+// query the server can't explain does
+class NoExplainDriver : public FakeDriver
+{
+public:
+	NoExplainDriver() : FakeDriver(0) { }
+
+	bool execute(const char* qstr, size_t length)
+	{
+		FakeDriver::execute(qstr, length);
+		return false;
+	}
+
+	int errnum() { return 1064; }		// ER_PARSE_ERROR
+	const char* error() { return "fake syntax error"; }
+};
+
+
+// Hands out one connection on a NoExplainDriver, logging to the given
+// slow query log
+class NoExplainPool : public libtabula::ConnectionPool
+{
+public:
+	NoExplainPool(libtabula::SlowQueryLog& log) :
+	log_(log),
+	conn_(0)
+	{
+	}
+
+	~NoExplainPool() { clear(); }
+
+	unsigned int max_idle_time() { return 60; }
+
+	libtabula::Connection* conn() const { return conn_; }
+
+private:
+	libtabula::Connection* create()
+	{
+		conn_ = new libtabula::Connection(new NoExplainDriver);
+		conn_->set_slow_query_log(&log_);
+		return conn_;
+	}
+
+	void destroy(libtabula::Connection* cp) { delete cp; }
+
+	libtabula::SlowQueryLog& log_;
+	libtabula::Connection* conn_;
+};
+
+
+// A failed EXPLAIN still logs the query, and leaves the pooled
+// connection logging as it was
+static bool
+test_explain_failure()
+{
+	remove(path);
+	libtabula::Connection conn(false);
+	libtabula::SlowQueryLog log(path, 0);
+	NoExplainPool pool(log);
+	log.set_explain(&pool);
+	const string sql("SELECT * FROM stock");
+	log.query_done(conn, sql.data(), sql.length(),
+			libtabula::Stopwatch::now(), 0, 0);
+	log.flush();
+	log.set_explain(0);
+	remove(path);
+
+	if (!pool.conn() || log.written() != 1) {
+		cerr << "Slow query log with a failing EXPLAIN wrote " <<
+				log.written() << " entries, expected 1!" << endl;
+		return false;
+	}
+	if (pool.conn()->slow_query_log() != &log) {
+		cerr << "Failed EXPLAIN left its connection's slow query "
+				"log off!" << endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+// A Connection's log follows it when copied, and a bad path throws
+static bool
+test_connection()
+{
+	libtabula::SlowQueryLog log(path);
+	libtabula::Connection a(false);
+	a.set_slow_query_log(&log);
+	libtabula::Connection b(a);
+	libtabula::Connection c(false);
+	c = a;
+	remove(path);
+	if (b.slow_query_log() != &log || c.slow_query_log() != &log) {
+		cerr << "Copied connection lost its slow query log!" << endl;
+		return false;
+	}
+
+	try {
+		libtabula::SlowQueryLog bad("no/such/dir/slow.log");
+		cerr << "Opened slow query log in a missing directory!" << endl;
+		return false;
+	}
+	catch (const libtabula::ExportFailed&) {
+		return true;
+	}
+}
+
+
+int
+main()
+{
+	try {
+		return	test_threshold() &&
+				test_sampling() &&
+				test_overflow() &&
+				test_explain_failure() &&
+				test_connection() ? 0 : 1;
+	}
+	catch (const libtabula::Exception& e) {
+		cerr << "Unexpected libtabula exception: " << e.what() << endl;
+		return 2;
+	}
+	catch (...) {
+		cerr << "Unhandled exception caught by test/slowlog!" << endl;
+		return 2;
+	}
+}
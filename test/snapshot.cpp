@@ -0,0 +1,180 @@
+/***********************************************************************
+ test/snapshot.cpp - Tests saving a result set with Snapshot and
+	loading it back.
+
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#include <libtabula.h>
+#include <snapshot.h>
+
+#include <iostream>
+#include <string>
+
+#include <stdio.h>
+
+using namespace std;
+
+static const char* path = "snapshot-test.snap";
+
+
+// Build a result set without a database server
+static libtabula::StoreQueryResult
+make_result(int rows)
+{
+	libtabula::Fields fields;
+	fields.push_back(libtabula::Field("id", "stock", "test",
+			libtabula::FieldType(libtabula::FieldType::ft_integer),
+			11, 4));
+	fields.push_back(libtabula::Field("data", "stock", "test",
+			libtabula::FieldType(libtabula::FieldType::ft_blob,
+				libtabula::FieldType::tf_null), 255, 6));
+
+	libtabula::StoreQueryResult res(fields);
+	for (int i = 0; i < rows; ++i) {
+		libtabula::Row::Impl* pd = new libtabula::Row::Impl;
+		char id[20];
+		snprintf(id, sizeof(id), "%d", i);
+		pd->push_back(libtabula::String(id, libtabula::FieldType::ft_integer));
+		if (i % 3) {
+			// Embedded null, to show binary data survives
+			pd->push_back(libtabula::String(string("a\0b", 3) + id,
+					libtabula::FieldType::ft_blob));
+		}
+		else {
+			pd->push_back(libtabula::String("NULL", 4,
+					libtabula::FieldType::ft_blob, true));
+		}
+		res.push_back(libtabula::Row(pd, res.field_names()));
+	}
+
+	return res;
+}
+
+
+static bool
+test_round_trip(int rows)
+{
+	libtabula::StoreQueryResult orig = make_result(rows);
+	libtabula::Snapshot snap;
+	snap.save(orig, path);
+	libtabula::StoreQueryResult res = snap.load(path);
+	remove(path);
+
+	if (!res || res.num_rows() != orig.num_rows() ||
+			res.num_fields() != 2) {
+		cerr << "Loaded " << res.num_rows() << " rows, " <<
+				res.num_fields() << " fields; expected " << rows <<
+				" and 2!" << endl;
+		return false;
+	}
+	else if (res.field_name(1) != "data" ||
+			string(res.field(1).table()) != "stock" ||
+			string(res.field(1).db()) != "test" ||
+			res.field(1).length() != 255 ||
+			res.field(1).max_length() != 6 ||
+			res.field_type(1).id() != orig.field_type(1).id()) {
+		cerr << "Field info didn't survive the round trip!" << endl;
+		return false;
+	}
+
+	for (int i = 0; i < rows; ++i) {
+		for (size_t f = 0; f < 2; ++f) {
+			const libtabula::String& a = orig[i][f];
+			const libtabula::String& b = res[i][f];
+			if (a.is_null() != b.is_null() || a.length() != b.length() ||
+					(!a.is_null() &&
+					 string(a.data(), a.length()) !=
+					 string(b.data(), b.length()))) {
+				cerr << "Row " << i << " field " << f << " is '" << b <<
+						"', expected '" << a << "'!" << endl;
+				return false;
+			}
+		}
+	}
+
+	// The rows must outlive the result set, and the mapping with it
+	libtabula::Row row = rows ? res[rows - 1] : libtabula::Row();
+	res = libtabula::StoreQueryResult();
+	if (rows && int(row["id"]) != rows - 1) {
+		cerr << "Row outliving its result set is broken!" << endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+static bool
+test_bad_files()
+{
+	libtabula::Snapshot snap(false);
+
+	FILE* f = fopen(path, "wb");
+	fputs("LTSNAPSH\x09", f);
+	fclose(f);
+	bool version = !snap.load(path) && !snap.error().empty();
+
+	snap.save(make_result(10), path);
+	f = fopen(path, "r+b");
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	fclose(f);
+	string contents(size_t(size) - 5, '\0');
+	f = fopen(path, "rb");
+	size_t got = fread(&contents[0], 1, contents.size(), f);
+	fclose(f);
+	f = fopen(path, "wb");
+	fwrite(contents.data(), 1, got, f);
+	fclose(f);
+	bool truncated = !snap.load(path);
+
+	remove(path);
+	bool missing = !snap.load(path);
+
+	if (!version || !truncated || !missing) {
+		cerr << "Snapshot accepted a bad file!" << endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+int
+main()
+{
+	try {
+		return	test_round_trip(0) &&
+				test_round_trip(1) &&
+				test_round_trip(1000) &&
+				test_bad_files() ? 0 : 1;
+	}
+	catch (const libtabula::Exception& e) {
+		cerr << "Unexpected libtabula exception: " << e.what() << endl;
+		return 2;
+	}
+	catch (...) {
+		cerr << "Unhandled exception caught by test/snapshot!" << endl;
+		return 2;
+	}
+}
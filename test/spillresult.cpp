@@ -0,0 +1,161 @@
+/***********************************************************************
+ test/spillresult.cpp - Tests the SpillQueryResult class against a fake
+	driver, both when the rows fit in its memory budget and when they
+	have to go to a temporary file.
+
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#include "fakedriver.h"
+
+#include <spillresult.h>
+
+#include <iostream>
+
+using namespace std;
+
+
+// Check that a row holds what FakeDriver put in row i
+static bool
+check_row(const libtabula::Row& row, int i)
+{
+	if (int(row["id"]) != i) {
+		cerr << "Expected row " << i << ", got " << row["id"] <<
+				'!' << endl;
+		return false;
+	}
+	if (i % 5 == 0) {
+		if (!row["name"].is_null()) {
+			cerr << "Row " << i << " should have a NULL name!" << endl;
+			return false;
+		}
+	}
+	else {
+		ostringstream os;
+		os << "row " << i;
+		if (string(row["name"]) != os.str()) {
+			cerr << "Row " << i << " has bad name " << row["name"] <<
+					'!' << endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+// Read the whole result set into a SpillQueryResult with the given
+// budget, then check it by index, backwards, and by iterator.
+static bool
+test_rows(int rows, size_t budget, bool expect_spill)
+{
+	FakeDriver driver(rows);
+	libtabula::UseQueryResult res = fake_use_result(driver);
+	libtabula::SpillQueryResult spill(res, budget);
+
+	if (!spill || spill.size() != size_t(rows)) {
+		cerr << "Got " << spill.size() << " rows with budget " <<
+				budget << ", expected " << rows << '!' << endl;
+		return false;
+	}
+	else if (spill.spilled() != expect_spill) {
+		cerr << "Result with " << rows << " rows and budget " << budget <<
+				(expect_spill ? " didn't" : " did") << " spill!" << endl;
+		return false;
+	}
+
+	for (int i = rows - 1; i >= 0; --i) {
+		if (!check_row(spill[i], i)) return false;
+	}
+
+	// Copies share the rows
+	libtabula::SpillQueryResult copy(spill);
+	int i = 0;
+	for (libtabula::SpillQueryResult::const_iterator it = copy.begin();
+			it != copy.end(); ++it, ++i) {
+		if (!check_row(*it, i)) return false;
+	}
+
+	return true;
+}
+
+
+// Once spilled, the memory used shouldn't grow with the result set
+static bool
+test_peak()
+{
+	const size_t budget = 4096;
+	FakeDriver driver(100000);
+	libtabula::UseQueryResult res = fake_use_result(driver);
+	libtabula::SpillQueryResult spill(res, budget);
+
+	// Rows average about 14 bytes packed, so the file holds over a
+	// megabyte, while memory holds the buffer and the row offsets.
+	size_t limit = 2 * budget + 100000 * 2 * sizeof(libtabula::ulonglong);
+	if (spill.disk_bytes() < 1000000 || spill.peak_bytes() > limit) {
+		cerr << "Spill used " << spill.peak_bytes() << " bytes of "
+				"memory and " << spill.disk_bytes() << " on disk!" << endl;
+		return false;
+	}
+
+	return check_row(spill.at(99999), 99999);
+}
+
+
+// The connection drops partway through
+static bool
+test_error()
+{
+	FakeDriver driver(100, 42);
+	libtabula::UseQueryResult res = fake_use_result(driver);
+	try {
+		libtabula::SpillQueryResult spill(res, 64);
+		cerr << "No exception from failed spill!" << endl;
+		return false;
+	}
+	catch (const libtabula::BadQuery&) {
+		return true;
+	}
+}
+
+
+int
+main()
+{
+	try {
+		return	test_rows(0, 1024, false) &&
+				test_rows(10, 1024, false) &&
+				test_rows(1000, 1000000, false) &&
+				test_rows(1000, 1, true) &&
+				test_rows(1000, 500, true) &&
+				test_peak() &&
+				test_error() ? 0 : 1;
+	}
+	catch (const libtabula::Exception& e) {
+		cerr << "Unexpected libtabula exception: " << e.what() << endl;
+		return 2;
+	}
+	catch (...) {
+		cerr << "Unhandled exception caught by test/spillresult!" << endl;
+		return 2;
+	}
+}
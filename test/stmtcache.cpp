@@ -0,0 +1,318 @@
+/***********************************************************************
+ test/stmtcache.cpp - Tests the StatementCache class's LRU bound, and
+	how it prepares statements again when they're lost.
+
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#include "fakedriver.h"
+
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+
+// A FakeDriver that "prepares" statements, remembering which session
+// each belongs to, as the C API does.  Running one records its text
+// and parameter values as a statement; a SELECT returns 3 rows.
+class StmtDriver : public FakeDriver
+{
+public:
+	class Statement : public PreparedStatement
+	{
+	public:
+		Statement(StmtDriver& driver, const string& sql) :
+		driver_(driver),
+		sql_(sql),
+		session_(driver.session_)
+		{
+		}
+
+		~Statement() { ++driver_.closed_; }
+
+		const string& sql() const { return sql_; }
+		int session() const { return session_; }
+
+	private:
+		StmtDriver& driver_;
+		string sql_;
+		int session_;
+	};
+	friend class Statement;
+
+	StmtDriver() :
+	FakeDriver(3),
+	session_(1),
+	fail_(0),
+	fail_count_(0),
+	closed_(0)
+	{
+		disable_exceptions();	// fetch_row() throws at the end otherwise
+	}
+
+	PreparedStatement* prepare(const string& sql, string&, int&)
+	{
+		prepared_.push_back(sql);
+		return new Statement(*this, sql);
+	}
+
+	bool execute_prepared(PreparedStatement& stmt,
+			const libtabula::SQLQueryParms& params,
+			libtabula::ResultBase::Impl*& result, string& error,
+			int& errnum)
+	{
+		Statement& s = dynamic_cast<Statement&>(stmt);
+		result = 0;
+		errnum = 0;
+		if (s.session() != session_) {
+			errnum = 1243;		// ER_UNKNOWN_STMT_HANDLER
+		}
+		else if (fail_count_) {
+			--fail_count_;
+			errnum = fail_;
+		}
+		if (errnum) {
+			error = "fake statement failure";
+			return false;
+		}
+
+		string text = s.sql();
+		for (size_t i = 0; i < params.size(); ++i) {
+			text += i ? ", " : " | ";
+			text += params[i].is_null() ? string("NULL") :
+					string(params[i].data(), params[i].length());
+		}
+		execute(text.data(), text.length());
+		if (s.sql().find("SELECT") == 0) {
+			result = new libtabula::ResultBase::Impl;
+		}
+		return true;
+	}
+
+	// Make the next n runs fail with the given error
+	void fail(int errnum, int n = 1) { fail_ = errnum; fail_count_ = n; }
+
+	// Start a new session, as ReconnectOption does behind our back
+	void reconnect() { ++session_; }
+
+	int closed() const { return closed_; }
+	const vector<string>& prepared() const { return prepared_; }
+
+private:
+	int session_;
+	int fail_;
+	int fail_count_;
+	int closed_;
+	vector<string> prepared_;
+};
+
+
+static bool
+check_prepared(const StmtDriver& driver, const char* const expected[],
+		size_t count)
+{
+	const vector<string>& actual = driver.prepared();
+	bool ok = actual.size() == count;
+	for (size_t i = 0; ok && i < count; ++i) {
+		ok = actual[i] == expected[i];
+	}
+
+	if (!ok) {
+		cerr << "Prepared " << actual.size() << " statements:" << endl;
+		for (size_t i = 0; i < actual.size(); ++i) {
+			cerr << "    " << actual[i] << endl;
+		}
+		cerr << "expected " << count << ':' << endl;
+		for (size_t i = 0; i < count; ++i) {
+			cerr << "    " << expected[i] << endl;
+		}
+	}
+	return ok;
+}
+
+
+// The cache holds no more than its limit, closing the least recently
+// used statement to make room
+static bool
+test_lru()
+{
+	StmtDriver* driver = new StmtDriver;
+	libtabula::Connection conn(driver);
+	libtabula::StatementCache& cache = conn.statements();
+	cache.set_max_statements(2);
+
+	const char* a = "SELECT * FROM stock";
+	const char* b = "DELETE FROM stock";
+	const char* c = "UPDATE stock SET num = 0";
+	libtabula::StoreQueryResult res = cache.store(a);
+	cache.exec(b);
+	cache.store(a);			// hit; b is now least recently used
+	cache.exec(c);			// evicts b
+	cache.store(a);			// hit
+	cache.exec(b);			// evicts c
+
+	static const char* const expected[] = { a, b, c, b };
+	if (!check_prepared(*driver, expected, 4)) return false;
+
+	if (res.num_rows() != 3 || cache.size() != 2 || cache.hits() != 2 ||
+			cache.misses() != 4 || cache.evictions() != 2 ||
+			driver->closed() != 2) {
+		cerr << "Cache of 2 has " << cache.size() << " statements after " <<
+				cache.hits() << " hits, " << cache.misses() <<
+				" misses and " << cache.evictions() << " evictions, "
+				"with " << driver->closed() << " closed and " <<
+				res.num_rows() << " rows!" << endl;
+		return false;
+	}
+
+	cache.set_max_statements(1);
+	conn.disconnect();
+	if (cache.size() != 0 || cache.evictions() != 3 ||
+			driver->closed() != 4) {
+		cerr << "Shrinking and disconnecting left " << cache.size() <<
+				" statements, with " << driver->closed() <<
+				" of 4 closed!" << endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+// Parameter values go to the driver as they are, not quoted into the
+// statement
+static bool
+test_params()
+{
+	StmtDriver* driver = new StmtDriver;
+	libtabula::Connection conn(driver);
+	libtabula::SQLQueryParms p;
+	p << "O'Brien" << 42 << libtabula::SQLTypeAdapter(libtabula::null);
+	conn.statements().exec("INSERT INTO stock VALUES (?, ?, ?)", p);
+
+	const vector<string>& sent = driver->statements();
+	if (sent.size() != 1 || sent[0] !=
+			"INSERT INTO stock VALUES (?, ?, ?) | O'Brien, 42, NULL") {
+		cerr << "Sent the wrong parameters:" << endl;
+		for (size_t i = 0; i < sent.size(); ++i) {
+			cerr << "    " << sent[i] << endl;
+		}
+		return false;
+	}
+
+	return true;
+}
+
+
+// A statement lost to a reconnect, or which the server wants prepared
+// again, is prepared again and retried once
+static bool
+test_reprepare()
+{
+	StmtDriver* driver = new StmtDriver;
+	libtabula::Connection conn(driver);
+	libtabula::StatementCache& cache = conn.statements();
+	const char* sql = "SELECT * FROM stock";
+
+	cache.store(sql);
+	driver->reconnect();
+	libtabula::StoreQueryResult res = cache.store(sql);
+	if (res.num_rows() != 3 || cache.reprepares() != 1 ||
+			driver->closed() != 1) {
+		cerr << "After a reconnect, got " << res.num_rows() <<
+				" rows with " << cache.reprepares() <<
+				" re-prepares!" << endl;
+		return false;
+	}
+
+	static const int errors[] = { 1243, 1615 };
+	for (size_t i = 0; i < 2; ++i) {
+		driver->fail(errors[i]);
+		res = cache.store(sql);
+		if (res.num_rows() != 3 || cache.reprepares() != 2 + i) {
+			cerr << "Error " << errors[i] << " didn't cause a "
+					"re-prepare!" << endl;
+			return false;
+		}
+	}
+
+	static const char* const expected[] = { sql, sql, sql, sql };
+	if (!check_prepared(*driver, expected, 4)) return false;
+
+	// Only once, though
+	driver->fail(1615, 2);
+	try {
+		cache.store(sql);
+		cerr << "Statement that kept needing re-preparing ran!" << endl;
+		return false;
+	}
+	catch (const libtabula::BadQuery& e) {
+		if (e.errnum() != 1615 || cache.reprepares() != 4) {
+			cerr << "Gave up after " << cache.reprepares() <<
+					" re-prepares, with error " << e.errnum() << endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+// Other errors are reported without a retry
+static bool
+test_error()
+{
+	StmtDriver* driver = new StmtDriver;
+	libtabula::Connection conn(driver);
+	libtabula::StatementCache& cache = conn.statements();
+	cache.disable_exceptions();
+
+	driver->fail(1062);		// ER_DUP_ENTRY
+	if (cache.exec("INSERT INTO stock VALUES (1)") ||
+			cache.reprepares() != 0 || driver->prepared().size() != 1) {
+		cerr << "Duplicate key error was retried or ignored!" << endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+int
+main()
+{
+	try {
+		return	test_lru() &&
+				test_params() &&
+				test_reprepare() &&
+				test_error() ? 0 : 1;
+	}
+	catch (const libtabula::Exception& e) {
+		cerr << "Unexpected libtabula exception: " << e.what() << endl;
+		return 2;
+	}
+	catch (...) {
+		cerr << "Unhandled exception caught by test/stmtcache!" << endl;
+		return 2;
+	}
+}
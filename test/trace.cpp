@@ -0,0 +1,246 @@
+/***********************************************************************
+ test/trace.cpp - Tests the TraceRecorder class with events from
+	several threads, made-up events of each kind, and a real
+	ConnectionPool.
+
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#include <connection.h>
+#include <cpool.h>
+#include <querystats.h>
+#include <thread.h>
+#include <trace.h>
+
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include <stdio.h>
+#include <string.h>
+
+using namespace std;
+
+
+class TestConnectionPool : public libtabula::ConnectionPool
+{
+public:
+	~TestConnectionPool() { clear(); }
+
+private:
+	libtabula::Connection* create() { return new libtabula::Connection; }
+	void destroy(libtabula::Connection* cp) { delete cp; }
+	unsigned int max_idle_time() { return 60; }
+};
+
+
+// Reports a few events to a recorder from whatever thread runs it
+class Reporter : public libtabula::Thread::Runnable
+{
+public:
+	Reporter(libtabula::TraceRecorder& rec, int n) : rec_(rec), n_(n) { }
+
+	void run()
+	{
+		for (int i = 0; i < n_; ++i) {
+			libtabula::QueryEvent ev(libtabula::QueryEvent::ev_row);
+			ev.finish();
+			rec_.observe(ev);
+		}
+	}
+
+private:
+	libtabula::TraceRecorder& rec_;
+	int n_;
+};
+
+
+// Counts the times needle appears in haystack
+static size_t
+count(const string& haystack, const char* needle)
+{
+	size_t n = 0;
+	for (size_t pos = haystack.find(needle); pos != string::npos;
+			pos = haystack.find(needle, pos + 1)) {
+		++n;
+	}
+	return n;
+}
+
+
+// Record from two worker threads and this one, overfilling this
+// thread's buffer
+static bool
+test_threads()
+{
+	libtabula::TraceRecorder rec(5);
+	Reporter r1(rec, 3), r2(rec, 3), r3(rec, 6);
+	if (libtabula::Thread::supported()) {
+		libtabula::Thread t1(r1), t2(r2);
+		t1.start();
+		t2.start();
+		t1.join();
+		t2.join();
+	}
+	else {
+		r1.run();
+		r2.run();
+	}
+	r3.run();
+
+	ostringstream os;
+	rec.write(os);
+	size_t threads = libtabula::Thread::supported() ? 3 : 1;
+	if (rec.size() != 11 || rec.dropped() != 1 ||
+			count(os.str(), "\"thread_name\"") != threads ||
+			count(os.str(), "\"name\":\"fetch_row\"") != 11) {
+		cerr << "Recorded " << rec.size() << " spans and dropped " <<
+				rec.dropped() << " on " <<
+				count(os.str(), "\"thread_name\"") <<
+				" threads, expected 11 and 1 on " << threads << '!' <<
+				endl;
+		return false;
+	}
+
+	rec.clear();
+	if (rec.size() != 0 || rec.dropped() != 0) {
+		cerr << "TraceRecorder::clear() didn't!" << endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+// Check how each awkward sort of event comes out in the JSON
+static bool
+test_spans()
+{
+	libtabula::TraceRecorder rec(100, 5);
+	int driver;		// just for its address
+
+	libtabula::QueryEvent ex(libtabula::QueryEvent::ev_execute,
+			reinterpret_cast<const libtabula::DBDriver*>(&driver));
+	const char* sql = "SEL\"\xc3\xa9 * FROM stock";
+	ex.sql = sql;
+	ex.sql_length = strlen(sql);
+	ex.start = 1000;
+	ex.elapsed = 20;
+	ex.errnum = 1064;
+	rec.observe(ex);
+
+	libtabula::QueryEvent hold(libtabula::QueryEvent::ev_release);
+	hold.start = 5000;
+	hold.elapsed = 300;
+	rec.observe(hold);
+
+	libtabula::QueryEvent rel(libtabula::QueryEvent::ev_release);
+	rel.start = 6000;
+	rec.observe(rel);
+
+	ostringstream os;
+	rec.write(os);
+	const string json = os.str();
+	static const char* const expected[] = {
+		"\"name\":\"execute\",\"pid\":1,\"tid\":1,\"ts\":1000,\"dur\":20",
+		"\"sql\":\"SEL\\\"\",\"errnum\":1064}",
+		"\"name\":\"hold\",\"pid\":1,\"tid\":1,\"ts\":4700,\"dur\":300",
+		"{\"ph\":\"i\",\"cat\":\"pool\",\"name\":\"release\",\"pid\":1,"
+				"\"tid\":1,\"ts\":6000,\"s\":\"t\"",
+	};
+	for (size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); ++i) {
+		if (json.find(expected[i]) == string::npos) {
+			cerr << "Trace " << json << "doesn't contain " <<
+					expected[i] << '!' << endl;
+			return false;
+		}
+	}
+	if (json.compare(0, 15, "{\"displayTimeUn") != 0 ||
+			json.compare(json.size() - 3, 3, "]}\n") != 0) {
+		cerr << "Trace isn't a JSON object!" << endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+// Record a real pool's events while passing them on to a QueryStats,
+// then save the trace
+static bool
+test_pool()
+{
+	libtabula::QueryStats stats;
+	libtabula::TraceRecorder rec(1000, 256, &stats);
+	TestConnectionPool pool;
+
+	libtabula::QueryObserver::install(&rec);
+	libtabula::Connection* pc = pool.grab();
+	pool.release(pc);
+	libtabula::QueryObserver::install(0);
+
+	if (rec.size() != 2 || stats.grab_latency().count() != 1) {
+		cerr << "Recorded " << rec.size() << " pool spans and passed " <<
+				stats.grab_latency().count() << " grabs on, "
+				"expected 2 and 1!" << endl;
+		return false;
+	}
+
+	const char* path = "trace-test.json";
+	rec.save(path);
+	FILE* f = fopen(path, "r");
+	bool saved = f != 0;
+	if (f) fclose(f);
+	remove(path);
+	if (!saved) {
+		cerr << "TraceRecorder::save() didn't save!" << endl;
+		return false;
+	}
+
+	try {
+		rec.save("no/such/dir/trace.json");
+		cerr << "Saved trace in a missing directory!" << endl;
+		return false;
+	}
+	catch (const libtabula::ExportFailed&) {
+		return true;
+	}
+}
+
+
+int
+main()
+{
+	try {
+		return	test_threads() &&
+				test_spans() &&
+				test_pool() ? 0 : 1;
+	}
+	catch (const libtabula::Exception& e) {
+		cerr << "Unexpected libtabula exception: " << e.what() << endl;
+		return 2;
+	}
+	catch (...) {
+		cerr << "Unhandled exception caught by test/trace!" << endl;
+		return 2;
+	}
+}
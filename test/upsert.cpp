@@ -0,0 +1,227 @@
+/***********************************************************************
+ test/upsert.cpp - Tests the INSERT ... ON DUPLICATE KEY UPDATE
+	statements Query::upsert() builds, and how Query::upsertfrom()
+	batches them under an insert policy.
+
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#include "fakedriver.h"
+#define LIBTABULA_ALLOW_SSQLS_V1	// suppress deprecation warning
+#include <ssqls.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Key is the first field only
+sql_create_3(widget, 1, 3,
+	libtabula::sql_int, id,
+	libtabula::sql_varchar, name,
+	libtabula::sql_double, weight)
+
+// Every field is part of the key
+sql_create_2(tag, 2, 0,
+	libtabula::sql_int, item,
+	libtabula::sql_varchar, label)
+
+
+static bool
+check_query(libtabula::Query& q, const char* expected)
+{
+	if (q.str() != expected) {
+		cerr << "Upsert query is" << endl << "    " << q.str() << endl <<
+				"expected" << endl << "    " << expected << endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+static bool
+test_single()
+{
+	libtabula::Query q(0);
+	q.upsert(widget(1, "one", 1.5));
+	return check_query(q, "INSERT INTO `widget` (`id`,`name`,`weight`) "
+			"VALUES (1,'one',1.5) ON DUPLICATE KEY UPDATE "
+			"`name` = VALUES(`name`),`weight` = VALUES(`weight`)");
+}
+
+
+static bool
+test_range()
+{
+	vector<widget> v;
+	v.push_back(widget(1, "one", 1.5));
+	v.push_back(widget(2, "two", 2.5));
+
+	libtabula::Query q(0);
+	q.upsert(v.begin(), v.end());
+	return check_query(q, "INSERT INTO `widget` (`id`,`name`,`weight`) "
+			"VALUES (1,'one',1.5),(2,'two',2.5) ON DUPLICATE KEY UPDATE "
+			"`name` = VALUES(`name`),`weight` = VALUES(`weight`)");
+}
+
+
+static bool
+test_all_keys()
+{
+	tag t;
+	t.item = 7;
+	t.label = "red";
+
+	libtabula::Query q(0);
+	q.upsert(t);
+	return check_query(q, "INSERT INTO `tag` (`item`,`label`) "
+			"VALUES (7,'red') ON DUPLICATE KEY UPDATE `item` = `item`");
+}
+
+
+static const char* const widget_clause = " ON DUPLICATE KEY UPDATE "
+		"`name` = VALUES(`name`),`weight` = VALUES(`weight`)";
+
+
+static bool
+check_statements(const FakeDriver& driver, const char* const expected[],
+		size_t count)
+{
+	const vector<string>& actual = driver.statements();
+	bool ok = actual.size() == count;
+	for (size_t i = 0; ok && i < count; ++i) {
+		ok = actual[i] == expected[i];
+	}
+
+	if (!ok) {
+		cerr << "Sent " << actual.size() << " statements:" << endl;
+		for (size_t i = 0; i < actual.size(); ++i) {
+			cerr << "    " << actual[i] << endl;
+		}
+		cerr << "expected " << count << ':' << endl;
+		for (size_t i = 0; i < count; ++i) {
+			cerr << "    " << expected[i] << endl;
+		}
+	}
+	return ok;
+}
+
+
+// A policy allowing two rows per statement splits five rows into three
+// upserts, each with the whole ON DUPLICATE KEY UPDATE clause, inside
+// the policy's transaction
+static bool
+test_upsertfrom()
+{
+	vector<widget> v;
+	for (int i = 1; i <= 5; ++i) v.push_back(widget(i, "w", 1.5));
+
+	FakeDriver* driver = new FakeDriver(0);
+	libtabula::Connection conn(driver);
+	libtabula::Query q = conn.query();
+	libtabula::Query::RowCountInsertPolicy<libtabula::Transaction>
+			policy(2);
+	q.upsertfrom(v.begin(), v.end(), policy);
+
+	const string head = "INSERT INTO `widget` (`id`,`name`,`weight`) "
+			"VALUES ";
+	const string s1 = head + "(1,'w',1.5),(2,'w',1.5)" + widget_clause;
+	const string s2 = head + "(3,'w',1.5),(4,'w',1.5)" + widget_clause;
+	const string s3 = head + "(5,'w',1.5)" + widget_clause;
+	const char* const expected[] = {
+		"START TRANSACTION",
+		s1.c_str(),
+		s2.c_str(),
+		s3.c_str(),
+		"COMMIT",
+	};
+	return check_statements(*driver, expected, 5);
+}
+
+
+// A size-based policy keeps each whole statement, clause and all,
+// within its limit
+static bool
+test_upsertfrom_size()
+{
+	vector<widget> v;
+	for (int i = 1; i <= 20; ++i) v.push_back(widget(i, "widget", 2.5));
+
+	FakeDriver* driver = new FakeDriver(0);
+	libtabula::Connection conn(driver);
+	libtabula::Query q = conn.query();
+	const int limit = 250;
+	libtabula::Query::MaxPacketInsertPolicy<libtabula::NoTransaction>
+			policy(limit);
+	q.upsertfrom(v.begin(), v.end(), policy);
+
+	const vector<string>& sent = driver->statements();
+	const string clause(widget_clause);
+	size_t rows = 0;
+	bool ok = sent.size() > 1;
+	for (size_t i = 0; i < sent.size(); ++i) {
+		const string& sql = sent[i];
+		if (sql.size() > size_t(limit) || sql.size() < clause.size() ||
+				sql.compare(sql.size() - clause.size(), clause.size(),
+					clause) != 0) {
+			ok = false;
+		}
+		for (size_t p = 0; (p = sql.find("'widget'", p)) != string::npos;
+				++p) {
+			++rows;
+		}
+	}
+
+	if (!ok || rows != v.size()) {
+		cerr << "Upserting " << v.size() << " rows " << limit <<
+				" bytes at a time sent " << rows << " rows in:" << endl;
+		for (size_t i = 0; i < sent.size(); ++i) {
+			cerr << "    " << sent[i] << endl;
+		}
+		return false;
+	}
+
+	return true;
+}
+
+
+int
+main()
+{
+	try {
+		return	test_single() &&
+				test_range() &&
+				test_all_keys() &&
+				test_upsertfrom() &&
+				test_upsertfrom_size() ? 0 : 1;
+	}
+	catch (const libtabula::Exception& e) {
+		cerr << "Unexpected libtabula exception: " << e.what() << endl;
+		return 2;
+	}
+	catch (...) {
+		cerr << "Unhandled exception caught by test/upsert!" << endl;
+		return 2;
+	}
+}
@@ -0,0 +1,215 @@
+/***********************************************************************
+ test/wherein.cpp - Tests the statements Query::remove_from() and
+	update_where_in() build, and how they split a key set into chunks.
+
+ Copyright © 2018 by Educational Technology Resources, Inc.  Others
+ may also hold copyrights on code in this file.  See the CREDITS.md
+ file in the top directory of the distribution for details.
+
+ This file is part of libtabula.
+
+ libtabula is free software; you can redistribute it and/or modify it
+ under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 2.1 of the License, or
+ (at your option) any later version.
+
+ libtabula is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with libtabula; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301
+ USA
+***********************************************************************/
+
+#include "fakedriver.h"
+#define LIBTABULA_ALLOW_SSQLS_V1	// suppress deprecation warning
+#include <ssqls.h>
+
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+// Key is the first field only
+sql_create_3(widget, 1, 3,
+	libtabula::sql_int, id,
+	libtabula::sql_varchar, name,
+	libtabula::sql_double, weight)
+
+// Key is the first two fields
+sql_create_3(part, 2, 3,
+	libtabula::sql_varchar, vendor,
+	libtabula::sql_int, num,
+	libtabula::sql_varchar, descr)
+
+typedef libtabula::Query::RowCountInsertPolicy<libtabula::NoTransaction>
+		Policy;
+
+
+// A FakeDriver that says each statement affected one row per key in
+// its IN list, as if every key matched
+class KeyDriver : public FakeDriver
+{
+public:
+	KeyDriver() : FakeDriver(0) { }
+
+	libtabula::ulonglong affected_rows()
+	{
+		const string& sql = statements().back();
+		size_t keys = 1, depth = 0;
+		bool quoted = false;
+		for (size_t i = sql.find(" IN (") + 5; i < sql.size(); ++i) {
+			if (quoted && sql[i] == '\\') ++i;
+			else if (sql[i] == '\'') quoted = !quoted;
+			else if (quoted) continue;
+			else if (sql[i] == '(') ++depth;
+			else if (sql[i] == ')' && depth) --depth;
+			else if (sql[i] == ',' && depth == 0) ++keys;
+		}
+		return keys;
+	}
+};
+
+
+static bool
+check_statements(const KeyDriver& driver, const char* const expected[],
+		size_t count)
+{
+	const vector<string>& actual = driver.statements();
+	bool ok = actual.size() == count;
+	for (size_t i = 0; ok && i < count; ++i) {
+		ok = actual[i] == expected[i];
+	}
+
+	if (!ok) {
+		cerr << "Sent " << actual.size() << " statements:" << endl;
+		for (size_t i = 0; i < actual.size(); ++i) {
+			cerr << "    " << actual[i] << endl;
+		}
+		cerr << "expected " << count << ':' << endl;
+		for (size_t i = 0; i < count; ++i) {
+			cerr << "    " << expected[i] << endl;
+		}
+	}
+	return ok;
+}
+
+
+static bool
+check_counts(libtabula::ulonglong total,
+		const vector<libtabula::ulonglong>& chunks, const size_t expected[],
+		size_t count)
+{
+	libtabula::ulonglong sum = 0;
+	bool ok = chunks.size() == count;
+	for (size_t i = 0; ok && i < count; ++i) {
+		ok = chunks[i] == expected[i];
+		sum += expected[i];
+	}
+
+	if (!ok || total != sum) {
+		cerr << "Got " << total << " rows affected in " << chunks.size() <<
+				" chunks:";
+		for (size_t i = 0; i < chunks.size(); ++i) cerr << ' ' << chunks[i];
+		cerr << endl;
+		return false;
+	}
+	return true;
+}
+
+
+// Seven keys, three to a statement, gives two full chunks and one
+// partial one
+static bool
+test_remove()
+{
+	vector<widget> v;
+	for (int i = 1; i <= 7; ++i) v.push_back(widget(i, "w", 1.5));
+
+	KeyDriver* driver = new KeyDriver;
+	libtabula::Connection conn(driver);
+	libtabula::Query q = conn.query();
+	Policy policy(3);
+	vector<libtabula::ulonglong> chunks;
+	libtabula::ulonglong total = q.remove_from(v.begin(), v.end(), policy,
+			&chunks);
+
+	static const char* const expected[] = {
+		"DELETE FROM `widget` WHERE `id` IN (1,2,3)",
+		"DELETE FROM `widget` WHERE `id` IN (4,5,6)",
+		"DELETE FROM `widget` WHERE `id` IN (7)",
+	};
+	static const size_t counts[] = { 3, 3, 1 };
+	return check_statements(*driver, expected, 3) &&
+			check_counts(total, chunks, counts, 3);
+}
+
+
+// A compound key becomes a list of row constructors, and a key set
+// that exactly fills its chunks leaves no empty statement at the end
+static bool
+test_update_compound()
+{
+	vector<part> v;
+	v.push_back(part("Acme", 1, "gear"));
+	v.push_back(part("Acme", 2, "cog"));
+	v.push_back(part("O'Brien", 1, "gear"));
+	v.push_back(part("Zeta", 9, "wheel"));
+
+	KeyDriver* driver = new KeyDriver;
+	libtabula::Connection conn(driver);
+	libtabula::Query q = conn.query();
+	Policy policy(2);
+	vector<libtabula::ulonglong> chunks;
+	libtabula::ulonglong total = q.update_where_in(v.begin(), v.end(),
+			"descr = 'spare'", policy, &chunks);
+
+	static const char* const expected[] = {
+		"UPDATE `part` SET descr = 'spare' WHERE (`vendor`,`num`) IN "
+				"(('Acme',1),('Acme',2))",
+		"UPDATE `part` SET descr = 'spare' WHERE (`vendor`,`num`) IN "
+				"(('O\\'Brien',1),('Zeta',9))",
+	};
+	static const size_t counts[] = { 2, 2 };
+	return check_statements(*driver, expected, 2) &&
+			check_counts(total, chunks, counts, 2);
+}
+
+
+// Nothing to do sends nothing
+static bool
+test_empty()
+{
+	vector<widget> v;
+	KeyDriver* driver = new KeyDriver;
+	libtabula::Connection conn(driver);
+	libtabula::Query q = conn.query();
+	Policy policy(3);
+	vector<libtabula::ulonglong> chunks(1, 42);
+	libtabula::ulonglong total = q.remove_from(v.begin(), v.end(), policy,
+			&chunks);
+	return check_statements(*driver, 0, 0) &&
+			check_counts(total, chunks, 0, 0);
+}
+
+
+int
+main()
+{
+	try {
+		return	test_remove() &&
+				test_update_compound() &&
+				test_empty() ? 0 : 1;
+	}
+	catch (const libtabula::Exception& e) {
+		cerr << "Unexpected libtabula exception: " << e.what() << endl;
+		return 2;
+	}
+	catch (...) {
+		cerr << "Unhandled exception caught by test/wherein!" << endl;
+		return 2;
+	}
+}